@@ -0,0 +1,79 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include "vulkan/vulkan.hpp"
+
+// Instance layers and extensions that were found on this system
+enum InstanceCapabilityBits
+{
+	INSTANCE_CAPABILITY_VALIDATION_LAYER = 0x1,
+	INSTANCE_CAPABILITY_SURFACE_EXTENSIONS = 0x2,
+	INSTANCE_CAPABILITY_DEBUG_UTILS = 0x4
+};
+
+// Results of the capability probe, written to disk as is
+struct CachedCapabilities
+{
+	uint32_t magic;
+	uint32_t formatVersion;
+
+	// The cache is only valid as long as the loader and driver stay the same
+	uint32_t loaderVersion;
+	uint32_t driverVersion;
+	uint8_t deviceUuid[VK_UUID_SIZE];
+
+	uint32_t instanceCapabilities;
+
+	bool hasDevice;
+	uint32_t physicalDeviceIndex;
+	uint32_t queueFamilyIndex;
+	bool supportsTimestamps;
+
+	bool hasSurfaceFormat;
+	VkFormat colorFormat;
+	VkColorSpaceKHR colorSpace;
+	VkPresentModeKHR presentMode;
+};
+
+// Remembers which layers, extensions, device, queue family and surface format
+// were picked on the last start, so the next start can skip enumerating them.
+// Everything is thrown away as soon as the loader version, the driver version
+// or the device UUID changes.
+class CapabilityCache
+{
+public:
+	CapabilityCache();
+	~CapabilityCache();
+
+	// An empty path disables the cache
+	void load(const char *path);
+	void save();
+
+	// Compare the key, a mismatch clears the cache and stores the new key
+	bool matchesLoader(uint32_t loaderVersion);
+	bool matchesDevice(uint32_t driverVersion, const uint8_t deviceUuid[VK_UUID_SIZE]);
+
+	// Forgets everything, for when a cached choice turned out to be wrong
+	void invalidate();
+
+	// Forgets the device, queue family and surface format but keeps what was
+	// found about the instance
+	void invalidateDevice();
+
+	const CachedCapabilities &getCapabilities() const;
+	CachedCapabilities &editCapabilities();
+
+	void recordHit();
+	void recordMiss();
+	uint32_t getHitCount() const;
+	uint32_t getMissCount() const;
+
+private:
+	std::string path;
+	CachedCapabilities capabilities;
+	bool isDirty;
+
+	uint32_t hitCount;
+	uint32_t missCount;
+};
\ No newline at end of file
@@ -0,0 +1,107 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+#include "vulkan/vulkan.hpp"
+
+struct VulkanContext;
+
+typedef uint32_t CachedPassId;
+
+// Records the commands of a pass into a secondary command buffer that
+// continues a render pass
+typedef void (*PassRecordFunction)(void *data, VkCommandBuffer commandBuffer);
+
+// Counters since the cache was created
+struct CommandCacheStatistics
+{
+	uint64_t hits;
+	uint64_t misses;
+	uint64_t invalidations;
+};
+
+// Keeps the secondary command buffers of static passes around between frames.
+// Every pass has one command buffer per frame slot and image, which is only
+// recorded again when one of the handles or versions it depends on changed,
+// so unchanged content costs a single vkCmdExecuteCommands per frame.
+class CommandBufferCache
+{
+public:
+	CommandBufferCache();
+	~CommandBufferCache();
+
+	void initialize(const VulkanContext &context, uint32_t imageCount);
+	void destroy();
+
+	// The record function is called whenever the pass has to be recorded
+	// again, the subpass is the one the command buffer is executed in
+	CachedPassId addPass(
+		const char *name,
+		VkRenderPass renderPass,
+		uint32_t subpass,
+		PassRecordFunction function,
+		void *data);
+
+	// Lets the pass run while queries of the primary command buffer are
+	// active, needs the inheritedQueries feature
+	void setInheritedQueries(
+		CachedPassId pass,
+		VkQueryControlFlags occlusionControlFlags,
+		VkQueryPipelineStatisticFlags pipelineStatisticFlags);
+
+	// Returns the command buffer of the pass for this frame slot and image,
+	// recording it first if it is missing or any of the dependencies differ
+	// from the last recording. The framebuffer is always a dependency. Only
+	// call this after waiting for the fence of the frame slot.
+	VkCommandBuffer getCommandBuffer(
+		CachedPassId pass,
+		uint32_t frameSlot,
+		uint32_t imageIndex,
+		VkFramebuffer framebuffer,
+		const uint64_t *dependencies,
+		uint32_t dependencyCount);
+
+	// For changes the dependencies cannot see, like a destroyed handle that
+	// might be reused by a new object
+	void invalidate(CachedPassId pass);
+	void invalidateDependency(uint64_t dependency);
+	void invalidateAll();
+
+	CommandCacheStatistics getStatistics() const;
+
+private:
+	struct Entry
+	{
+		VkCommandBuffer commandBuffer;
+		std::vector<uint64_t> dependencies;
+		bool isValid;
+	};
+
+	struct Pass
+	{
+		const char *name;
+		VkRenderPass renderPass;
+		uint32_t subpass;
+		PassRecordFunction function;
+		void *data;
+
+		bool inheritsQueries;
+		VkQueryControlFlags occlusionControlFlags;
+		VkQueryPipelineStatisticFlags pipelineStatisticFlags;
+
+		// Indexed by frame slot * image count + image index
+		std::vector<Entry> entries;
+	};
+
+	void record(Pass &pass, Entry &entry, VkFramebuffer framebuffer);
+
+private:
+	VkDevice device;
+	const VkAllocationCallbacks *allocator;
+	VkCommandPool commandPool;
+	uint32_t framesInFlight;
+	uint32_t imageCount;
+
+	std::vector<Pass> passes;
+	CommandCacheStatistics statistics;
+};
\ No newline at end of file
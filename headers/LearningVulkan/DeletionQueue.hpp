@@ -0,0 +1,65 @@
+#pragma once
+
+#include <cstdint>
+#include <mutex>
+#include <vector>
+#include "vulkan/vulkan.hpp"
+
+struct DeletionStatistics
+{
+	uint32_t pendingCount;		// Objects still waiting for the GPU
+	uint32_t peakPendingCount;
+	uint64_t destroyedCount;
+};
+
+// Destroys device objects once the GPU no longer uses them, so they can be
+// released in the middle of a run without waiting for the device to idle.
+// Every retired object is stamped with the frame being recorded and
+// destroyed after the GPU finished that frame. Objects of the same frame are
+// destroyed in the order they were retired, so views go before their images
+// and buffers before their memory.
+class DeletionQueue
+{
+public:
+	DeletionQueue();
+	~DeletionQueue();
+
+	void initialize(VkDevice device, const VkAllocationCallbacks *allocator);
+
+	// Destroys everything that is still queued, the GPU has to be idle
+	void destroy();
+
+	// Buffers, images, views, memory, framebuffers, render passes, pipelines,
+	// pipeline and descriptor set layouts, descriptor pools, samplers, shader
+	// modules, query pools, semaphores, fences and swap chains. Can be called
+	// from any thread.
+	void retire(VkObjectType type, uint64_t handle);
+
+	// Called by the renderer before recording a frame, with the number of
+	// frames the GPU is known to have finished
+	void beginFrame(uint64_t frame, uint64_t completedFrameCount);
+
+	DeletionStatistics getStatistics() const;
+
+private:
+	struct RetiredObject
+	{
+		VkObjectType type;
+		uint64_t handle;
+		uint64_t frame;		// Last frame that may use the object
+	};
+
+	void destroyObject(const RetiredObject &object);
+
+private:
+	VkDevice device;
+	const VkAllocationCallbacks *allocator;
+
+	// Sorted by frame, objects are always retired into the current one
+	mutable std::mutex mutex;
+	std::vector<RetiredObject> objects;
+	std::vector<RetiredObject> readyObjects;
+	uint64_t currentFrame;
+
+	DeletionStatistics statistics;
+};
\ No newline at end of file
@@ -0,0 +1,58 @@
+#pragma once
+
+#include <cstdint>
+
+// Settings of the dynamic resolution controller, a target frame time of 0
+// renders at the full resolution
+struct DynamicResolutionSettings
+{
+	double targetFrameTime;	// GPU frame budget in milliseconds
+	float minScale;			// Smallest fraction of the output size, per axis
+	float maxScale;			// Largest fraction of the output size, at most 1
+	float scaleStep;		// Scales are multiples of this, so tiny changes do not re-record commands
+	float headroom;			// Fraction of the budget that has to be unused before scaling up
+	uint32_t settleFrames;	// Frames ignored after a change, should cover the frames in flight
+};
+
+// Picks the render scale from the measured GPU frame times. The GPU time is
+// assumed to grow with the number of pixels, so the scale that fits the
+// budget is the current one times the square root of budget / frame time.
+// Going over the budget scales down right away, scaling up only happens one
+// step at a time after a while under budget, which keeps the scale from
+// oscillating.
+class ResolutionController
+{
+public:
+	ResolutionController();
+	~ResolutionController();
+
+	void setSettings(const DynamicResolutionSettings &settings);
+	const DynamicResolutionSettings &getSettings() const;
+	bool isEnabled() const;
+
+	// Takes the GPU time of a completed frame in milliseconds, returns true
+	// if the scale changed
+	bool update(double gpuFrameTime);
+
+	float getScale() const;
+	uint32_t getChangeCount() const;
+
+	// Size of the area to render for an output size, at least one pixel
+	void getRenderExtent(
+		uint32_t outputWidth,
+		uint32_t outputHeight,
+		uint32_t &renderWidth,
+		uint32_t &renderHeight) const;
+
+private:
+	// Rounds down to a multiple of the step, within the allowed range
+	float quantize(float scale) const;
+
+private:
+	DynamicResolutionSettings settings;
+	float scale;
+	double smoothedFrameTime;
+	uint32_t settleFrameCount;		// Frames left to ignore
+	uint32_t headroomFrameCount;	// Consecutive frames with enough headroom
+	uint32_t changeCount;
+};
\ No newline at end of file
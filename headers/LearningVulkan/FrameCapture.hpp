@@ -0,0 +1,109 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "vulkan/vulkan.hpp"
+
+struct VulkanContext;
+enum class MultiGpuMode;
+
+enum class CaptureFormat
+{
+	Raw,	// Tightly packed pixels, exactly as they were rendered
+	Png		// Uncompressed RGBA PNG
+};
+
+// A host-visible buffer a rendered image gets copied into
+struct CaptureSlot
+{
+	enum class State
+	{
+		Free,
+		Submitted,	// Copy is recorded and submitted, waiting on the fence
+		Encoding	// Copy is done, the worker thread owns the slot
+	};
+
+	VkBuffer buffer;
+	VkDeviceMemory memory;
+	void *mapped;
+	VkFence fence;
+
+	State state;
+	std::string fileName;
+	CaptureFormat format;
+};
+
+// Copies rendered images into a ring of host-visible buffers without ever
+// waiting on the GPU. Fences are polled a few frames later and finished
+// copies are written to disk by a worker thread. If every slot is busy, a
+// capture is dropped instead of stalling the render loop.
+class FrameCapture
+{
+public:
+	FrameCapture();
+	~FrameCapture();
+
+	void initialize(const VulkanContext &context, uint32_t slotCount);
+	void destroy();
+
+	// Captures the next rendered frame
+	void requestCapture(const char *fileName, CaptureFormat format);
+
+	// Captures every frame as "<prefix>_<frame number>", nullptr stops
+	void setContinuousCapture(const char *filePrefix, CaptureFormat format);
+
+	// Records a copy of the image (in the given layout) if a capture is
+	// pending and a slot is free, the image is returned to the same layout.
+	// The copy waits for the stage and access of the last write to the image.
+	bool recordCopy(
+		VkCommandBuffer commandBuffer,
+		VkImage image,
+		VkImageLayout layout,
+		VkPipelineStageFlags srcStageMask,
+		VkAccessFlags srcAccessMask);
+
+	// Signals the fence of the recorded copy once all submitted work is done,
+	// must be called after the command buffer has been submitted
+	void submit(VkQueue queue);
+
+	// Hands finished copies over to the worker thread, never blocks
+	void poll();
+
+	uint32_t getDroppedCaptureCount() const;
+
+private:
+	void encodeThread();
+	void writeImage(const CaptureSlot &slot) const;
+
+private:
+	VkDevice device;
+	const VkAllocationCallbacks *allocator;
+	uint32_t width;
+	uint32_t height;
+	VkFormat imageFormat;
+	VkDeviceSize imageSize;
+	bool isCoherent;
+	MultiGpuMode multiGpuMode;
+	uint32_t deviceGroupSize;
+
+	std::vector<CaptureSlot> slots;
+	int32_t recordedSlot;
+
+	std::deque<std::pair<std::string, CaptureFormat>> requests;
+	std::string continuousPrefix;
+	CaptureFormat continuousFormat;
+	uint32_t continuousFrameNumber;
+	uint32_t droppedCaptureCount;
+
+	// Slot states and the encode queue are shared with the worker thread
+	std::mutex mutex;
+	std::condition_variable encodeCondition;
+	std::deque<uint32_t> encodeQueue;
+	std::thread worker;
+	bool stopWorker;
+};
\ No newline at end of file
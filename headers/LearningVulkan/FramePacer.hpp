@@ -0,0 +1,87 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#ifdef _WIN32
+#include <Windows.h>
+#endif
+
+// Buckets of the pacing error histogram, the upper bounds are in
+// PACING_BUCKET_LIMITS and the last bucket takes everything above
+const uint32_t PACING_BUCKET_COUNT = 8;
+
+struct PacingStatistics
+{
+	uint64_t frameCount;
+	uint64_t lateFrameCount;	// Started after their target, nothing to wait for
+
+	// How far the actual frame start was from its target, in milliseconds
+	double meanError;
+	double maxError;
+	uint64_t errorHistogram[PACING_BUCKET_COUNT];
+
+	// Where the waiting went, in milliseconds
+	double sleepTime;
+	double spinTime;
+
+	// Current prediction of how long the CPU work of a frame takes, including
+	// the safety margin
+	double predictedFrameTime;
+};
+
+// Limits the frame rate and spaces the frames evenly. Each frame starts as
+// late as possible while still finishing before its present deadline, so the
+// input it reads is as fresh as possible. Waiting uses a high resolution
+// timer for the bulk of the time and spins for the last bit, which a sleep
+// cannot hit precisely.
+class FramePacer
+{
+public:
+	FramePacer();
+	~FramePacer();
+
+	// A rate of 0 turns pacing off
+	void setTargetFrameRate(double framesPerSecond);
+
+	// Presents every interval-th refresh of a display with the given rate
+	void setPresentInterval(uint32_t interval, double refreshRate);
+
+	bool isEnabled() const;
+
+	// Blocks until the next frame should start
+	void waitForNextFrame();
+
+	// Marks the end of the frame's CPU work, used to predict when frames
+	// have to start
+	void endFrame();
+
+	PacingStatistics getStatistics() const;
+	void resetStatistics();
+
+	static const char *getBucketName(uint32_t bucket);
+
+private:
+	typedef std::chrono::steady_clock Clock;
+
+	void sleepUntil(Clock::time_point time);
+	double predictFrameTime() const;
+
+private:
+#ifdef _WIN32
+	HANDLE timer;
+#endif
+	bool isHighResolutionTimer;
+
+	Clock::duration framePeriod;
+	Clock::time_point nextDeadline;
+	Clock::time_point frameStart;
+	bool hasDeadline;
+
+	// Frame times of the last frames, the prediction is the slowest of them
+	static const uint32_t FRAME_TIME_HISTORY = 16;
+	double frameTimes[FRAME_TIME_HISTORY];
+	uint32_t frameTimeIndex;
+
+	PacingStatistics statistics;
+	double totalError;
+};
\ No newline at end of file
@@ -0,0 +1,92 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+#include "vulkan/vulkan.hpp"
+
+struct VulkanContext;
+class Logger;
+
+typedef uint32_t CounterScopeId;
+
+// What the GPU did inside a scope during one frame
+struct PassCounters
+{
+	uint64_t inputAssemblyVertices;
+	uint64_t inputAssemblyPrimitives;
+	uint64_t vertexShaderInvocations;
+	uint64_t clippingInvocations;
+	uint64_t clippingPrimitives;
+	uint64_t fragmentShaderInvocations;
+	uint64_t samplesPassed;
+
+	// Fragment shader invocations per pixel of the render target
+	double overdraw;
+
+	// The counters are only filled in once the first frame with this scope
+	// has finished on the GPU
+	bool isValid;
+};
+
+// Pipeline statistics and occlusion queries around named scopes, usually
+// whole passes. Every frame slot has its own queries, which are read back
+// after the fence of the slot was waited on, so reading them never stalls.
+class GpuCounters
+{
+public:
+	GpuCounters();
+	~GpuCounters();
+
+	// Pipeline statistics stay zero without the pipelineStatisticsQuery
+	// feature, and without occlusionQueryPrecise any non-zero sample count
+	// only means that something passed
+	void initialize(const VulkanContext &context, uint32_t maxScopes);
+	void destroy();
+
+	// The name has to stay valid until the counters are destroyed
+	CounterScopeId addScope(const char *name);
+
+	// Reads the results of the last frame recorded in this slot and resets
+	// the queries, has to be recorded outside of a render pass. The overdraw
+	// of the frame is measured against its render area.
+	void beginFrame(
+		VkCommandBuffer commandBuffer,
+		uint32_t frameSlot,
+		uint32_t renderWidth,
+		uint32_t renderHeight);
+
+	void beginScope(VkCommandBuffer commandBuffer, CounterScopeId scope);
+	void endScope(VkCommandBuffer commandBuffer, CounterScopeId scope);
+
+	// How the secondary command buffers executed inside a scope have to be
+	// recorded
+	VkQueryPipelineStatisticFlags getPipelineStatisticFlags() const;
+	VkQueryControlFlags getOcclusionControlFlags() const;
+
+	uint32_t getScopeCount() const;
+	const char *getScopeName(CounterScopeId scope) const;
+	const PassCounters &getCounters(CounterScopeId scope) const;
+
+	void log(Logger &logger) const;
+
+private:
+	void readResults(uint32_t frameSlot);
+
+private:
+	VkDevice device;
+	const VkAllocationCallbacks *allocator;
+	uint32_t maxScopes;
+
+	VkQueryPipelineStatisticFlags pipelineStatisticFlags;
+	VkQueryControlFlags occlusionControlFlags;
+	VkQueryPool pipelineStatisticsPool;
+	VkQueryPool occlusionPool;
+
+	std::vector<const char *> scopeNames;
+	std::vector<PassCounters> counters;
+
+	// Scopes recorded in every frame slot since its queries were reset
+	std::vector<std::vector<bool>> recordedScopes;
+	std::vector<double> pixelCounts;
+	uint32_t currentFrameSlot;
+};
\ No newline at end of file
@@ -0,0 +1,163 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+#include "vulkan/vulkan.hpp"
+
+// Host allocations are tracked per category, the first five categories match
+// VkSystemAllocationScope and the last one is used by the renderer itself
+enum class HostCategory : uint32_t
+{
+	Command,
+	Object,
+	Cache,
+	Device,
+	Instance,
+	Renderer,
+	Count
+};
+
+const uint32_t HOST_CATEGORY_COUNT = static_cast<uint32_t>(HostCategory::Count);
+
+struct HostCategoryStatistics
+{
+	uint64_t liveBytes;
+	uint64_t peakBytes;
+	uint64_t allocationCount;
+	uint64_t reallocationCount;
+	uint64_t freeCount;
+	uint64_t internalBytes;	// Reported by the driver through the internal allocation callbacks
+};
+
+struct HostMemoryStatistics
+{
+	HostCategoryStatistics categories[HOST_CATEGORY_COUNT];
+
+	// Where allocations were served from
+	uint64_t poolAllocationCount;
+	uint64_t arenaAllocationCount;
+	uint64_t systemAllocationCount;
+
+	// Memory held by the pools and the arena, whether it is in use or not
+	uint64_t reservedBytes;
+};
+
+// Supplies the VkAllocationCallbacks for the renderer. Small allocations are
+// served from size-class pools with free lists, so creating and destroying
+// objects does not hit the system heap every time. Allocations that only last
+// for the duration of a single command come from a bump arena that is reset as
+// soon as everything in it has been freed.
+class HostAllocator
+{
+public:
+	HostAllocator();
+	~HostAllocator();
+
+	// Pass these to every vkCreate*, vkAllocate*, vkDestroy* and vkFree* call
+	const VkAllocationCallbacks *getCallbacks() const;
+
+	void *allocate(size_t size, size_t alignment, HostCategory category);
+	void *reallocate(void *original, size_t size, size_t alignment, HostCategory category);
+	void free(void *memory);
+
+	// Arrays of Vulkan structures and handles, the elements are not
+	// constructed or destroyed
+	template<typename T>
+	T *allocateArray(uint32_t count)
+	{
+		return static_cast<T *>(allocate(sizeof(T) * count, alignof(T), HostCategory::Renderer));
+	}
+
+	template<typename T>
+	void freeArray(T *array)
+	{
+		free(array);
+	}
+
+	HostMemoryStatistics getStatistics() const;
+
+	static const char *getCategoryName(HostCategory category);
+
+private:
+	// Chunk of memory that is split into equally sized slots
+	struct Pool
+	{
+		std::mutex mutex;
+		size_t slotSize;
+		void *freeList;
+		std::vector<void *> chunks;
+	};
+
+	struct Arena
+	{
+		std::mutex mutex;
+		void *block;
+		uint8_t *memory;
+		size_t offset;
+		uint32_t liveAllocations;
+	};
+
+	struct CategoryCounters
+	{
+		std::atomic<uint64_t> liveBytes;
+		std::atomic<uint64_t> peakBytes;
+		std::atomic<uint64_t> allocationCount;
+		std::atomic<uint64_t> reallocationCount;
+		std::atomic<uint64_t> freeCount;
+		std::atomic<uint64_t> internalBytes;
+	};
+
+	static const uint32_t POOL_COUNT = 8;
+
+	void *allocateFromPool(uint32_t poolIndex);
+	void freeToPool(uint32_t poolIndex, void *slot);
+	void *allocateFromArena(size_t size);
+	void freeToArena();
+
+	void trackAllocation(HostCategory category, size_t size);
+	void trackFree(HostCategory category, size_t size);
+
+	static VKAPI_ATTR void *VKAPI_CALL allocationCallback(
+		void *userData,
+		size_t size,
+		size_t alignment,
+		VkSystemAllocationScope scope);
+
+	static VKAPI_ATTR void *VKAPI_CALL reallocationCallback(
+		void *userData,
+		void *original,
+		size_t size,
+		size_t alignment,
+		VkSystemAllocationScope scope);
+
+	static VKAPI_ATTR void VKAPI_CALL freeCallback(
+		void *userData,
+		void *memory);
+
+	static VKAPI_ATTR void VKAPI_CALL internalAllocationCallback(
+		void *userData,
+		size_t size,
+		VkInternalAllocationType type,
+		VkSystemAllocationScope scope);
+
+	static VKAPI_ATTR void VKAPI_CALL internalFreeCallback(
+		void *userData,
+		size_t size,
+		VkInternalAllocationType type,
+		VkSystemAllocationScope scope);
+
+private:
+	VkAllocationCallbacks callbacks;
+
+	Pool pools[POOL_COUNT];
+	Arena arena;
+
+	CategoryCounters counters[HOST_CATEGORY_COUNT];
+	std::atomic<uint64_t> poolAllocationCount;
+	std::atomic<uint64_t> arenaAllocationCount;
+	std::atomic<uint64_t> systemAllocationCount;
+	std::atomic<uint64_t> reservedBytes;
+};
\ No newline at end of file
@@ -0,0 +1,160 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+#include "vulkan/vulkan.hpp"
+
+struct VulkanContext;
+class DeletionQueue;
+class JobSystem;
+class TraceWriter;
+struct Mesh;
+
+typedef uint32_t MeshId;
+typedef uint32_t MaterialId;
+typedef uint32_t InstanceId;
+
+// Per-instance vertex attributes (binding 1, locations 1 to 4)
+struct InstanceData
+{
+	float transform[12];	// Rows of a 3x4 matrix
+	float color[4];
+};
+
+// Geometry that is shared by all instances, a mesh without an index buffer
+// is drawn with vkCmdDraw
+struct InstanceMesh
+{
+	VkBuffer vertexBuffer;
+	uint32_t vertexCount;
+	VkBuffer indexBuffer;
+	uint32_t indexCount;
+	const Mesh *geometry;	// Optional, what the buffers hold, for traces. Has to outlive the mesh.
+};
+
+struct InstanceMaterial
+{
+	VkPipeline pipeline;
+	VkPipelineLayout pipelineLayout;
+	VkDescriptorSet descriptorSet;	// Optional, bound to set 0
+};
+
+// Draws large numbers of identical meshes. Instances are grouped by mesh and
+// material, every group is a single instanced draw call. The per-instance
+// data lives in a device-local vertex buffer and only the ranges that changed
+// since the last frame are uploaded. The buffer grows when it runs out of
+// room, the old one goes through the deletion queue.
+class InstanceRenderer
+{
+public:
+	InstanceRenderer();
+	~InstanceRenderer();
+
+	void initialize(
+		const VulkanContext &context,
+		uint32_t initialInstances,
+		uint32_t maxInstances,
+		JobSystem &jobSystem,
+		DeletionQueue &deletionQueue);
+	void destroy();
+
+	MeshId addMesh(const InstanceMesh &mesh);
+	MaterialId addMaterial(const InstanceMaterial &material);
+
+	InstanceId addInstance(MeshId mesh, MaterialId material, const InstanceData &data);
+	void updateInstance(InstanceId instance, const InstanceData &data);
+	void removeInstance(InstanceId instance);
+
+	// Copies the changed instances into the instance buffer, has to be
+	// recorded outside of a render pass
+	void recordUploads(VkCommandBuffer commandBuffer, uint32_t frameSlot);
+
+	// Records one draw call per batch, has to be recorded inside a render pass
+	void recordDraws(VkCommandBuffer commandBuffer);
+
+	// Writes every change to the trace, starting with everything that exists
+	// right now. Pass nullptr to stop.
+	void setTrace(TraceWriter *trace);
+
+	uint32_t getInstanceCount() const;
+	uint32_t getDrawCount() const;
+	uint32_t getBufferCapacity() const;
+
+	// Changes whenever recordDraws would record different commands, updating
+	// instances only changes the uploads
+	uint64_t getDrawVersion() const;
+
+	// Vertex input state that pipelines drawing instances have to use
+	static void getVertexInputDescription(
+		VkVertexInputBindingDescription bindings[2],
+		VkVertexInputAttributeDescription attributes[5]);
+
+private:
+	// All instances that share a mesh and a material, stored in a contiguous
+	// range of the instance buffer
+	struct InstanceBatch
+	{
+		MeshId mesh;
+		MaterialId material;
+		uint32_t firstInstance;
+		uint32_t capacity;
+		std::vector<InstanceData> instances;
+		std::vector<InstanceId> owners;
+
+		// Range of instances that changed since the last upload
+		uint32_t dirtyBegin;
+		uint32_t dirtyEnd;
+	};
+
+	struct InstanceLocation
+	{
+		uint32_t batch;
+		uint32_t index;
+	};
+
+	void createBuffers(uint32_t capacity);
+	void growBuffers(uint32_t requiredInstances);
+	uint32_t findOrCreateBatch(MeshId mesh, MaterialId material);
+	void growBatch(uint32_t batchIndex);
+	void relayoutBatches();
+	void markDirty(InstanceBatch &batch, uint32_t begin, uint32_t end);
+	void sortBatches();
+
+	static void copyInstancesJob(void *data, uint32_t begin, uint32_t end);
+
+private:
+	VkDevice device;
+	const VkAllocationCallbacks *allocator;
+	JobSystem *jobSystem;
+	DeletionQueue *deletionQueue;
+	TraceWriter *trace;
+	VkPhysicalDeviceMemoryProperties memoryProperties;
+	uint32_t maxInstances;
+	uint32_t bufferCapacity;
+	bool isStagingCoherent;
+
+	VkBuffer instanceBuffer;
+	VkDeviceMemory instanceMemory;
+
+	// One staging buffer per frame in flight, so uploads never overwrite data
+	// the GPU is still copying from
+	std::vector<VkBuffer> stagingBuffers;
+	std::vector<VkDeviceMemory> stagingMemory;
+	std::vector<void *> stagingData;
+
+	std::vector<InstanceMesh> meshes;
+	std::vector<InstanceMaterial> materials;
+	std::vector<InstanceBatch> batches;
+	std::vector<uint32_t> drawOrder;
+	bool isDrawOrderDirty;
+	uint64_t drawVersion;
+
+	std::vector<InstanceLocation> locations;
+	std::vector<InstanceId> freeInstanceIds;
+	uint32_t instanceCount;
+	uint32_t allocatedInstances;
+
+	std::vector<VkBufferCopy> copyRegions;
+	std::vector<const InstanceData *> copySources;
+	uint8_t *copyDestination;
+};
\ No newline at end of file
@@ -0,0 +1,98 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Runs the items [begin, end) of a job
+typedef void (*JobFunction)(void *data, uint32_t begin, uint32_t end);
+
+// Number of unfinished jobs, every job decrements its counter once it is done
+struct JobCounter
+{
+	std::atomic<uint32_t> value;
+
+	JobCounter() : value(0) {}
+};
+
+// Work-stealing job scheduler. Every worker pushes and pops jobs at the bottom
+// of its own deque, idle workers steal from the top of the others. The thread
+// that calls initialize becomes worker 0 and is the only other thread that
+// may submit jobs. Waiting on a counter runs other jobs in the meantime, so
+// jobs may wait on the jobs they spawn.
+class JobSystem
+{
+public:
+	JobSystem();
+	~JobSystem();
+
+	// 0 uses one worker per hardware thread, 1 runs every job on the calling
+	// thread
+	void initialize(uint32_t workerCount);
+	void destroy();
+
+	void run(JobFunction function, void *data, uint32_t begin, uint32_t end, JobCounter &counter);
+
+	// Splits [0, count) into jobs of at most batchSize items
+	void parallelFor(JobFunction function, void *data, uint32_t count, uint32_t batchSize, JobCounter &counter);
+
+	void wait(JobCounter &counter);
+
+	uint32_t getWorkerCount() const;
+
+	// Index of the worker the calling thread belongs to
+	uint32_t getCurrentWorkerIndex() const;
+
+private:
+	struct Job
+	{
+		JobFunction function;
+		void *data;
+		uint32_t begin;
+		uint32_t end;
+		JobCounter *counter;
+
+		// Set while the job is queued or running, the slot of the pool can
+		// only be reused once it is clear
+		std::atomic<bool> isPending;
+
+		Job() : isPending(false) {}
+	};
+
+	// Chase-Lev deque, the owner works at the bottom and thieves take from the
+	// top
+	struct Worker
+	{
+		std::unique_ptr<Job[]> jobPool;
+		uint32_t allocatedJobs;
+
+		std::unique_ptr<std::atomic<Job *>[]> deque;
+		std::atomic<int64_t> top;
+		std::atomic<int64_t> bottom;
+
+		std::thread thread;
+		uint32_t stealIndex;
+	};
+
+	Worker *getCurrentWorker();
+	void push(Worker &worker, Job *job);
+	Job *pop(Worker &worker);
+	Job *steal(Worker &worker);
+
+	Job *findJob(Worker &worker);
+	void execute(Job *job);
+	void runWorker(uint32_t workerIndex);
+
+private:
+	uint32_t id;
+	std::vector<std::unique_ptr<Worker>> workers;
+
+	std::atomic<bool> stopWorkers;
+	std::atomic<uint32_t> queuedJobs;
+	std::mutex sleepMutex;
+	std::condition_variable sleepCondition;
+};
\ No newline at end of file
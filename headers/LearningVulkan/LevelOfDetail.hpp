@@ -0,0 +1,55 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+#include "LearningVulkan/Mesh.hpp"
+
+struct LodLevel
+{
+	Mesh mesh;
+	float geometricError;	// Object-space distance to the full resolution mesh
+};
+
+// Levels ordered from full resolution (level 0) to coarsest
+typedef std::vector<LodLevel> LodChain;
+
+// Settings that decide which level of detail an object is rendered with
+struct LodSettings
+{
+	float projectionScale;	// Viewport height / (2 * tan(vertical FOV / 2))
+	float pixelThreshold;	// Largest acceptable error on screen, in pixels
+	float hysteresis;		// Fraction of the threshold that has to be crossed before switching
+};
+
+// Quadric error metric simplification: collapses the edges that add the least
+// error until the mesh has no more than the target number of triangles
+LodLevel simplifyMesh(const Mesh &mesh, uint32_t targetTriangleCount);
+
+// Every level has "reduction" times as many triangles as the level before it
+LodChain buildLodChain(const Mesh &mesh, uint32_t levelCount, float reduction);
+
+// Picks a level per object from its projected screen-space error. Objects
+// remember their current level, so they only switch once the error moves far
+// enough past the threshold, which prevents popping back and forth.
+class LodSelector
+{
+public:
+	LodSelector();
+	~LodSelector();
+
+	void setSettings(const LodSettings &settings);
+
+	// Has to be called before selecting levels from multiple threads, each
+	// object may then only be selected by one thread at a time
+	void setObjectCount(uint32_t objectCount);
+
+	// Objects are identified by an index, new indices start at level 0
+	uint32_t selectLevel(uint32_t object, const LodChain &chain, float distance);
+
+	// Error in pixels of a level seen from the given distance
+	float getScreenSpaceError(const LodLevel &level, float distance) const;
+
+private:
+	LodSettings settings;
+	std::vector<uint32_t> currentLevels;
+};
\ No newline at end of file
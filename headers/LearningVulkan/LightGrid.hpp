@@ -0,0 +1,273 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+#include "vulkan/vulkan.hpp"
+
+struct VulkanContext;
+class JobSystem;
+class TraceWriter;
+
+// Matches the std430 layout of the light buffer
+struct PointLight
+{
+	float position[3];	// World space
+	float radius;		// Nothing past this distance is lit
+	float color[3];
+	float intensity;
+};
+
+// Shape of the cluster grid: screen tiles times depth slices, where the
+// slices grow exponentially with the distance
+struct LightGridSettings
+{
+	uint32_t tilesX;
+	uint32_t tilesY;
+	uint32_t slices;
+	uint32_t maxLightsPerCluster;	// Lights past this are left out of the cluster
+};
+
+// Camera the grid is built for, looking down -z in view space
+struct LightGridView
+{
+	float viewMatrix[12];	// Rows of the world to view transform
+	float tanHalfFovX;
+	float tanHalfFovY;
+	float nearPlane;
+	float farPlane;
+};
+
+// Matches the std430 layout of the view buffer, the camera of the last build
+// for materials that shade with the grid. Cached draw commands cannot push
+// the camera, so it comes through this buffer.
+struct LightGridShadingView
+{
+	float viewMatrix[12];	// Rows of the world to view transform
+	float tanHalfFovX;
+	float tanHalfFovY;
+	float nearPlane;
+	float farPlane;
+	uint32_t tilesX;
+	uint32_t tilesY;
+	uint32_t slices;
+	uint32_t lightCount;
+};
+
+// Range of a cluster in the light index list
+struct ClusterRange
+{
+	uint32_t offset;
+	uint32_t count;
+};
+
+// Everything the fragment shader reads besides the lights. A fragment finds
+// its cluster from the tile it is in (tiles count from the top left) and its
+// slice, floor(log(depth / near) / log(far / near) * slices). Clusters are
+// stored slice by slice, row by row.
+struct LightGridData
+{
+	std::vector<ClusterRange> clusters;
+	std::vector<uint32_t> lightIndices;
+	uint32_t overflowCount;	// Lights left out of full clusters
+};
+
+struct LightGridStatistics
+{
+	double binTime;		// Milliseconds the last build took
+	double gpuBinTime;	// Milliseconds of the last binning pass read back
+	uint32_t lightCount;
+	uint32_t occupiedClusterCount;
+	uint32_t maxClusterLightCount;
+	uint32_t lightIndexCount;
+	uint32_t overflowCount;
+};
+
+// Push constants of the binning stage
+struct LightBinStep
+{
+	float viewMatrix[12];
+	uint32_t tilesX;
+	uint32_t tilesY;
+	uint32_t slices;
+	uint32_t maxLightsPerCluster;
+	uint32_t lightCount;
+	uint32_t padding[3];
+};
+
+// Matches the counter buffer, cleared before every binning pass
+struct LightBinCounters
+{
+	uint32_t lightIndexCount;
+	uint32_t occupiedClusterCount;
+	uint32_t maxClusterLightCount;
+	uint32_t overflowCount;
+};
+
+// SPIR-V of the compute binning stage, with a local size of
+// LIGHT_BIN_GROUP_SIZE. Its descriptor set has these storage buffers:
+//
+//   0: lights (PointLight), 1: cluster ranges (ClusterRange), 2: light
+//   indices (uint), 3: cluster edges (float), 4: counters (LightBinCounters)
+//
+// The edges are the slices + 1 depths, then the tilesX + 1 and tilesY + 1
+// slopes binLightsReference tests against. The LightBinStep is in the push
+// constants. Thread c below the cluster count tests every light against
+// cluster c in order like binLightsReference, writes the first
+// maxLightsPerCluster hits to the indices from c * maxLightsPerCluster on
+// and sets range c to that offset and their count. It adds to the counters
+// with atomics, the lights past the limit are the overflow.
+struct LightGridShaders
+{
+	std::vector<uint32_t> bin;
+};
+
+const uint32_t LIGHT_BIN_GROUP_SIZE = 64;
+
+// Tests every light against every cluster, slow but simple enough to verify
+// the light grid against
+void binLightsReference(
+	const std::vector<PointLight> &lights,
+	const LightGridView &view,
+	const LightGridSettings &settings,
+	LightGridData &data);
+
+// Clustered forward lighting. Every frame the lights are binned into a 3D
+// grid of view frustum cells, so fragments only shade the lights of their
+// own cluster. Binning runs on the job system, one job per depth slice, and
+// only tests the tiles a light's bounds overlap. The result goes through a
+// staging buffer per frame slot into storage buffers that materials bind.
+// Once the binning pipeline is created the lights are binned on the GPU
+// instead, only the lights and the cluster edges are uploaded.
+class LightGrid
+{
+public:
+	LightGrid();
+	~LightGrid();
+
+	void initialize(
+		const VulkanContext &context,
+		const LightGridSettings &settings,
+		uint32_t maxLights,
+		JobSystem &jobSystem);
+
+	void destroy();
+
+	// Bins on the GPU from then on, the pipeline cache is optional
+	void createPipelines(const LightGridShaders &shaders, VkPipelineCache pipelineCache);
+
+	void setLights(const PointLight *lights, uint32_t lightCount);
+	void setView(const LightGridView &view);
+
+	// Writes every change of the lights and the view to the trace, starting
+	// with the current ones. Pass nullptr to stop.
+	void setTrace(TraceWriter *trace);
+
+	// Bins the lights if they or the view changed since the last build
+	void build();
+
+	// Copies the last build into the storage buffers, or bins it there on
+	// the GPU, has to be recorded outside of a render pass. The fence of the
+	// frame slot has to be signaled.
+	void recordUploads(VkCommandBuffer commandBuffer, uint32_t frameSlot);
+
+	// Copies the grid on the GPU back in the next frame, to verify it
+	void requestReadback();
+
+	// The grid copied back after requestReadback, packed like the CPU build.
+	// Only while the GPU is idle, returns false if there is none yet.
+	bool getGpuData(LightGridData &data) const;
+
+	bool usesGpuBinning() const;
+
+	// Lights, cluster ranges, light indices and the view, for the descriptor
+	// sets of materials that are lit. The view is read in vertex and
+	// fragment shaders, the rest in fragment shaders.
+	void getBufferInfos(VkDescriptorBufferInfo bufferInfos[4]) const;
+
+	const std::vector<PointLight> &getLights() const;
+	const LightGridView &getView() const;
+	const LightGridSettings &getSettings() const;
+
+	// The last build on the CPU, see getGpuData for the GPU
+	const LightGridData &getData() const;
+	LightGridStatistics getStatistics() const;
+
+private:
+	static void binSlicesJob(void *data, uint32_t begin, uint32_t end);
+
+	void recordBinning(VkCommandBuffer commandBuffer, uint32_t frameSlot);
+	void recordGridReadback(VkCommandBuffer commandBuffer);
+	void getShadingView(LightGridShadingView &shadingView) const;
+
+	// Where the view goes in a staging buffer
+	VkDeviceSize getViewStagingOffset() const;
+	void readCounters(uint32_t frameSlot);
+
+private:
+	VkDevice device;
+	const VkAllocationCallbacks *allocator;
+	JobSystem *jobSystem;
+	VkPhysicalDeviceMemoryProperties memoryProperties;
+	LightGridSettings settings;
+	uint32_t maxLights;
+	bool isStagingCoherent;
+	bool isReadbackCoherent;
+	bool supportsTimestamps;
+	float timestampPeriod;
+
+	VkBuffer lightBuffer;
+	VkDeviceMemory lightMemory;
+	VkBuffer clusterBuffer;
+	VkDeviceMemory clusterMemory;
+	VkBuffer indexBuffer;
+	VkDeviceMemory indexMemory;
+	VkBuffer viewBuffer;
+	VkDeviceMemory viewMemory;
+
+	// Holds the lights, then the clusters, then the indices, then the view
+	std::vector<VkBuffer> stagingBuffers;
+	std::vector<VkDeviceMemory> stagingMemory;
+	std::vector<void *> stagingData;
+
+	// Only for binning on the GPU. The counters and the two timestamps of
+	// every frame slot are read back once its fence is signaled, the grid
+	// only on request.
+	VkBuffer edgeBuffer;
+	VkDeviceMemory edgeMemory;
+	VkBuffer counterBuffer;
+	VkDeviceMemory counterMemory;
+	std::vector<VkBuffer> readbackBuffers;
+	std::vector<VkDeviceMemory> readbackMemory;
+	std::vector<void *> readbackData;
+	std::vector<bool> hasReadback;
+	VkBuffer gridReadbackBuffer;
+	VkDeviceMemory gridReadbackMemory;
+	void *gridReadbackData;
+	bool isReadbackRequested;
+	bool hasGridReadback;
+	VkQueryPool timestampQueryPool;
+
+	VkDescriptorSetLayout descriptorSetLayout;
+	VkDescriptorPool descriptorPool;
+	VkDescriptorSet descriptorSet;
+	VkPipelineLayout pipelineLayout;
+	VkPipeline binPipeline;
+
+	std::vector<PointLight> lights;
+	LightGridView view;
+	bool hasView;
+	bool isDirty;
+	TraceWriter *trace;
+	uint64_t buildVersion;
+	uint64_t uploadedVersion;
+
+	// Scratch space of the slice jobs: view space bounds of every light and
+	// a fixed number of light slots per cluster
+	std::vector<float> viewSpaceLights;
+	std::vector<uint32_t> clusterLights;
+	std::vector<uint32_t> clusterCounts;
+	std::vector<uint32_t> sliceOverflowCounts;
+
+	LightGridData data;
+	LightGridStatistics statistics;
+};
\ No newline at end of file
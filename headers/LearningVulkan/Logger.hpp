@@ -0,0 +1,75 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+enum class LogSeverity : uint32_t
+{
+	Verbose,
+	Info,
+	Warning,
+	Error
+};
+
+struct LogStatistics
+{
+	uint64_t writtenCount;
+	uint64_t droppedCount;		// The queue of the logging thread was full
+	uint64_t suppressedCount;	// Repeats of a recently written message
+};
+
+// Asynchronous logger that can be called from any thread, including from
+// inside driver callbacks. Every thread gets its own lock-free queue, a
+// background thread drains them and does the actual writing. Messages below
+// the minimum severity are rejected before they are formatted, and a message
+// that repeats within a second is only counted, not queued again.
+class Logger
+{
+public:
+	Logger();
+	~Logger();
+
+	void start(FILE *output, LogSeverity minimumSeverity);
+
+	// Writes everything that is still queued and stops the background thread
+	void stop();
+
+	void setMinimumSeverity(LogSeverity severity);
+	bool isEnabled(LogSeverity severity) const;
+
+	void log(LogSeverity severity, const char *format, ...);
+	void write(LogSeverity severity, const char *message);
+
+	LogStatistics getStatistics() const;
+
+private:
+	struct ThreadQueue;
+
+	ThreadQueue *getThreadQueue();
+	void drainQueues();
+	void runWriter();
+
+private:
+	const uint32_t id;
+
+	FILE *output;
+	std::atomic<uint32_t> minimumSeverity;
+
+	mutable std::mutex queueMutex;
+	std::vector<std::unique_ptr<ThreadQueue>> queues;
+
+	std::thread writerThread;
+	std::mutex writerMutex;
+	std::condition_variable writerCondition;
+	bool stopWriter;
+
+	std::atomic<uint64_t> writtenCount;
+	std::chrono::steady_clock::time_point startTime;
+};
\ No newline at end of file
@@ -0,0 +1,16 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+struct Vertex
+{
+	float x, y, z;
+};
+
+// Indexed triangle list
+struct Mesh
+{
+	std::vector<Vertex> vertices;
+	std::vector<uint32_t> indices;
+};
\ No newline at end of file
@@ -0,0 +1,84 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+#include "vulkan/vulkan.hpp"
+#include "LearningVulkan/Mesh.hpp"
+
+// Size limits of a meshlet, what mesh shader implementations handle best
+const uint32_t MESHLET_MAX_VERTICES = 64;
+const uint32_t MESHLET_MAX_TRIANGLES = 124;
+
+struct Meshlet
+{
+	uint32_t vertexOffset;		// First entry in MeshletMesh::meshletVertices
+	uint32_t vertexCount;
+	uint32_t triangleOffset;	// First triangle in MeshletMesh::meshletTriangles and indices
+	uint32_t triangleCount;
+
+	// Bounding sphere
+	float center[3];
+	float radius;
+
+	// All triangle normals lie in the cone around the axis. A cutoff of 1
+	// means the triangles face too many directions to ever be backfacing
+	// together.
+	float coneAxis[3];
+	float coneCutoff;
+};
+
+// A mesh split into small clusters of triangles. The local vertex and
+// triangle lists are the layout a mesh shader reads, the index buffer has the
+// same triangles with global indices, meshlet after meshlet, so every meshlet
+// can be drawn as a range of it.
+struct MeshletMesh
+{
+	std::vector<Vertex> vertices;
+	std::vector<Meshlet> meshlets;
+	std::vector<uint32_t> meshletVertices;	// Global index of every local vertex
+	std::vector<uint8_t> meshletTriangles;	// Three local indices per triangle
+	std::vector<uint32_t> indices;
+};
+
+// Grows every meshlet from a seed triangle, adding the neighbouring triangle
+// that needs the fewest new vertices, so meshlets stay compact and their
+// bounds tight
+MeshletMesh buildMeshlets(
+	const Mesh &mesh,
+	uint32_t maxVertices = MESHLET_MAX_VERTICES,
+	uint32_t maxTriangles = MESHLET_MAX_TRIANGLES);
+
+// View frustum planes pointing inwards, a point is inside if
+// a * x + b * y + c * z + d >= 0 for every plane
+struct CullingView
+{
+	float planes[6][4];
+	float cameraPosition[3];
+};
+
+// Extracts the planes from a row-major view projection matrix that maps to
+// Vulkan clip space (depth from 0 to w)
+CullingView makeCullingView(const float viewProjection[16], const float cameraPosition[3]);
+
+struct MeshletCullStatistics
+{
+	uint64_t meshletCount;
+	uint64_t visibleMeshletCount;
+	uint64_t frustumCulledCount;
+	uint64_t backfaceCulledCount;
+	uint64_t triangleCount;
+	uint64_t visibleTriangleCount;
+};
+
+// Culls the meshlets of an object placed with a 3x4 transform (rows, like
+// InstanceData). Every visible meshlet is written as an indexed indirect draw
+// of its range of the index buffer. Front faces wind counter-clockwise around
+// their normal, the backface test is skipped for non-uniformly scaled
+// objects. Returns the number of commands written.
+uint32_t cullMeshlets(
+	const MeshletMesh &mesh,
+	const float transform[12],
+	const CullingView &view,
+	uint32_t firstInstance,
+	VkDrawIndexedIndirectCommand *commands,
+	MeshletCullStatistics &statistics);
\ No newline at end of file
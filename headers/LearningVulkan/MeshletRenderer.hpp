@@ -0,0 +1,222 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+#include "vulkan/vulkan.hpp"
+#include "LearningVulkan/Meshlet.hpp"
+
+struct VulkanContext;
+
+// Matches the std430 layout of the object buffer, the rows of a 3x4
+// transform like InstanceData
+struct MeshletObject
+{
+	float transform[12];
+};
+
+// Push constants of the cull stages, the view every meshlet is tested against
+struct MeshletCullStep
+{
+	float planes[6][4];
+	float cameraPosition[3];
+	uint32_t meshletCount;	// Meshlets of one object
+	uint32_t objectCount;
+	uint32_t padding[3];
+};
+
+// Matches the counter buffer, cleared before every cull
+struct MeshletCullCounters
+{
+	uint32_t visibleMeshletCount;
+	uint32_t frustumCulledCount;
+	uint32_t backfaceCulledCount;
+	uint32_t visibleTriangleCount;
+};
+
+// SPIR-V of the compute cull stage, with a local size of MESHLET_GROUP_SIZE.
+// Its descriptor set has these storage buffers:
+//
+//   0: meshlets (Meshlet), 1: objects (MeshletObject),
+//   2: draw commands (VkDrawIndexedIndirectCommand), 3: counters
+//   (MeshletCullCounters), 4: meshlet vertices (uint), 5: meshlet triangles
+//   (bytes packed into uints), 6: vertices (three floats each), 7: the rows
+//   of the view projection matrix (four vec4)
+//
+// The MeshletCullStep is in the push constants. Thread i below
+// objectCount * meshletCount tests meshlet i % meshletCount of object
+// i / meshletCount like cullMeshlets does and writes command i: the meshlet's
+// range of the index buffer, an instance count of 1 if it is visible or 0 if
+// it is not, and the object index as the first instance. It adds to the
+// counters with atomics.
+//
+// Task shaders of mesh shader materials follow the same contract with one
+// invocation per meshlet, but emit a mesh workgroup for every visible meshlet
+// instead of writing commands. The mesh shaders project with binding 7.
+struct MeshletShaders
+{
+	std::vector<uint32_t> cull;
+};
+
+// Draws the meshlets of every object. A material that uses mesh shaders has
+// to be created with getPipelineLayout(), set 0 is bound to the meshlet
+// buffers and the MeshletCullStep is in the push constants. Any other
+// material reads indexed vertices from binding 0 and the transform of
+// objects[gl_InstanceIndex] from its own descriptor set.
+struct MeshletMaterial
+{
+	VkPipeline pipeline;
+	VkPipelineLayout pipelineLayout;
+	VkDescriptorSet descriptorSet;	// Bound to set 0, unused by mesh shaders
+	bool usesMeshShaders;
+};
+
+struct MeshletRendererStatistics
+{
+	uint64_t cullCount;
+	MeshletCullCounters counters;	// Of the last cull that was read back
+	uint64_t countersCull;			// Number of culls the counters include
+	bool usesMeshShaders;			// The last cull ran in a task shader
+};
+
+const uint32_t MESHLET_GROUP_SIZE = 64;
+
+// Culls and draws the meshlets of one mesh for many objects without any
+// per-meshlet work on the CPU. Every frame the meshlets are tested against
+// the view on the GPU. With VK_EXT_mesh_shader and a mesh shader material
+// the test runs in the task shader and only visible meshlets are expanded,
+// otherwise a compute pass writes one indexed indirect draw per meshlet that
+// a single vkCmdDrawIndexedIndirect replays. cullMeshlets is the CPU
+// reference of both.
+class MeshletRenderer
+{
+public:
+	MeshletRenderer();
+	~MeshletRenderer();
+
+	void initialize(const VulkanContext &context, uint32_t maxObjects);
+	void destroy();
+
+	// Has to be called before the first cull, the pipeline cache is optional
+	void createPipelines(const MeshletShaders &shaders, VkPipelineCache pipelineCache);
+
+	// Can only be set once, the buffers are sized for its meshlets
+	void setMesh(const MeshletMesh &mesh);
+
+	void setObjects(const MeshletObject *objects, uint32_t objectCount);
+	void setView(const CullingView &view);
+
+	// Only mesh shader materials project with it, row-major like the matrix
+	// of makeCullingView
+	void setViewProjection(const float viewProjection[16]);
+
+	void setMaterial(const MeshletMaterial &material);
+
+	// Uploads the changed objects and culls the meshlets, has to be recorded
+	// outside of a render pass. The fence of the frame slot has to be
+	// signaled.
+	void recordCulling(VkCommandBuffer commandBuffer, uint32_t frameSlot);
+
+	// Records the draw, has to be recorded inside a render pass
+	void recordDraws(VkCommandBuffer commandBuffer);
+
+	// Copies back the counters of task shaders, which only finish counting
+	// in the draw. Has to be recorded after the render pass.
+	void recordReadback(VkCommandBuffer commandBuffer, uint32_t frameSlot);
+
+	// Reads the counters of every frame slot, only while the GPU is idle
+	void collectStatistics();
+
+	bool supportsMeshShaders() const;
+	VkDescriptorSetLayout getDescriptorSetLayout() const;
+	VkPipelineLayout getPipelineLayout() const;
+
+	// Objects, for the descriptor sets of materials without mesh shaders
+	VkDescriptorBufferInfo getObjectBufferInfo() const;
+
+	MeshletRendererStatistics getStatistics() const;
+
+	// Changes whenever recordDraws would record different commands
+	uint64_t getDrawVersion() const;
+
+private:
+	bool usesMeshShaders() const;
+	void recordCounterReadback(VkCommandBuffer commandBuffer, uint32_t frameSlot);
+	void readCounters(uint32_t frameSlot);
+
+	VkShaderModule createShaderModule(const std::vector<uint32_t> &code);
+	VkPipeline createComputePipeline(VkShaderModule shaderModule, VkPipelineCache pipelineCache);
+
+	void createMeshBuffer(
+		const void *data,
+		VkDeviceSize size,
+		VkBufferUsageFlags usage,
+		VkBuffer &buffer,
+		VkDeviceMemory &memory);
+
+private:
+	VkDevice device;
+	const VkAllocationCallbacks *allocator;
+	VkPhysicalDeviceMemoryProperties memoryProperties;
+	uint32_t maxObjects;
+	uint32_t maxDrawIndirectCount;
+	VkShaderStageFlags cullStages;
+	bool hasMeshShaders;
+
+	// Static once the mesh is set, in host visible memory
+	VkBuffer meshletBuffer;
+	VkDeviceMemory meshletMemory;
+	VkBuffer meshletVertexBuffer;
+	VkDeviceMemory meshletVertexMemory;
+	VkBuffer meshletTriangleBuffer;
+	VkDeviceMemory meshletTriangleMemory;
+	VkBuffer vertexBuffer;
+	VkDeviceMemory vertexMemory;
+	VkBuffer indexBuffer;
+	VkDeviceMemory indexMemory;
+	uint32_t meshletCount;
+
+	VkBuffer objectBuffer;
+	VkDeviceMemory objectMemory;
+	VkBuffer drawBuffer;
+	VkDeviceMemory drawMemory;
+	VkBuffer counterBuffer;
+	VkDeviceMemory counterMemory;
+	VkBuffer viewBuffer;
+	VkDeviceMemory viewMemory;
+
+	// The objects go through a staging buffer per frame slot, and the
+	// counters of every slot are copied back
+	std::vector<VkBuffer> stagingBuffers;
+	std::vector<VkDeviceMemory> stagingMemory;
+	std::vector<void *> stagingData;
+	std::vector<VkBuffer> readbackBuffers;
+	std::vector<VkDeviceMemory> readbackMemory;
+	std::vector<void *> readbackData;
+	std::vector<uint64_t> readbackCulls;
+	bool isStagingCoherent;
+	bool isReadbackCoherent;
+
+	VkDescriptorSetLayout descriptorSetLayout;
+	VkDescriptorPool descriptorPool;
+	VkDescriptorSet descriptorSet;
+	VkPipelineLayout pipelineLayout;
+	VkPipeline cullPipeline;
+
+#ifdef VK_EXT_mesh_shader
+	PFN_vkCmdDrawMeshTasksEXT fpVkCmdDrawMeshTasksEXT;
+#endif
+
+	std::vector<MeshletObject> objects;
+	uint64_t objectVersion;
+	uint64_t uploadedObjectVersion;
+	MeshletCullStep step;
+	float viewProjection[16];
+	bool hasView;
+
+	MeshletMaterial material;
+	bool hasMaterial;
+	bool isReadbackPending;
+	uint64_t drawVersion;
+
+	MeshletRendererStatistics statistics;
+};
\ No newline at end of file
@@ -0,0 +1,177 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+#include "vulkan/vulkan.hpp"
+#include "LearningVulkan/Meshlet.hpp"
+
+struct VulkanContext;
+
+// Most views a pass renders, enough for the faces of a cube map
+const uint32_t MAX_MULTIVIEW_VIEWS = 6;
+
+struct MultiviewSettings
+{
+	uint32_t width;			// Size of every view
+	uint32_t height;
+	uint32_t viewCount;		// Layers of the attachments, 0 disables the pass
+	VkFormat colorFormat;
+	bool isCubeMap;			// Six views that are sampled as a cube
+	bool forcePerView;		// Renders the views one pass at a time even with multiview support
+};
+
+// Matches the std140 layout of the view buffer, one per view. With multiview
+// the shaders pick their view with gl_ViewIndex.
+struct MultiviewViewData
+{
+	float viewProjection[16];	// Row-major, Vulkan clip space
+	float cameraPosition[4];
+};
+
+// The frustums of all views of a pass. Planes that every view has, like the
+// top, bottom, near and far planes of two eyes next to each other, are only
+// tested once, and a sphere around all frustums rejects what no view sees.
+struct MultiviewCullingView
+{
+	CullingView views[MAX_MULTIVIEW_VIEWS];
+	uint32_t viewCount;
+	float sharedPlanes[6][4];
+	uint32_t sharedPlaneCount;
+	uint32_t viewPlanes[6];		// Indices of the planes that differ between the views
+	uint32_t viewPlaneCount;
+	float boundsCenter[3];
+	float boundsRadius;
+};
+
+MultiviewCullingView makeMultiviewCullingView(const CullingView *views, uint32_t viewCount);
+
+// Views a sphere is visible in, one bit per view
+uint32_t cullSphereMultiview(const MultiviewCullingView &view, const float center[3], float radius);
+
+// Tests every view on its own, what a pass per view would do
+uint32_t cullSpherePerView(const CullingView *views, uint32_t viewCount, const float center[3], float radius);
+
+// View projections of the faces of a cube map around a position, in the
+// layer order of Vulkan cube maps (+X, -X, +Y, -Y, +Z, -Z)
+void makeCubeViewProjections(
+	const float position[3],
+	float nearPlane,
+	float farPlane,
+	float viewProjections[6][16]);
+
+// A pass the application has to draw into. The viewport and scissor are set
+// already. With multiview the draws go to every view of the mask at once,
+// otherwise there is a pass per view and the shaders have to be told the
+// view index, in place of gl_ViewIndex.
+struct MultiviewDraw
+{
+	uint32_t viewMask;		// Views of this pass
+	uint32_t viewIndex;		// First view of this pass
+	bool isMultiview;
+	const MultiviewCullingView *cullingView;
+};
+
+typedef void (*MultiviewDrawFunction)(void *data, VkCommandBuffer commandBuffer, const MultiviewDraw &draw);
+
+struct MultiviewStatistics
+{
+	uint32_t renderPassCount;		// Render passes of the last recording
+	uint64_t totalRenderPassCount;
+	uint64_t recordCount;
+};
+
+// Renders several views of a scene, the eyes of a headset or the faces of a
+// reflection probe, into the layers of a color and depth image. With
+// VK_KHR_multiview one render pass draws every view and the application
+// records its draws once, so the CPU cost does not grow with the number of
+// views. Without it every view gets a pass of its own. Visibility is decided
+// once for all views with the culling view of the pass.
+class MultiviewPass
+{
+public:
+	MultiviewPass();
+	~MultiviewPass();
+
+	void initialize(const VulkanContext &context, const MultiviewSettings &settings);
+	void destroy();
+
+	// The application draws the scene for every pass
+	void setDrawFunction(MultiviewDrawFunction drawFunction, void *data);
+
+	// One per view, uploaded by the next recording
+	void setViews(const MultiviewViewData *views);
+
+	// Records the passes, has to be recorded outside of a render pass. The
+	// color image can be sampled afterwards.
+	void recordPass(VkCommandBuffer commandBuffer, uint32_t frameSlot);
+
+	bool isMultiview() const;
+	const MultiviewSettings &getSettings() const;
+
+	// Pipelines have to be compatible with it, color and depth
+	VkRenderPass getRenderPass() const;
+
+	// All layers, a cube view for cube maps, without a sampler
+	VkDescriptorImageInfo getColorImageInfo() const;
+
+	// The views as a uniform buffer, for the descriptor sets of materials
+	VkDescriptorBufferInfo getViewBufferInfo() const;
+
+	const MultiviewCullingView &getCullingView() const;
+	MultiviewStatistics getStatistics() const;
+
+private:
+	void createImage(
+		const VulkanContext &context,
+		VkFormat format,
+		VkImageUsageFlags usage,
+		VkImageAspectFlags aspectMask,
+		VkImage &image,
+		VkDeviceMemory &memory);
+
+	VkImageView createImageView(
+		VkImage image,
+		VkImageViewType viewType,
+		VkFormat format,
+		VkImageAspectFlags aspectMask,
+		uint32_t baseLayer,
+		uint32_t layerCount);
+
+	void createRenderPass();
+	void uploadViews(VkCommandBuffer commandBuffer, uint32_t frameSlot);
+
+private:
+	VkDevice device;
+	const VkAllocationCallbacks *allocator;
+	MultiviewSettings settings;
+	bool useMultiview;
+	bool isStagingCoherent;
+
+	VkImage colorImage;
+	VkDeviceMemory colorMemory;
+	VkImageView colorView;	// Every layer, for sampling
+	VkImage depthImage;
+	VkDeviceMemory depthMemory;
+	VkRenderPass renderPass;
+
+	// A single framebuffer of all layers with multiview, one per layer
+	// otherwise
+	std::vector<VkImageView> attachmentViews;
+	std::vector<VkFramebuffer> framebuffers;
+
+	VkBuffer viewBuffer;
+	VkDeviceMemory viewMemory;
+	std::vector<VkBuffer> stagingBuffers;
+	std::vector<VkDeviceMemory> stagingMemory;
+	std::vector<void *> stagingData;
+
+	MultiviewDrawFunction drawFunction;
+	void *drawData;
+
+	MultiviewViewData views[MAX_MULTIVIEW_VIEWS];
+	MultiviewCullingView cullingView;
+	uint64_t viewVersion;
+	uint64_t uploadedVersion;
+
+	MultiviewStatistics statistics;
+};
\ No newline at end of file
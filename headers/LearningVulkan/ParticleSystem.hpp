@@ -0,0 +1,229 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+#include "vulkan/vulkan.hpp"
+
+struct VulkanContext;
+class TraceWriter;
+
+// Matches the std430 layout of the particle buffers
+struct Particle
+{
+	float position[3];
+	float age;			// Seconds since the particle was emitted
+	float velocity[3];
+	float lifetime;		// The particle dies when its age reaches this
+};
+
+// Where and how particles are emitted and what moves them afterwards
+struct ParticleEmitter
+{
+	float position[3];
+	float radius;			// Particles start at most this far from the position
+	float velocity[3];
+	float velocitySpread;	// Largest random velocity added in any direction
+	float gravity[3];
+	float drag;				// Fraction of the velocity lost per second
+	float minLifetime;		// Seconds
+	float maxLifetime;
+	float emitRate;			// Particles per second
+};
+
+// Push constants of the compute stages, everything a single simulation step
+// needs. The CPU reference takes the same steps.
+struct ParticleStep
+{
+	float position[3];
+	float radius;
+	float velocity[3];
+	float velocitySpread;
+	float gravity[3];
+	float drag;
+	float minLifetime;
+	float maxLifetime;
+	float deltaTime;
+	uint32_t emitCount;		// Particles emitted by this step
+	uint32_t seed;			// Differs between steps
+	uint32_t maxParticles;
+	uint32_t padding[2];
+};
+
+// Matches the counter buffer. The draw command is read by vkCmdDrawIndirect,
+// its instance count is the number of live particles.
+struct ParticleCounters
+{
+	VkDrawIndirectCommand draw;
+	uint32_t scratchCount;	// Particles simulate and emit wrote to the scratch buffer
+};
+
+// SPIR-V of the compute stages, each with a local size of
+// PARTICLE_GROUP_SIZE. They share one descriptor set: binding 0 holds the
+// live particles, binding 1 the scratch particles and binding 2 the
+// counters, all storage buffers. The ParticleStep is in the push constants.
+//
+// simulate: thread i below counters.draw.instanceCount integrates live
+//           particle i into scratch particle i, thread 0 sets scratchCount
+//           to min(instanceCount + emitCount, maxParticles)
+// emit:     thread j below emitCount writes a new particle to scratch
+//           particle instanceCount + j, if that is below maxParticles
+// compact:  thread i below scratchCount appends scratch particle i to the
+//           live particles if its age is below its lifetime, by atomically
+//           incrementing counters.draw.instanceCount
+//
+// Both the shaders and the CPU reference integrate and emit like
+// simulateParticlesReference and draw their random numbers from
+// particleRandom.
+struct ParticleShaders
+{
+	std::vector<uint32_t> emit;
+	std::vector<uint32_t> simulate;
+	std::vector<uint32_t> compact;
+};
+
+// Draws every live particle as an instance of a quad (six vertices). The
+// pipeline reads the live particles from a storage buffer in its descriptor
+// set.
+struct ParticleMaterial
+{
+	VkPipeline pipeline;
+	VkPipelineLayout pipelineLayout;
+	VkDescriptorSet descriptorSet;	// Bound to set 0
+};
+
+struct ParticleStatistics
+{
+	uint64_t stepCount;
+	uint64_t emittedCount;		// Particles the steps asked to emit
+	uint32_t liveCount;			// After the last step the GPU finished
+	uint64_t liveCountStep;		// Number of steps liveCount includes
+};
+
+const uint32_t PARTICLE_GROUP_SIZE = 64;
+
+// PCG hash, the shaders have to use the same one
+uint32_t particleHash(uint32_t value);
+
+// Random number in [0, 1) for one of the values (channel 0 to 7) of a
+// particle emitted by a step
+float particleRandom(uint32_t seed, uint32_t index, uint32_t channel);
+
+// Emits a single particle, index counts the particles of the step
+void emitParticleReference(const ParticleStep &step, uint32_t index, Particle &particle);
+
+// Takes a simulation step on the CPU: moves the live particles, emits new
+// ones behind them and drops the dead ones without changing the order of the
+// rest. The GPU compacts in whatever order the threads finish, so results
+// have to be compared as sets.
+void simulateParticlesReference(const ParticleStep &step, std::vector<Particle> &particles);
+
+// Particle effects that cost the CPU nothing but the push constants. Every
+// step emits, simulates and compacts the particles in compute shaders, and
+// compaction leaves the live count in the instance count of an indirect draw.
+// The draw is recorded once and reads the count on the GPU, so it can be
+// replayed while the particles keep changing.
+class ParticleSystem
+{
+public:
+	ParticleSystem();
+	~ParticleSystem();
+
+	void initialize(const VulkanContext &context, uint32_t maxParticles);
+	void destroy();
+
+	// Has to be called before the first step, the pipeline cache is optional
+	void createPipelines(const ParticleShaders &shaders, VkPipelineCache pipelineCache);
+
+	void setEmitter(const ParticleEmitter &emitter);
+	void setMaterial(const ParticleMaterial &material);
+
+	// Queues a simulation step for the next frame, steps that are not
+	// recorded before the next one is queued are merged into it
+	void update(float deltaTime);
+
+	// The step the next frame records
+	const ParticleStep &getStep() const;
+
+	// Writes every change of the emitter and every update to the trace,
+	// starting with the current emitter. The live particles are not
+	// written, a replay starts without any. Pass nullptr to stop.
+	void setTrace(TraceWriter *trace);
+
+	// Records the queued step, has to be recorded outside of a render pass.
+	// The fence of the frame slot has to be signaled.
+	void recordSimulation(VkCommandBuffer commandBuffer, uint32_t frameSlot);
+
+	// Records the indirect draw, has to be recorded inside a render pass
+	void recordDraws(VkCommandBuffer commandBuffer);
+
+	// Copies the live particles back after the next step, to verify them
+	void requestReadback();
+
+	// The live particles copied back after requestReadback, in the order
+	// compaction left them. Only while the GPU is idle, returns false if
+	// there are none yet.
+	bool getGpuParticles(std::vector<Particle> &particles) const;
+
+	// Live particles, for the descriptor set of the material
+	VkDescriptorBufferInfo getParticleBufferInfo() const;
+
+	ParticleStatistics getStatistics() const;
+
+	// Changes whenever recordDraws would record different commands
+	uint64_t getDrawVersion() const;
+
+private:
+	VkShaderModule createShaderModule(const std::vector<uint32_t> &code);
+	VkPipeline createComputePipeline(VkShaderModule shaderModule, VkPipelineCache pipelineCache);
+	void recordParticleReadback(VkCommandBuffer commandBuffer);
+
+private:
+	VkDevice device;
+	const VkAllocationCallbacks *allocator;
+	VkPhysicalDeviceMemoryProperties memoryProperties;
+	uint32_t maxParticles;
+
+	VkBuffer particleBuffer;
+	VkDeviceMemory particleMemory;
+	VkBuffer scratchBuffer;
+	VkDeviceMemory scratchMemory;
+	VkBuffer counterBuffer;
+	VkDeviceMemory counterMemory;
+
+	// The counters of every frame slot are copied back, so the live count is
+	// known without waiting for the GPU
+	std::vector<VkBuffer> readbackBuffers;
+	std::vector<VkDeviceMemory> readbackMemory;
+	std::vector<void *> readbackData;
+	std::vector<uint64_t> readbackSteps;
+	bool isReadbackCoherent;
+
+	// The counters, then every particle. As large as the particle buffers,
+	// so it is only created once requested.
+	VkBuffer particleReadbackBuffer;
+	VkDeviceMemory particleReadbackMemory;
+	void *particleReadbackData;
+	bool isReadbackRequested;
+	bool hasParticleReadback;
+
+	VkDescriptorSetLayout descriptorSetLayout;
+	VkDescriptorPool descriptorPool;
+	VkDescriptorSet descriptorSet;
+	VkPipelineLayout pipelineLayout;
+	VkPipeline emitPipeline;
+	VkPipeline simulatePipeline;
+	VkPipeline compactPipeline;
+
+	ParticleMaterial material;
+	bool hasMaterial;
+	uint64_t drawVersion;
+
+	ParticleEmitter emitter;
+	ParticleStep step;
+	bool hasPendingStep;
+	bool areCountersCleared;
+	float emitRemainder;
+	TraceWriter *trace;
+
+	ParticleStatistics statistics;
+};
\ No newline at end of file
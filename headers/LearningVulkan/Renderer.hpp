@@ -1,43 +1,190 @@
 #pragma once
 
 #include <cstdint>
+#include <mutex>
+#include <string>
+#include <vector>
+#ifdef VK_USE_PLATFORM_WIN32_KHR
 #include <Windows.h>
+#endif
 #include "vulkan/vulkan.hpp"
+#include "LearningVulkan/CapabilityCache.hpp"
+#include "LearningVulkan/CommandBufferCache.hpp"
+#include "LearningVulkan/DeletionQueue.hpp"
+#include "LearningVulkan/DynamicResolution.hpp"
+#include "LearningVulkan/FrameCapture.hpp"
+#include "LearningVulkan/FramePacer.hpp"
+#include "LearningVulkan/GpuCounters.hpp"
+#include "LearningVulkan/HostAllocator.hpp"
+#include "LearningVulkan/InstanceRenderer.hpp"
+#include "LearningVulkan/JobSystem.hpp"
+#include "LearningVulkan/LightGrid.hpp"
+#include "LearningVulkan/MeshletRenderer.hpp"
+#include "LearningVulkan/MultiviewPass.hpp"
+#include "LearningVulkan/ParticleSystem.hpp"
+#include "LearningVulkan/ShaderPermutations.hpp"
+#include "LearningVulkan/ShadowAtlas.hpp"
+#include "LearningVulkan/Logger.hpp"
+#include "LearningVulkan/TaskGraph.hpp"
+#include "LearningVulkan/WorkloadTrace.hpp"
+#include "LearningVulkan/Mesh.hpp"
 
-struct Vertex
+// How frames are distributed over a device group (multiple GPUs that are
+// exposed as a single logical device)
+enum class MultiGpuMode
 {
-	float x, y, z;
+	Disabled,
+	AlternateFrame,	// Every GPU renders a whole frame, in turns
+	SplitFrame		// Every GPU renders a horizontal strip of each frame
 };
 
+// Rows of the image one GPU renders with split frame rendering, the last GPU
+// takes the remainder
+void getSplitFrameStrip(
+	uint32_t height,
+	uint32_t deviceGroupSize,
+	uint32_t deviceIndex,
+	uint32_t &stripStart,
+	uint32_t &stripHeight);
+
+// Maximum number of frames the CPU can record ahead of the GPU
+const uint32_t MAX_FRAMES_IN_FLIGHT = 4;
+
+// Size of the instance buffer at startup, it doubles when it runs out of
+// room up to the maximum
+const uint32_t INITIAL_INSTANCES = 4096;
+const uint32_t MAX_INSTANCES = 65536;
+
+// Size of the light buffer
+const uint32_t MAX_LIGHTS = 16384;
+
+// Size of the particle buffers
+const uint32_t MAX_PARTICLES = 262144;
+
+// Objects the meshlet renderer culls and draws
+const uint32_t MAX_MESHLET_OBJECTS = 4096;
+
+// Passes that can have GPU counters
+const uint32_t MAX_COUNTER_SCOPES = 8;
+
+// Everything a single frame in flight needs, so the CPU can record the next
+// frame while the GPU is still busy with the previous ones
+struct FrameResources
+{
+	VkCommandBuffer drawCommandBuffer;
+	VkSemaphore imageAcquiredSemaphore;
+	VkSemaphore renderCompleteSemaphore;
+	VkFence renderFence;
+	bool hasTimestamps;
+};
+
+// Measurements of the most recently completed frame
+struct FrameStatistics
+{
+	double gpuFrameTime;			// In milliseconds, 0 if timestamps are unsupported
+	double cpuRecordTime;			// Milliseconds spent recording the frame's commands
+	VkDeviceSize deviceMemoryUsage;	// Bytes allocated through vkAllocateMemory
+	uint32_t renderWidth;			// Size of the rendered area, before upscaling
+	uint32_t renderHeight;
+};
+
+struct VulkanContext;
+
+// Application work that runs while the renderer starts up. Immediate tasks
+// start right away and must not use the device, tasks that run after the
+// device was created can use it to create pipelines and other objects. By
+// then the render pass and the renderer's components exist as well.
+enum class StartupStage
+{
+	Immediate,
+	AfterDevice
+};
+
+typedef void (*StartupTaskFunction)(void *data, const VulkanContext &context);
+
 struct VulkanContext
 {
 	uint32_t width;
 	uint32_t height;
 	uint32_t presentQueueIndex;
 
+	// Size of the area that is rendered to, only smaller than the output
+	// with dynamic resolution
+	uint32_t renderWidth;
+	uint32_t renderHeight;
+
+	// A headless context renders into offscreen images instead of a swap chain
+	bool headless;
+	bool enableValidation;
+
+	// Host memory callbacks for every object created through this context
+	const VkAllocationCallbacks *allocator;
+
 	VkInstance instance;
 
 	VkDevice device;
 	VkPhysicalDevice physicalDevice;
+
+	MultiGpuMode multiGpuMode;
+	uint32_t deviceGroupSize;
+	VkPhysicalDevice deviceGroupDevices[VK_MAX_DEVICE_GROUP_SIZE];
+	VkDeviceGroupPresentModeFlagBitsKHR deviceGroupPresentMode;
+
 	VkPhysicalDeviceProperties physicalDeviceProperties;
 	VkPhysicalDeviceMemoryProperties physicalDeviceMemoryProperties;
+	VkPhysicalDeviceFeatures enabledFeatures;
+
+	// Render passes can draw into several layers at once
+	bool supportsMultiview;
+	uint32_t maxMultiviewViewCount;
+
+	// VK_EXT_mesh_shader with task and mesh shaders is enabled
+	bool supportsMeshShaders;
+
 	VkImage *presentImages;
+	VkImageView *presentImageViews;
+	VkDeviceMemory *offscreenImageMemory;
+	uint32_t imageCount;
+	VkFormat colorFormat;
+	VkImageLayout finalLayout;
+
 	VkImage depthImage;
+	VkDeviceMemory depthImageMemory;
 	VkImageView depthImageView;
 	
 	VkFramebuffer *framebuffers;
 	VkRenderPass renderPass;
 
+	// Dynamic resolution renders into the top left corner of this image and
+	// scales it up into the color image
+	bool dynamicResolution;
+	VkImage sceneImage;
+	VkDeviceMemory sceneImageMemory;
+	VkImageView sceneImageView;
+	VkFramebuffer sceneFramebuffer;
+
 	VkBuffer vertexInputBuffer;
+	VkDeviceMemory vertexInputMemory;
 	VkQueue presentQueue;
 	
+	VkCommandPool commandPool;
 	VkCommandBuffer setupCommandBuffer;
-	VkCommandBuffer drawCommandBuffer;
+	VkFence setupFence;
+
+	FrameResources frames[MAX_FRAMES_IN_FLIGHT];
+	uint32_t framesInFlight;
+	uint32_t frameIndex;
+
+	bool supportsTimestamps;
+	VkQueryPool timestampQueryPool;
+	VkDeviceSize allocatedDeviceMemory;
+	double lastGpuFrameTime;
+	double lastRecordTime;
 	
 	VkSurfaceKHR surface;
 	VkSwapchainKHR swapChain;
 	
-	VkDebugReportCallbackEXT debugCallback;
+	VkDebugUtilsMessengerEXT debugMessenger;
 };
 
 class Renderer
@@ -46,12 +193,231 @@ public:
 	Renderer();
 	~Renderer();
 
-	void initialize(uint32_t width, uint32_t height, HWND windowHandle);
+	// Has to be called before initializing, the name has to stay valid until
+	// the renderer is destroyed
+	void addStartupTask(
+		const char *name,
+		StartupTaskFunction function,
+		void *data,
+		StartupStage stage);
+
+	// File that remembers the capability probe between runs, has to be set
+	// before initializing, nullptr probes every time
+	void setCapabilityCachePath(const char *path);
+
+	// File that keeps compiled shader variants and the pipeline cache between
+	// runs, has to be set before initializing, nullptr disables it
+	void setShaderCachePath(const char *path);
+
+	// Renders at whatever fraction of the output size keeps the GPU frame
+	// time within the budget, and scales the result up. Has to be set before
+	// initializing. Materials need a dynamic viewport and scissor.
+	void setDynamicResolution(const DynamicResolutionSettings &settings);
+	const ResolutionController &getResolutionController() const;
+
+	// Renders the views of a headset or a cube map every frame before the
+	// scene, has to be set before initializing. Pipelines for it are created
+	// by startup tasks that run after the device was created.
+	void setMultiview(const MultiviewSettings &settings);
+
+#ifdef VK_USE_PLATFORM_WIN32_KHR
+	void initialize(
+		uint32_t width,
+		uint32_t height,
+		HWND windowHandle,
+		MultiGpuMode multiGpuMode = MultiGpuMode::Disabled);
+#endif
+
+	// Renders into offscreen images without a window or swap chain, a worker
+	// count of 0 uses every core. Without a device group of several GPUs the
+	// multi-GPU mode falls back to a single GPU.
+	void initializeHeadless(
+		uint32_t width,
+		uint32_t height,
+		uint32_t framesInFlight,
+		bool enableValidation = false,
+		uint32_t workerCount = 0,
+		MultiGpuMode multiGpuMode = MultiGpuMode::Disabled);
+
 	void render();
 
+	// Records every frame and every change to the instances, lights and
+	// particle emitter into a file that the replay tool can run without this
+	// application. Has to be called after initializing.
+	bool startTrace(const char *path);
+	void stopTrace();
+
+	// Blocks until the GPU has finished all submitted frames, and destroys
+	// everything that was waiting for them
+	void waitIdle();
+
+	// Destroys device objects once the frames in flight are done with them,
+	// for resources that are released while rendering
+	DeletionQueue &getDeletionQueue();
+
+	FrameStatistics getFrameStatistics() const;
+
+	// Pipeline statistics and occlusion results per pass, one frame in flight
+	// behind. Without support for inherited queries nothing is counted.
+	const GpuCounters &getGpuCounters() const;
+	void logGpuCounters();
+
+	// How often the cached draw commands could be used as they were
+	CommandCacheStatistics getCommandCacheStatistics() const;
+
+	// Limits the frame rate of render, off until a target is set
+	FramePacer &getFramePacer();
+
+	// Live and peak host memory per allocation scope
+	HostMemoryStatistics getHostMemoryStatistics() const;
+
+	// When every startup task ran, and how long the whole startup took in
+	// milliseconds
+	const std::vector<TaskTiming> &getStartupTimeline() const;
+	double getStartupTime() const;
+
+	// The mode that is actually used and the GPUs it uses, known after
+	// initializing
+	MultiGpuMode getMultiGpuMode() const;
+	uint32_t getDeviceGroupSize() const;
+
+	// How many capability probes were answered from the cache during startup
+	uint32_t getCapabilityCacheHits() const;
+	uint32_t getCapabilityCacheMisses() const;
+
+	// Saves the next rendered frame to disk without stalling the render loop
+	void captureFrame(const char *fileName, CaptureFormat format = CaptureFormat::Png);
+
+	// Saves every rendered frame, pass nullptr to stop
+	void setContinuousCapture(const char *filePrefix, CaptureFormat format = CaptureFormat::Png);
+
+	// Meshes, materials and instances that are drawn every frame
+	InstanceRenderer &getInstanceRenderer();
+
+	// Point lights binned into view clusters every frame, materials bind its
+	// buffers to shade only the lights near a fragment
+	LightGrid &getLightGrid();
+
+	// Shadows of the most important lights of the light grid, the
+	// application draws the casters and reports when they move
+	ShadowAtlas &getShadowAtlas();
+
+	// Particles simulated in compute shaders, the application provides the
+	// shaders and the material in a startup task after the device
+	ParticleSystem &getParticleSystem();
+
+	// Meshlets of one mesh culled on the GPU, the application provides the
+	// cull shader, the mesh and the material in a startup task after the
+	// device
+	MeshletRenderer &getMeshletRenderer();
+
+	// Layered color and depth images the application draws several views
+	// into, only initialized if multiview settings were given
+	MultiviewPass &getMultiviewPass();
+
+	// Shader variants built on first use, programs can be added by startup
+	// tasks that run after the device was created
+	ShaderPermutations &getShaderPermutations();
+
+	// Runs the per-frame work of the renderer, the application can use it for
+	// its own work as well
+	JobSystem &getJobSystem();
+
+	// The hardcoded triangle, usable as an instanced mesh
+	InstanceMesh getTriangleMesh() const;
+
 private:
+	struct StartupTask
+	{
+		const char *name;
+		StartupTaskFunction function;
+		void *data;
+		StartupStage stage;
+		Renderer *renderer;
+	};
+
+	void renderFrame();
+
+	// Runs all creation steps and startup tasks as a task graph
+	void runStartup();
+
+	void createInstance();
+	void probeInstanceCapabilities(uint32_t requiredCapabilities);
+#ifdef VK_USE_PLATFORM_WIN32_KHR
+	void createSurface(HWND windowHandle);
+#endif
+	void selectPhysicalDevice();
+	void createDevice();
+	void createSwapChain();
+	void querySurfaceFormat(VkColorSpaceKHR &colorSpace, VkPresentModeKHR &presentMode);
+	void createOffscreenImages();
+	void createCommandBuffers();
+	void transitionPresentImages();
+	void createDepthImage();
+	void createSceneImage();
+	void createRenderPass();
+	void createFramebuffers();
+	void createVertexBuffer();
+	void createFrameResources();
+
+	// Destroys every object created during startup, in reverse order
+	void destroyDeviceObjects();
+
 	void loadExtensions();
 
+	// Gives the objects readable names in validation messages
+	void nameObjects();
+	void setObjectName(VkObjectType type, uint64_t handle, const char *name);
+
+	static void recordDrawPass(void *data, VkCommandBuffer commandBuffer);
+
+	// Scales the rendered area of the scene image up into a color image
+	void recordUpscale(VkCommandBuffer commandBuffer, uint32_t imageIndex);
+
+	void trackDeviceMemory(VkDeviceSize size);
+
+	// Index of the first memory type that matches the requirements
+	uint32_t findMemoryType(
+		uint32_t memoryTypeBits,
+		VkMemoryPropertyFlags desiredMemoryFlags) const;
+
+	// Mask of the physical devices that take part in the current frame
+	uint32_t getFrameDeviceMask() const;
+
 private:
+	// Declared first so it outlives everything that allocates from it
+	HostAllocator hostAllocator;
+	Logger logger;
+	JobSystem jobSystem;
+
 	VulkanContext context;
+	DeletionQueue deletionQueue;
+	FrameCapture frameCapture;
+	InstanceRenderer instanceRenderer;
+	Mesh triangleGeometry;	// What the vertex input buffer holds
+	LightGrid lightGrid;
+	ShadowAtlas shadowAtlas;
+	ParticleSystem particleSystem;
+	MeshletRenderer meshletRenderer;
+	MultiviewPass multiviewPass;
+	MultiviewSettings multiviewSettings;
+	ShaderPermutations shaderPermutations;
+	CommandBufferCache commandBufferCache;
+	CachedPassId drawPass;
+	GpuCounters gpuCounters;
+	CounterScopeId drawScope;
+	TraceWriter trace;
+	FramePacer framePacer;
+	ResolutionController resolutionController;
+
+#ifdef VK_USE_PLATFORM_WIN32_KHR
+	HWND windowHandle;
+#endif
+	CapabilityCache capabilityCache;
+	std::string capabilityCachePath;
+	std::string shaderCachePath;
+	std::vector<StartupTask> startupTasks;
+	std::vector<TaskTiming> startupTimeline;
+	double startupTime;
+	std::mutex deviceMemoryMutex;
 };
\ No newline at end of file
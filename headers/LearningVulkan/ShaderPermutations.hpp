@@ -0,0 +1,196 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "vulkan/vulkan.hpp"
+#include "LearningVulkan/JobSystem.hpp"
+
+struct VulkanContext;
+
+typedef uint32_t ProgramId;
+
+// Largest number of features a program can have, one bit of the feature mask
+// per feature
+const uint32_t MAX_SHADER_FEATURES = 32;
+
+// How a feature toggle reaches the shader. Specialization constants share
+// the SPIR-V of all variants and are folded in when the pipeline is built,
+// defines need SPIR-V of their own.
+enum class FeatureBinding
+{
+	SpecializationConstant,
+	Define
+};
+
+struct ShaderFeature
+{
+	const char *name;		// Name of the define
+	FeatureBinding binding;
+	uint32_t constantId;	// Specialization constant, a VkBool32
+};
+
+// Produces the SPIR-V of a shader for a set of defines, for example by running
+// a compiler or loading an offline compiled file. Runs on worker threads.
+typedef bool (*ShaderCompileFunction)(
+	void *data,
+	const char *source,
+	const char *const *defines,
+	uint32_t defineCount,
+	std::vector<uint32_t> &spirv);
+
+// Identifies the current contents of a shader, for example a hash of the file
+// and its includes. Cached SPIR-V is only reused while the version stays the
+// same, so a shader that changes under the same name is never mistaken for
+// the cached one. Called with the compile data when a program is added.
+typedef uint64_t (*ShaderVersionFunction)(void *data, const char *source);
+
+// Creates the pipeline of a variant from its specialized shader stages.
+// Runs on worker threads, the pipeline is owned by the permutation cache.
+typedef VkPipeline (*PipelineBuildFunction)(
+	void *data,
+	const VkPipelineShaderStageCreateInfo *stages,
+	uint32_t stageCount,
+	VkPipelineCache pipelineCache);
+
+struct ShaderStageSource
+{
+	VkShaderStageFlagBits stage;
+	const char *source;		// Passed to the compile function as is
+};
+
+// A pipeline with feature toggles, bit i of a feature mask enables feature i.
+// The strings have to stay valid as long as the program exists.
+struct ShaderProgramDescription
+{
+	const char *name;
+	std::vector<ShaderStageSource> stages;
+	std::vector<ShaderFeature> features;
+	ShaderCompileFunction compile;
+	void *compileData;
+	ShaderVersionFunction getSourceVersion;
+	PipelineBuildFunction buildPipeline;
+	void *buildData;
+};
+
+struct ShaderCacheStatistics
+{
+	uint32_t variantCount;		// Variants that were requested
+	uint32_t readyCount;
+	uint32_t failedCount;
+	uint32_t compileCount;		// Shaders compiled to SPIR-V
+	uint32_t cachedCodeCount;	// Shaders whose SPIR-V came from the cache file
+	uint32_t moduleCount;		// Unique shader modules
+	uint32_t sharedModuleCount;	// Shaders that reused the module of identical SPIR-V
+	double buildTime;			// Milliseconds spent building variants, summed over threads
+};
+
+// Builds the variants of shader programs on first use instead of every
+// combination up front. Variants are built on the job system and used as
+// soon as they are ready. SPIR-V is keyed by its shader and defines, so
+// variants that only differ in specialization constants compile once, and
+// identical SPIR-V is deduplicated by hash into a single module. The SPIR-V,
+// the pipeline cache and the list of variants that were used are saved to
+// disk, so the next start can build the same variants without compiling.
+class ShaderPermutations
+{
+public:
+	ShaderPermutations();
+	~ShaderPermutations();
+
+	void initialize(const VulkanContext &context, JobSystem &jobSystem);
+
+	// Waits for the variants that are still being built
+	void destroy();
+
+	// Has to be called between initializing and adding programs, returns
+	// false if there was no usable cache
+	bool load(const char *path);
+	bool save(const char *path);
+
+	ProgramId addProgram(const ShaderProgramDescription &description);
+
+	// Returns VK_NULL_HANDLE while the variant is being built, the first
+	// call starts building it. Has to be called from the thread that
+	// renders, callers should keep the pipeline once it is ready.
+	VkPipeline getPipeline(ProgramId program, uint32_t featureMask);
+
+	// Builds the variant right away if it is not ready yet, for variants a
+	// frame cannot do without. Returns VK_NULL_HANDLE if building failed.
+	VkPipeline requirePipeline(ProgramId program, uint32_t featureMask);
+
+	// Starts building every variant of the added programs that the loaded
+	// cache saw in use
+	void prewarm();
+
+	// For pipelines the application builds itself
+	VkPipelineCache getPipelineCache() const;
+
+	ShaderCacheStatistics getStatistics() const;
+
+private:
+	enum VariantState
+	{
+		VARIANT_BUILDING,
+		VARIANT_READY,
+		VARIANT_FAILED
+	};
+
+	struct Program
+	{
+		ShaderProgramDescription description;
+		uint64_t layoutHash;	// Identifies the program across runs
+		std::vector<uint64_t> sourceVersions;	// One per stage
+	};
+
+	struct Variant
+	{
+		ShaderPermutations *owner;
+		const Program *program;
+		uint32_t featureMask;
+		std::atomic<uint32_t> state;
+		VkPipeline pipeline;
+		JobCounter counter;
+	};
+
+	// A variant that was used, as saved in the cache file
+	struct VariantKey
+	{
+		uint64_t layoutHash;
+		uint32_t featureMask;
+	};
+
+	Variant &findOrAddVariant(ProgramId program, uint32_t featureMask, bool &isNew);
+	static void buildVariantJob(void *data, uint32_t begin, uint32_t end);
+	void buildVariant(Variant &variant);
+
+	// Compiles the SPIR-V unless it is known already, and returns the module
+	// for it
+	VkShaderModule getShaderModule(
+		const Program &program,
+		uint32_t stageIndex,
+		const std::vector<const char *> &defines);
+
+private:
+	VkDevice device;
+	const VkAllocationCallbacks *allocator;
+	JobSystem *jobSystem;
+	VkPipelineCache pipelineCache;
+
+	// Only touched by the thread that renders
+	std::deque<Program> programs;
+	std::deque<Variant> variants;
+	std::unordered_map<uint64_t, uint32_t> variantIndices;
+
+	// Shared with the build jobs
+	mutable std::mutex mutex;
+	std::unordered_map<uint64_t, uint64_t> compiledCode;	// Shader and defines to SPIR-V hash
+	std::unordered_map<uint64_t, std::vector<uint32_t>> spirv;
+	std::unordered_map<uint64_t, VkShaderModule> modules;
+	std::vector<VariantKey> loadedVariants;
+	ShaderCacheStatistics statistics;
+};
\ No newline at end of file
@@ -0,0 +1,193 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+#include "vulkan/vulkan.hpp"
+#include "LearningVulkan/LightGrid.hpp"
+
+struct VulkanContext;
+
+typedef uint32_t CasterId;
+
+// Shadow casters that never move are drawn into a layer that is kept
+// between frames, the others are drawn over a copy of it
+enum class ShadowLayer
+{
+	Static,
+	Dynamic
+};
+
+struct ShadowAtlasSettings
+{
+	uint32_t atlasSize;			// Width and height in texels
+	uint32_t minFaceSize;		// Smallest cube face, a power of two
+	uint32_t maxFaceSize;		// Cube face of a light that covers the camera
+	uint32_t maxShadowedLights;	// The most important lights get a tile
+};
+
+// Matches the std430 layout of the tile buffer, one per light. The six cube
+// faces of a light are laid out in three columns and two rows, +X, -X, +Y
+// on top and -Y, +Z, -Z below. Lights without a tile have a face scale of 0.
+struct ShadowTileData
+{
+	float offset[2];	// Top left corner of the tile in atlas coordinates
+	float faceScale;	// Size of a face in atlas coordinates
+	float padding;
+};
+
+// A cube face the application has to draw the casters of a layer into. The
+// viewport and scissor are set already.
+struct ShadowFaceDraw
+{
+	uint32_t lightIndex;
+	const PointLight *light;
+	uint32_t face;
+	ShadowLayer layer;
+	VkRect2D rect;
+};
+
+typedef void (*ShadowDrawFunction)(void *data, VkCommandBuffer commandBuffer, const ShadowFaceDraw &draw);
+
+struct ShadowAtlasStatistics
+{
+	uint32_t shadowedLightCount;
+	uint32_t droppedLightCount;		// Important enough, but the atlas was full
+	uint32_t staticTileUpdates;		// Tiles whose static layer was drawn by the last update
+	uint32_t dynamicTileUpdates;	// Tiles whose dynamic layer was drawn by the last update
+	uint64_t totalTileUpdates;
+	uint64_t totalTilesSkipped;		// Shadowed lights that were left as they were
+};
+
+// Point light shadows that are only drawn again when something in them
+// changed. Lights get a tile of the atlas sized by how large they are on
+// screen, and keep it as long as the size stays the same. A tile is drawn
+// again when its light moved, when it moved within the atlas, or when a
+// caster that overlaps the light was added, moved or removed. Static casters
+// are drawn into a separate depth image that is copied into the atlas before
+// the dynamic casters are drawn over it, so a moving character does not cause
+// the static scene around a light to be drawn again.
+class ShadowAtlas
+{
+public:
+	ShadowAtlas();
+	~ShadowAtlas();
+
+	void initialize(const VulkanContext &context, const ShadowAtlasSettings &settings, uint32_t maxLights);
+	void destroy();
+
+	// The application draws the casters of every face that changed
+	void setDrawFunction(ShadowDrawFunction drawFunction, void *data);
+
+	// Bounding spheres of the casters, changes mark the tiles of the lights
+	// they overlap as dirty
+	CasterId addCaster(const float center[3], float radius, ShadowLayer layer);
+	void moveCaster(CasterId caster, const float center[3], float radius);
+	void removeCaster(CasterId caster);
+
+	// Assigns the tiles for the lights and finds the tiles that have to be
+	// drawn again. Lights are identified by their index.
+	void update(const PointLight *lights, uint32_t lightCount, const float cameraPosition[3]);
+
+	// Draws the dirty tiles and uploads the tile data, has to be recorded
+	// outside of a render pass
+	void recordUpdates(VkCommandBuffer commandBuffer, uint32_t frameSlot);
+
+	// Caster pipelines have to be compatible with it, depth only
+	VkRenderPass getRenderPass() const;
+
+	// Atlas for the descriptor sets of materials, without a sampler
+	VkDescriptorImageInfo getAtlasImageInfo() const;
+	VkDescriptorBufferInfo getTileBufferInfo() const;
+
+	const std::vector<ShadowTileData> &getTiles() const;
+	ShadowAtlasStatistics getStatistics() const;
+
+private:
+	struct ShadowCaster
+	{
+		float center[3];
+		float radius;
+		ShadowLayer layer;
+		bool isAlive;
+	};
+
+	struct LightState
+	{
+		PointLight light;
+		float importance;
+		uint32_t requestedFaceSize;	// Smaller tiles are used while the atlas is full
+		uint32_t faceSize;		// 0 without a tile
+		uint32_t x;				// Top left corner in texels
+		uint32_t y;
+		bool isStaticDirty;
+		bool isDynamicDirty;
+	};
+
+	void markCasterChange(const float center[3], float radius, ShadowLayer layer);
+	uint32_t chooseFaceSize(float importance) const;
+
+	// Cells of the atlas are minFaceSize texels wide
+	bool isAreaFree(uint32_t cellX, uint32_t cellY, uint32_t cellWidth, uint32_t cellHeight) const;
+	void markArea(uint32_t cellX, uint32_t cellY, uint32_t cellWidth, uint32_t cellHeight);
+	bool allocateTile(LightState &state, uint32_t faceSize);
+
+	void createDepthImage(
+		const VulkanContext &context,
+		VkImageUsageFlags usage,
+		VkImage &image,
+		VkDeviceMemory &memory,
+		VkImageView &view);
+
+	void drawTiles(VkCommandBuffer commandBuffer, VkFramebuffer framebuffer, ShadowLayer layer);
+
+private:
+	VkDevice device;
+	const VkAllocationCallbacks *allocator;
+	ShadowAtlasSettings settings;
+	uint32_t maxLights;
+	bool isStagingCoherent;
+
+	VkImage atlasImage;
+	VkDeviceMemory atlasMemory;
+	VkImageView atlasView;
+	VkFramebuffer atlasFramebuffer;
+	VkImage staticImage;
+	VkDeviceMemory staticMemory;
+	VkImageView staticView;
+	VkFramebuffer staticFramebuffer;
+	VkRenderPass renderPass;
+	bool areImagesCleared;
+
+	VkBuffer tileBuffer;
+	VkDeviceMemory tileMemory;
+	std::vector<VkBuffer> stagingBuffers;
+	std::vector<VkDeviceMemory> stagingMemory;
+	std::vector<void *> stagingData;
+
+	ShadowDrawFunction drawFunction;
+	void *drawData;
+
+	std::vector<ShadowCaster> casters;
+	std::vector<CasterId> freeCasterIds;
+
+	// Bounds that changed since the last update, old and new bounds of a
+	// moved caster are both in here
+	std::vector<float> staticChanges;
+	std::vector<float> dynamicChanges;
+
+	std::vector<LightState> lightStates;
+	std::vector<uint32_t> lightOrder;
+	std::vector<uint8_t> cells;
+	uint32_t cellCount;
+
+	// Lights whose tiles are drawn by the next recording
+	std::vector<uint32_t> staticDirtyLights;
+	std::vector<uint32_t> dynamicDirtyLights;
+	std::vector<VkImageCopy> copyRegions;
+
+	std::vector<ShadowTileData> tiles;
+	uint64_t tileVersion;
+	uint64_t uploadedVersion;
+
+	ShadowAtlasStatistics statistics;
+};
\ No newline at end of file
@@ -0,0 +1,66 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <vector>
+#include "LearningVulkan/JobSystem.hpp"
+
+typedef uint32_t TaskId;
+typedef void (*TaskFunction)(void *data);
+
+// When a task ran, in milliseconds since the graph started executing
+struct TaskTiming
+{
+	const char *name;
+	double startTime;
+	double endTime;
+	uint32_t workerIndex;
+};
+
+// Tasks with dependencies between them, every task starts as a job as soon as
+// all of its dependencies are done
+class TaskGraph
+{
+public:
+	TaskGraph();
+	~TaskGraph();
+
+	// The name has to stay valid until the graph is cleared
+	TaskId addTask(const char *name, TaskFunction function, void *data);
+	void addDependency(TaskId task, TaskId dependency);
+
+	// Blocks until every task has finished, has to be called from worker 0
+	void execute(JobSystem &jobSystem);
+
+	// Timings of the last execution, in the order the tasks were added
+	std::vector<TaskTiming> getTimeline() const;
+	double getTotalTime() const;
+
+	void clear();
+
+private:
+	struct Task
+	{
+		const char *name;
+		TaskFunction function;
+		void *data;
+
+		std::vector<TaskId> dependents;
+		uint32_t dependencyCount;
+		std::atomic<uint32_t> remainingDependencies;
+
+		TaskTiming timing;
+	};
+
+	static void runTaskJob(void *data, uint32_t begin, uint32_t end);
+
+private:
+	std::vector<std::unique_ptr<Task>> tasks;
+
+	JobSystem *jobSystem;
+	JobCounter counter;
+	std::chrono::steady_clock::time_point startTime;
+	double totalTime;
+};
\ No newline at end of file
@@ -7,6 +7,25 @@ class Utility
 public:
 	static void checkVulkanResult(VkResult &result, char *message);
 
+	// Looks for the first memory type that matches the requirements, returns
+	// false if there is none
+	static bool findMemoryType(
+		const VkPhysicalDeviceMemoryProperties &memoryProperties,
+		uint32_t memoryTypeBits,
+		VkMemoryPropertyFlags desiredMemoryFlags,
+		uint32_t &memoryTypeIndex);
+
+	// Creates a buffer and binds it to a dedicated allocation
+	static void createBuffer(
+		VkDevice device,
+		const VkAllocationCallbacks *allocator,
+		const VkPhysicalDeviceMemoryProperties &memoryProperties,
+		VkDeviceSize size,
+		VkBufferUsageFlags usage,
+		VkMemoryPropertyFlags memoryFlags,
+		VkBuffer &buffer,
+		VkDeviceMemory &memory);
+
 private:
 	Utility();
 	~Utility();
@@ -0,0 +1,132 @@
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <vector>
+#include "vulkan/vulkan.hpp"
+#include "LearningVulkan/InstanceRenderer.hpp"
+#include "LearningVulkan/LightGrid.hpp"
+#include "LearningVulkan/Mesh.hpp"
+#include "LearningVulkan/ParticleSystem.hpp"
+
+// Everything the application asked the renderer to do, in the order it did
+enum class TraceCommand : uint8_t
+{
+	AddMesh,
+	AddMaterial,
+	AddInstance,
+	UpdateInstance,
+	RemoveInstance,
+	Frame,
+	SetLights,
+	SetLightView,
+	SetParticleEmitter,
+	UpdateParticles
+};
+
+struct TraceHeader
+{
+	uint32_t magic;
+	uint32_t version;
+	uint32_t width;
+	uint32_t height;
+	uint32_t framesInFlight;
+};
+
+// A single command, only the fields used by the command are filled in
+struct TraceRecord
+{
+	TraceCommand command;
+
+	// Mesh, material or instance the command is about
+	uint32_t id;
+
+	// AddMesh, meshes without a CPU copy of their geometry cannot be
+	// recreated when replaying
+	bool hasGeometry;
+	uint32_t vertexCount;
+	uint32_t indexCount;
+	std::vector<Vertex> vertices;
+	std::vector<uint32_t> indices;
+
+	// AddInstance and UpdateInstance
+	MeshId mesh;
+	MaterialId material;
+	InstanceData data;
+
+	// SetLights and SetLightView
+	std::vector<PointLight> lights;
+	LightGridView lightView;
+
+	// SetParticleEmitter and UpdateParticles, the time step is in seconds
+	ParticleEmitter emitter;
+	float deltaTime;
+
+	// Frame, how long the renderer took to record and submit it, in
+	// milliseconds
+	double cpuTime;
+};
+
+// Writes the renderer workload into a compact binary stream, so it can be
+// replayed without the application that produced it. Meshes carry their
+// geometry, and the lights and particle effects their inputs.
+class TraceWriter
+{
+public:
+	TraceWriter();
+	~TraceWriter();
+
+	bool open(const char *path, uint32_t width, uint32_t height, uint32_t framesInFlight);
+	void close();
+	bool isOpen() const;
+
+	void addMesh(MeshId mesh, const InstanceMesh &meshData);
+	void addMaterial(MaterialId material);
+	void addInstance(InstanceId instance, MeshId mesh, MaterialId material, const InstanceData &data);
+	void updateInstance(InstanceId instance, const InstanceData &data);
+	void removeInstance(InstanceId instance);
+	void setLights(const PointLight *lights, uint32_t lightCount);
+	void setLightView(const LightGridView &view);
+	void setParticleEmitter(const ParticleEmitter &emitter);
+	void updateParticles(float deltaTime);
+	void frame(double cpuTime);
+
+	uint32_t getFrameCount() const;
+
+private:
+	void write(const void *data, size_t size);
+	void flush();
+
+private:
+	FILE *file;
+	std::vector<uint8_t> buffer;
+	uint32_t frameCount;
+};
+
+class TraceReader
+{
+public:
+	TraceReader();
+	~TraceReader();
+
+	bool open(const char *path);
+	void close();
+
+	const TraceHeader &getHeader() const;
+
+	// Returns false at the end of the trace, or at a command that could not
+	// be decoded
+	bool read(TraceRecord &record);
+
+	// Whether reading stopped before the end of the trace
+	bool isTruncated() const;
+
+private:
+	bool readCommand(TraceRecord &record);
+	bool readBytes(void *data, size_t size);
+
+private:
+	FILE *file;
+	TraceHeader header;
+	bool hasDecodeError;
+};
\ No newline at end of file
@@ -0,0 +1,24 @@
+// The sources call assert with a message as a second argument, which the
+// Microsoft compiler ignores. Other compilers reject it, so on those this
+// header takes the place of the standard one and accepts the message. Like
+// the standard header it has no include guard, including it again defines
+// assert again.
+#include_next <assert.h>
+
+#ifdef __cplusplus
+#include <cstdio>
+#include <cstdlib>
+#else
+#include <stdio.h>
+#include <stdlib.h>
+#endif
+
+#undef assert
+
+#ifdef NDEBUG
+#define assert(...) ((void)0)
+#else
+#define LEARNING_VULKAN_ASSERT(condition, message, ...) \
+	((condition) ? (void)0 : (fprintf(stderr, "%s:%d: Assertion '%s' failed. %s\n", __FILE__, __LINE__, #condition, message), abort()))
+#define assert(...) LEARNING_VULKAN_ASSERT(__VA_ARGS__, "", "")
+#endif
\ No newline at end of file
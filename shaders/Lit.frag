@@ -0,0 +1,101 @@
+#version 450
+
+// Shades a fragment with the lights of its cluster in the light grid, see
+// LightGridData for how the cluster is found. Emissive instances skip the
+// lights and show their color, the light markers of the "lights" scene.
+
+layout(constant_id = 0) const bool EMISSIVE = false;
+
+struct PointLight
+{
+	vec3 position;
+	float radius;
+	vec3 color;
+	float intensity;
+};
+
+struct ClusterRange
+{
+	uint offset;
+	uint count;
+};
+
+layout(std430, set = 0, binding = 0) readonly buffer Lights
+{
+	PointLight lights[];
+};
+
+layout(std430, set = 0, binding = 1) readonly buffer Clusters
+{
+	ClusterRange clusters[];
+};
+
+layout(std430, set = 0, binding = 2) readonly buffer LightIndices
+{
+	uint lightIndices[];
+};
+
+layout(std430, set = 0, binding = 3) readonly buffer View
+{
+	vec4 viewMatrix[3];
+	float tanHalfFovX;
+	float tanHalfFovY;
+	float nearPlane;
+	float farPlane;
+	uint tilesX;
+	uint tilesY;
+	uint slices;
+	uint lightCount;
+} view;
+
+layout(location = 0) in vec3 viewPosition;
+layout(location = 1) in vec4 instanceColor;
+
+layout(location = 0) out vec4 outColor;
+
+const float AMBIENT = 0.05;
+
+void main()
+{
+	if (EMISSIVE)
+	{
+		outColor = instanceColor;
+		return;
+	}
+
+	// The camera looks down -z, tiles count from the top left
+	float depth = -viewPosition.z;
+	float tanX = viewPosition.x / depth;
+	float tanY = viewPosition.y / depth;
+
+	int tileX = int(floor((tanX / view.tanHalfFovX + 1.0) * 0.5 * float(view.tilesX)));
+	int tileY = int(floor((1.0 - tanY / view.tanHalfFovY) * 0.5 * float(view.tilesY)));
+	int slice = int(floor(log(depth / view.nearPlane) / log(view.farPlane / view.nearPlane) * float(view.slices)));
+
+	uint i = uint(clamp(tileX, 0, int(view.tilesX) - 1));
+	uint j = uint(clamp(tileY, 0, int(view.tilesY) - 1));
+	uint k = uint(clamp(slice, 0, int(view.slices) - 1));
+	ClusterRange cluster = clusters[(k * view.tilesY + j) * view.tilesX + i];
+
+	// Flat triangles have no normals, the face is turned towards the camera
+	vec3 normal = normalize(cross(dFdx(viewPosition), dFdy(viewPosition)));
+	if (dot(normal, viewPosition) > 0.0)
+		normal = -normal;
+
+	vec3 lighting = vec3(AMBIENT);
+
+	for (uint l = 0; l < cluster.count; ++l)
+	{
+		PointLight light = lights[lightIndices[cluster.offset + l]];
+		vec4 world = vec4(light.position, 1.0);
+		vec3 lightPosition = vec3(dot(view.viewMatrix[0], world), dot(view.viewMatrix[1], world), dot(view.viewMatrix[2], world));
+
+		vec3 toLight = lightPosition - viewPosition;
+		float lightDistance = length(toLight);
+		float falloff = clamp(1.0 - lightDistance / light.radius, 0.0, 1.0);
+
+		lighting += light.color * light.intensity * falloff * falloff * max(dot(normal, toLight / lightDistance), 0.0);
+	}
+
+	outColor = vec4(instanceColor.rgb * lighting, instanceColor.a);
+}
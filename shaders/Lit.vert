@@ -0,0 +1,45 @@
+#version 450
+
+// Instances drawn by InstanceRenderer, projected with the camera the light
+// grid was last built for, see LightGridShadingView. The projection matches
+// makeViewProjection of the benchmark.
+
+layout(location = 0) in vec3 position;
+layout(location = 1) in vec4 transform0;
+layout(location = 2) in vec4 transform1;
+layout(location = 3) in vec4 transform2;
+layout(location = 4) in vec4 color;
+
+layout(std430, set = 0, binding = 3) readonly buffer View
+{
+	vec4 viewMatrix[3];
+	float tanHalfFovX;
+	float tanHalfFovY;
+	float nearPlane;
+	float farPlane;
+	uint tilesX;
+	uint tilesY;
+	uint slices;
+	uint lightCount;
+} view;
+
+layout(location = 0) out vec3 viewPosition;
+layout(location = 1) out vec4 instanceColor;
+
+void main()
+{
+	vec4 local = vec4(position, 1.0);
+	vec4 world = vec4(dot(transform0, local), dot(transform1, local), dot(transform2, local), 1.0);
+
+	viewPosition = vec3(dot(view.viewMatrix[0], world), dot(view.viewMatrix[1], world), dot(view.viewMatrix[2], world));
+	instanceColor = color;
+
+	// Vulkan clip space points y down and has depth from 0 to 1
+	float depthScale = view.farPlane / (view.nearPlane - view.farPlane);
+
+	gl_Position = vec4(
+		viewPosition.x / view.tanHalfFovX,
+		-viewPosition.y / view.tanHalfFovY,
+		depthScale * viewPosition.z + depthScale * view.nearPlane,
+		-viewPosition.z);
+}
@@ -0,0 +1,21 @@
+#version 450
+
+// Shades the meshlets Meshlet.mesh draws in the color of their meshlet, lit
+// from a fixed direction
+
+layout(location = 0) in vec3 worldPosition;
+layout(location = 1) flat in vec3 meshletColor;
+
+layout(location = 0) out vec4 outColor;
+
+const vec3 LIGHT_DIRECTION = vec3(0.267, 0.802, -0.535);
+const float AMBIENT = 0.2;
+
+void main()
+{
+	// Flat triangles, the face normal works for both sides
+	vec3 normal = normalize(cross(dFdx(worldPosition), dFdy(worldPosition)));
+	float diffuse = abs(dot(normal, LIGHT_DIRECTION));
+
+	outColor = vec4(meshletColor * (AMBIENT + (1.0 - AMBIENT) * diffuse), 1.0);
+}
@@ -0,0 +1,12 @@
+#version 450
+
+// Objects of the "multiview" scene in the color of their grid cell
+
+layout(location = 0) in vec3 color;
+
+layout(location = 0) out vec4 outColor;
+
+void main()
+{
+	outColor = vec4(color, 1.0);
+}
@@ -0,0 +1,52 @@
+#version 450
+#extension GL_EXT_multiview : require
+
+// Objects of the "multiview" scene, a triangle at the grid position of
+// gl_InstanceIndex, projected with the view of the pass. With multiview
+// gl_ViewIndex picks the view, a pass per view pushes its index instead and
+// gl_ViewIndex stays 0. See MultiviewViewData for the views.
+
+struct View
+{
+	vec4 viewProjection[4];
+	vec4 cameraPosition;
+};
+
+layout(std140, set = 0, binding = 0) uniform Views
+{
+	View views[6];
+};
+
+layout(push_constant) uniform Pass
+{
+	uint viewIndex;
+} pass;
+
+// Same as MULTIVIEW_GRID_SIZE and MULTIVIEW_GRID_SPACING of the benchmark
+const uint GRID_SIZE = 64;
+const float GRID_SPACING = 3.0;
+
+// On the unit circle, so the triangle stays inside the sphere the objects
+// are culled with
+const vec2 CORNERS[3] = vec2[3](vec2(0.0, 1.0), vec2(-0.866, -0.5), vec2(0.866, -0.5));
+
+layout(location = 0) out vec3 color;
+
+void main()
+{
+	uint object = uint(gl_InstanceIndex);
+	uvec2 cell = uvec2(object % GRID_SIZE, object / GRID_SIZE);
+	vec2 corner = CORNERS[gl_VertexIndex];
+
+	vec4 world = vec4(float(cell.x) * GRID_SPACING + corner.x, corner.y, float(cell.y) * GRID_SPACING, 1.0);
+	View view = views[uint(gl_ViewIndex) + pass.viewIndex];
+
+	gl_Position = vec4(
+		dot(view.viewProjection[0], world),
+		dot(view.viewProjection[1], world),
+		dot(view.viewProjection[2], world),
+		dot(view.viewProjection[3], world));
+
+	// A checkerboard, so neighbouring objects can be told apart
+	color = ((cell.x + cell.y) % 2 == 0) ? vec3(0.9, 0.6, 0.2) : vec3(0.2, 0.5, 0.9);
+}
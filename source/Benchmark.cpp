@@ -0,0 +1,2396 @@
+#ifdef _WIN32
+#include <Windows.h>
+#include <Psapi.h>
+#else
+#include <sys/resource.h>
+#endif
+#include <algorithm>
+#include <assert.h>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include "LearningVulkan/LevelOfDetail.hpp"
+#include "LearningVulkan/Meshlet.hpp"
+#include "LearningVulkan/Renderer.hpp"
+#include "LearningVulkan/Utility.hpp"
+
+// Settings of a single benchmark run, all of them can be overridden from the
+// command line
+struct BenchmarkSettings
+{
+	const char *scene;
+	uint32_t width;
+	uint32_t height;
+	uint32_t frameCount;
+	uint32_t warmUpFrameCount;
+	uint32_t framesInFlight;
+	uint32_t workerCount;
+	bool enableValidation;
+	const char *capturePrefix;
+	const char *capabilityCachePath;
+	const char *shaderCachePath;
+	const char *tracePath;
+	double targetFrameRate;
+	double gpuBudget;
+	uint32_t lightCount;
+	uint32_t viewCount;
+	bool perView;
+	MultiGpuMode multiGpuMode;
+	const char *shaderDirectory;
+};
+
+// Triangle counts of the "lod" scene, summed over all measured frames
+struct LodStatistics
+{
+	double buildTime;
+	double selectionTime;
+	uint64_t fullTriangleCount;
+	uint64_t selectedTriangleCount;
+};
+
+// Everything the "lod" scene needs besides the renderer
+struct LodScene
+{
+	LodChain chain;
+	LodSelector selector;
+	LodStatistics statistics;
+};
+
+// Objects in the "lod" scene are laid out on a grid of this size
+static const uint32_t LOD_GRID_SIZE = 128;
+static const float LOD_GRID_SPACING = 4.0f;
+
+// Rows of the grid every selection job handles
+static const uint32_t LOD_ROWS_PER_JOB = 4;
+
+// Shared by all selection jobs of a frame
+struct LodSelectionJob
+{
+	LodSelector *selector;
+	const LodChain *chain;
+	float cameraX;
+	float cameraY;
+	float cameraZ;
+	std::atomic<uint64_t> fullTriangleCount;
+	std::atomic<uint64_t> selectedTriangleCount;
+};
+
+// Results of the "meshlets" scene, summed over all measured frames
+struct MeshletStatistics
+{
+	double buildTime;
+	double cullTime;
+	uint64_t meshletCount;
+	uint64_t visibleMeshletCount;
+	uint64_t frustumCulledCount;
+	uint64_t backfaceCulledCount;
+	uint64_t triangleCount;
+	uint64_t visibleTriangleCount;
+};
+
+// Everything a graphics pipeline of the benchmark needs besides its shaders.
+// Pipelines that draw instances use the vertex input of InstanceRenderer,
+// the others have none and build their triangles from gl_VertexIndex, or
+// use mesh shaders. Viewport and scissor are dynamic.
+struct GraphicsPipelineSettings
+{
+	VkDevice device;
+	const VkAllocationCallbacks *allocator;
+	VkPipelineLayout layout;
+	VkRenderPass renderPass;
+	bool drawsInstances;
+};
+
+// Everything the "meshlets" scene needs besides the renderer. With the
+// compiled shaders the meshlets are culled on the GPU as well, and the
+// counters of the last frame are compared against the CPU. Where mesh
+// shaders are supported they cull in the task shader and draw the visible
+// meshlets, see Meshlet.task.
+struct MeshletScene
+{
+	MeshletMesh mesh;
+	std::vector<VkDrawIndexedIndirectCommand> commands;
+	float aspectRatio;
+	MeshletStatistics statistics;
+	MeshletShaders shaders;
+	MeshletRenderer *renderer;
+	ShaderPermutations *permutations;
+	const char *shaderDirectory;
+	GraphicsPipelineSettings pipelineSettings;
+	VkPipeline meshPipeline;
+	CullingView view;
+	float viewProjection[16];
+	MeshletCullStatistics lastFrame;
+};
+
+// Objects in the "meshlets" scene are laid out on a grid of this size
+static const uint32_t MESHLET_GRID_SIZE = 32;
+static const float MESHLET_GRID_SPACING = 3.0f;
+
+// Rows of the grid every culling job handles
+static const uint32_t MESHLET_ROWS_PER_JOB = 2;
+
+// Shared by all culling jobs of a frame
+struct MeshletCullJob
+{
+	const MeshletMesh *mesh;
+	CullingView view;
+	VkDrawIndexedIndirectCommand *commands;
+	std::atomic<uint64_t> meshletCount;
+	std::atomic<uint64_t> visibleMeshletCount;
+	std::atomic<uint64_t> frustumCulledCount;
+	std::atomic<uint64_t> backfaceCulledCount;
+	std::atomic<uint64_t> triangleCount;
+	std::atomic<uint64_t> visibleTriangleCount;
+};
+
+// Feature of the lit program that shows the instance color as it is
+static const uint32_t LIT_FEATURE_EMISSIVE = 1u << 0;
+
+// Results of the "lights" scene, summed over all measured frames
+struct LightStatistics
+{
+	double binTime;
+	double gpuBinTime;
+	uint64_t lightIndexCount;
+	uint64_t occupiedClusterCount;
+	uint64_t overflowCount;
+	uint32_t maxClusterLightCount;
+	bool matchesReference;
+	uint32_t deferredDeletionFrames;	// Warm-up frames that began with the old instance buffer still queued
+};
+
+// Everything the "lights" scene needs besides the renderer. With the
+// compiled shaders the lights are binned on the GPU, and a field of
+// triangles on the ground is shaded with the grid, so shading costs more
+// with every light. Every light has a small emissive triangle of its color,
+// added halfway through the warm-up. They outgrow the instance buffer while
+// frames are in flight, so the old one goes through the deletion queue.
+struct LightScene
+{
+	std::vector<PointLight> lights;
+	float aspectRatio;
+	LightStatistics statistics;
+	LightGridShaders shaders;
+	LightGrid *grid;
+	ShaderPermutations *permutations;
+	const char *shaderDirectory;
+	VkDescriptorSetLayout descriptorSetLayout;
+	VkDescriptorPool descriptorPool;
+	VkDescriptorSet descriptorSet;
+	GraphicsPipelineSettings pipelineSettings;
+	ProgramId litProgram;
+	VkPipeline litPipeline;
+	VkPipeline emissivePipeline;
+	MeshId triangleMesh;
+	MaterialId emissiveMaterial;
+};
+
+// Results of the "multiview" scene, summed over all measured frames. Every
+// frame is culled once for all views and once per view, to compare the two.
+struct MultiviewSceneStatistics
+{
+	double sharedCullTime;
+	double perViewCullTime;
+	uint64_t sharedDrawCount;	// One per object any view sees
+	uint64_t perViewDrawCount;	// One per object and view that sees it
+	uint64_t mismatchCount;		// Objects whose views differ between the two
+	uint32_t sharedPlaneCount;
+};
+
+// Everything the "multiview" scene needs besides the renderer. With the
+// compiled shaders every pass draws a triangle for each visible object, once
+// for all views with multiview and once per view otherwise, see
+// Multiview.vert.
+struct MultiviewScene
+{
+	uint32_t viewCount;
+	float aspectRatio;
+	std::vector<uint32_t> sharedMasks;
+	std::vector<uint32_t> perViewMasks;
+	std::vector<VkDrawIndexedIndirectCommand> sharedCommands;
+	std::vector<VkDrawIndexedIndirectCommand> perViewCommands;
+	uint32_t sharedDrawCount;
+	uint32_t viewDrawOffsets[MAX_MULTIVIEW_VIEWS + 1];	// Per-view commands of every view
+	MultiviewSceneStatistics statistics;
+	MultiviewPass *pass;
+	ShaderPermutations *permutations;
+	const char *shaderDirectory;
+	VkDescriptorSetLayout descriptorSetLayout;
+	VkDescriptorPool descriptorPool;
+	VkDescriptorSet descriptorSet;
+	GraphicsPipelineSettings pipelineSettings;
+	VkPipeline pipeline;
+};
+
+// Results of the "particles" scene, compared once after the last frame
+struct ParticleSceneStatistics
+{
+	uint32_t gpuLiveCount;
+	uint32_t referenceLiveCount;
+	uint64_t mismatchCount;		// Particles without a counterpart on the other side
+	double referenceTime;
+};
+
+// Everything the "particles" scene needs besides the renderer. Every frame
+// takes a fixed step, the steps the GPU took are replayed on the CPU once the
+// particles of the last one are read back.
+struct ParticleScene
+{
+	ParticleShaders shaders;
+	ParticleSystem *system;
+	ShaderPermutations *permutations;
+	std::vector<ParticleStep> steps;
+	ParticleSceneStatistics statistics;
+};
+
+// Every frame of the "particles" scene advances the particles by this much,
+// so the steps are the same on every run
+static const float PARTICLE_TIME_STEP = 1.0f / 60.0f;
+
+// Rounding differs between the CPU and the GPU, particles match within this
+// fraction of their values
+static const float PARTICLE_TOLERANCE = 1e-3f;
+
+// Results of the "shadows" scene, summed over all measured frames
+struct ShadowSceneStatistics
+{
+	uint64_t staticTileUpdates;
+	uint64_t dynamicTileUpdates;
+	uint64_t overlappedTileCount;	// Shadowed lights the moving caster overlapped before or after it moved
+	uint64_t mismatchCount;			// Tiles drawn again that should not have been, or the other way around
+	uint32_t maxDynamicTileUpdates;
+};
+
+// Everything the "shadows" scene needs besides the renderer. A field of
+// static casters and a single moving one sit among the lights, seen from a
+// camera that stays put, so only the tiles of the lights the moving caster
+// overlaps should be drawn again. The casters are bounding spheres, their
+// draw function records nothing.
+struct ShadowScene
+{
+	std::vector<PointLight> lights;
+	float aspectRatio;
+	CasterId movingCaster;
+	float casterCenter[3];
+	float previousCasterCenter[3];
+	ShadowSceneStatistics statistics;
+};
+
+// Static casters of the "shadows" scene are laid out on a grid of this size
+// across the light area, the moving one circles its middle
+static const uint32_t SHADOW_CASTER_GRID_SIZE = 16;
+static const float SHADOW_CASTER_RADIUS = 1.0f;
+static const float SHADOW_CASTER_ORBIT = 20.0f;
+
+// Objects in the "multiview" scene are laid out on a grid of this size
+static const uint32_t MULTIVIEW_GRID_SIZE = 64;
+static const float MULTIVIEW_GRID_SPACING = 3.0f;
+static const float MULTIVIEW_OBJECT_RADIUS = 1.0f;
+
+// Distance between the eyes of the stereo views
+static const float EYE_SEPARATION = 0.064f;
+
+// Lights in the "lights" scene are spread over a box of this size
+static const float LIGHT_AREA_SIZE = 96.0f;
+static const float LIGHT_AREA_HEIGHT = 8.0f;
+
+// The ground of the "lights" scene is a grid of triangles covering the
+// light area, the lights have markers of this size
+static const uint32_t LIGHT_GROUND_GRID_SIZE = 48;
+static const float LIGHT_MARKER_SIZE = 0.2f;
+
+// Dense UV sphere with a unit radius
+static Mesh createSphereMesh(uint32_t rings, uint32_t segments)
+{
+	const float pi = 3.14159265358979f;
+	Mesh mesh;
+
+	for (uint32_t ring = 0; ring <= rings; ++ring)
+	{
+		float theta = pi * ring / rings;
+
+		for (uint32_t segment = 0; segment < segments; ++segment)
+		{
+			float phi = 2.0f * pi * segment / segments;
+			Vertex vertex = { sinf(theta) * cosf(phi), cosf(theta), sinf(theta) * sinf(phi) };
+			mesh.vertices.push_back(vertex);
+		}
+	}
+
+	for (uint32_t ring = 0; ring < rings; ++ring)
+	{
+		for (uint32_t segment = 0; segment < segments; ++segment)
+		{
+			uint32_t next = (segment + 1) % segments;
+			uint32_t a = ring * segments + segment;
+			uint32_t b = ring * segments + next;
+			uint32_t c = (ring + 1) * segments + segment;
+			uint32_t d = (ring + 1) * segments + next;
+
+			uint32_t indices[] = { a, c, b, b, c, d };
+			mesh.indices.insert(mesh.indices.end(), indices, indices + 6);
+		}
+	}
+
+	return mesh;
+}
+
+// Simplifies a dense sphere, runs while the renderer starts up
+static void buildLodSceneTask(void *data, const VulkanContext &context)
+{
+	LodScene &scene = *static_cast<LodScene *>(data);
+
+	typedef std::chrono::high_resolution_clock Clock;
+
+	Clock::time_point buildStart = Clock::now();
+	scene.chain = buildLodChain(createSphereMesh(128, 256), 6, 0.5f);
+	scene.statistics.buildTime = std::chrono::duration<double, std::milli>(Clock::now() - buildStart).count();
+}
+
+// Selects the levels of the rows [begin, end) of the grid
+static void selectLevelsJob(void *data, uint32_t begin, uint32_t end)
+{
+	LodSelectionJob &job = *static_cast<LodSelectionJob *>(data);
+	const LodChain &chain = *job.chain;
+
+	uint64_t fullTriangleCount = 0;
+	uint64_t selectedTriangleCount = 0;
+
+	for (uint32_t z = begin; z < end; ++z)
+	{
+		for (uint32_t x = 0; x < LOD_GRID_SIZE; ++x)
+		{
+			float dx = x * LOD_GRID_SPACING - job.cameraX;
+			float dz = z * LOD_GRID_SPACING - job.cameraZ;
+			float distance = sqrtf(dx * dx + job.cameraY * job.cameraY + dz * dz);
+
+			uint32_t level = job.selector->selectLevel(z * LOD_GRID_SIZE + x, chain, distance);
+
+			fullTriangleCount += chain[0].mesh.indices.size() / 3;
+			selectedTriangleCount += chain[level].mesh.indices.size() / 3;
+		}
+	}
+
+	job.fullTriangleCount += fullTriangleCount;
+	job.selectedTriangleCount += selectedTriangleCount;
+}
+
+// Picks a level for every object on the grid as seen from a camera flying
+// over it, and adds the resulting triangle counts to the statistics
+static void selectSceneLevels(
+	JobSystem &jobSystem,
+	LodSelector &selector,
+	const LodChain &chain,
+	uint32_t frame,
+	LodStatistics &statistics)
+{
+	float extent = LOD_GRID_SIZE * LOD_GRID_SPACING;
+
+	LodSelectionJob job;
+	job.selector = &selector;
+	job.chain = &chain;
+	job.cameraX = fmodf(frame * 0.05f, extent);
+	job.cameraY = 8.0f;
+	job.cameraZ = -8.0f;
+	job.fullTriangleCount = 0;
+	job.selectedTriangleCount = 0;
+
+	JobCounter counter;
+	jobSystem.parallelFor(selectLevelsJob, &job, LOD_GRID_SIZE, LOD_ROWS_PER_JOB, counter);
+	jobSystem.wait(counter);
+
+	statistics.fullTriangleCount += job.fullTriangleCount;
+	statistics.selectedTriangleCount += job.selectedTriangleCount;
+}
+
+// Builds the meshlets of a dense sphere, runs while the renderer starts up
+static void buildMeshletSceneTask(void *data, const VulkanContext &context)
+{
+	MeshletScene &scene = *static_cast<MeshletScene *>(data);
+
+	typedef std::chrono::high_resolution_clock Clock;
+
+	Clock::time_point buildStart = Clock::now();
+	scene.mesh = buildMeshlets(createSphereMesh(128, 256));
+	scene.statistics.buildTime = std::chrono::duration<double, std::milli>(Clock::now() - buildStart).count();
+
+	// Room for every meshlet of every object
+	scene.commands.resize(scene.mesh.meshlets.size() * MESHLET_GRID_SIZE * MESHLET_GRID_SIZE);
+}
+
+// Places the objects of the grid for the GPU cull, with the same transforms
+// cullMeshletsJob uses
+static void createMeshletObjects(MeshletRenderer &renderer)
+{
+	std::vector<MeshletObject> objects(MESHLET_GRID_SIZE * MESHLET_GRID_SIZE);
+
+	for (uint32_t z = 0; z < MESHLET_GRID_SIZE; ++z)
+	{
+		for (uint32_t x = 0; x < MESHLET_GRID_SIZE; ++x)
+		{
+			MeshletObject object =
+			{
+				{
+					1.0f, 0.0f, 0.0f, x * MESHLET_GRID_SPACING,
+					0.0f, 1.0f, 0.0f, 0.0f,
+					0.0f, 0.0f, 1.0f, z * MESHLET_GRID_SPACING
+				}
+			};
+
+			objects[z * MESHLET_GRID_SIZE + x] = object;
+		}
+	}
+
+	renderer.setObjects(objects.data(), static_cast<uint32_t>(objects.size()));
+}
+
+// Loads a compiled shader, SPIR-V is a stream of words
+static bool loadSpirv(const char *directory, const char *name, std::vector<uint32_t> &code)
+{
+	std::string path = std::string(directory) + "/" + name;
+
+	FILE *file = fopen(path.c_str(), "rb");
+	if (!file)
+	{
+		fprintf(stderr, "Failed to open the shader \"%s\".\n", path.c_str());
+		return false;
+	}
+
+	fseek(file, 0, SEEK_END);
+	long size = ftell(file);
+	fseek(file, 0, SEEK_SET);
+
+	code.resize(size > 0 ? size / sizeof(uint32_t) : 0);
+	size_t readSize = code.empty() ? 0 : fread(code.data(), sizeof(uint32_t), code.size(), file);
+	fclose(file);
+
+	return !code.empty() && readSize == code.size();
+}
+
+// Loads the compiled shaders of the permutation cache, the source is the
+// name of the shader in the shader directory. Without a compiler there are
+// no variants with defines.
+static bool loadShaderVariant(
+	void *data,
+	const char *source,
+	const char *const *defines,
+	uint32_t defineCount,
+	std::vector<uint32_t> &spirv)
+{
+	if (defineCount != 0)
+	{
+		fprintf(stderr, "The compiled shader \"%s\" has no variants with defines.\n", source);
+		return false;
+	}
+
+	std::string name = std::string(source) + ".spv";
+	return loadSpirv(static_cast<const char *>(data), name.c_str(), spirv);
+}
+
+// FNV-1a of the compiled shader, so cached variants of a shader that was
+// compiled again are not used
+static uint64_t getShaderFileVersion(void *data, const char *source)
+{
+	std::vector<uint32_t> code;
+	std::string name = std::string(source) + ".spv";
+
+	if (!loadSpirv(static_cast<const char *>(data), name.c_str(), code))
+		return 0;
+
+	const uint8_t *bytes = reinterpret_cast<const uint8_t *>(code.data());
+	uint64_t hash = 14695981039346656037ull;
+
+	for (size_t i = 0; i < sizeof(uint32_t) * code.size(); ++i)
+	{
+		hash ^= bytes[i];
+		hash *= 1099511628211ull;
+	}
+
+	return hash;
+}
+
+// Builds the variants of the benchmark's programs, the data is the
+// GraphicsPipelineSettings. Runs on worker threads.
+static VkPipeline buildGraphicsPipeline(
+	void *data,
+	const VkPipelineShaderStageCreateInfo *stages,
+	uint32_t stageCount,
+	VkPipelineCache pipelineCache)
+{
+	const GraphicsPipelineSettings &settings = *static_cast<const GraphicsPipelineSettings *>(data);
+
+	VkVertexInputBindingDescription bindings[2] = {};
+	VkVertexInputAttributeDescription attributes[5] = {};
+	InstanceRenderer::getVertexInputDescription(bindings, attributes);
+
+	VkPipelineVertexInputStateCreateInfo vertexInputState = {};
+	vertexInputState.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
+
+	if (settings.drawsInstances)
+	{
+		vertexInputState.vertexBindingDescriptionCount = 2;
+		vertexInputState.pVertexBindingDescriptions = bindings;
+		vertexInputState.vertexAttributeDescriptionCount = 5;
+		vertexInputState.pVertexAttributeDescriptions = attributes;
+	}
+
+	VkPipelineInputAssemblyStateCreateInfo inputAssemblyState = {};
+	inputAssemblyState.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
+	inputAssemblyState.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
+
+	VkPipelineViewportStateCreateInfo viewportState = {};
+	viewportState.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
+	viewportState.viewportCount = 1;
+	viewportState.scissorCount = 1;
+
+	// The triangles of the scenes are seen from both sides
+	VkPipelineRasterizationStateCreateInfo rasterizationState = {};
+	rasterizationState.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
+	rasterizationState.polygonMode = VK_POLYGON_MODE_FILL;
+	rasterizationState.cullMode = VK_CULL_MODE_NONE;
+	rasterizationState.frontFace = VK_FRONT_FACE_COUNTER_CLOCKWISE;
+	rasterizationState.lineWidth = 1.0f;
+
+	VkPipelineMultisampleStateCreateInfo multisampleState = {};
+	multisampleState.sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
+	multisampleState.rasterizationSamples = VK_SAMPLE_COUNT_1_BIT;
+
+	// Depth is cleared to 1
+	VkPipelineDepthStencilStateCreateInfo depthStencilState = {};
+	depthStencilState.sType = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO;
+	depthStencilState.depthTestEnable = VK_TRUE;
+	depthStencilState.depthWriteEnable = VK_TRUE;
+	depthStencilState.depthCompareOp = VK_COMPARE_OP_LESS;
+
+	VkPipelineColorBlendAttachmentState blendAttachment = {};
+	blendAttachment.colorWriteMask =
+		VK_COLOR_COMPONENT_R_BIT |
+		VK_COLOR_COMPONENT_G_BIT |
+		VK_COLOR_COMPONENT_B_BIT |
+		VK_COLOR_COMPONENT_A_BIT;
+
+	VkPipelineColorBlendStateCreateInfo colorBlendState = {};
+	colorBlendState.sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
+	colorBlendState.attachmentCount = 1;
+	colorBlendState.pAttachments = &blendAttachment;
+
+	// Dynamic resolution changes the rendered area without new pipelines
+	VkDynamicState dynamicStates[2] = { VK_DYNAMIC_STATE_VIEWPORT, VK_DYNAMIC_STATE_SCISSOR };
+
+	VkPipelineDynamicStateCreateInfo dynamicState = {};
+	dynamicState.sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
+	dynamicState.dynamicStateCount = 2;
+	dynamicState.pDynamicStates = dynamicStates;
+
+	VkGraphicsPipelineCreateInfo pipelineCreateInfo = {};
+	pipelineCreateInfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
+	pipelineCreateInfo.stageCount = stageCount;
+	pipelineCreateInfo.pStages = stages;
+	// Both are ignored by mesh shader pipelines
+	pipelineCreateInfo.pVertexInputState = &vertexInputState;
+	pipelineCreateInfo.pInputAssemblyState = &inputAssemblyState;
+	pipelineCreateInfo.pViewportState = &viewportState;
+	pipelineCreateInfo.pRasterizationState = &rasterizationState;
+	pipelineCreateInfo.pMultisampleState = &multisampleState;
+	pipelineCreateInfo.pDepthStencilState = &depthStencilState;
+	pipelineCreateInfo.pColorBlendState = &colorBlendState;
+	pipelineCreateInfo.pDynamicState = &dynamicState;
+	pipelineCreateInfo.layout = settings.layout;
+	pipelineCreateInfo.renderPass = settings.renderPass;
+	pipelineCreateInfo.subpass = 0;
+
+	VkPipeline pipeline = VK_NULL_HANDLE;
+	VkResult result = vkCreateGraphicsPipelines(
+		settings.device,
+		pipelineCache,
+		1,
+		&pipelineCreateInfo,
+		settings.allocator,
+		&pipeline);
+
+	return result == VK_SUCCESS ? pipeline : VK_NULL_HANDLE;
+}
+
+// Creates the pipeline of the GPU cull once the device exists, through the
+// pipeline cache the shader variants are saved with. With mesh shaders the
+// material culls in its task shader and draws with the renderer's layout.
+static void createMeshletPipelinesTask(void *data, const VulkanContext &context)
+{
+	MeshletScene &scene = *static_cast<MeshletScene *>(data);
+	scene.renderer->createPipelines(scene.shaders, scene.permutations->getPipelineCache());
+
+#ifdef VK_EXT_mesh_shader
+	if (!scene.renderer->supportsMeshShaders())
+		return;
+
+	GraphicsPipelineSettings &pipelineSettings = scene.pipelineSettings;
+	pipelineSettings.device = context.device;
+	pipelineSettings.allocator = context.allocator;
+	pipelineSettings.layout = scene.renderer->getPipelineLayout();
+	pipelineSettings.renderPass = context.renderPass;
+	pipelineSettings.drawsInstances = false;
+
+	ShaderProgramDescription description;
+	description.name = "Meshlet";
+	description.stages.push_back({ VK_SHADER_STAGE_TASK_BIT_EXT, "Meshlet.task" });
+	description.stages.push_back({ VK_SHADER_STAGE_MESH_BIT_EXT, "Meshlet.mesh" });
+	description.stages.push_back({ VK_SHADER_STAGE_FRAGMENT_BIT, "Meshlet.frag" });
+	description.compile = loadShaderVariant;
+	description.compileData = const_cast<char *>(scene.shaderDirectory);
+	description.getSourceVersion = getShaderFileVersion;
+	description.buildPipeline = buildGraphicsPipeline;
+	description.buildData = &scene.pipelineSettings;
+
+	ProgramId program = scene.permutations->addProgram(description);
+	scene.meshPipeline = scene.permutations->requirePipeline(program, 0);
+
+	assert(scene.meshPipeline != VK_NULL_HANDLE, "Failed to build the meshlet pipeline.");
+#endif
+}
+
+// Camera of the scenes that render from a moving viewpoint
+static const float CAMERA_FIELD_OF_VIEW = 60.0f * 3.14159265358979f / 180.0f;
+static const float CAMERA_NEAR_PLANE = 0.1f;
+static const float CAMERA_FAR_PLANE = 200.0f;
+
+// Row-major view matrix looking from the eye at the target with y up, the
+// camera looks down -z
+static void makeViewMatrix(const float eye[3], const float target[3], float view[16])
+{
+	float forward[3] = { target[0] - eye[0], target[1] - eye[1], target[2] - eye[2] };
+	float forwardLength = sqrtf(forward[0] * forward[0] + forward[1] * forward[1] + forward[2] * forward[2]);
+
+	for (int k = 0; k < 3; ++k)
+		forward[k] /= forwardLength;
+
+	// Right is forward x up, up is right x forward
+	float right[3] = { -forward[2], 0.0f, forward[0] };
+	float rightLength = sqrtf(right[0] * right[0] + right[2] * right[2]);
+	right[0] /= rightLength;
+	right[2] /= rightLength;
+
+	float up[3] =
+	{
+		right[1] * forward[2] - right[2] * forward[1],
+		right[2] * forward[0] - right[0] * forward[2],
+		right[0] * forward[1] - right[1] * forward[0]
+	};
+
+	float rows[16] =
+	{
+		right[0], right[1], right[2], -(right[0] * eye[0] + right[1] * eye[1] + right[2] * eye[2]),
+		up[0], up[1], up[2], -(up[0] * eye[0] + up[1] * eye[1] + up[2] * eye[2]),
+		-forward[0], -forward[1], -forward[2], forward[0] * eye[0] + forward[1] * eye[1] + forward[2] * eye[2],
+		0.0f, 0.0f, 0.0f, 1.0f
+	};
+
+	memcpy(view, rows, sizeof(rows));
+}
+
+// Row-major perspective view projection for Vulkan clip space, looking from
+// the eye at the target with y up
+static void makeViewProjection(
+	const float eye[3],
+	const float target[3],
+	float aspectRatio,
+	float viewProjection[16])
+{
+	const float nearPlane = CAMERA_NEAR_PLANE;
+	const float farPlane = CAMERA_FAR_PLANE;
+
+	float view[16];
+	makeViewMatrix(eye, target, view);
+
+	// Vulkan clip space points y down and has depth from 0 to 1
+	float focalLength = 1.0f / tanf(CAMERA_FIELD_OF_VIEW * 0.5f);
+	float projection[16] =
+	{
+		focalLength / aspectRatio, 0.0f, 0.0f, 0.0f,
+		0.0f, -focalLength, 0.0f, 0.0f,
+		0.0f, 0.0f, farPlane / (nearPlane - farPlane), nearPlane * farPlane / (nearPlane - farPlane),
+		0.0f, 0.0f, -1.0f, 0.0f
+	};
+
+	for (int row = 0; row < 4; ++row)
+	{
+		for (int column = 0; column < 4; ++column)
+		{
+			viewProjection[row * 4 + column] =
+				projection[row * 4 + 0] * view[0 * 4 + column] +
+				projection[row * 4 + 1] * view[1 * 4 + column] +
+				projection[row * 4 + 2] * view[2 * 4 + column] +
+				projection[row * 4 + 3] * view[3 * 4 + column];
+		}
+	}
+}
+
+// Culls the meshlets of the objects in the rows [begin, end) of the grid
+static void cullMeshletsJob(void *data, uint32_t begin, uint32_t end)
+{
+	MeshletCullJob &job = *static_cast<MeshletCullJob *>(data);
+	uint32_t meshletsPerObject = static_cast<uint32_t>(job.mesh->meshlets.size());
+
+	MeshletCullStatistics statistics = {};
+
+	for (uint32_t z = begin; z < end; ++z)
+	{
+		for (uint32_t x = 0; x < MESHLET_GRID_SIZE; ++x)
+		{
+			uint32_t object = z * MESHLET_GRID_SIZE + x;
+
+			float transform[12] =
+			{
+				1.0f, 0.0f, 0.0f, x * MESHLET_GRID_SPACING,
+				0.0f, 1.0f, 0.0f, 0.0f,
+				0.0f, 0.0f, 1.0f, z * MESHLET_GRID_SPACING
+			};
+
+			// Every object has a fixed range of commands, a real draw would
+			// use the count as the draw count of vkCmdDrawIndexedIndirect
+			cullMeshlets(
+				*job.mesh,
+				transform,
+				job.view,
+				object,
+				job.commands + object * meshletsPerObject,
+				statistics);
+		}
+	}
+
+	job.meshletCount += statistics.meshletCount;
+	job.visibleMeshletCount += statistics.visibleMeshletCount;
+	job.frustumCulledCount += statistics.frustumCulledCount;
+	job.backfaceCulledCount += statistics.backfaceCulledCount;
+	job.triangleCount += statistics.triangleCount;
+	job.visibleTriangleCount += statistics.visibleTriangleCount;
+}
+
+// Culls the meshlets of every object on the grid as seen from a camera
+// moving along it, and adds the results to the statistics
+static void cullSceneMeshlets(JobSystem &jobSystem, MeshletScene &scene, uint32_t frame)
+{
+	float extent = MESHLET_GRID_SIZE * MESHLET_GRID_SPACING;
+
+	float eye[3] = { fmodf(frame * 0.05f, extent), 6.0f, -6.0f };
+	float target[3] = { eye[0], 0.0f, eye[2] + 20.0f };
+
+	makeViewProjection(eye, target, scene.aspectRatio, scene.viewProjection);
+
+	scene.view = makeCullingView(scene.viewProjection, eye);
+
+	MeshletCullJob job;
+	job.mesh = &scene.mesh;
+	job.view = scene.view;
+	job.commands = scene.commands.data();
+	job.meshletCount = 0;
+	job.visibleMeshletCount = 0;
+	job.frustumCulledCount = 0;
+	job.backfaceCulledCount = 0;
+	job.triangleCount = 0;
+	job.visibleTriangleCount = 0;
+
+	JobCounter counter;
+	jobSystem.parallelFor(cullMeshletsJob, &job, MESHLET_GRID_SIZE, MESHLET_ROWS_PER_JOB, counter);
+	jobSystem.wait(counter);
+
+	// The GPU counters only cover the last cull
+	scene.lastFrame.meshletCount = job.meshletCount;
+	scene.lastFrame.visibleMeshletCount = job.visibleMeshletCount;
+	scene.lastFrame.frustumCulledCount = job.frustumCulledCount;
+	scene.lastFrame.backfaceCulledCount = job.backfaceCulledCount;
+	scene.lastFrame.triangleCount = job.triangleCount;
+	scene.lastFrame.visibleTriangleCount = job.visibleTriangleCount;
+
+	MeshletStatistics &statistics = scene.statistics;
+	statistics.meshletCount += job.meshletCount;
+	statistics.visibleMeshletCount += job.visibleMeshletCount;
+	statistics.frustumCulledCount += job.frustumCulledCount;
+	statistics.backfaceCulledCount += job.backfaceCulledCount;
+	statistics.triangleCount += job.triangleCount;
+	statistics.visibleTriangleCount += job.visibleTriangleCount;
+}
+
+// Difference of a GPU counter and the CPU statistic it should match
+static uint64_t absoluteDifference(uint32_t gpuCount, uint64_t cpuCount)
+{
+	return gpuCount > cpuCount ? gpuCount - cpuCount : cpuCount - gpuCount;
+}
+
+// Scatters lights with random positions, sizes and colors, the same ones on
+// every run
+static void createSceneLights(uint32_t lightCount, std::vector<PointLight> &lights)
+{
+	uint32_t state = 12345;
+	auto random = [&state]()
+	{
+		state = state * 1664525u + 1013904223u;
+		return (state >> 8) / 16777216.0f;
+	};
+
+	lights.resize(lightCount);
+
+	for (PointLight &light : lights)
+	{
+		light.position[0] = random() * LIGHT_AREA_SIZE;
+		light.position[1] = random() * LIGHT_AREA_HEIGHT;
+		light.position[2] = random() * LIGHT_AREA_SIZE;
+		light.radius = 2.0f + random() * 6.0f;
+		light.color[0] = random();
+		light.color[1] = random();
+		light.color[2] = random();
+		light.intensity = 1.0f;
+	}
+}
+
+// Moves the camera of the light grid across the lights, the renderer bins
+// them while rendering the frame
+static void updateLightSceneView(LightGrid &lightGrid, const LightScene &scene, uint32_t frame)
+{
+	float eye[3] = { fmodf(frame * 0.05f, LIGHT_AREA_SIZE), 6.0f, -6.0f };
+	float target[3] = { eye[0], 0.0f, eye[2] + 20.0f };
+
+	float view[16];
+	makeViewMatrix(eye, target, view);
+
+	LightGridView gridView = {};
+	memcpy(gridView.viewMatrix, view, sizeof(gridView.viewMatrix));
+	gridView.tanHalfFovY = tanf(CAMERA_FIELD_OF_VIEW * 0.5f);
+	gridView.tanHalfFovX = gridView.tanHalfFovY * scene.aspectRatio;
+	gridView.nearPlane = CAMERA_NEAR_PLANE;
+	gridView.farPlane = CAMERA_FAR_PLANE;
+
+	lightGrid.setView(gridView);
+}
+
+// Creates the pipeline of the GPU binning and the lit materials once the
+// device exists. The materials read the grid from set 0, see Lit.frag.
+static void createLightPipelinesTask(void *data, const VulkanContext &context)
+{
+	LightScene &scene = *static_cast<LightScene *>(data);
+	scene.grid->createPipelines(scene.shaders, scene.permutations->getPipelineCache());
+
+	const uint32_t bindingCount = 4;
+
+	VkDescriptorSetLayoutBinding bindings[bindingCount] = {};
+	for (uint32_t i = 0; i < bindingCount; ++i)
+	{
+		bindings[i].binding = i;
+		bindings[i].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+		bindings[i].descriptorCount = 1;
+		bindings[i].stageFlags = VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT;
+	}
+
+	VkDescriptorSetLayoutCreateInfo setLayoutCreateInfo = {};
+	setLayoutCreateInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+	setLayoutCreateInfo.bindingCount = bindingCount;
+	setLayoutCreateInfo.pBindings = bindings;
+
+	VkResult result = vkCreateDescriptorSetLayout(context.device, &setLayoutCreateInfo, context.allocator, &scene.descriptorSetLayout);
+	Utility::checkVulkanResult(result, "Failed to create the lit descriptor set layout.");
+
+	VkDescriptorPoolSize poolSize = {};
+	poolSize.type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+	poolSize.descriptorCount = bindingCount;
+
+	VkDescriptorPoolCreateInfo poolCreateInfo = {};
+	poolCreateInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+	poolCreateInfo.maxSets = 1;
+	poolCreateInfo.poolSizeCount = 1;
+	poolCreateInfo.pPoolSizes = &poolSize;
+
+	result = vkCreateDescriptorPool(context.device, &poolCreateInfo, context.allocator, &scene.descriptorPool);
+	Utility::checkVulkanResult(result, "Failed to create the lit descriptor pool.");
+
+	VkDescriptorSetAllocateInfo setAllocateInfo = {};
+	setAllocateInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+	setAllocateInfo.descriptorPool = scene.descriptorPool;
+	setAllocateInfo.descriptorSetCount = 1;
+	setAllocateInfo.pSetLayouts = &scene.descriptorSetLayout;
+
+	result = vkAllocateDescriptorSets(context.device, &setAllocateInfo, &scene.descriptorSet);
+	Utility::checkVulkanResult(result, "Failed to allocate the lit descriptor set.");
+
+	VkDescriptorBufferInfo bufferInfos[bindingCount] = {};
+	scene.grid->getBufferInfos(bufferInfos);
+
+	VkWriteDescriptorSet descriptorWrite = {};
+	descriptorWrite.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+	descriptorWrite.dstSet = scene.descriptorSet;
+	descriptorWrite.dstBinding = 0;
+	descriptorWrite.descriptorCount = bindingCount;
+	descriptorWrite.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+	descriptorWrite.pBufferInfo = bufferInfos;
+
+	vkUpdateDescriptorSets(context.device, 1, &descriptorWrite, 0, nullptr);
+
+	VkPipelineLayoutCreateInfo layoutCreateInfo = {};
+	layoutCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+	layoutCreateInfo.setLayoutCount = 1;
+	layoutCreateInfo.pSetLayouts = &scene.descriptorSetLayout;
+
+	GraphicsPipelineSettings &pipelineSettings = scene.pipelineSettings;
+	pipelineSettings.device = context.device;
+	pipelineSettings.allocator = context.allocator;
+	pipelineSettings.renderPass = context.renderPass;
+	pipelineSettings.drawsInstances = true;
+
+	result = vkCreatePipelineLayout(context.device, &layoutCreateInfo, context.allocator, &pipelineSettings.layout);
+	Utility::checkVulkanResult(result, "Failed to create the lit pipeline layout.");
+
+	// Both variants share the SPIR-V, the emissive one only differs in a
+	// specialization constant
+	ShaderFeature emissive = { "EMISSIVE", FeatureBinding::SpecializationConstant, 0 };
+
+	ShaderProgramDescription description;
+	description.name = "Lit";
+	description.stages.push_back({ VK_SHADER_STAGE_VERTEX_BIT, "Lit.vert" });
+	description.stages.push_back({ VK_SHADER_STAGE_FRAGMENT_BIT, "Lit.frag" });
+	description.features.push_back(emissive);
+	description.compile = loadShaderVariant;
+	description.compileData = const_cast<char *>(scene.shaderDirectory);
+	description.getSourceVersion = getShaderFileVersion;
+	description.buildPipeline = buildGraphicsPipeline;
+	description.buildData = &scene.pipelineSettings;
+
+	scene.litProgram = scene.permutations->addProgram(description);
+	scene.litPipeline = scene.permutations->requirePipeline(scene.litProgram, 0);
+	scene.emissivePipeline = scene.permutations->requirePipeline(scene.litProgram, LIT_FEATURE_EMISSIVE);
+
+	assert(scene.litPipeline != VK_NULL_HANDLE && scene.emissivePipeline != VK_NULL_HANDLE,
+		"Failed to build the lit pipelines.");
+}
+
+// Lays the triangles of the ground flat over the light area, drawn with the
+// lit materials
+static void addLightSceneGround(Renderer &renderer, LightScene &scene)
+{
+	InstanceRenderer &instanceRenderer = renderer.getInstanceRenderer();
+	scene.triangleMesh = instanceRenderer.addMesh(renderer.getTriangleMesh());
+
+	InstanceMaterial litMaterial = { scene.litPipeline, scene.pipelineSettings.layout, scene.descriptorSet };
+	InstanceMaterial emissiveMaterial = { scene.emissivePipeline, scene.pipelineSettings.layout, scene.descriptorSet };
+
+	MaterialId lit = instanceRenderer.addMaterial(litMaterial);
+	scene.emissiveMaterial = instanceRenderer.addMaterial(emissiveMaterial);
+
+	// The triangle spans [-1, 1] in x and y, y becomes z on the ground
+	float spacing = LIGHT_AREA_SIZE / LIGHT_GROUND_GRID_SIZE;
+	float scale = spacing * 0.5f;
+
+	for (uint32_t z = 0; z < LIGHT_GROUND_GRID_SIZE; ++z)
+	{
+		for (uint32_t x = 0; x < LIGHT_GROUND_GRID_SIZE; ++x)
+		{
+			InstanceData instance =
+			{
+				{
+					scale, 0.0f, 0.0f, (x + 0.5f) * spacing,
+					0.0f, 0.0f, 0.0f, 0.0f,
+					0.0f, scale, 0.0f, (z + 0.5f) * spacing
+				},
+				{ 0.8f, 0.8f, 0.8f, 1.0f }
+			};
+
+			instanceRenderer.addInstance(scene.triangleMesh, lit, instance);
+		}
+	}
+}
+
+// Puts a marker at every light
+static void addLightSceneMarkers(Renderer &renderer, const LightScene &scene)
+{
+	InstanceRenderer &instanceRenderer = renderer.getInstanceRenderer();
+
+	for (const PointLight &light : scene.lights)
+	{
+		InstanceData instance =
+		{
+			{
+				LIGHT_MARKER_SIZE, 0.0f, 0.0f, light.position[0],
+				0.0f, LIGHT_MARKER_SIZE, 0.0f, light.position[1],
+				0.0f, 0.0f, 1.0f, light.position[2]
+			},
+			{ light.color[0], light.color[1], light.color[2], 1.0f }
+		};
+
+		instanceRenderer.addInstance(scene.triangleMesh, scene.emissiveMaterial, instance);
+	}
+}
+
+// Lit materials are only used by the cached draw commands of the frames in
+// flight, the renderer destroys them once those are done
+static void retireLightSceneObjects(Renderer &renderer, const LightScene &scene)
+{
+	DeletionQueue &deletionQueue = renderer.getDeletionQueue();
+
+	deletionQueue.retire(VK_OBJECT_TYPE_PIPELINE_LAYOUT, reinterpret_cast<uint64_t>(scene.pipelineSettings.layout));
+	deletionQueue.retire(VK_OBJECT_TYPE_DESCRIPTOR_POOL, reinterpret_cast<uint64_t>(scene.descriptorPool));
+	deletionQueue.retire(VK_OBJECT_TYPE_DESCRIPTOR_SET_LAYOUT, reinterpret_cast<uint64_t>(scene.descriptorSetLayout));
+}
+
+// Bins the lights of the last build again by testing every cluster, the
+// data is either the CPU build or the grid read back from the GPU
+static bool matchesReferenceBinning(const LightGrid &lightGrid, const LightGridData &data)
+{
+	LightGridData reference;
+	binLightsReference(lightGrid.getLights(), lightGrid.getView(), lightGrid.getSettings(), reference);
+
+	if (data.lightIndices != reference.lightIndices ||
+		data.overflowCount != reference.overflowCount ||
+		data.clusters.size() != reference.clusters.size())
+	{
+		return false;
+	}
+
+	for (size_t i = 0; i < data.clusters.size(); ++i)
+	{
+		if (data.clusters[i].offset != reference.clusters[i].offset ||
+			data.clusters[i].count != reference.clusters[i].count)
+		{
+			return false;
+		}
+	}
+
+	return true;
+}
+
+// Creates the pipelines of the particle steps once the device exists
+static void createParticlePipelinesTask(void *data, const VulkanContext &context)
+{
+	ParticleScene &scene = *static_cast<ParticleScene *>(data);
+	scene.system->createPipelines(scene.shaders, scene.permutations->getPipelineCache());
+}
+
+// A fountain that keeps tens of thousands of particles alive
+static void setSceneEmitter(ParticleSystem &particleSystem)
+{
+	ParticleEmitter emitter =
+	{
+		{ 0.0f, 2.0f, 0.0f },
+		0.5f,
+		{ 0.0f, 6.0f, 0.0f },
+		2.0f,
+		{ 0.0f, -9.81f, 0.0f },
+		0.1f,
+		1.0f,
+		3.0f,
+		30000.0f
+	};
+
+	particleSystem.setEmitter(emitter);
+}
+
+// Particles emitted by the same step are told apart by their lifetimes
+static bool isParticleBefore(const Particle &a, const Particle &b)
+{
+	if (a.age != b.age)
+		return a.age < b.age;
+
+	return a.lifetime < b.lifetime;
+}
+
+static bool isSameParticle(const Particle &a, const Particle &b)
+{
+	const float *valuesA = &a.position[0];
+	const float *valuesB = &b.position[0];
+
+	// Position, age, velocity and lifetime
+	for (uint32_t i = 0; i < 8; ++i)
+	{
+		if (fabsf(valuesA[i] - valuesB[i]) > PARTICLE_TOLERANCE * (1.0f + fabsf(valuesB[i])))
+			return false;
+	}
+
+	return true;
+}
+
+// Replays the steps the GPU took on the CPU and counts the particles either
+// side has that the other does not. Both are sorted, rounding can swap
+// neighbours whose lifetimes are almost the same, so a few of them around
+// every particle are searched.
+static void compareSceneParticles(ParticleScene &scene)
+{
+	typedef std::chrono::high_resolution_clock Clock;
+	ParticleSceneStatistics &statistics = scene.statistics;
+
+	Clock::time_point referenceStart = Clock::now();
+
+	std::vector<Particle> reference;
+	for (const ParticleStep &step : scene.steps)
+		simulateParticlesReference(step, reference);
+
+	statistics.referenceTime = std::chrono::duration<double, std::milli>(Clock::now() - referenceStart).count();
+	statistics.referenceLiveCount = static_cast<uint32_t>(reference.size());
+
+	std::vector<Particle> particles;
+	if (scene.system->getStatistics().stepCount != scene.steps.size() || !scene.system->getGpuParticles(particles))
+	{
+		statistics.gpuLiveCount = 0;
+		statistics.mismatchCount = reference.size();
+		return;
+	}
+
+	statistics.gpuLiveCount = static_cast<uint32_t>(particles.size());
+
+	std::sort(reference.begin(), reference.end(), isParticleBefore);
+	std::sort(particles.begin(), particles.end(), isParticleBefore);
+
+	const size_t window = 8;
+	std::vector<bool> isMatched(particles.size(), false);
+	size_t matchCount = 0;
+
+	for (size_t i = 0; i < reference.size(); ++i)
+	{
+		size_t begin = i > window ? i - window : 0;
+		size_t end = std::min(i + window + 1, particles.size());
+
+		for (size_t j = begin; j < end; ++j)
+		{
+			if (!isMatched[j] && isSameParticle(particles[j], reference[i]))
+			{
+				isMatched[j] = true;
+				++matchCount;
+				break;
+			}
+		}
+	}
+
+	statistics.mismatchCount = (reference.size() - matchCount) + (particles.size() - matchCount);
+}
+
+// Looks over the middle of the light area from a point that stays put, so
+// the lights keep their tiles
+static void setShadowSceneView(LightGrid &lightGrid, const ShadowScene &scene)
+{
+	float eye[3] = { LIGHT_AREA_SIZE * 0.5f, 12.0f, LIGHT_AREA_SIZE * 0.5f - 32.0f };
+	float target[3] = { LIGHT_AREA_SIZE * 0.5f, 0.0f, LIGHT_AREA_SIZE * 0.5f };
+
+	float view[16];
+	makeViewMatrix(eye, target, view);
+
+	LightGridView gridView = {};
+	memcpy(gridView.viewMatrix, view, sizeof(gridView.viewMatrix));
+	gridView.tanHalfFovY = tanf(CAMERA_FIELD_OF_VIEW * 0.5f);
+	gridView.tanHalfFovX = gridView.tanHalfFovY * scene.aspectRatio;
+	gridView.nearPlane = CAMERA_NEAR_PLANE;
+	gridView.farPlane = CAMERA_FAR_PLANE;
+
+	lightGrid.setView(gridView);
+}
+
+// The scene only counts which tiles are drawn again
+static void drawShadowCasters(void *data, VkCommandBuffer commandBuffer, const ShadowFaceDraw &draw)
+{
+}
+
+static void getShadowCasterCenter(uint32_t frame, float center[3])
+{
+	float angle = frame * 0.02f;
+
+	center[0] = LIGHT_AREA_SIZE * 0.5f + SHADOW_CASTER_ORBIT * cosf(angle);
+	center[1] = SHADOW_CASTER_RADIUS;
+	center[2] = LIGHT_AREA_SIZE * 0.5f + SHADOW_CASTER_ORBIT * sinf(angle);
+}
+
+static void addShadowSceneCasters(ShadowAtlas &shadowAtlas, ShadowScene &scene)
+{
+	float spacing = LIGHT_AREA_SIZE / SHADOW_CASTER_GRID_SIZE;
+
+	for (uint32_t z = 0; z < SHADOW_CASTER_GRID_SIZE; ++z)
+	{
+		for (uint32_t x = 0; x < SHADOW_CASTER_GRID_SIZE; ++x)
+		{
+			float center[3] = { (x + 0.5f) * spacing, SHADOW_CASTER_RADIUS, (z + 0.5f) * spacing };
+			shadowAtlas.addCaster(center, SHADOW_CASTER_RADIUS, ShadowLayer::Static);
+		}
+	}
+
+	getShadowCasterCenter(0, scene.casterCenter);
+	memcpy(scene.previousCasterCenter, scene.casterCenter, sizeof(scene.casterCenter));
+	scene.movingCaster = shadowAtlas.addCaster(scene.casterCenter, SHADOW_CASTER_RADIUS, ShadowLayer::Dynamic);
+}
+
+static void moveShadowSceneCaster(ShadowAtlas &shadowAtlas, ShadowScene &scene, uint32_t frame)
+{
+	memcpy(scene.previousCasterCenter, scene.casterCenter, sizeof(scene.casterCenter));
+	getShadowCasterCenter(frame, scene.casterCenter);
+
+	shadowAtlas.moveCaster(scene.movingCaster, scene.casterCenter, SHADOW_CASTER_RADIUS);
+}
+
+// Same test as the atlas, a light overlaps the caster if their spheres touch
+static bool overlapsShadowCaster(const PointLight &light, const float center[3])
+{
+	float dx = light.position[0] - center[0];
+	float dy = light.position[1] - center[1];
+	float dz = light.position[2] - center[2];
+	float radius = light.radius + SHADOW_CASTER_RADIUS;
+
+	return dx * dx + dy * dy + dz * dz <= radius * radius;
+}
+
+// Compares the tiles the last update drew again against the shadowed lights
+// the moving caster overlapped. Nothing else changed, so the static layers
+// stay as they are.
+static void countShadowSceneUpdates(const ShadowAtlas &shadowAtlas, ShadowScene &scene)
+{
+	ShadowAtlasStatistics atlasStatistics = shadowAtlas.getStatistics();
+	const std::vector<ShadowTileData> &tiles = shadowAtlas.getTiles();
+	ShadowSceneStatistics &statistics = scene.statistics;
+
+	uint32_t overlappedTileCount = 0;
+	for (size_t i = 0; i < tiles.size(); ++i)
+	{
+		if (tiles[i].faceScale > 0.0f &&
+			(overlapsShadowCaster(scene.lights[i], scene.previousCasterCenter) ||
+			overlapsShadowCaster(scene.lights[i], scene.casterCenter)))
+		{
+			++overlappedTileCount;
+		}
+	}
+
+	statistics.staticTileUpdates += atlasStatistics.staticTileUpdates;
+	statistics.dynamicTileUpdates += atlasStatistics.dynamicTileUpdates;
+	statistics.overlappedTileCount += overlappedTileCount;
+	statistics.mismatchCount += atlasStatistics.staticTileUpdates + absoluteDifference(atlasStatistics.dynamicTileUpdates, overlappedTileCount);
+	statistics.maxDynamicTileUpdates = std::max(statistics.maxDynamicTileUpdates, atlasStatistics.dynamicTileUpdates);
+}
+
+// Views of the "multiview" scene for a camera moving along the grid. Six
+// views are the faces of a cube map around the camera, any other number are
+// eyes next to each other that look the same way.
+static void makeSceneViews(const MultiviewScene &scene, uint32_t frame, MultiviewViewData *views)
+{
+	float extent = MULTIVIEW_GRID_SIZE * MULTIVIEW_GRID_SPACING;
+	float eye[3] = { fmodf(frame * 0.05f, extent), 6.0f, -6.0f };
+
+	if (scene.viewCount == 6)
+	{
+		float viewProjections[6][16];
+		makeCubeViewProjections(eye, CAMERA_NEAR_PLANE, CAMERA_FAR_PLANE, viewProjections);
+
+		for (uint32_t i = 0; i < 6; ++i)
+		{
+			memcpy(views[i].viewProjection, viewProjections[i], sizeof(views[i].viewProjection));
+			memcpy(views[i].cameraPosition, eye, sizeof(eye));
+			views[i].cameraPosition[3] = 1.0f;
+		}
+
+		return;
+	}
+
+	// The eyes are spread along the right vector of the camera
+	float forward[3] = { 0.0f, -6.0f, 20.0f };
+	float rightLength = sqrtf(forward[0] * forward[0] + forward[2] * forward[2]);
+	float right[3] = { -forward[2] / rightLength, 0.0f, forward[0] / rightLength };
+
+	for (uint32_t i = 0; i < scene.viewCount; ++i)
+	{
+		float offset = (i - (scene.viewCount - 1) * 0.5f) * EYE_SEPARATION;
+
+		float viewEye[3];
+		float target[3];
+		for (int k = 0; k < 3; ++k)
+		{
+			viewEye[k] = eye[k] + right[k] * offset;
+			target[k] = viewEye[k] + forward[k];
+		}
+
+		makeViewProjection(viewEye, target, scene.aspectRatio, views[i].viewProjection);
+		memcpy(views[i].cameraPosition, viewEye, sizeof(viewEye));
+		views[i].cameraPosition[3] = 1.0f;
+	}
+}
+
+// Culls every object on the grid once for all views, and once for every
+// view on its own like a pass per view would, writing a draw for every
+// visible object in either case
+static void cullSceneViews(MultiviewScene &scene, const MultiviewViewData *views)
+{
+	typedef std::chrono::high_resolution_clock Clock;
+
+	const uint32_t objectCount = MULTIVIEW_GRID_SIZE * MULTIVIEW_GRID_SIZE;
+	MultiviewSceneStatistics &statistics = scene.statistics;
+
+	VkDrawIndexedIndirectCommand command = {};
+	command.indexCount = 3;
+	command.instanceCount = 1;
+
+	CullingView cullingViews[MAX_MULTIVIEW_VIEWS];
+
+	Clock::time_point sharedStart = Clock::now();
+
+	for (uint32_t i = 0; i < scene.viewCount; ++i)
+		cullingViews[i] = makeCullingView(views[i].viewProjection, views[i].cameraPosition);
+
+	MultiviewCullingView cullingView = makeMultiviewCullingView(cullingViews, scene.viewCount);
+	uint32_t sharedDrawCount = 0;
+
+	for (uint32_t object = 0; object < objectCount; ++object)
+	{
+		float center[3] =
+		{
+			(object % MULTIVIEW_GRID_SIZE) * MULTIVIEW_GRID_SPACING,
+			0.0f,
+			(object / MULTIVIEW_GRID_SIZE) * MULTIVIEW_GRID_SPACING
+		};
+
+		uint32_t viewMask = cullSphereMultiview(cullingView, center, MULTIVIEW_OBJECT_RADIUS);
+		scene.sharedMasks[object] = viewMask;
+
+		if (viewMask != 0)
+		{
+			command.firstInstance = object;
+			scene.sharedCommands[sharedDrawCount++] = command;
+		}
+	}
+
+	statistics.sharedCullTime += std::chrono::duration<double, std::milli>(Clock::now() - sharedStart).count();
+
+	Clock::time_point perViewStart = Clock::now();
+	uint32_t perViewDrawCount = 0;
+
+	for (uint32_t i = 0; i < scene.viewCount; ++i)
+	{
+		CullingView view = makeCullingView(views[i].viewProjection, views[i].cameraPosition);
+		scene.viewDrawOffsets[i] = perViewDrawCount;
+
+		for (uint32_t object = 0; object < objectCount; ++object)
+		{
+			float center[3] =
+			{
+				(object % MULTIVIEW_GRID_SIZE) * MULTIVIEW_GRID_SPACING,
+				0.0f,
+				(object / MULTIVIEW_GRID_SIZE) * MULTIVIEW_GRID_SPACING
+			};
+
+			if (i == 0)
+				scene.perViewMasks[object] = 0;
+
+			if (cullSpherePerView(&view, 1, center, MULTIVIEW_OBJECT_RADIUS) != 0)
+			{
+				scene.perViewMasks[object] |= 1u << i;
+
+				command.firstInstance = object;
+				scene.perViewCommands[perViewDrawCount++] = command;
+			}
+		}
+	}
+
+	statistics.perViewCullTime += std::chrono::duration<double, std::milli>(Clock::now() - perViewStart).count();
+
+	scene.sharedDrawCount = sharedDrawCount;
+	scene.viewDrawOffsets[scene.viewCount] = perViewDrawCount;
+
+	statistics.sharedDrawCount += sharedDrawCount;
+	statistics.perViewDrawCount += perViewDrawCount;
+	statistics.sharedPlaneCount = cullingView.sharedPlaneCount;
+
+	for (uint32_t object = 0; object < objectCount; ++object)
+	{
+		if (scene.sharedMasks[object] != scene.perViewMasks[object])
+			++statistics.mismatchCount;
+	}
+}
+
+// Draws the objects the views of the pass see. One pass for all views draws
+// every object any view sees once, a pass per view only those of its view.
+static void drawMultiviewScene(void *data, VkCommandBuffer commandBuffer, const MultiviewDraw &draw)
+{
+	const MultiviewScene &scene = *static_cast<const MultiviewScene *>(data);
+
+	vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, scene.pipeline);
+
+	vkCmdBindDescriptorSets(
+		commandBuffer,
+		VK_PIPELINE_BIND_POINT_GRAPHICS,
+		scene.pipelineSettings.layout,
+		0,
+		1,
+		&scene.descriptorSet,
+		0,
+		nullptr);
+
+	// gl_ViewIndex is 0 without multiview
+	uint32_t viewIndex = draw.isMultiview ? 0 : draw.viewIndex;
+	vkCmdPushConstants(commandBuffer, scene.pipelineSettings.layout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(viewIndex), &viewIndex);
+
+	const VkDrawIndexedIndirectCommand *commands = scene.sharedCommands.data();
+	uint32_t drawCount = scene.sharedDrawCount;
+
+	if (!draw.isMultiview)
+	{
+		commands = scene.perViewCommands.data() + scene.viewDrawOffsets[draw.viewIndex];
+		drawCount = scene.viewDrawOffsets[draw.viewIndex + 1] - scene.viewDrawOffsets[draw.viewIndex];
+	}
+
+	// The triangles come from gl_VertexIndex, the object from the instance
+	for (uint32_t i = 0; i < drawCount; ++i)
+		vkCmdDraw(commandBuffer, 3, 1, 0, commands[i].firstInstance);
+}
+
+// Creates the pipeline of the multiview scene once the device and the pass
+// exist. Multiview.vert reads gl_ViewIndex, which needs the multiview
+// feature even for a pass per view, without it the passes only clear.
+static void createMultiviewPipelinesTask(void *data, const VulkanContext &context)
+{
+	MultiviewScene &scene = *static_cast<MultiviewScene *>(data);
+
+	if (!context.supportsMultiview)
+		return;
+
+	VkDescriptorSetLayoutBinding binding = {};
+	binding.binding = 0;
+	binding.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+	binding.descriptorCount = 1;
+	binding.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
+
+	VkDescriptorSetLayoutCreateInfo setLayoutCreateInfo = {};
+	setLayoutCreateInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+	setLayoutCreateInfo.bindingCount = 1;
+	setLayoutCreateInfo.pBindings = &binding;
+
+	VkResult result = vkCreateDescriptorSetLayout(context.device, &setLayoutCreateInfo, context.allocator, &scene.descriptorSetLayout);
+	Utility::checkVulkanResult(result, "Failed to create the multiview descriptor set layout.");
+
+	VkDescriptorPoolSize poolSize = {};
+	poolSize.type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+	poolSize.descriptorCount = 1;
+
+	VkDescriptorPoolCreateInfo poolCreateInfo = {};
+	poolCreateInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+	poolCreateInfo.maxSets = 1;
+	poolCreateInfo.poolSizeCount = 1;
+	poolCreateInfo.pPoolSizes = &poolSize;
+
+	result = vkCreateDescriptorPool(context.device, &poolCreateInfo, context.allocator, &scene.descriptorPool);
+	Utility::checkVulkanResult(result, "Failed to create the multiview descriptor pool.");
+
+	VkDescriptorSetAllocateInfo setAllocateInfo = {};
+	setAllocateInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+	setAllocateInfo.descriptorPool = scene.descriptorPool;
+	setAllocateInfo.descriptorSetCount = 1;
+	setAllocateInfo.pSetLayouts = &scene.descriptorSetLayout;
+
+	result = vkAllocateDescriptorSets(context.device, &setAllocateInfo, &scene.descriptorSet);
+	Utility::checkVulkanResult(result, "Failed to allocate the multiview descriptor set.");
+
+	VkDescriptorBufferInfo bufferInfo = scene.pass->getViewBufferInfo();
+
+	VkWriteDescriptorSet descriptorWrite = {};
+	descriptorWrite.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+	descriptorWrite.dstSet = scene.descriptorSet;
+	descriptorWrite.dstBinding = 0;
+	descriptorWrite.descriptorCount = 1;
+	descriptorWrite.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+	descriptorWrite.pBufferInfo = &bufferInfo;
+
+	vkUpdateDescriptorSets(context.device, 1, &descriptorWrite, 0, nullptr);
+
+	// The view of a pass per view
+	VkPushConstantRange pushConstantRange = {};
+	pushConstantRange.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
+	pushConstantRange.offset = 0;
+	pushConstantRange.size = sizeof(uint32_t);
+
+	VkPipelineLayoutCreateInfo layoutCreateInfo = {};
+	layoutCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+	layoutCreateInfo.setLayoutCount = 1;
+	layoutCreateInfo.pSetLayouts = &scene.descriptorSetLayout;
+	layoutCreateInfo.pushConstantRangeCount = 1;
+	layoutCreateInfo.pPushConstantRanges = &pushConstantRange;
+
+	GraphicsPipelineSettings &pipelineSettings = scene.pipelineSettings;
+	pipelineSettings.device = context.device;
+	pipelineSettings.allocator = context.allocator;
+	pipelineSettings.renderPass = scene.pass->getRenderPass();
+	pipelineSettings.drawsInstances = false;
+
+	result = vkCreatePipelineLayout(context.device, &layoutCreateInfo, context.allocator, &pipelineSettings.layout);
+	Utility::checkVulkanResult(result, "Failed to create the multiview pipeline layout.");
+
+	ShaderProgramDescription description;
+	description.name = "Multiview";
+	description.stages.push_back({ VK_SHADER_STAGE_VERTEX_BIT, "Multiview.vert" });
+	description.stages.push_back({ VK_SHADER_STAGE_FRAGMENT_BIT, "Multiview.frag" });
+	description.compile = loadShaderVariant;
+	description.compileData = const_cast<char *>(scene.shaderDirectory);
+	description.getSourceVersion = getShaderFileVersion;
+	description.buildPipeline = buildGraphicsPipeline;
+	description.buildData = &scene.pipelineSettings;
+
+	ProgramId program = scene.permutations->addProgram(description);
+	scene.pipeline = scene.permutations->requirePipeline(program, 0);
+
+	assert(scene.pipeline != VK_NULL_HANDLE, "Failed to build the multiview pipeline.");
+}
+
+// Like the lit materials, only used by the commands of the frames in flight
+static void retireMultiviewSceneObjects(Renderer &renderer, const MultiviewScene &scene)
+{
+	DeletionQueue &deletionQueue = renderer.getDeletionQueue();
+
+	deletionQueue.retire(VK_OBJECT_TYPE_PIPELINE_LAYOUT, reinterpret_cast<uint64_t>(scene.pipelineSettings.layout));
+	deletionQueue.retire(VK_OBJECT_TYPE_DESCRIPTOR_POOL, reinterpret_cast<uint64_t>(scene.descriptorPool));
+	deletionQueue.retire(VK_OBJECT_TYPE_DESCRIPTOR_SET_LAYOUT, reinterpret_cast<uint64_t>(scene.descriptorSetLayout));
+}
+
+// Largest amount of memory the process had resident at once, in bytes
+static uint64_t getPeakWorkingSet()
+{
+#ifdef _WIN32
+	PROCESS_MEMORY_COUNTERS memoryCounters = {};
+	memoryCounters.cb = sizeof(memoryCounters);
+	GetProcessMemoryInfo(GetCurrentProcess(), &memoryCounters, sizeof(memoryCounters));
+
+	return memoryCounters.PeakWorkingSetSize;
+#else
+	// Linux reports kilobytes
+	struct rusage usage = {};
+	getrusage(RUSAGE_SELF, &usage);
+
+	return static_cast<uint64_t>(usage.ru_maxrss) * 1024;
+#endif
+}
+
+static const char *getMultiGpuModeName(MultiGpuMode mode)
+{
+	switch (mode)
+	{
+	case MultiGpuMode::AlternateFrame:
+		return "afr";
+	case MultiGpuMode::SplitFrame:
+		return "sfr";
+	default:
+		return "off";
+	}
+}
+
+void printUsage()
+{
+	printf(
+		"Usage: LearningVulkanBenchmark [options]\n"
+		"  --scene <name>             Scene to render (clear, lod, meshlets, lights, shadows, multiview, particles)\n"
+		"  --width <pixels>           Render width (default 1280)\n"
+		"  --height <pixels>          Render height (default 720)\n"
+		"  --frames <count>           Number of measured frames (default 1000)\n"
+		"  --warm-up <count>          Frames rendered before measuring (default 10)\n"
+		"  --frames-in-flight <count> Frames the CPU may run ahead (1 to %u, default 2)\n"
+		"  --threads <count>          Worker threads for jobs (default 0, one per core)\n"
+		"  --validation               Enable the validation layers\n"
+		"  --capture <prefix>         Save every measured frame as <prefix>_<frame>.raw\n"
+		"  --capability-cache <file>  Capability cache to use (default capabilities.cache)\n"
+		"  --cold-start               Probe all capabilities instead of using the cache\n"
+		"  --shader-cache <file>      Shader variant and pipeline cache to use (default shaders.cache)\n"
+		"  --trace <file>             Record the measured frames for LearningVulkanReplay\n"
+		"  --fps <rate>               Pace the frames to this rate (default 0, unlimited)\n"
+		"  --gpu-budget <ms>          Scale the resolution to keep GPU frames within this time\n"
+		"  --lights <count>           Point lights of the \"lights\" and \"shadows\" scenes (up to %u, default 1024)\n"
+		"  --views <count>            Views of the \"multiview\" scene (up to %u, 6 is a cube map, default 2)\n"
+		"  --per-view                 Render the views one pass at a time, even with multiview support\n"
+		"  --multi-gpu <mode>         Use a device group (off, afr, sfr, default off)\n"
+		"  --shaders <directory>      Compiled shaders, the \"meshlets\" and \"lights\" scenes run on the GPU and draw with them,\n"
+		"                             the \"particles\" scene needs them\n",
+		MAX_FRAMES_IN_FLIGHT,
+		MAX_LIGHTS,
+		MAX_MULTIVIEW_VIEWS);
+}
+
+bool parseArguments(int argc, char **argv, BenchmarkSettings &settings)
+{
+	for (int i = 1; i < argc; ++i)
+	{
+		// All options except for "--validation" and "--cold-start" expect a
+		// value
+		bool hasValue = (i + 1 < argc);
+
+		if (strcmp(argv[i], "--validation") == 0)
+			settings.enableValidation = true;
+		else if (strcmp(argv[i], "--cold-start") == 0)
+			settings.capabilityCachePath = nullptr;
+		else if (strcmp(argv[i], "--scene") == 0 && hasValue)
+			settings.scene = argv[++i];
+		else if (strcmp(argv[i], "--width") == 0 && hasValue)
+			settings.width = strtoul(argv[++i], nullptr, 10);
+		else if (strcmp(argv[i], "--height") == 0 && hasValue)
+			settings.height = strtoul(argv[++i], nullptr, 10);
+		else if (strcmp(argv[i], "--frames") == 0 && hasValue)
+			settings.frameCount = strtoul(argv[++i], nullptr, 10);
+		else if (strcmp(argv[i], "--warm-up") == 0 && hasValue)
+			settings.warmUpFrameCount = strtoul(argv[++i], nullptr, 10);
+		else if (strcmp(argv[i], "--frames-in-flight") == 0 && hasValue)
+			settings.framesInFlight = strtoul(argv[++i], nullptr, 10);
+		else if (strcmp(argv[i], "--threads") == 0 && hasValue)
+			settings.workerCount = strtoul(argv[++i], nullptr, 10);
+		else if (strcmp(argv[i], "--capture") == 0 && hasValue)
+			settings.capturePrefix = argv[++i];
+		else if (strcmp(argv[i], "--capability-cache") == 0 && hasValue)
+			settings.capabilityCachePath = argv[++i];
+		else if (strcmp(argv[i], "--shader-cache") == 0 && hasValue)
+			settings.shaderCachePath = argv[++i];
+		else if (strcmp(argv[i], "--trace") == 0 && hasValue)
+			settings.tracePath = argv[++i];
+		else if (strcmp(argv[i], "--fps") == 0 && hasValue)
+			settings.targetFrameRate = strtod(argv[++i], nullptr);
+		else if (strcmp(argv[i], "--gpu-budget") == 0 && hasValue)
+			settings.gpuBudget = strtod(argv[++i], nullptr);
+		else if (strcmp(argv[i], "--lights") == 0 && hasValue)
+			settings.lightCount = strtoul(argv[++i], nullptr, 10);
+		else if (strcmp(argv[i], "--views") == 0 && hasValue)
+			settings.viewCount = strtoul(argv[++i], nullptr, 10);
+		else if (strcmp(argv[i], "--per-view") == 0)
+			settings.perView = true;
+		else if (strcmp(argv[i], "--multi-gpu") == 0 && hasValue)
+		{
+			const char *mode = argv[++i];
+
+			if (strcmp(mode, "off") == 0)
+				settings.multiGpuMode = MultiGpuMode::Disabled;
+			else if (strcmp(mode, "afr") == 0)
+				settings.multiGpuMode = MultiGpuMode::AlternateFrame;
+			else if (strcmp(mode, "sfr") == 0)
+				settings.multiGpuMode = MultiGpuMode::SplitFrame;
+			else
+				return false;
+		}
+		else if (strcmp(argv[i], "--shaders") == 0 && hasValue)
+			settings.shaderDirectory = argv[++i];
+		else
+			return false;
+	}
+
+	if (strcmp(settings.scene, "clear") != 0 &&
+		strcmp(settings.scene, "lod") != 0 &&
+		strcmp(settings.scene, "meshlets") != 0 &&
+		strcmp(settings.scene, "lights") != 0 &&
+		strcmp(settings.scene, "shadows") != 0 &&
+		strcmp(settings.scene, "multiview") != 0 &&
+		strcmp(settings.scene, "particles") != 0)
+	{
+		fprintf(stderr, "Unknown scene \"%s\".\n", settings.scene);
+		return false;
+	}
+
+	// Particles are only simulated on the GPU
+	if (strcmp(settings.scene, "particles") == 0 && !settings.shaderDirectory)
+	{
+		fprintf(stderr, "The \"particles\" scene needs --shaders.\n");
+		return false;
+	}
+
+	return	settings.width != 0 &&
+			settings.height != 0 &&
+			settings.frameCount != 0 &&
+			settings.framesInFlight != 0 &&
+			settings.framesInFlight <= MAX_FRAMES_IN_FLIGHT &&
+			settings.lightCount <= MAX_LIGHTS &&
+			settings.viewCount != 0 &&
+			settings.viewCount <= MAX_MULTIVIEW_VIEWS;
+}
+
+int main(int argc, char **argv)
+{
+	BenchmarkSettings settings = {};
+	settings.scene = "clear";
+	settings.width = 1280;
+	settings.height = 720;
+	settings.frameCount = 1000;
+	settings.warmUpFrameCount = 10;
+	settings.framesInFlight = 2;
+	settings.workerCount = 0;
+	settings.enableValidation = false;
+	settings.capturePrefix = nullptr;
+	settings.capabilityCachePath = "capabilities.cache";
+	settings.shaderCachePath = "shaders.cache";
+	settings.tracePath = nullptr;
+	settings.targetFrameRate = 0.0;
+	settings.gpuBudget = 0.0;
+	settings.lightCount = 1024;
+	settings.viewCount = 2;
+	settings.perView = false;
+	settings.multiGpuMode = MultiGpuMode::Disabled;
+	settings.shaderDirectory = nullptr;
+
+	if (!parseArguments(argc, argv, settings))
+	{
+		printUsage();
+		return 1;
+	}
+
+	typedef std::chrono::high_resolution_clock Clock;
+
+	// Time to first frame includes everything the renderer does at startup
+	Clock::time_point startupStart = Clock::now();
+
+	Renderer vulkanRenderer;
+
+	// The "lod" scene simplifies a dense sphere at load time and selects a
+	// level for every object on a grid each frame
+	bool isLodScene = (strcmp(settings.scene, "lod") == 0);
+	LodScene lodScene;
+	lodScene.statistics = {};
+
+	if (isLodScene)
+	{
+		const float fieldOfView = 60.0f * 3.14159265358979f / 180.0f;
+
+		LodSettings lodSettings = {};
+		lodSettings.projectionScale = settings.height / (2.0f * tanf(fieldOfView * 0.5f));
+		lodSettings.pixelThreshold = 1.0f;
+		lodSettings.hysteresis = 0.1f;
+		lodScene.selector.setSettings(lodSettings);
+		lodScene.selector.setObjectCount(LOD_GRID_SIZE * LOD_GRID_SIZE);
+
+		// Overlaps with creating the device
+		vulkanRenderer.addStartupTask("Build LOD chain", buildLodSceneTask, &lodScene, StartupStage::Immediate);
+	}
+
+	// The "meshlets" scene splits a dense sphere into meshlets at load time
+	// and culls them for every object on a grid each frame
+	bool isMeshletScene = (strcmp(settings.scene, "meshlets") == 0);
+	MeshletScene meshletScene;
+	meshletScene.aspectRatio = static_cast<float>(settings.width) / settings.height;
+	meshletScene.statistics = {};
+	meshletScene.renderer = &vulkanRenderer.getMeshletRenderer();
+	meshletScene.permutations = &vulkanRenderer.getShaderPermutations();
+	meshletScene.shaderDirectory = settings.shaderDirectory;
+	meshletScene.pipelineSettings = {};
+	meshletScene.meshPipeline = VK_NULL_HANDLE;
+	meshletScene.lastFrame = {};
+
+	bool isGpuMeshletCull = isMeshletScene && settings.shaderDirectory;
+
+	if (isMeshletScene)
+		vulkanRenderer.addStartupTask("Build meshlets", buildMeshletSceneTask, &meshletScene, StartupStage::Immediate);
+
+	if (isGpuMeshletCull)
+	{
+		if (!loadSpirv(settings.shaderDirectory, "MeshletCull.comp.spv", meshletScene.shaders.cull))
+			return 1;
+
+		vulkanRenderer.addStartupTask("Create meshlet pipelines", createMeshletPipelinesTask, &meshletScene, StartupStage::AfterDevice);
+	}
+
+	// The "lights" scene bins point lights into the light grid each frame
+	bool isLightScene = (strcmp(settings.scene, "lights") == 0);
+	LightScene lightScene;
+	lightScene.aspectRatio = static_cast<float>(settings.width) / settings.height;
+	lightScene.statistics = {};
+	lightScene.grid = &vulkanRenderer.getLightGrid();
+	lightScene.permutations = &vulkanRenderer.getShaderPermutations();
+	lightScene.shaderDirectory = settings.shaderDirectory;
+	lightScene.descriptorSetLayout = VK_NULL_HANDLE;
+	lightScene.descriptorPool = VK_NULL_HANDLE;
+	lightScene.descriptorSet = VK_NULL_HANDLE;
+	lightScene.pipelineSettings = {};
+	lightScene.litProgram = 0;
+	lightScene.litPipeline = VK_NULL_HANDLE;
+	lightScene.emissivePipeline = VK_NULL_HANDLE;
+	lightScene.triangleMesh = 0;
+	lightScene.emissiveMaterial = 0;
+
+	bool isGpuLightBinning = isLightScene && settings.shaderDirectory;
+
+	if (isLightScene)
+		createSceneLights(settings.lightCount, lightScene.lights);
+
+	if (isGpuLightBinning)
+	{
+		if (!loadSpirv(settings.shaderDirectory, "LightBin.comp.spv", lightScene.shaders.bin))
+			return 1;
+
+		vulkanRenderer.addStartupTask("Create light pipelines", createLightPipelinesTask, &lightScene, StartupStage::AfterDevice);
+	}
+
+	// The "shadows" scene moves a single caster among the lights every frame
+	bool isShadowScene = (strcmp(settings.scene, "shadows") == 0);
+	ShadowScene shadowScene;
+	shadowScene.aspectRatio = static_cast<float>(settings.width) / settings.height;
+	shadowScene.movingCaster = 0;
+	shadowScene.statistics = {};
+
+	if (isShadowScene)
+		createSceneLights(settings.lightCount, shadowScene.lights);
+
+	// The "multiview" scene renders several views of the camera every frame
+	// and culls a grid of objects for all of them. Without the shaders its
+	// passes only clear.
+	bool isMultiviewScene = (strcmp(settings.scene, "multiview") == 0);
+	MultiviewScene multiviewScene;
+	multiviewScene.viewCount = settings.viewCount;
+	multiviewScene.aspectRatio = static_cast<float>(settings.width) / settings.height;
+	multiviewScene.sharedDrawCount = 0;
+	multiviewScene.statistics = {};
+	multiviewScene.pass = &vulkanRenderer.getMultiviewPass();
+	multiviewScene.permutations = &vulkanRenderer.getShaderPermutations();
+	multiviewScene.shaderDirectory = settings.shaderDirectory;
+	multiviewScene.descriptorSetLayout = VK_NULL_HANDLE;
+	multiviewScene.descriptorPool = VK_NULL_HANDLE;
+	multiviewScene.descriptorSet = VK_NULL_HANDLE;
+	multiviewScene.pipelineSettings = {};
+	multiviewScene.pipeline = VK_NULL_HANDLE;
+	memset(multiviewScene.viewDrawOffsets, 0, sizeof(multiviewScene.viewDrawOffsets));
+
+	bool isMultiviewDrawn = isMultiviewScene && settings.shaderDirectory;
+
+	if (isMultiviewScene)
+	{
+		const uint32_t objectCount = MULTIVIEW_GRID_SIZE * MULTIVIEW_GRID_SIZE;
+		multiviewScene.sharedMasks.resize(objectCount);
+		multiviewScene.perViewMasks.resize(objectCount);
+		multiviewScene.sharedCommands.resize(objectCount);
+		multiviewScene.perViewCommands.resize(objectCount * settings.viewCount);
+
+		// Cube faces are square
+		bool isCubeMap = (settings.viewCount == 6);
+
+		MultiviewSettings multiviewSettings = {};
+		multiviewSettings.width = isCubeMap ? settings.height : settings.width;
+		multiviewSettings.height = settings.height;
+		multiviewSettings.viewCount = settings.viewCount;
+		multiviewSettings.colorFormat = VK_FORMAT_R8G8B8A8_UNORM;
+		multiviewSettings.isCubeMap = isCubeMap;
+		multiviewSettings.forcePerView = settings.perView;
+		vulkanRenderer.setMultiview(multiviewSettings);
+	}
+
+	if (isMultiviewDrawn)
+		vulkanRenderer.addStartupTask("Create multiview pipelines", createMultiviewPipelinesTask, &multiviewScene, StartupStage::AfterDevice);
+
+	// The "particles" scene emits, simulates and compacts particles in
+	// compute shaders every frame and compares the last frame against the CPU
+	bool isParticleScene = (strcmp(settings.scene, "particles") == 0);
+	ParticleScene particleScene;
+	particleScene.system = &vulkanRenderer.getParticleSystem();
+	particleScene.permutations = &vulkanRenderer.getShaderPermutations();
+	particleScene.statistics = {};
+
+	if (isParticleScene)
+	{
+		if (!loadSpirv(settings.shaderDirectory, "ParticleEmit.comp.spv", particleScene.shaders.emit) ||
+			!loadSpirv(settings.shaderDirectory, "ParticleSimulate.comp.spv", particleScene.shaders.simulate) ||
+			!loadSpirv(settings.shaderDirectory, "ParticleCompact.comp.spv", particleScene.shaders.compact))
+		{
+			return 1;
+		}
+
+		setSceneEmitter(*particleScene.system);
+		particleScene.steps.reserve(settings.frameCount);
+
+		vulkanRenderer.addStartupTask("Create particle pipelines", createParticlePipelinesTask, &particleScene, StartupStage::AfterDevice);
+	}
+
+	vulkanRenderer.setCapabilityCachePath(settings.capabilityCachePath);
+	vulkanRenderer.setShaderCachePath(settings.shaderCachePath);
+
+	// GPU times arrive a few frames late, changes wait until they show up
+	DynamicResolutionSettings resolutionSettings = {};
+	resolutionSettings.targetFrameTime = settings.gpuBudget;
+	resolutionSettings.minScale = 0.5f;
+	resolutionSettings.maxScale = 1.0f;
+	resolutionSettings.scaleStep = 0.05f;
+	resolutionSettings.headroom = 0.15f;
+	resolutionSettings.settleFrames = settings.framesInFlight + 1;
+	vulkanRenderer.setDynamicResolution(resolutionSettings);
+
+	vulkanRenderer.initializeHeadless(
+		settings.width,
+		settings.height,
+		settings.framesInFlight,
+		settings.enableValidation,
+		settings.workerCount,
+		settings.multiGpuMode);
+
+	// The meshlets are built by the time the renderer is initialized
+	if (isGpuMeshletCull)
+	{
+		meshletScene.renderer->setMesh(meshletScene.mesh);
+		createMeshletObjects(*meshletScene.renderer);
+
+		if (meshletScene.meshPipeline != VK_NULL_HANDLE)
+		{
+			MeshletMaterial material = { meshletScene.meshPipeline, meshletScene.pipelineSettings.layout, VK_NULL_HANDLE, true };
+			meshletScene.renderer->setMaterial(material);
+		}
+	}
+
+	if (multiviewScene.pipeline != VK_NULL_HANDLE)
+		multiviewScene.pass->setDrawFunction(drawMultiviewScene, &multiviewScene);
+
+	LightGrid &lightGrid = vulkanRenderer.getLightGrid();
+	if (isLightScene)
+		lightGrid.setLights(lightScene.lights.data(), settings.lightCount);
+
+	if (isGpuLightBinning)
+		addLightSceneGround(vulkanRenderer, lightScene);
+
+	// Without a warm-up the markers are there from the first frame
+	uint32_t markerFrame = settings.warmUpFrameCount / 2;
+	if (isGpuLightBinning && settings.warmUpFrameCount == 0)
+		addLightSceneMarkers(vulkanRenderer, lightScene);
+
+	ShadowAtlas &shadowAtlas = vulkanRenderer.getShadowAtlas();
+	if (isShadowScene)
+	{
+		lightGrid.setLights(shadowScene.lights.data(), settings.lightCount);
+		setShadowSceneView(lightGrid, shadowScene);
+
+		shadowAtlas.setDrawFunction(drawShadowCasters, nullptr);
+		addShadowSceneCasters(shadowAtlas, shadowScene);
+	}
+
+	vulkanRenderer.render();
+	vulkanRenderer.waitIdle();
+
+	double timeToFirstFrame = std::chrono::duration<double, std::milli>(Clock::now() - startupStart).count();
+
+	// Give the driver a chance to settle before measuring anything
+	DeletionQueue &deletionQueue = vulkanRenderer.getDeletionQueue();
+
+	for (uint32_t i = 0; i < settings.warmUpFrameCount; ++i)
+	{
+		if (isGpuLightBinning && i == markerFrame)
+			addLightSceneMarkers(vulkanRenderer, lightScene);
+
+		// The old buffers have to stay alive until the frames in flight are
+		// done with them, and not a frame longer
+		if (deletionQueue.getStatistics().pendingCount > 0)
+			++lightScene.statistics.deferredDeletionFrames;
+
+		vulkanRenderer.render();
+	}
+
+	vulkanRenderer.waitIdle();
+
+	// Capturing should not change the frame rate, which is exactly what this
+	// option is meant to verify
+	if (settings.capturePrefix)
+		vulkanRenderer.setContinuousCapture(settings.capturePrefix, CaptureFormat::Raw);
+
+	if (settings.tracePath && !vulkanRenderer.startTrace(settings.tracePath))
+		return 1;
+
+	// Paced frames wait inside render, that time is taken out of the CPU
+	// frame time again
+	FramePacer &framePacer = vulkanRenderer.getFramePacer();
+	framePacer.setTargetFrameRate(settings.targetFrameRate);
+
+	double cpuTime = 0.0;
+	double recordTime = 0.0;
+	double gpuTime = 0.0;
+	uint32_t gpuSampleCount = 0;
+	double renderScale = 0.0;
+
+	framePacer.resetStatistics();
+	Clock::time_point benchmarkStart = Clock::now();
+
+	for (uint32_t i = 0; i < settings.frameCount; ++i)
+	{
+		Clock::time_point frameStart = Clock::now();
+
+		if (isLodScene)
+		{
+			Clock::time_point selectionStart = Clock::now();
+			selectSceneLevels(vulkanRenderer.getJobSystem(), lodScene.selector, lodScene.chain, i, lodScene.statistics);
+			lodScene.statistics.selectionTime += std::chrono::duration<double, std::milli>(Clock::now() - selectionStart).count();
+		}
+
+		if (isMeshletScene)
+		{
+			Clock::time_point cullStart = Clock::now();
+			cullSceneMeshlets(vulkanRenderer.getJobSystem(), meshletScene, i);
+			meshletScene.statistics.cullTime += std::chrono::duration<double, std::milli>(Clock::now() - cullStart).count();
+
+			if (isGpuMeshletCull)
+			{
+				meshletScene.renderer->setView(meshletScene.view);
+				meshletScene.renderer->setViewProjection(meshletScene.viewProjection);
+			}
+		}
+
+		if (isLightScene)
+			updateLightSceneView(lightGrid, lightScene, i);
+
+		// The grid of the last frame is compared once the GPU is idle
+		if (isGpuLightBinning && i + 1 == settings.frameCount)
+			lightGrid.requestReadback();
+
+		// The particles of the last frame are compared once the GPU is idle.
+		// Steps that are not recorded are merged into the next one.
+		ParticleStep particleStep = {};
+
+		if (isParticleScene)
+		{
+			particleScene.system->update(PARTICLE_TIME_STEP);
+			particleStep = particleScene.system->getStep();
+
+			if (i + 1 == settings.frameCount)
+				particleScene.system->requestReadback();
+		}
+
+		if (isShadowScene)
+			moveShadowSceneCaster(shadowAtlas, shadowScene, i + 1);
+
+		if (isMultiviewScene)
+		{
+			MultiviewViewData views[MAX_MULTIVIEW_VIEWS];
+			makeSceneViews(multiviewScene, i, views);
+			cullSceneViews(multiviewScene, views);
+
+			vulkanRenderer.getMultiviewPass().setViews(views);
+		}
+
+		vulkanRenderer.render();
+		Clock::time_point frameEnd = Clock::now();
+
+		if (isShadowScene)
+			countShadowSceneUpdates(shadowAtlas, shadowScene);
+
+		if (isParticleScene && particleScene.system->getStatistics().stepCount > particleScene.steps.size())
+			particleScene.steps.push_back(particleStep);
+
+		if (isLightScene)
+		{
+			LightGridStatistics gridStatistics = lightGrid.getStatistics();
+			LightStatistics &lightStatistics = lightScene.statistics;
+
+			lightStatistics.binTime += gridStatistics.binTime;
+			lightStatistics.gpuBinTime += gridStatistics.gpuBinTime;
+			lightStatistics.lightIndexCount += gridStatistics.lightIndexCount;
+			lightStatistics.occupiedClusterCount += gridStatistics.occupiedClusterCount;
+			lightStatistics.overflowCount += gridStatistics.overflowCount;
+
+			if (gridStatistics.maxClusterLightCount > lightStatistics.maxClusterLightCount)
+				lightStatistics.maxClusterLightCount = gridStatistics.maxClusterLightCount;
+
+			// Verified once, the reference is far too slow for every frame
+			if (i == 0 && !isGpuLightBinning)
+				lightStatistics.matchesReference = matchesReferenceBinning(lightGrid, lightGrid.getData());
+		}
+
+		cpuTime += std::chrono::duration<double, std::milli>(frameEnd - frameStart).count();
+
+		FrameStatistics statistics = vulkanRenderer.getFrameStatistics();
+		recordTime += statistics.cpuRecordTime;
+
+		// The GPU time belongs to the most recently completed frame, which
+		// lags behind by the number of frames in flight
+		if (statistics.gpuFrameTime > 0.0)
+		{
+			gpuTime += statistics.gpuFrameTime;
+			++gpuSampleCount;
+		}
+
+		renderScale += static_cast<double>(statistics.renderWidth) / settings.width;
+	}
+
+	vulkanRenderer.waitIdle();
+
+	Clock::time_point benchmarkEnd = Clock::now();
+	vulkanRenderer.stopTrace();
+	vulkanRenderer.logGpuCounters();
+	double totalTime = std::chrono::duration<double>(benchmarkEnd - benchmarkStart).count();
+
+	// The view and lights of the grid are still those of the last frame
+	if (isGpuLightBinning)
+	{
+		LightGridData gpuData;
+		lightScene.statistics.matchesReference =
+			lightGrid.getGpuData(gpuData) && matchesReferenceBinning(lightGrid, gpuData);
+
+		retireLightSceneObjects(vulkanRenderer, lightScene);
+	}
+
+	if (multiviewScene.pipeline != VK_NULL_HANDLE)
+		retireMultiviewSceneObjects(vulkanRenderer, multiviewScene);
+
+	if (isParticleScene)
+		compareSceneParticles(particleScene);
+
+	FrameStatistics statistics = vulkanRenderer.getFrameStatistics();
+
+	PacingStatistics pacingStatistics = framePacer.getStatistics();
+	cpuTime -= pacingStatistics.sleepTime + pacingStatistics.spinTime;
+
+	uint64_t peakWorkingSet = getPeakWorkingSet();
+
+	// Machine-readable results, so they can be compared against a baseline
+	printf("{\n");
+	printf("\t\"scene\": \"%s\",\n", settings.scene);
+	printf("\t\"width\": %u,\n", settings.width);
+	printf("\t\"height\": %u,\n", settings.height);
+	printf("\t\"frames\": %u,\n", settings.frameCount);
+	printf("\t\"framesInFlight\": %u,\n", settings.framesInFlight);
+	printf("\t\"threads\": %u,\n", vulkanRenderer.getJobSystem().getWorkerCount());
+	printf("\t\"multiGpuMode\": \"%s\",\n", getMultiGpuModeName(vulkanRenderer.getMultiGpuMode()));
+	printf("\t\"deviceGroupSize\": %u,\n", vulkanRenderer.getDeviceGroupSize());
+	printf("\t\"timeToFirstFrameMs\": %.3f,\n", timeToFirstFrame);
+	printf("\t\"startupMs\": %.3f,\n", vulkanRenderer.getStartupTime());
+	printf("\t\"capabilityCacheHits\": %u,\n", vulkanRenderer.getCapabilityCacheHits());
+	printf("\t\"capabilityCacheMisses\": %u,\n", vulkanRenderer.getCapabilityCacheMisses());
+
+	// Shaders compiled this run and shaders that came from the cache file
+	ShaderCacheStatistics shaderCacheStatistics = vulkanRenderer.getShaderPermutations().getStatistics();
+	printf("\t\"shaderCache\": {\n");
+	printf("\t\t\"variants\": %u,\n", shaderCacheStatistics.variantCount);
+	printf("\t\t\"readyVariants\": %u,\n", shaderCacheStatistics.readyCount);
+	printf("\t\t\"failedVariants\": %u,\n", shaderCacheStatistics.failedCount);
+	printf("\t\t\"compiledShaders\": %u,\n", shaderCacheStatistics.compileCount);
+	printf("\t\t\"cachedShaders\": %u,\n", shaderCacheStatistics.cachedCodeCount);
+	printf("\t\t\"modules\": %u,\n", shaderCacheStatistics.moduleCount);
+	printf("\t\t\"sharedModules\": %u,\n", shaderCacheStatistics.sharedModuleCount);
+	printf("\t\t\"buildTimeMs\": %.3f\n", shaderCacheStatistics.buildTime);
+	printf("\t},\n");
+
+	// Startup timeline, shows which steps overlapped
+	const std::vector<TaskTiming> &startupTimeline = vulkanRenderer.getStartupTimeline();
+	printf("\t\"startupTasks\": [\n");
+
+	for (size_t i = 0; i < startupTimeline.size(); ++i)
+	{
+		const TaskTiming &timing = startupTimeline[i];
+
+		printf(
+			"\t\t{ \"name\": \"%s\", \"startMs\": %.3f, \"endMs\": %.3f, \"worker\": %u }%s\n",
+			timing.name,
+			timing.startTime,
+			timing.endTime,
+			timing.workerIndex,
+			i + 1 < startupTimeline.size() ? "," : "");
+	}
+
+	printf("\t],\n");
+	printf("\t\"framesPerSecond\": %.3f,\n", settings.frameCount / totalTime);
+	printf("\t\"cpuFrameTimeMs\": %.6f,\n", cpuTime / settings.frameCount);
+	printf("\t\"recordTimeMs\": %.6f,\n", recordTime / settings.frameCount);
+	printf("\t\"gpuFrameTimeMs\": %.6f,\n", gpuSampleCount ? gpuTime / gpuSampleCount : 0.0);
+	printf("\t\"deviceMemoryBytes\": %llu,\n", static_cast<unsigned long long>(statistics.deviceMemoryUsage));
+
+	// Fraction of the output size that was rendered, 1 without a budget
+	printf("\t\"dynamicResolution\": {\n");
+	printf("\t\t\"gpuBudgetMs\": %.3f,\n", settings.gpuBudget);
+	printf("\t\t\"meanScale\": %.4f,\n", renderScale / settings.frameCount);
+	printf("\t\t\"renderWidth\": %u,\n", statistics.renderWidth);
+	printf("\t\t\"renderHeight\": %u,\n", statistics.renderHeight);
+	printf("\t\t\"scaleChanges\": %u\n", vulkanRenderer.getResolutionController().getChangeCount());
+	printf("\t},\n");
+
+	// How evenly the frames were spaced, only filled in with a target rate
+	printf("\t\"pacing\": {\n");
+	printf("\t\t\"targetFramesPerSecond\": %.3f,\n", settings.targetFrameRate);
+	printf("\t\t\"lateFrames\": %llu,\n", static_cast<unsigned long long>(pacingStatistics.lateFrameCount));
+	printf("\t\t\"meanErrorMs\": %.6f,\n", pacingStatistics.meanError);
+	printf("\t\t\"maxErrorMs\": %.6f,\n", pacingStatistics.maxError);
+	printf("\t\t\"sleepMs\": %.3f,\n", pacingStatistics.sleepTime);
+	printf("\t\t\"spinMs\": %.3f,\n", pacingStatistics.spinTime);
+	printf("\t\t\"predictedFrameTimeMs\": %.6f,\n", pacingStatistics.predictedFrameTime);
+	printf("\t\t\"errorHistogram\": [\n");
+
+	for (uint32_t i = 0; i < PACING_BUCKET_COUNT; ++i)
+	{
+		printf(
+			"\t\t\t{ \"bucket\": \"%s\", \"frames\": %llu }%s\n",
+			FramePacer::getBucketName(i),
+			static_cast<unsigned long long>(pacingStatistics.errorHistogram[i]),
+			i + 1 < PACING_BUCKET_COUNT ? "," : "");
+	}
+
+	printf("\t\t]\n");
+	printf("\t},\n");
+
+	// Frames that could reuse the recorded draw commands, counted since startup
+	CommandCacheStatistics commandCacheStatistics = vulkanRenderer.getCommandCacheStatistics();
+	uint64_t commandCacheLookups = commandCacheStatistics.hits + commandCacheStatistics.misses;
+
+	// Per-pass GPU counters of one of the last frames, to spot overdraw and
+	// vertex-bound passes
+	const GpuCounters &gpuCounters = vulkanRenderer.getGpuCounters();
+	printf("\t\"passes\": [\n");
+
+	for (CounterScopeId i = 0; i < gpuCounters.getScopeCount(); ++i)
+	{
+		const PassCounters &counters = gpuCounters.getCounters(i);
+
+		printf("\t\t{\n");
+		printf("\t\t\t\"name\": \"%s\",\n", gpuCounters.getScopeName(i));
+		printf("\t\t\t\"valid\": %s,\n", counters.isValid ? "true" : "false");
+		printf("\t\t\t\"inputAssemblyVertices\": %llu,\n", static_cast<unsigned long long>(counters.inputAssemblyVertices));
+		printf("\t\t\t\"inputAssemblyPrimitives\": %llu,\n", static_cast<unsigned long long>(counters.inputAssemblyPrimitives));
+		printf("\t\t\t\"vertexShaderInvocations\": %llu,\n", static_cast<unsigned long long>(counters.vertexShaderInvocations));
+		printf("\t\t\t\"clippingInvocations\": %llu,\n", static_cast<unsigned long long>(counters.clippingInvocations));
+		printf("\t\t\t\"clippingPrimitives\": %llu,\n", static_cast<unsigned long long>(counters.clippingPrimitives));
+		printf("\t\t\t\"fragmentShaderInvocations\": %llu,\n", static_cast<unsigned long long>(counters.fragmentShaderInvocations));
+		printf("\t\t\t\"samplesPassed\": %llu,\n", static_cast<unsigned long long>(counters.samplesPassed));
+		printf("\t\t\t\"overdraw\": %.4f\n", counters.overdraw);
+		printf("\t\t}%s\n", i + 1 < gpuCounters.getScopeCount() ? "," : "");
+	}
+
+	printf("\t],\n");
+
+	printf("\t\"commandCache\": {\n");
+	printf("\t\t\"hits\": %llu,\n", static_cast<unsigned long long>(commandCacheStatistics.hits));
+	printf("\t\t\"misses\": %llu,\n", static_cast<unsigned long long>(commandCacheStatistics.misses));
+	printf("\t\t\"invalidations\": %llu,\n", static_cast<unsigned long long>(commandCacheStatistics.invalidations));
+	printf("\t\t\"hitRate\": %.4f\n", commandCacheLookups ? static_cast<double>(commandCacheStatistics.hits) / commandCacheLookups : 0.0);
+	printf("\t},\n");
+
+	// Host memory per allocation scope, to find where the driver churns
+	HostMemoryStatistics hostStatistics = vulkanRenderer.getHostMemoryStatistics();
+
+	printf("\t\"hostMemory\": {\n");
+
+	for (uint32_t i = 0; i < HOST_CATEGORY_COUNT; ++i)
+	{
+		const HostCategoryStatistics &category = hostStatistics.categories[i];
+
+		printf("\t\t\"%s\": {\n", HostAllocator::getCategoryName(static_cast<HostCategory>(i)));
+		printf("\t\t\t\"liveBytes\": %llu,\n", static_cast<unsigned long long>(category.liveBytes));
+		printf("\t\t\t\"peakBytes\": %llu,\n", static_cast<unsigned long long>(category.peakBytes));
+		printf("\t\t\t\"allocations\": %llu,\n", static_cast<unsigned long long>(category.allocationCount));
+		printf("\t\t\t\"reallocations\": %llu,\n", static_cast<unsigned long long>(category.reallocationCount));
+		printf("\t\t\t\"frees\": %llu,\n", static_cast<unsigned long long>(category.freeCount));
+		printf("\t\t\t\"internalBytes\": %llu\n", static_cast<unsigned long long>(category.internalBytes));
+		printf("\t\t},\n");
+	}
+
+	printf("\t\t\"poolAllocations\": %llu,\n", static_cast<unsigned long long>(hostStatistics.poolAllocationCount));
+	printf("\t\t\"arenaAllocations\": %llu,\n", static_cast<unsigned long long>(hostStatistics.arenaAllocationCount));
+	printf("\t\t\"systemAllocations\": %llu,\n", static_cast<unsigned long long>(hostStatistics.systemAllocationCount));
+	printf("\t\t\"reservedBytes\": %llu\n", static_cast<unsigned long long>(hostStatistics.reservedBytes));
+	printf("\t},\n");
+
+	printf("\t\"peakWorkingSetBytes\": %llu%s\n", static_cast<unsigned long long>(peakWorkingSet), (isLodScene || isMeshletScene || isLightScene || isShadowScene || isMultiviewScene || isParticleScene) ? "," : "");
+
+	if (isLodScene)
+	{
+		printf("\t\"lodLevels\": %u,\n", static_cast<uint32_t>(lodScene.chain.size()));
+		printf("\t\"lodBuildTimeMs\": %.3f,\n", lodScene.statistics.buildTime);
+		printf("\t\"lodSelectionTimeMs\": %.6f,\n", lodScene.statistics.selectionTime / settings.frameCount);
+		printf("\t\"trianglesFull\": %llu,\n", static_cast<unsigned long long>(lodScene.statistics.fullTriangleCount / settings.frameCount));
+		printf("\t\"trianglesLod\": %llu\n", static_cast<unsigned long long>(lodScene.statistics.selectedTriangleCount / settings.frameCount));
+	}
+
+	if (isMeshletScene)
+	{
+		const MeshletStatistics &meshletStatistics = meshletScene.statistics;
+
+		printf("\t\"meshletsPerObject\": %u,\n", static_cast<uint32_t>(meshletScene.mesh.meshlets.size()));
+		printf("\t\"meshletBuildTimeMs\": %.3f,\n", meshletStatistics.buildTime);
+		printf("\t\"meshletCullTimeMs\": %.6f,\n", meshletStatistics.cullTime / settings.frameCount);
+		printf("\t\"meshlets\": %llu,\n", static_cast<unsigned long long>(meshletStatistics.meshletCount / settings.frameCount));
+		printf("\t\"meshletsVisible\": %llu,\n", static_cast<unsigned long long>(meshletStatistics.visibleMeshletCount / settings.frameCount));
+		printf("\t\"meshletsFrustumCulled\": %llu,\n", static_cast<unsigned long long>(meshletStatistics.frustumCulledCount / settings.frameCount));
+		printf("\t\"meshletsBackfaceCulled\": %llu,\n", static_cast<unsigned long long>(meshletStatistics.backfaceCulledCount / settings.frameCount));
+		printf("\t\"trianglesFull\": %llu,\n", static_cast<unsigned long long>(meshletStatistics.triangleCount / settings.frameCount));
+		printf("\t\"trianglesVisible\": %llu,\n", static_cast<unsigned long long>(meshletStatistics.visibleTriangleCount / settings.frameCount));
+
+		// Meshlets the GPU culled differently than the CPU in the last frame,
+		// in the compute pass or the task shader. Rounding may move a few of
+		// the ones right on a plane.
+		MeshletRendererStatistics gpuStatistics = meshletScene.renderer->getStatistics();
+		const MeshletCullStatistics &cpuStatistics = meshletScene.lastFrame;
+		uint64_t mismatchCount = 0;
+
+		if (isGpuMeshletCull)
+		{
+			if (gpuStatistics.countersCull == gpuStatistics.cullCount)
+			{
+				mismatchCount =
+					absoluteDifference(gpuStatistics.counters.visibleMeshletCount, cpuStatistics.visibleMeshletCount) +
+					absoluteDifference(gpuStatistics.counters.frustumCulledCount, cpuStatistics.frustumCulledCount) +
+					absoluteDifference(gpuStatistics.counters.backfaceCulledCount, cpuStatistics.backfaceCulledCount);
+			}
+			else
+				mismatchCount = cpuStatistics.meshletCount;
+		}
+
+		printf("\t\"gpuCull\": %s,\n", isGpuMeshletCull ? "true" : "false");
+		printf("\t\"meshShaders\": %s,\n", meshletScene.renderer->supportsMeshShaders() ? "true" : "false");
+		printf("\t\"meshShaderCull\": %s,\n", gpuStatistics.usesMeshShaders ? "true" : "false");
+		printf("\t\"gpuCullMismatches\": %llu\n", static_cast<unsigned long long>(mismatchCount));
+	}
+
+	if (isLightScene)
+	{
+		const LightStatistics &lightStatistics = lightScene.statistics;
+		const LightGridSettings &gridSettings = lightGrid.getSettings();
+		uint32_t clusterCount = gridSettings.tilesX * gridSettings.tilesY * gridSettings.slices;
+
+		printf("\t\"lights\": %u,\n", settings.lightCount);
+		printf("\t\"clusters\": %u,\n", clusterCount);
+
+		// Binning on the GPU leaves nothing to time on the CPU
+		if (lightGrid.usesGpuBinning())
+			printf("\t\"lightBinTimeMs\": null,\n");
+		else
+			printf("\t\"lightBinTimeMs\": %.6f,\n", lightStatistics.binTime / settings.frameCount);
+
+		printf("\t\"lightsPerCluster\": %.3f,\n", static_cast<double>(lightStatistics.lightIndexCount) / settings.frameCount / clusterCount);
+		printf("\t\"lightsPerOccupiedCluster\": %.3f,\n", lightStatistics.occupiedClusterCount ? static_cast<double>(lightStatistics.lightIndexCount) / lightStatistics.occupiedClusterCount : 0.0);
+		printf("\t\"maxLightsPerCluster\": %u,\n", lightStatistics.maxClusterLightCount);
+		printf("\t\"lightOverflow\": %llu,\n", static_cast<unsigned long long>(lightStatistics.overflowCount / settings.frameCount));
+		printf("\t\"gpuLightBinning\": %s,\n", isGpuLightBinning ? "true" : "false");
+		printf("\t\"gpuLightBinTimeMs\": %.6f,\n", lightStatistics.gpuBinTime / settings.frameCount);
+
+		// Only the markers added during the warm-up outgrow the instance buffer
+		if (isGpuLightBinning && settings.warmUpFrameCount > 0)
+			printf("\t\"deferredDeletionFrames\": %u,\n", lightStatistics.deferredDeletionFrames);
+		else
+			printf("\t\"deferredDeletionFrames\": null,\n");
+
+		printf("\t\"matchesReference\": %s\n", lightStatistics.matchesReference ? "true" : "false");
+	}
+
+	if (isShadowScene)
+	{
+		const ShadowSceneStatistics &shadowStatistics = shadowScene.statistics;
+
+		printf("\t\"lights\": %u,\n", settings.lightCount);
+		printf("\t\"shadowCasters\": %u,\n", SHADOW_CASTER_GRID_SIZE * SHADOW_CASTER_GRID_SIZE + 1);
+		printf("\t\"shadowedLights\": %u,\n", shadowAtlas.getStatistics().shadowedLightCount);
+		printf("\t\"shadowStaticTileUpdates\": %.3f,\n", static_cast<double>(shadowStatistics.staticTileUpdates) / settings.frameCount);
+		printf("\t\"shadowDynamicTileUpdates\": %.3f,\n", static_cast<double>(shadowStatistics.dynamicTileUpdates) / settings.frameCount);
+		printf("\t\"shadowMaxDynamicTileUpdates\": %u,\n", shadowStatistics.maxDynamicTileUpdates);
+		printf("\t\"shadowOverlappedTiles\": %.3f,\n", static_cast<double>(shadowStatistics.overlappedTileCount) / settings.frameCount);
+		printf("\t\"shadowTileUpdateMismatches\": %llu\n", static_cast<unsigned long long>(shadowStatistics.mismatchCount));
+	}
+
+	if (isMultiviewScene)
+	{
+		const MultiviewPass &multiviewPass = vulkanRenderer.getMultiviewPass();
+		const MultiviewSceneStatistics &multiviewStatistics = multiviewScene.statistics;
+
+		printf("\t\"views\": %u,\n", settings.viewCount);
+		printf("\t\"multiview\": %s,\n", multiviewPass.isMultiview() ? "true" : "false");
+		printf("\t\"multiviewDrawn\": %s,\n", multiviewScene.pipeline != VK_NULL_HANDLE ? "true" : "false");
+		printf("\t\"renderPassesPerFrame\": %u,\n", multiviewPass.getStatistics().renderPassCount);
+		printf("\t\"sharedPlanes\": %u,\n", multiviewStatistics.sharedPlaneCount);
+		printf("\t\"sharedCullTimeMs\": %.6f,\n", multiviewStatistics.sharedCullTime / settings.frameCount);
+		printf("\t\"perViewCullTimeMs\": %.6f,\n", multiviewStatistics.perViewCullTime / settings.frameCount);
+		printf("\t\"sharedDraws\": %llu,\n", static_cast<unsigned long long>(multiviewStatistics.sharedDrawCount / settings.frameCount));
+		printf("\t\"perViewDraws\": %llu,\n", static_cast<unsigned long long>(multiviewStatistics.perViewDrawCount / settings.frameCount));
+		printf("\t\"cullMismatches\": %llu\n", static_cast<unsigned long long>(multiviewStatistics.mismatchCount));
+	}
+
+	if (isParticleScene)
+	{
+		ParticleStatistics gpuStatistics = particleScene.system->getStatistics();
+		const ParticleSceneStatistics &particleStatistics = particleScene.statistics;
+
+		printf("\t\"particleSteps\": %llu,\n", static_cast<unsigned long long>(gpuStatistics.stepCount));
+		printf("\t\"particlesEmitted\": %llu,\n", static_cast<unsigned long long>(gpuStatistics.emittedCount));
+		printf("\t\"particlesLive\": %u,\n", particleStatistics.gpuLiveCount);
+		printf("\t\"particlesReference\": %u,\n", particleStatistics.referenceLiveCount);
+		printf("\t\"particleReferenceTimeMs\": %.3f,\n", particleStatistics.referenceTime);
+		printf("\t\"particleMismatches\": %llu\n", static_cast<unsigned long long>(particleStatistics.mismatchCount));
+	}
+
+	printf("}\n");
+
+	return 0;
+}
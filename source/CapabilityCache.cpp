@@ -0,0 +1,149 @@
+#include "LearningVulkan/CapabilityCache.hpp"
+
+#include <cstdio>
+#include <cstring>
+
+// Identifies the file, the format version has to change whenever
+// CachedCapabilities does
+static const uint32_t CACHE_MAGIC = 0x4350414C;	// "LAPC"
+static const uint32_t CACHE_FORMAT_VERSION = 1;
+
+static CachedCapabilities createEmptyCapabilities()
+{
+	CachedCapabilities capabilities;
+	memset(&capabilities, 0, sizeof(capabilities));
+
+	capabilities.magic = CACHE_MAGIC;
+	capabilities.formatVersion = CACHE_FORMAT_VERSION;
+	return capabilities;
+}
+
+CapabilityCache::CapabilityCache() :
+	capabilities(createEmptyCapabilities()),
+	isDirty(false),
+	hitCount(0),
+	missCount(0)
+{
+}
+
+CapabilityCache::~CapabilityCache()
+{
+}
+
+void CapabilityCache::load(const char *path)
+{
+	this->path = path ? path : "";
+	capabilities = createEmptyCapabilities();
+	isDirty = false;
+
+	if (this->path.empty())
+		return;
+
+	FILE *file = fopen(this->path.c_str(), "rb");
+	if (!file)
+		return;
+
+	CachedCapabilities loaded;
+	bool isValid =
+		fread(&loaded, sizeof(loaded), 1, file) == 1 &&
+		loaded.magic == CACHE_MAGIC &&
+		loaded.formatVersion == CACHE_FORMAT_VERSION;
+
+	fclose(file);
+
+	if (isValid)
+		capabilities = loaded;
+}
+
+void CapabilityCache::save()
+{
+	if (!isDirty || path.empty())
+		return;
+
+	FILE *file = fopen(path.c_str(), "wb");
+	if (!file)
+		return;
+
+	fwrite(&capabilities, sizeof(capabilities), 1, file);
+	fclose(file);
+
+	isDirty = false;
+}
+
+bool CapabilityCache::matchesLoader(uint32_t loaderVersion)
+{
+	if (capabilities.loaderVersion == loaderVersion)
+		return true;
+
+	// A different loader may see different layers and extensions
+	invalidate();
+	capabilities.loaderVersion = loaderVersion;
+
+	return false;
+}
+
+bool CapabilityCache::matchesDevice(uint32_t driverVersion, const uint8_t deviceUuid[VK_UUID_SIZE])
+{
+	if (capabilities.hasDevice &&
+		capabilities.driverVersion == driverVersion &&
+		memcmp(capabilities.deviceUuid, deviceUuid, VK_UUID_SIZE) == 0)
+	{
+		return true;
+	}
+
+	// Only the instance part of the cache survives a driver update
+	invalidateDevice();
+
+	capabilities.driverVersion = driverVersion;
+	memcpy(capabilities.deviceUuid, deviceUuid, VK_UUID_SIZE);
+
+	return false;
+}
+
+void CapabilityCache::invalidate()
+{
+	capabilities = createEmptyCapabilities();
+	isDirty = true;
+}
+
+void CapabilityCache::invalidateDevice()
+{
+	uint32_t loaderVersion = capabilities.loaderVersion;
+	uint32_t instanceCapabilities = capabilities.instanceCapabilities;
+
+	capabilities = createEmptyCapabilities();
+	capabilities.loaderVersion = loaderVersion;
+	capabilities.instanceCapabilities = instanceCapabilities;
+	isDirty = true;
+}
+
+const CachedCapabilities &CapabilityCache::getCapabilities() const
+{
+	return capabilities;
+}
+
+CachedCapabilities &CapabilityCache::editCapabilities()
+{
+	isDirty = true;
+	return capabilities;
+}
+
+void CapabilityCache::recordHit()
+{
+	++hitCount;
+}
+
+void CapabilityCache::recordMiss()
+{
+	++missCount;
+}
+
+uint32_t CapabilityCache::getHitCount() const
+{
+	return hitCount;
+}
+
+uint32_t CapabilityCache::getMissCount() const
+{
+	return missCount;
+}
\ No newline at end of file
@@ -0,0 +1,216 @@
+#include "LearningVulkan/CommandBufferCache.hpp"
+#include "LearningVulkan/Renderer.hpp"
+#include "LearningVulkan/Utility.hpp"
+
+#include <algorithm>
+#include <assert.h>
+
+CommandBufferCache::CommandBufferCache() :
+	device(VK_NULL_HANDLE),
+	allocator(nullptr),
+	commandPool(VK_NULL_HANDLE),
+	framesInFlight(0),
+	imageCount(0)
+{
+	statistics = {};
+}
+
+CommandBufferCache::~CommandBufferCache()
+{
+	destroy();
+}
+
+void CommandBufferCache::initialize(const VulkanContext &context, uint32_t imageCount)
+{
+	device = context.device;
+	allocator = context.allocator;
+	framesInFlight = context.framesInFlight;
+	this->imageCount = imageCount;
+
+	// A pool of its own, so recording never has to be synchronized with the
+	// primary command buffers of the renderer
+	VkCommandPoolCreateInfo commandPoolCreateInfo = {};
+	commandPoolCreateInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+	commandPoolCreateInfo.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
+	commandPoolCreateInfo.queueFamilyIndex = context.presentQueueIndex;
+
+	VkResult result = vkCreateCommandPool(
+		device,
+		&commandPoolCreateInfo,
+		allocator,
+		&commandPool);
+
+	Utility::checkVulkanResult(result, "Failed to create the command buffer cache pool.");
+}
+
+void CommandBufferCache::destroy()
+{
+	if (device == VK_NULL_HANDLE)
+		return;
+
+	// Frees every cached command buffer as well
+	vkDestroyCommandPool(device, commandPool, allocator);
+
+	passes.clear();
+	device = VK_NULL_HANDLE;
+}
+
+CachedPassId CommandBufferCache::addPass(
+	const char *name,
+	VkRenderPass renderPass,
+	uint32_t subpass,
+	PassRecordFunction function,
+	void *data)
+{
+	Pass pass;
+	pass.name = name;
+	pass.renderPass = renderPass;
+	pass.subpass = subpass;
+	pass.function = function;
+	pass.data = data;
+	pass.inheritsQueries = false;
+	pass.occlusionControlFlags = 0;
+	pass.pipelineStatisticFlags = 0;
+
+	uint32_t entryCount = framesInFlight * imageCount;
+	std::vector<VkCommandBuffer> commandBuffers(entryCount);
+
+	VkCommandBufferAllocateInfo allocateInfo = {};
+	allocateInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+	allocateInfo.commandPool = commandPool;
+	allocateInfo.level = VK_COMMAND_BUFFER_LEVEL_SECONDARY;
+	allocateInfo.commandBufferCount = entryCount;
+
+	VkResult result = vkAllocateCommandBuffers(device, &allocateInfo, commandBuffers.data());
+	Utility::checkVulkanResult(result, "Failed to allocate cached command buffers.");
+
+	pass.entries.resize(entryCount);
+
+	for (uint32_t i = 0; i < entryCount; ++i)
+	{
+		pass.entries[i].commandBuffer = commandBuffers[i];
+		pass.entries[i].isValid = false;
+	}
+
+	passes.push_back(pass);
+	return static_cast<CachedPassId>(passes.size() - 1);
+}
+
+void CommandBufferCache::setInheritedQueries(
+	CachedPassId pass,
+	VkQueryControlFlags occlusionControlFlags,
+	VkQueryPipelineStatisticFlags pipelineStatisticFlags)
+{
+	Pass &cachedPass = passes[pass];
+	cachedPass.inheritsQueries = true;
+	cachedPass.occlusionControlFlags = occlusionControlFlags;
+	cachedPass.pipelineStatisticFlags = pipelineStatisticFlags;
+
+	// Everything recorded so far has the wrong inheritance info
+	invalidate(pass);
+}
+
+VkCommandBuffer CommandBufferCache::getCommandBuffer(
+	CachedPassId pass,
+	uint32_t frameSlot,
+	uint32_t imageIndex,
+	VkFramebuffer framebuffer,
+	const uint64_t *dependencies,
+	uint32_t dependencyCount)
+{
+	assert(pass < passes.size() && frameSlot < framesInFlight && imageIndex < imageCount,
+		"Unknown cached command buffer.");
+
+	Pass &cachedPass = passes[pass];
+	Entry &entry = cachedPass.entries[frameSlot * imageCount + imageIndex];
+
+	// The framebuffer comes first, followed by whatever the caller depends on
+	bool isCurrent =
+		entry.isValid &&
+		entry.dependencies.size() == dependencyCount + 1 &&
+		entry.dependencies[0] == (uint64_t)framebuffer &&
+		std::equal(dependencies, dependencies + dependencyCount, entry.dependencies.begin() + 1);
+
+	if (isCurrent)
+	{
+		++statistics.hits;
+		return entry.commandBuffer;
+	}
+
+	entry.dependencies.clear();
+	entry.dependencies.push_back((uint64_t)framebuffer);
+	entry.dependencies.insert(entry.dependencies.end(), dependencies, dependencies + dependencyCount);
+
+	record(cachedPass, entry, framebuffer);
+	++statistics.misses;
+
+	return entry.commandBuffer;
+}
+
+void CommandBufferCache::invalidate(CachedPassId pass)
+{
+	for (Entry &entry : passes[pass].entries)
+	{
+		if (entry.isValid)
+			++statistics.invalidations;
+
+		entry.isValid = false;
+	}
+}
+
+void CommandBufferCache::invalidateDependency(uint64_t dependency)
+{
+	for (Pass &pass : passes)
+	{
+		for (Entry &entry : pass.entries)
+		{
+			if (!entry.isValid)
+				continue;
+
+			if (std::find(entry.dependencies.begin(), entry.dependencies.end(), dependency) != entry.dependencies.end())
+			{
+				entry.isValid = false;
+				++statistics.invalidations;
+			}
+		}
+	}
+}
+
+void CommandBufferCache::invalidateAll()
+{
+	for (CachedPassId i = 0; i < passes.size(); ++i)
+		invalidate(i);
+}
+
+CommandCacheStatistics CommandBufferCache::getStatistics() const
+{
+	return statistics;
+}
+
+void CommandBufferCache::record(Pass &pass, Entry &entry, VkFramebuffer framebuffer)
+{
+	VkCommandBufferInheritanceInfo inheritanceInfo = {};
+	inheritanceInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO;
+	inheritanceInfo.renderPass = pass.renderPass;
+	inheritanceInfo.subpass = pass.subpass;
+	inheritanceInfo.framebuffer = framebuffer;
+
+	if (pass.inheritsQueries)
+	{
+		inheritanceInfo.occlusionQueryEnable = VK_TRUE;
+		inheritanceInfo.queryFlags = pass.occlusionControlFlags;
+		inheritanceInfo.pipelineStatistics = pass.pipelineStatisticFlags;
+	}
+
+	// Recorded once and submitted many times, so no one-time-submit flag
+	VkCommandBufferBeginInfo beginInfo = {};
+	beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+	beginInfo.flags = VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT;
+	beginInfo.pInheritanceInfo = &inheritanceInfo;
+
+	vkBeginCommandBuffer(entry.commandBuffer, &beginInfo);
+	pass.function(pass.data, entry.commandBuffer);
+	vkEndCommandBuffer(entry.commandBuffer);
+
+	entry.isValid = true;
+}
\ No newline at end of file
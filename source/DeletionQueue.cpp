@@ -0,0 +1,147 @@
+#include "LearningVulkan/DeletionQueue.hpp"
+
+#include <assert.h>
+
+DeletionQueue::DeletionQueue() :
+	device(VK_NULL_HANDLE),
+	allocator(nullptr),
+	currentFrame(0)
+{
+	statistics = {};
+}
+
+DeletionQueue::~DeletionQueue()
+{
+	destroy();
+}
+
+void DeletionQueue::initialize(VkDevice device, const VkAllocationCallbacks *allocator)
+{
+	this->device = device;
+	this->allocator = allocator;
+}
+
+void DeletionQueue::destroy()
+{
+	if (device == VK_NULL_HANDLE)
+		return;
+
+	for (const RetiredObject &object : objects)
+		destroyObject(object);
+
+	statistics.destroyedCount += objects.size();
+	statistics.pendingCount = 0;
+
+	objects.clear();
+	device = VK_NULL_HANDLE;
+}
+
+void DeletionQueue::retire(VkObjectType type, uint64_t handle)
+{
+	if (handle == 0)
+		return;
+
+	std::lock_guard<std::mutex> lock(mutex);
+
+	RetiredObject object;
+	object.type = type;
+	object.handle = handle;
+	object.frame = currentFrame;
+	objects.push_back(object);
+
+	statistics.pendingCount = static_cast<uint32_t>(objects.size());
+	if (statistics.pendingCount > statistics.peakPendingCount)
+		statistics.peakPendingCount = statistics.pendingCount;
+}
+
+void DeletionQueue::beginFrame(uint64_t frame, uint64_t completedFrameCount)
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+
+		currentFrame = frame;
+
+		size_t readyCount = 0;
+		while (readyCount < objects.size() && objects[readyCount].frame < completedFrameCount)
+			++readyCount;
+
+		if (readyCount == 0)
+			return;
+
+		readyObjects.assign(objects.begin(), objects.begin() + readyCount);
+		objects.erase(objects.begin(), objects.begin() + readyCount);
+
+		statistics.pendingCount = static_cast<uint32_t>(objects.size());
+		statistics.destroyedCount += readyCount;
+	}
+
+	// Other threads can keep retiring objects meanwhile
+	for (const RetiredObject &object : readyObjects)
+		destroyObject(object);
+
+	readyObjects.clear();
+}
+
+DeletionStatistics DeletionQueue::getStatistics() const
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	return statistics;
+}
+
+void DeletionQueue::destroyObject(const RetiredObject &object)
+{
+	switch (object.type)
+	{
+	case VK_OBJECT_TYPE_BUFFER:
+		vkDestroyBuffer(device, (VkBuffer)object.handle, allocator);
+		break;
+	case VK_OBJECT_TYPE_IMAGE:
+		vkDestroyImage(device, (VkImage)object.handle, allocator);
+		break;
+	case VK_OBJECT_TYPE_IMAGE_VIEW:
+		vkDestroyImageView(device, (VkImageView)object.handle, allocator);
+		break;
+	case VK_OBJECT_TYPE_DEVICE_MEMORY:
+		vkFreeMemory(device, (VkDeviceMemory)object.handle, allocator);
+		break;
+	case VK_OBJECT_TYPE_FRAMEBUFFER:
+		vkDestroyFramebuffer(device, (VkFramebuffer)object.handle, allocator);
+		break;
+	case VK_OBJECT_TYPE_RENDER_PASS:
+		vkDestroyRenderPass(device, (VkRenderPass)object.handle, allocator);
+		break;
+	case VK_OBJECT_TYPE_PIPELINE:
+		vkDestroyPipeline(device, (VkPipeline)object.handle, allocator);
+		break;
+	case VK_OBJECT_TYPE_PIPELINE_LAYOUT:
+		vkDestroyPipelineLayout(device, (VkPipelineLayout)object.handle, allocator);
+		break;
+	case VK_OBJECT_TYPE_DESCRIPTOR_SET_LAYOUT:
+		vkDestroyDescriptorSetLayout(device, (VkDescriptorSetLayout)object.handle, allocator);
+		break;
+	case VK_OBJECT_TYPE_DESCRIPTOR_POOL:
+		vkDestroyDescriptorPool(device, (VkDescriptorPool)object.handle, allocator);
+		break;
+	case VK_OBJECT_TYPE_SAMPLER:
+		vkDestroySampler(device, (VkSampler)object.handle, allocator);
+		break;
+	case VK_OBJECT_TYPE_SHADER_MODULE:
+		vkDestroyShaderModule(device, (VkShaderModule)object.handle, allocator);
+		break;
+	case VK_OBJECT_TYPE_QUERY_POOL:
+		vkDestroyQueryPool(device, (VkQueryPool)object.handle, allocator);
+		break;
+	case VK_OBJECT_TYPE_SEMAPHORE:
+		vkDestroySemaphore(device, (VkSemaphore)object.handle, allocator);
+		break;
+	case VK_OBJECT_TYPE_FENCE:
+		vkDestroyFence(device, (VkFence)object.handle, allocator);
+		break;
+	case VK_OBJECT_TYPE_SWAPCHAIN_KHR:
+		vkDestroySwapchainKHR(device, (VkSwapchainKHR)object.handle, allocator);
+		break;
+	default:
+		assert(false, "Unsupported object type in the deletion queue.");
+		break;
+	}
+}
\ No newline at end of file
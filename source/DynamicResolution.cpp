@@ -0,0 +1,133 @@
+#include "LearningVulkan/DynamicResolution.hpp"
+
+#include <algorithm>
+#include <assert.h>
+#include <cmath>
+
+// Weight of the newest frame time, smooths out single slow frames
+static const double FRAME_TIME_SMOOTHING = 0.1;
+
+// Frames in a row with enough headroom before scaling up by a step
+static const uint32_t HEADROOM_FRAME_COUNT = 30;
+
+ResolutionController::ResolutionController() :
+	scale(1.0f),
+	smoothedFrameTime(0.0),
+	settleFrameCount(0),
+	headroomFrameCount(0),
+	changeCount(0)
+{
+	settings = {};
+	settings.minScale = 1.0f;
+	settings.maxScale = 1.0f;
+	settings.scaleStep = 0.05f;
+}
+
+ResolutionController::~ResolutionController()
+{
+}
+
+void ResolutionController::setSettings(const DynamicResolutionSettings &settings)
+{
+	assert(settings.targetFrameTime <= 0.0 || settings.scaleStep > 0.0f,
+		"Dynamic resolution needs a scale step.");
+
+	this->settings = settings;
+	this->settings.maxScale = std::min(settings.maxScale, 1.0f);
+	this->settings.minScale = std::min(settings.minScale, this->settings.maxScale);
+
+	// Start sharp and only give up resolution when the budget requires it
+	scale = quantize(this->settings.maxScale);
+	smoothedFrameTime = 0.0;
+	settleFrameCount = 0;
+	headroomFrameCount = 0;
+}
+
+const DynamicResolutionSettings &ResolutionController::getSettings() const
+{
+	return settings;
+}
+
+bool ResolutionController::isEnabled() const
+{
+	return settings.targetFrameTime > 0.0;
+}
+
+bool ResolutionController::update(double gpuFrameTime)
+{
+	if (!isEnabled() || gpuFrameTime <= 0.0)
+		return false;
+
+	// These frames were still recorded at the previous scale
+	if (settleFrameCount > 0)
+	{
+		--settleFrameCount;
+		return false;
+	}
+
+	if (smoothedFrameTime == 0.0)
+		smoothedFrameTime = gpuFrameTime;
+	else
+		smoothedFrameTime += (gpuFrameTime - smoothedFrameTime) * FRAME_TIME_SMOOTHING;
+
+	float newScale = scale;
+
+	if (smoothedFrameTime > settings.targetFrameTime)
+	{
+		// At least one step down, or rounding could keep the scale as it is
+		float fittingScale = scale * static_cast<float>(sqrt(settings.targetFrameTime / smoothedFrameTime));
+		newScale = quantize(std::min(fittingScale, scale - settings.scaleStep));
+		headroomFrameCount = 0;
+	}
+	else if (smoothedFrameTime < settings.targetFrameTime * (1.0 - settings.headroom))
+	{
+		if (++headroomFrameCount >= HEADROOM_FRAME_COUNT)
+		{
+			newScale = quantize(scale + settings.scaleStep);
+			headroomFrameCount = 0;
+		}
+	}
+	else
+	{
+		headroomFrameCount = 0;
+	}
+
+	if (newScale == scale)
+		return false;
+
+	scale = newScale;
+	smoothedFrameTime = 0.0;
+	settleFrameCount = settings.settleFrames;
+	++changeCount;
+
+	return true;
+}
+
+float ResolutionController::getScale() const
+{
+	return scale;
+}
+
+uint32_t ResolutionController::getChangeCount() const
+{
+	return changeCount;
+}
+
+void ResolutionController::getRenderExtent(
+	uint32_t outputWidth,
+	uint32_t outputHeight,
+	uint32_t &renderWidth,
+	uint32_t &renderHeight) const
+{
+	renderWidth = std::max(static_cast<uint32_t>(outputWidth * scale + 0.5f), 1u);
+	renderHeight = std::max(static_cast<uint32_t>(outputHeight * scale + 0.5f), 1u);
+}
+
+float ResolutionController::quantize(float scale) const
+{
+	// The small bias keeps exact multiples from rounding down a whole step
+	float steps = floorf(scale / settings.scaleStep + 0.001f);
+	float quantizedScale = steps * settings.scaleStep;
+
+	return std::max(settings.minScale, std::min(quantizedScale, settings.maxScale));
+}
\ No newline at end of file
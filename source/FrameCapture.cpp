@@ -0,0 +1,573 @@
+#include "LearningVulkan/FrameCapture.hpp"
+#include "LearningVulkan/Renderer.hpp"
+#include "LearningVulkan/Utility.hpp"
+
+#include <assert.h>
+#include <cstdio>
+
+// CRC used by the PNG chunks
+static uint32_t updateCrc(uint32_t crc, const uint8_t *data, size_t size)
+{
+	static uint32_t table[256];
+	static bool tableInitialized = false;
+
+	if (!tableInitialized)
+	{
+		for (uint32_t i = 0; i < 256; ++i)
+		{
+			uint32_t value = i;
+			for (uint32_t j = 0; j < 8; ++j)
+				value = (value & 1) ? (0xEDB88320u ^ (value >> 1)) : (value >> 1);
+
+			table[i] = value;
+		}
+
+		tableInitialized = true;
+	}
+
+	crc = ~crc;
+	for (size_t i = 0; i < size; ++i)
+		crc = table[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+
+	return ~crc;
+}
+
+static void writeBigEndian(std::vector<uint8_t> &output, uint32_t value)
+{
+	output.push_back(static_cast<uint8_t>(value >> 24));
+	output.push_back(static_cast<uint8_t>(value >> 16));
+	output.push_back(static_cast<uint8_t>(value >> 8));
+	output.push_back(static_cast<uint8_t>(value));
+}
+
+static void writePngChunk(FILE *file, const char *type, const std::vector<uint8_t> &data)
+{
+	std::vector<uint8_t> header;
+	writeBigEndian(header, static_cast<uint32_t>(data.size()));
+	header.insert(header.end(), type, type + 4);
+
+	uint32_t crc = updateCrc(0, header.data() + 4, 4);
+	crc = updateCrc(crc, data.data(), data.size());
+
+	std::vector<uint8_t> footer;
+	writeBigEndian(footer, crc);
+
+	fwrite(header.data(), 1, header.size(), file);
+	fwrite(data.data(), 1, data.size(), file);
+	fwrite(footer.data(), 1, footer.size(), file);
+}
+
+// Writes the RGBA pixels as a PNG that uses uncompressed deflate blocks, the
+// files are big but encoding them costs next to nothing
+static void writePng(FILE *file, const uint8_t *pixels, uint32_t width, uint32_t height)
+{
+	const uint8_t signature[] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' };
+	fwrite(signature, 1, sizeof(signature), file);
+
+	std::vector<uint8_t> header;
+	writeBigEndian(header, width);
+	writeBigEndian(header, height);
+	header.push_back(8);	// Bits per channel
+	header.push_back(6);	// RGBA
+	header.push_back(0);	// Deflate
+	header.push_back(0);	// Adaptive filtering
+	header.push_back(0);	// No interlacing
+	writePngChunk(file, "IHDR", header);
+
+	// Every scanline starts with its filter type (none)
+	size_t rowSize = static_cast<size_t>(width) * 4;
+	std::vector<uint8_t> scanlines;
+	scanlines.reserve((rowSize + 1) * height);
+
+	for (uint32_t y = 0; y < height; ++y)
+	{
+		scanlines.push_back(0);
+		scanlines.insert(
+			scanlines.end(),
+			pixels + rowSize * y,
+			pixels + rowSize * (y + 1));
+	}
+
+	std::vector<uint8_t> compressed;
+	compressed.reserve(scanlines.size() + scanlines.size() / 65535 * 5 + 16);
+	compressed.push_back(0x78);
+	compressed.push_back(0x01);
+
+	uint32_t adlerA = 1;
+	uint32_t adlerB = 0;
+	size_t offset = 0;
+
+	do
+	{
+		size_t blockSize = scanlines.size() - offset;
+		if (blockSize > 65535)
+			blockSize = 65535;
+
+		bool isLastBlock = (offset + blockSize == scanlines.size());
+		uint16_t length = static_cast<uint16_t>(blockSize);
+
+		compressed.push_back(isLastBlock ? 1 : 0);
+		compressed.push_back(static_cast<uint8_t>(length));
+		compressed.push_back(static_cast<uint8_t>(length >> 8));
+		compressed.push_back(static_cast<uint8_t>(~length));
+		compressed.push_back(static_cast<uint8_t>(~length >> 8));
+
+		for (size_t i = offset; i < offset + blockSize; ++i)
+		{
+			adlerA = (adlerA + scanlines[i]) % 65521;
+			adlerB = (adlerB + adlerA) % 65521;
+		}
+
+		compressed.insert(
+			compressed.end(),
+			scanlines.begin() + offset,
+			scanlines.begin() + offset + blockSize);
+
+		offset += blockSize;
+	} while (offset < scanlines.size());
+
+	writeBigEndian(compressed, (adlerB << 16) | adlerA);
+	writePngChunk(file, "IDAT", compressed);
+	writePngChunk(file, "IEND", std::vector<uint8_t>());
+}
+
+FrameCapture::FrameCapture() :
+	device(VK_NULL_HANDLE),
+	allocator(nullptr),
+	multiGpuMode(MultiGpuMode::Disabled),
+	deviceGroupSize(1),
+	recordedSlot(-1),
+	continuousFrameNumber(0),
+	droppedCaptureCount(0),
+	stopWorker(false)
+{
+}
+
+FrameCapture::~FrameCapture()
+{
+	destroy();
+}
+
+void FrameCapture::initialize(const VulkanContext &context, uint32_t slotCount)
+{
+	device = context.device;
+	allocator = context.allocator;
+	width = context.width;
+	height = context.height;
+	imageFormat = context.colorFormat;
+	multiGpuMode = context.multiGpuMode;
+	deviceGroupSize = context.deviceGroupSize;
+
+	// Only 32-bit color formats can be captured
+	assert(imageFormat == VK_FORMAT_R8G8B8A8_UNORM ||
+		imageFormat == VK_FORMAT_R8G8B8A8_SRGB ||
+		imageFormat == VK_FORMAT_B8G8R8A8_UNORM ||
+		imageFormat == VK_FORMAT_B8G8R8A8_SRGB,
+		"Unsupported capture format.");
+
+	imageSize = static_cast<VkDeviceSize>(width) * height * 4;
+
+	VkBufferCreateInfo bufferCreateInfo = {};
+	bufferCreateInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+	bufferCreateInfo.size = imageSize;
+	bufferCreateInfo.usage = VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+	bufferCreateInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+	VkFenceCreateInfo fenceCreateInfo = {};
+	fenceCreateInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+
+	slots.resize(slotCount);
+	for (auto &slot : slots)
+	{
+		VkResult result = vkCreateBuffer(device, &bufferCreateInfo, allocator, &slot.buffer);
+		Utility::checkVulkanResult(result, "Failed to create a capture buffer.");
+
+		VkMemoryRequirements memoryRequirements = {};
+		vkGetBufferMemoryRequirements(device, slot.buffer, &memoryRequirements);
+
+		// Cached memory makes reading back on the CPU a lot faster, but it is
+		// not available everywhere
+		uint32_t memoryTypeIndex = 0;
+		VkMemoryPropertyFlags memoryFlags =
+			VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
+			VK_MEMORY_PROPERTY_HOST_CACHED_BIT;
+
+		if (!Utility::findMemoryType(
+			context.physicalDeviceMemoryProperties,
+			memoryRequirements.memoryTypeBits,
+			memoryFlags,
+			memoryTypeIndex))
+		{
+			memoryFlags = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT;
+
+			bool foundMemoryType = Utility::findMemoryType(
+				context.physicalDeviceMemoryProperties,
+				memoryRequirements.memoryTypeBits,
+				memoryFlags,
+				memoryTypeIndex);
+
+			assert(foundMemoryType, "Failed to find host-visible memory for captures.");
+		}
+
+		VkMemoryPropertyFlags actualFlags =
+			context.physicalDeviceMemoryProperties.memoryTypes[memoryTypeIndex].propertyFlags;
+		isCoherent = (actualFlags & VK_MEMORY_PROPERTY_HOST_COHERENT_BIT) != 0;
+
+		VkMemoryAllocateInfo allocateInfo = {};
+		allocateInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+		allocateInfo.allocationSize = memoryRequirements.size;
+		allocateInfo.memoryTypeIndex = memoryTypeIndex;
+
+		result = vkAllocateMemory(device, &allocateInfo, allocator, &slot.memory);
+		Utility::checkVulkanResult(result, "Failed to allocate capture memory.");
+
+		result = vkBindBufferMemory(device, slot.buffer, slot.memory, 0);
+		Utility::checkVulkanResult(result, "Failed to bind capture memory.");
+
+		// Stays mapped for the lifetime of the slot
+		result = vkMapMemory(device, slot.memory, 0, VK_WHOLE_SIZE, 0, &slot.mapped);
+		Utility::checkVulkanResult(result, "Failed to map capture memory.");
+
+		result = vkCreateFence(device, &fenceCreateInfo, allocator, &slot.fence);
+		Utility::checkVulkanResult(result, "Failed to create a capture fence.");
+
+		slot.state = CaptureSlot::State::Free;
+	}
+
+	stopWorker = false;
+	worker = std::thread(&FrameCapture::encodeThread, this);
+}
+
+void FrameCapture::destroy()
+{
+	if (device == VK_NULL_HANDLE)
+		return;
+
+	// Let the worker finish whatever it is encoding
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		stopWorker = true;
+	}
+
+	encodeCondition.notify_one();
+	worker.join();
+
+	for (auto &slot : slots)
+	{
+		// Copies that are still in flight are written out as well
+		if (slot.state == CaptureSlot::State::Submitted)
+		{
+			vkWaitForFences(device, 1, &slot.fence, VK_TRUE, UINT64_MAX);
+
+			if (!isCoherent)
+			{
+				VkMappedMemoryRange range = {};
+				range.sType = VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE;
+				range.memory = slot.memory;
+				range.size = VK_WHOLE_SIZE;
+				vkInvalidateMappedMemoryRanges(device, 1, &range);
+			}
+
+			writeImage(slot);
+		}
+
+		vkUnmapMemory(device, slot.memory);
+		vkDestroyFence(device, slot.fence, allocator);
+		vkDestroyBuffer(device, slot.buffer, allocator);
+		vkFreeMemory(device, slot.memory, allocator);
+	}
+
+	slots.clear();
+	device = VK_NULL_HANDLE;
+}
+
+void FrameCapture::requestCapture(const char *fileName, CaptureFormat format)
+{
+	requests.push_back(std::make_pair(std::string(fileName), format));
+}
+
+void FrameCapture::setContinuousCapture(const char *filePrefix, CaptureFormat format)
+{
+	continuousPrefix = filePrefix ? filePrefix : "";
+	continuousFormat = format;
+	continuousFrameNumber = 0;
+}
+
+bool FrameCapture::recordCopy(
+	VkCommandBuffer commandBuffer,
+	VkImage image,
+	VkImageLayout layout,
+	VkPipelineStageFlags srcStageMask,
+	VkAccessFlags srcAccessMask)
+{
+	if (requests.empty() && continuousPrefix.empty())
+		return false;
+
+	// Find a free slot, a capture is dropped rather than waiting for one
+	int32_t freeSlot = -1;
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		for (uint32_t i = 0; i < slots.size(); ++i)
+		{
+			if (slots[i].state == CaptureSlot::State::Free)
+			{
+				freeSlot = static_cast<int32_t>(i);
+				break;
+			}
+		}
+	}
+
+	if (freeSlot == -1)
+	{
+		++droppedCaptureCount;
+		return false;
+	}
+
+	CaptureSlot &slot = slots[freeSlot];
+
+	if (!requests.empty())
+	{
+		slot.fileName = requests.front().first;
+		slot.format = requests.front().second;
+		requests.pop_front();
+	}
+	else
+	{
+		char frameNumber[16];
+		sprintf(frameNumber, "_%06u", continuousFrameNumber++);
+
+		slot.fileName = continuousPrefix + frameNumber;
+		slot.format = continuousFormat;
+	}
+
+	VkImageSubresourceRange resourceRange = {};
+	resourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+	resourceRange.baseMipLevel = 0;
+	resourceRange.levelCount = 1;
+	resourceRange.baseArrayLayer = 0;
+	resourceRange.layerCount = 1;
+
+	VkImageMemoryBarrier layoutTransitionBarrier = {};
+	layoutTransitionBarrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+	layoutTransitionBarrier.srcAccessMask = srcAccessMask;
+	layoutTransitionBarrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+	layoutTransitionBarrier.oldLayout = layout;
+	layoutTransitionBarrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+	layoutTransitionBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	layoutTransitionBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	layoutTransitionBarrier.image = image;
+	layoutTransitionBarrier.subresourceRange = resourceRange;
+
+	vkCmdPipelineBarrier(
+		commandBuffer,
+		srcStageMask,
+		VK_PIPELINE_STAGE_TRANSFER_BIT,
+		0,
+		0, nullptr,
+		0, nullptr,
+		1, &layoutTransitionBarrier);
+
+	VkBufferImageCopy copyRegion = {};
+	copyRegion.bufferOffset = 0;
+	copyRegion.bufferRowLength = 0;		// Tightly packed
+	copyRegion.bufferImageHeight = 0;
+	copyRegion.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+	copyRegion.imageSubresource.mipLevel = 0;
+	copyRegion.imageSubresource.baseArrayLayer = 0;
+	copyRegion.imageSubresource.layerCount = 1;
+	copyRegion.imageOffset = { 0, 0, 0 };
+	copyRegion.imageExtent = { width, height, 1 };
+
+	if (multiGpuMode == MultiGpuMode::SplitFrame && deviceGroupSize > 1)
+	{
+		// Every GPU only rendered its own strip into its instance of the
+		// image, so each one copies that strip
+		for (uint32_t i = 0; i < deviceGroupSize; ++i)
+		{
+			uint32_t stripStart;
+			uint32_t stripHeight;
+			getSplitFrameStrip(height, deviceGroupSize, i, stripStart, stripHeight);
+
+			copyRegion.bufferOffset = static_cast<VkDeviceSize>(stripStart) * width * 4;
+			copyRegion.imageOffset = { 0, static_cast<int32_t>(stripStart), 0 };
+			copyRegion.imageExtent = { width, stripHeight, 1 };
+
+			vkCmdSetDeviceMask(commandBuffer, 1u << i);
+			vkCmdCopyImageToBuffer(
+				commandBuffer,
+				image,
+				VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+				slot.buffer,
+				1,
+				&copyRegion);
+		}
+
+		vkCmdSetDeviceMask(commandBuffer, (1u << deviceGroupSize) - 1);
+	}
+	else
+	{
+		vkCmdCopyImageToBuffer(
+			commandBuffer,
+			image,
+			VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+			slot.buffer,
+			1,
+			&copyRegion);
+	}
+
+	// Make the copy visible to the host once the fence signals
+	VkBufferMemoryBarrier bufferBarrier = {};
+	bufferBarrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+	bufferBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+	bufferBarrier.dstAccessMask = VK_ACCESS_HOST_READ_BIT;
+	bufferBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	bufferBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	bufferBarrier.buffer = slot.buffer;
+	bufferBarrier.offset = 0;
+	bufferBarrier.size = VK_WHOLE_SIZE;
+
+	layoutTransitionBarrier.srcAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+	layoutTransitionBarrier.dstAccessMask = VK_ACCESS_MEMORY_READ_BIT;
+	layoutTransitionBarrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+	layoutTransitionBarrier.newLayout = layout;
+
+	vkCmdPipelineBarrier(
+		commandBuffer,
+		VK_PIPELINE_STAGE_TRANSFER_BIT,
+		VK_PIPELINE_STAGE_HOST_BIT | VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT,
+		0,
+		0, nullptr,
+		1, &bufferBarrier,
+		1, &layoutTransitionBarrier);
+
+	recordedSlot = freeSlot;
+	return true;
+}
+
+void FrameCapture::submit(VkQueue queue)
+{
+	if (recordedSlot == -1)
+		return;
+
+	CaptureSlot &slot = slots[recordedSlot];
+
+	// An empty submission signals its fence once all earlier work on the
+	// queue (including the copy) has finished
+	VkResult result = vkQueueSubmit(queue, 0, nullptr, slot.fence);
+	Utility::checkVulkanResult(result, "Failed to submit the capture fence.");
+
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		slot.state = CaptureSlot::State::Submitted;
+	}
+
+	recordedSlot = -1;
+}
+
+void FrameCapture::poll()
+{
+	bool queuedWork = false;
+
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+
+		for (uint32_t i = 0; i < slots.size(); ++i)
+		{
+			CaptureSlot &slot = slots[i];
+
+			if (slot.state != CaptureSlot::State::Submitted ||
+				vkGetFenceStatus(device, slot.fence) != VK_SUCCESS)
+			{
+				continue;
+			}
+
+			vkResetFences(device, 1, &slot.fence);
+
+			if (!isCoherent)
+			{
+				VkMappedMemoryRange range = {};
+				range.sType = VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE;
+				range.memory = slot.memory;
+				range.size = VK_WHOLE_SIZE;
+				vkInvalidateMappedMemoryRanges(device, 1, &range);
+			}
+
+			slot.state = CaptureSlot::State::Encoding;
+			encodeQueue.push_back(i);
+			queuedWork = true;
+		}
+	}
+
+	if (queuedWork)
+		encodeCondition.notify_one();
+}
+
+uint32_t FrameCapture::getDroppedCaptureCount() const
+{
+	return droppedCaptureCount;
+}
+
+void FrameCapture::encodeThread()
+{
+	std::unique_lock<std::mutex> lock(mutex);
+
+	for (;;)
+	{
+		encodeCondition.wait(lock, [this]
+		{
+			return stopWorker || !encodeQueue.empty();
+		});
+
+		if (encodeQueue.empty())
+			break;
+
+		uint32_t slotIndex = encodeQueue.front();
+		encodeQueue.pop_front();
+
+		// Encoding happens without holding the lock, the render thread does
+		// not touch slots that are being encoded
+		lock.unlock();
+		writeImage(slots[slotIndex]);
+		lock.lock();
+
+		slots[slotIndex].state = CaptureSlot::State::Free;
+	}
+}
+
+void FrameCapture::writeImage(const CaptureSlot &slot) const
+{
+	const uint8_t *pixels = static_cast<const uint8_t *>(slot.mapped);
+
+	if (slot.format == CaptureFormat::Raw)
+	{
+		FILE *file = fopen((slot.fileName + ".raw").c_str(), "wb");
+		if (!file)
+			return;
+
+		fwrite(pixels, 1, static_cast<size_t>(imageSize), file);
+		fclose(file);
+		return;
+	}
+
+	FILE *file = fopen((slot.fileName + ".png").c_str(), "wb");
+	if (!file)
+		return;
+
+	// PNG expects RGBA, swap the channels of BGRA images in a copy (the
+	// mapped memory may be uncached, so it is read exactly once)
+	std::vector<uint8_t> rgba(pixels, pixels + imageSize);
+
+	if (imageFormat == VK_FORMAT_B8G8R8A8_UNORM ||
+		imageFormat == VK_FORMAT_B8G8R8A8_SRGB)
+	{
+		for (size_t i = 0; i < rgba.size(); i += 4)
+		{
+			uint8_t blue = rgba[i];
+			rgba[i] = rgba[i + 2];
+			rgba[i + 2] = blue;
+		}
+	}
+
+	writePng(file, rgba.data(), width, height);
+	fclose(file);
+}
\ No newline at end of file
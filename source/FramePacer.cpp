@@ -0,0 +1,226 @@
+#include "LearningVulkan/FramePacer.hpp"
+
+#include <algorithm>
+#ifdef _WIN32
+#include <timeapi.h>
+#pragma comment(lib, "winmm.lib")
+#else
+#include <thread>
+#endif
+
+// Only available since Windows 10 1803, older versions fall back to a
+// regular timer with a raised system timer resolution
+#if defined(_WIN32) && !defined(CREATE_WAITABLE_TIMER_HIGH_RESOLUTION)
+#define CREATE_WAITABLE_TIMER_HIGH_RESOLUTION 0x00000002
+#endif
+
+// How long before the target the sleep ends, the rest is spun away. Has to
+// cover how late the timer can wake up.
+static const std::chrono::microseconds HIGH_RESOLUTION_SPIN_TIME(1000);
+static const std::chrono::microseconds LOW_RESOLUTION_SPIN_TIME(2000);
+
+// Added to the predicted frame time, so small spikes still make the deadline
+static const double FRAME_TIME_MARGIN = 0.5;
+
+// Upper bounds of the histogram buckets in milliseconds
+static const double PACING_BUCKET_LIMITS[PACING_BUCKET_COUNT - 1] =
+{
+	0.05, 0.1, 0.25, 0.5, 1.0, 2.0, 4.0
+};
+
+static const char *PACING_BUCKET_NAMES[PACING_BUCKET_COUNT] =
+{
+	"< 0.05 ms",
+	"< 0.1 ms",
+	"< 0.25 ms",
+	"< 0.5 ms",
+	"< 1 ms",
+	"< 2 ms",
+	"< 4 ms",
+	">= 4 ms"
+};
+
+FramePacer::FramePacer() :
+	framePeriod(Clock::duration::zero()),
+	hasDeadline(false),
+	frameTimeIndex(0),
+	totalError(0.0)
+{
+#ifdef _WIN32
+	timer = CreateWaitableTimerExW(
+		nullptr,
+		nullptr,
+		CREATE_WAITABLE_TIMER_HIGH_RESOLUTION,
+		TIMER_ALL_ACCESS);
+
+	isHighResolutionTimer = (timer != nullptr);
+
+	if (!isHighResolutionTimer)
+	{
+		timer = CreateWaitableTimerExW(nullptr, nullptr, 0, TIMER_ALL_ACCESS);
+		timeBeginPeriod(1);
+	}
+#else
+	// Sleeps on other platforms already wake up within tens of microseconds
+	isHighResolutionTimer = true;
+#endif
+
+	std::fill(frameTimes, frameTimes + FRAME_TIME_HISTORY, 0.0);
+	resetStatistics();
+}
+
+FramePacer::~FramePacer()
+{
+#ifdef _WIN32
+	if (!isHighResolutionTimer)
+		timeEndPeriod(1);
+
+	CloseHandle(timer);
+#endif
+}
+
+void FramePacer::setTargetFrameRate(double framesPerSecond)
+{
+	if (framesPerSecond <= 0.0)
+	{
+		framePeriod = Clock::duration::zero();
+	}
+	else
+	{
+		framePeriod = std::chrono::duration_cast<Clock::duration>(
+			std::chrono::duration<double>(1.0 / framesPerSecond));
+	}
+
+	// Start a new schedule with the next frame
+	hasDeadline = false;
+}
+
+void FramePacer::setPresentInterval(uint32_t interval, double refreshRate)
+{
+	setTargetFrameRate(interval != 0 ? refreshRate / interval : 0.0);
+}
+
+bool FramePacer::isEnabled() const
+{
+	return framePeriod != Clock::duration::zero();
+}
+
+void FramePacer::waitForNextFrame()
+{
+	Clock::time_point now = Clock::now();
+
+	if (!isEnabled())
+	{
+		frameStart = now;
+		return;
+	}
+
+	double predictedFrameTime = predictFrameTime();
+	Clock::duration frameDuration = std::chrono::duration_cast<Clock::duration>(
+		std::chrono::duration<double, std::milli>(predictedFrameTime));
+
+	// Every frame is due one period after the previous one, and starts just
+	// early enough to be done by then
+	if (hasDeadline)
+		nextDeadline += framePeriod;
+	else
+		nextDeadline = now + frameDuration;
+
+	hasDeadline = true;
+
+	Clock::time_point target = nextDeadline - frameDuration;
+
+	if (target < now)
+	{
+		// Too slow for the schedule, start right away and move the schedule
+		// instead of trying to catch up with a burst of frames
+		++statistics.lateFrameCount;
+		nextDeadline = now + frameDuration;
+		target = now;
+	}
+	else
+	{
+		Clock::time_point sleepStart = Clock::now();
+		sleepUntil(target);
+
+		Clock::time_point spinStart = Clock::now();
+		while (Clock::now() < target)
+		{
+#ifdef _WIN32
+			YieldProcessor();
+#else
+			std::this_thread::yield();
+#endif
+		}
+
+		statistics.sleepTime += std::chrono::duration<double, std::milli>(spinStart - sleepStart).count();
+		statistics.spinTime += std::chrono::duration<double, std::milli>(Clock::now() - spinStart).count();
+	}
+
+	frameStart = Clock::now();
+
+	double error = std::chrono::duration<double, std::milli>(frameStart - target).count();
+
+	uint32_t bucket = 0;
+	while (bucket < PACING_BUCKET_COUNT - 1 && error >= PACING_BUCKET_LIMITS[bucket])
+		++bucket;
+
+	++statistics.errorHistogram[bucket];
+	++statistics.frameCount;
+	totalError += error;
+	statistics.meanError = totalError / statistics.frameCount;
+	statistics.maxError = std::max(statistics.maxError, error);
+	statistics.predictedFrameTime = predictedFrameTime;
+}
+
+void FramePacer::endFrame()
+{
+	frameTimes[frameTimeIndex] = std::chrono::duration<double, std::milli>(Clock::now() - frameStart).count();
+	frameTimeIndex = (frameTimeIndex + 1) % FRAME_TIME_HISTORY;
+}
+
+PacingStatistics FramePacer::getStatistics() const
+{
+	return statistics;
+}
+
+void FramePacer::resetStatistics()
+{
+	statistics = {};
+	totalError = 0.0;
+}
+
+const char *FramePacer::getBucketName(uint32_t bucket)
+{
+	return PACING_BUCKET_NAMES[bucket];
+}
+
+void FramePacer::sleepUntil(Clock::time_point time)
+{
+	Clock::duration spinTime = isHighResolutionTimer ?
+		Clock::duration(HIGH_RESOLUTION_SPIN_TIME) :
+		Clock::duration(LOW_RESOLUTION_SPIN_TIME);
+
+	Clock::duration sleepTime = time - Clock::now() - spinTime;
+	if (sleepTime <= Clock::duration::zero())
+		return;
+
+#ifdef _WIN32
+	// Negative due times are relative, in 100 nanosecond units
+	LARGE_INTEGER dueTime;
+	dueTime.QuadPart = -static_cast<LONGLONG>(
+		std::chrono::duration_cast<std::chrono::nanoseconds>(sleepTime).count() / 100);
+
+	if (SetWaitableTimer(timer, &dueTime, 0, nullptr, nullptr, FALSE))
+		WaitForSingleObject(timer, INFINITE);
+#else
+	std::this_thread::sleep_for(sleepTime);
+#endif
+}
+
+double FramePacer::predictFrameTime() const
+{
+	// The slowest recent frame, a mean would miss every other deadline on a
+	// workload that alternates between fast and slow frames
+	return *std::max_element(frameTimes, frameTimes + FRAME_TIME_HISTORY) + FRAME_TIME_MARGIN;
+}
\ No newline at end of file
@@ -0,0 +1,263 @@
+#include "LearningVulkan/GpuCounters.hpp"
+#include "LearningVulkan/Logger.hpp"
+#include "LearningVulkan/Renderer.hpp"
+#include "LearningVulkan/Utility.hpp"
+
+#include <assert.h>
+
+// Results are written in the order of the bits, so this has to match the
+// order of the fields in PassCounters
+static const VkQueryPipelineStatisticFlags PIPELINE_STATISTIC_FLAGS =
+	VK_QUERY_PIPELINE_STATISTIC_INPUT_ASSEMBLY_VERTICES_BIT |
+	VK_QUERY_PIPELINE_STATISTIC_INPUT_ASSEMBLY_PRIMITIVES_BIT |
+	VK_QUERY_PIPELINE_STATISTIC_VERTEX_SHADER_INVOCATIONS_BIT |
+	VK_QUERY_PIPELINE_STATISTIC_CLIPPING_INVOCATIONS_BIT |
+	VK_QUERY_PIPELINE_STATISTIC_CLIPPING_PRIMITIVES_BIT |
+	VK_QUERY_PIPELINE_STATISTIC_FRAGMENT_SHADER_INVOCATIONS_BIT;
+
+static const uint32_t PIPELINE_STATISTIC_COUNT = 6;
+
+GpuCounters::GpuCounters() :
+	device(VK_NULL_HANDLE),
+	allocator(nullptr),
+	maxScopes(0),
+	pipelineStatisticFlags(0),
+	occlusionControlFlags(0),
+	pipelineStatisticsPool(VK_NULL_HANDLE),
+	occlusionPool(VK_NULL_HANDLE),
+	currentFrameSlot(0)
+{
+}
+
+GpuCounters::~GpuCounters()
+{
+	destroy();
+}
+
+void GpuCounters::initialize(const VulkanContext &context, uint32_t maxScopes)
+{
+	device = context.device;
+	allocator = context.allocator;
+	this->maxScopes = maxScopes;
+
+	VkQueryPoolCreateInfo queryPoolCreateInfo = {};
+	queryPoolCreateInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+	queryPoolCreateInfo.queryCount = context.framesInFlight * maxScopes;
+
+	VkResult result;
+
+	if (context.enabledFeatures.pipelineStatisticsQuery)
+	{
+		pipelineStatisticFlags = PIPELINE_STATISTIC_FLAGS;
+
+		queryPoolCreateInfo.queryType = VK_QUERY_TYPE_PIPELINE_STATISTICS;
+		queryPoolCreateInfo.pipelineStatistics = pipelineStatisticFlags;
+
+		result = vkCreateQueryPool(
+			device,
+			&queryPoolCreateInfo,
+			allocator,
+			&pipelineStatisticsPool);
+
+		Utility::checkVulkanResult(result, "Failed to create the pipeline statistics query pool.");
+	}
+
+	if (context.enabledFeatures.occlusionQueryPrecise)
+		occlusionControlFlags = VK_QUERY_CONTROL_PRECISE_BIT;
+
+	queryPoolCreateInfo.queryType = VK_QUERY_TYPE_OCCLUSION;
+	queryPoolCreateInfo.pipelineStatistics = 0;
+
+	result = vkCreateQueryPool(
+		device,
+		&queryPoolCreateInfo,
+		allocator,
+		&occlusionPool);
+
+	Utility::checkVulkanResult(result, "Failed to create the occlusion query pool.");
+
+	recordedScopes.assign(context.framesInFlight, std::vector<bool>(maxScopes, false));
+	pixelCounts.assign(context.framesInFlight, 0.0);
+}
+
+void GpuCounters::destroy()
+{
+	if (device == VK_NULL_HANDLE)
+		return;
+
+	if (pipelineStatisticsPool != VK_NULL_HANDLE)
+		vkDestroyQueryPool(device, pipelineStatisticsPool, allocator);
+
+	vkDestroyQueryPool(device, occlusionPool, allocator);
+
+	pipelineStatisticsPool = VK_NULL_HANDLE;
+	occlusionPool = VK_NULL_HANDLE;
+	scopeNames.clear();
+	counters.clear();
+	recordedScopes.clear();
+	pixelCounts.clear();
+	device = VK_NULL_HANDLE;
+}
+
+CounterScopeId GpuCounters::addScope(const char *name)
+{
+	assert(scopeNames.size() < maxScopes, "Too many counter scopes.");
+
+	PassCounters scopeCounters = {};
+
+	scopeNames.push_back(name);
+	counters.push_back(scopeCounters);
+
+	return static_cast<CounterScopeId>(scopeNames.size() - 1);
+}
+
+void GpuCounters::beginFrame(
+	VkCommandBuffer commandBuffer,
+	uint32_t frameSlot,
+	uint32_t renderWidth,
+	uint32_t renderHeight)
+{
+	// The results belong to the render area the slot was last recorded with
+	readResults(frameSlot);
+	currentFrameSlot = frameSlot;
+	pixelCounts[frameSlot] = static_cast<double>(renderWidth) * renderHeight;
+
+	uint32_t firstQuery = frameSlot * maxScopes;
+
+	if (pipelineStatisticsPool != VK_NULL_HANDLE)
+		vkCmdResetQueryPool(commandBuffer, pipelineStatisticsPool, firstQuery, maxScopes);
+
+	vkCmdResetQueryPool(commandBuffer, occlusionPool, firstQuery, maxScopes);
+}
+
+void GpuCounters::beginScope(VkCommandBuffer commandBuffer, CounterScopeId scope)
+{
+	uint32_t query = currentFrameSlot * maxScopes + scope;
+
+	if (pipelineStatisticsPool != VK_NULL_HANDLE)
+		vkCmdBeginQuery(commandBuffer, pipelineStatisticsPool, query, 0);
+
+	vkCmdBeginQuery(commandBuffer, occlusionPool, query, occlusionControlFlags);
+
+	recordedScopes[currentFrameSlot][scope] = true;
+}
+
+void GpuCounters::endScope(VkCommandBuffer commandBuffer, CounterScopeId scope)
+{
+	uint32_t query = currentFrameSlot * maxScopes + scope;
+
+	vkCmdEndQuery(commandBuffer, occlusionPool, query);
+
+	if (pipelineStatisticsPool != VK_NULL_HANDLE)
+		vkCmdEndQuery(commandBuffer, pipelineStatisticsPool, query);
+}
+
+VkQueryPipelineStatisticFlags GpuCounters::getPipelineStatisticFlags() const
+{
+	return pipelineStatisticFlags;
+}
+
+VkQueryControlFlags GpuCounters::getOcclusionControlFlags() const
+{
+	return occlusionControlFlags;
+}
+
+uint32_t GpuCounters::getScopeCount() const
+{
+	return static_cast<uint32_t>(scopeNames.size());
+}
+
+const char *GpuCounters::getScopeName(CounterScopeId scope) const
+{
+	return scopeNames[scope];
+}
+
+const PassCounters &GpuCounters::getCounters(CounterScopeId scope) const
+{
+	return counters[scope];
+}
+
+void GpuCounters::log(Logger &logger) const
+{
+	for (CounterScopeId i = 0; i < scopeNames.size(); ++i)
+	{
+		const PassCounters &scopeCounters = counters[i];
+		if (!scopeCounters.isValid)
+			continue;
+
+		logger.log(
+			LogSeverity::Info,
+			"%s: %llu input vertices, %llu input primitives, %llu vertex shader invocations, "
+			"%llu clipping invocations, %llu clipping primitives, %llu fragments (%.2fx overdraw), %llu samples passed",
+			scopeNames[i],
+			static_cast<unsigned long long>(scopeCounters.inputAssemblyVertices),
+			static_cast<unsigned long long>(scopeCounters.inputAssemblyPrimitives),
+			static_cast<unsigned long long>(scopeCounters.vertexShaderInvocations),
+			static_cast<unsigned long long>(scopeCounters.clippingInvocations),
+			static_cast<unsigned long long>(scopeCounters.clippingPrimitives),
+			static_cast<unsigned long long>(scopeCounters.fragmentShaderInvocations),
+			scopeCounters.overdraw,
+			static_cast<unsigned long long>(scopeCounters.samplesPassed));
+	}
+}
+
+void GpuCounters::readResults(uint32_t frameSlot)
+{
+	std::vector<bool> &recorded = recordedScopes[frameSlot];
+	double pixelCount = pixelCounts[frameSlot];
+
+	for (CounterScopeId i = 0; i < recorded.size(); ++i)
+	{
+		if (!recorded[i])
+			continue;
+
+		recorded[i] = false;
+
+		uint32_t query = frameSlot * maxScopes + i;
+		PassCounters &scopeCounters = counters[i];
+
+		// The fence of the slot has been waited on, so the results are
+		// available and this never waits
+		if (pipelineStatisticsPool != VK_NULL_HANDLE)
+		{
+			uint64_t statistics[PIPELINE_STATISTIC_COUNT] = {};
+			VkResult result = vkGetQueryPoolResults(
+				device,
+				pipelineStatisticsPool,
+				query,
+				1,
+				sizeof(statistics),
+				statistics,
+				sizeof(statistics),
+				VK_QUERY_RESULT_64_BIT);
+
+			if (result != VK_SUCCESS)
+				continue;
+
+			scopeCounters.inputAssemblyVertices = statistics[0];
+			scopeCounters.inputAssemblyPrimitives = statistics[1];
+			scopeCounters.vertexShaderInvocations = statistics[2];
+			scopeCounters.clippingInvocations = statistics[3];
+			scopeCounters.clippingPrimitives = statistics[4];
+			scopeCounters.fragmentShaderInvocations = statistics[5];
+			scopeCounters.overdraw = pixelCount > 0.0 ? statistics[5] / pixelCount : 0.0;
+		}
+
+		uint64_t samplesPassed = 0;
+		VkResult result = vkGetQueryPoolResults(
+			device,
+			occlusionPool,
+			query,
+			1,
+			sizeof(samplesPassed),
+			&samplesPassed,
+			sizeof(samplesPassed),
+			VK_QUERY_RESULT_64_BIT);
+
+		if (result != VK_SUCCESS)
+			continue;
+
+		scopeCounters.samplesPassed = samplesPassed;
+		scopeCounters.isValid = true;
+	}
+}
\ No newline at end of file
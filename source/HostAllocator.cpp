@@ -0,0 +1,411 @@
+#include "LearningVulkan/HostAllocator.hpp"
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+
+// Stored in front of every allocation, so frees and reallocations know where
+// the memory came from
+struct AllocationHeader
+{
+	uint64_t size;
+	uint32_t offset;	// From the start of a system allocation to the header
+	uint8_t source;
+	uint8_t category;
+	uint16_t padding;
+};
+
+static_assert(sizeof(AllocationHeader) == 16, "The header has to keep allocations 16 byte aligned.");
+
+// Pools and the arena only hand out memory with this alignment, anything that
+// needs more comes from the system heap
+static const size_t MIN_ALIGNMENT = 16;
+static const size_t HEADER_SIZE = sizeof(AllocationHeader);
+
+// Slots of the smallest pool, every following pool doubles the size
+static const size_t MIN_SLOT_SIZE = 32;
+static const size_t CHUNK_SIZE = 64 * 1024;
+static const size_t ARENA_SIZE = 64 * 1024;
+
+// Values of AllocationHeader::source besides the pool indices
+static const uint8_t SOURCE_ARENA = 0xFE;
+static const uint8_t SOURCE_SYSTEM = 0xFF;
+
+static uint8_t *alignPointer(void *pointer, size_t alignment)
+{
+	uintptr_t address = reinterpret_cast<uintptr_t>(pointer);
+	address = (address + alignment - 1) & ~(static_cast<uintptr_t>(alignment) - 1);
+	return reinterpret_cast<uint8_t *>(address);
+}
+
+static AllocationHeader *getHeader(void *memory)
+{
+	return reinterpret_cast<AllocationHeader *>(static_cast<uint8_t *>(memory) - HEADER_SIZE);
+}
+
+HostAllocator::HostAllocator()
+{
+	callbacks = {};
+	callbacks.pUserData = this;
+	callbacks.pfnAllocation = allocationCallback;
+	callbacks.pfnReallocation = reallocationCallback;
+	callbacks.pfnFree = freeCallback;
+	callbacks.pfnInternalAllocation = internalAllocationCallback;
+	callbacks.pfnInternalFree = internalFreeCallback;
+
+	for (uint32_t i = 0; i < POOL_COUNT; ++i)
+	{
+		pools[i].slotSize = MIN_SLOT_SIZE << i;
+		pools[i].freeList = nullptr;
+	}
+
+	arena.block = nullptr;
+	arena.memory = nullptr;
+	arena.offset = 0;
+	arena.liveAllocations = 0;
+
+	for (CategoryCounters &category : counters)
+	{
+		category.liveBytes = 0;
+		category.peakBytes = 0;
+		category.allocationCount = 0;
+		category.reallocationCount = 0;
+		category.freeCount = 0;
+		category.internalBytes = 0;
+	}
+
+	poolAllocationCount = 0;
+	arenaAllocationCount = 0;
+	systemAllocationCount = 0;
+	reservedBytes = 0;
+}
+
+HostAllocator::~HostAllocator()
+{
+	for (Pool &pool : pools)
+	{
+		for (void *chunk : pool.chunks)
+			std::free(chunk);
+	}
+
+	std::free(arena.block);
+}
+
+const VkAllocationCallbacks *HostAllocator::getCallbacks() const
+{
+	return &callbacks;
+}
+
+void *HostAllocator::allocate(size_t size, size_t alignment, HostCategory category)
+{
+	if (size == 0)
+		return nullptr;
+
+	size_t totalSize = size + HEADER_SIZE;
+	uint8_t *memory = nullptr;
+	uint8_t source = SOURCE_SYSTEM;
+	uint32_t offset = 0;
+
+	if (alignment <= MIN_ALIGNMENT)
+	{
+		// Command allocations are short-lived, so they can simply be bumped
+		if (category == HostCategory::Command)
+		{
+			memory = static_cast<uint8_t *>(allocateFromArena(totalSize));
+			source = SOURCE_ARENA;
+		}
+
+		if (!memory && totalSize <= (MIN_SLOT_SIZE << (POOL_COUNT - 1)))
+		{
+			uint32_t poolIndex = 0;
+			while (pools[poolIndex].slotSize < totalSize)
+				++poolIndex;
+
+			memory = static_cast<uint8_t *>(allocateFromPool(poolIndex));
+			source = static_cast<uint8_t>(poolIndex);
+		}
+	}
+
+	if (!memory)
+	{
+		// Room for the header in front of the aligned allocation
+		size_t systemAlignment = std::max(alignment, MIN_ALIGNMENT);
+		uint8_t *block = static_cast<uint8_t *>(std::malloc(totalSize + systemAlignment));
+
+		if (!block)
+			return nullptr;
+
+		memory = alignPointer(block + HEADER_SIZE, systemAlignment) - HEADER_SIZE;
+		source = SOURCE_SYSTEM;
+		offset = static_cast<uint32_t>(memory - block);
+
+		++systemAllocationCount;
+	}
+
+	AllocationHeader *header = reinterpret_cast<AllocationHeader *>(memory);
+	header->size = size;
+	header->offset = offset;
+	header->source = source;
+	header->category = static_cast<uint8_t>(category);
+	header->padding = 0;
+
+	++counters[static_cast<uint32_t>(category)].allocationCount;
+	trackAllocation(category, size);
+
+	return memory + HEADER_SIZE;
+}
+
+void *HostAllocator::reallocate(void *original, size_t size, size_t alignment, HostCategory category)
+{
+	if (!original)
+		return allocate(size, alignment, category);
+
+	if (size == 0)
+	{
+		free(original);
+		return nullptr;
+	}
+
+	AllocationHeader *header = getHeader(original);
+	HostCategory originalCategory = static_cast<HostCategory>(header->category);
+	size_t originalSize = static_cast<size_t>(header->size);
+
+	// Pool slots are usually larger than requested, which often leaves enough
+	// room to grow in place
+	bool fitsInPlace =
+		header->source < POOL_COUNT &&
+		size + HEADER_SIZE <= pools[header->source].slotSize &&
+		(reinterpret_cast<uintptr_t>(original) & (alignment - 1)) == 0;
+
+	if (fitsInPlace)
+	{
+		trackFree(originalCategory, originalSize);
+		trackAllocation(category, size);
+
+		header->size = size;
+		header->category = static_cast<uint8_t>(category);
+
+		++counters[static_cast<uint32_t>(category)].reallocationCount;
+		return original;
+	}
+
+	void *memory = allocate(size, alignment, category);
+	if (!memory)
+		return nullptr;
+
+	memcpy(memory, original, std::min(size, originalSize));
+	free(original);
+
+	// Count the move as a single reallocation instead of an allocation and a
+	// free
+	CategoryCounters &counter = counters[static_cast<uint32_t>(category)];
+	--counter.allocationCount;
+	++counter.reallocationCount;
+	--counters[static_cast<uint32_t>(originalCategory)].freeCount;
+
+	return memory;
+}
+
+void HostAllocator::free(void *memory)
+{
+	if (!memory)
+		return;
+
+	AllocationHeader *header = getHeader(memory);
+	HostCategory category = static_cast<HostCategory>(header->category);
+
+	++counters[static_cast<uint32_t>(category)].freeCount;
+	trackFree(category, static_cast<size_t>(header->size));
+
+	if (header->source == SOURCE_SYSTEM)
+		std::free(reinterpret_cast<uint8_t *>(header) - header->offset);
+	else if (header->source == SOURCE_ARENA)
+		freeToArena();
+	else
+		freeToPool(header->source, header);
+}
+
+HostMemoryStatistics HostAllocator::getStatistics() const
+{
+	HostMemoryStatistics statistics = {};
+
+	for (uint32_t i = 0; i < HOST_CATEGORY_COUNT; ++i)
+	{
+		statistics.categories[i].liveBytes = counters[i].liveBytes;
+		statistics.categories[i].peakBytes = counters[i].peakBytes;
+		statistics.categories[i].allocationCount = counters[i].allocationCount;
+		statistics.categories[i].reallocationCount = counters[i].reallocationCount;
+		statistics.categories[i].freeCount = counters[i].freeCount;
+		statistics.categories[i].internalBytes = counters[i].internalBytes;
+	}
+
+	statistics.poolAllocationCount = poolAllocationCount;
+	statistics.arenaAllocationCount = arenaAllocationCount;
+	statistics.systemAllocationCount = systemAllocationCount;
+	statistics.reservedBytes = reservedBytes;
+
+	return statistics;
+}
+
+const char *HostAllocator::getCategoryName(HostCategory category)
+{
+	switch (category)
+	{
+	case HostCategory::Command:
+		return "command";
+	case HostCategory::Object:
+		return "object";
+	case HostCategory::Cache:
+		return "cache";
+	case HostCategory::Device:
+		return "device";
+	case HostCategory::Instance:
+		return "instance";
+	case HostCategory::Renderer:
+		return "renderer";
+	default:
+		return "unknown";
+	}
+}
+
+void *HostAllocator::allocateFromPool(uint32_t poolIndex)
+{
+	Pool &pool = pools[poolIndex];
+	std::lock_guard<std::mutex> lock(pool.mutex);
+
+	if (!pool.freeList)
+	{
+		void *chunk = std::malloc(CHUNK_SIZE + MIN_ALIGNMENT);
+		if (!chunk)
+			return nullptr;
+
+		pool.chunks.push_back(chunk);
+		reservedBytes += CHUNK_SIZE;
+
+		// Thread all slots of the new chunk onto the free list
+		uint8_t *slots = alignPointer(chunk, MIN_ALIGNMENT);
+		size_t slotCount = CHUNK_SIZE / pool.slotSize;
+
+		for (size_t i = slotCount; i > 0; --i)
+		{
+			void *slot = slots + (i - 1) * pool.slotSize;
+			*static_cast<void **>(slot) = pool.freeList;
+			pool.freeList = slot;
+		}
+	}
+
+	void *slot = pool.freeList;
+	pool.freeList = *static_cast<void **>(slot);
+
+	++poolAllocationCount;
+	return slot;
+}
+
+void HostAllocator::freeToPool(uint32_t poolIndex, void *slot)
+{
+	Pool &pool = pools[poolIndex];
+	std::lock_guard<std::mutex> lock(pool.mutex);
+
+	*static_cast<void **>(slot) = pool.freeList;
+	pool.freeList = slot;
+}
+
+void *HostAllocator::allocateFromArena(size_t size)
+{
+	std::lock_guard<std::mutex> lock(arena.mutex);
+
+	if (!arena.block)
+	{
+		arena.block = std::malloc(ARENA_SIZE + MIN_ALIGNMENT);
+		if (!arena.block)
+			return nullptr;
+
+		arena.memory = alignPointer(arena.block, MIN_ALIGNMENT);
+		reservedBytes += ARENA_SIZE;
+	}
+
+	size_t offset = (arena.offset + MIN_ALIGNMENT - 1) & ~(MIN_ALIGNMENT - 1);
+	if (offset + size > ARENA_SIZE)
+		return nullptr;
+
+	arena.offset = offset + size;
+	++arena.liveAllocations;
+
+	++arenaAllocationCount;
+	return arena.memory + offset;
+}
+
+void HostAllocator::freeToArena()
+{
+	std::lock_guard<std::mutex> lock(arena.mutex);
+
+	// Nothing is reused until the whole arena is empty again
+	if (--arena.liveAllocations == 0)
+		arena.offset = 0;
+}
+
+void HostAllocator::trackAllocation(HostCategory category, size_t size)
+{
+	CategoryCounters &counter = counters[static_cast<uint32_t>(category)];
+
+	uint64_t liveBytes = counter.liveBytes.fetch_add(size) + size;
+	uint64_t peakBytes = counter.peakBytes;
+
+	while (liveBytes > peakBytes && !counter.peakBytes.compare_exchange_weak(peakBytes, liveBytes))
+	{
+	}
+}
+
+void HostAllocator::trackFree(HostCategory category, size_t size)
+{
+	counters[static_cast<uint32_t>(category)].liveBytes -= size;
+}
+
+VKAPI_ATTR void *VKAPI_CALL HostAllocator::allocationCallback(
+	void *userData,
+	size_t size,
+	size_t alignment,
+	VkSystemAllocationScope scope)
+{
+	HostAllocator *allocator = static_cast<HostAllocator *>(userData);
+	return allocator->allocate(size, alignment, static_cast<HostCategory>(scope));
+}
+
+VKAPI_ATTR void *VKAPI_CALL HostAllocator::reallocationCallback(
+	void *userData,
+	void *original,
+	size_t size,
+	size_t alignment,
+	VkSystemAllocationScope scope)
+{
+	HostAllocator *allocator = static_cast<HostAllocator *>(userData);
+	return allocator->reallocate(original, size, alignment, static_cast<HostCategory>(scope));
+}
+
+VKAPI_ATTR void VKAPI_CALL HostAllocator::freeCallback(
+	void *userData,
+	void *memory)
+{
+	HostAllocator *allocator = static_cast<HostAllocator *>(userData);
+	allocator->free(memory);
+}
+
+VKAPI_ATTR void VKAPI_CALL HostAllocator::internalAllocationCallback(
+	void *userData,
+	size_t size,
+	VkInternalAllocationType type,
+	VkSystemAllocationScope scope)
+{
+	HostAllocator *allocator = static_cast<HostAllocator *>(userData);
+	allocator->counters[scope].internalBytes += size;
+}
+
+VKAPI_ATTR void VKAPI_CALL HostAllocator::internalFreeCallback(
+	void *userData,
+	size_t size,
+	VkInternalAllocationType type,
+	VkSystemAllocationScope scope)
+{
+	HostAllocator *allocator = static_cast<HostAllocator *>(userData);
+	allocator->counters[scope].internalBytes -= size;
+}
\ No newline at end of file
@@ -0,0 +1,647 @@
+#include "LearningVulkan/InstanceRenderer.hpp"
+#include "LearningVulkan/DeletionQueue.hpp"
+#include "LearningVulkan/JobSystem.hpp"
+#include "LearningVulkan/Renderer.hpp"
+#include "LearningVulkan/Utility.hpp"
+#include "LearningVulkan/WorkloadTrace.hpp"
+
+#include <algorithm>
+#include <assert.h>
+#include <cstring>
+
+// Batches never shrink below this many instances, so small batches do not
+// have to move around every time an instance is added
+const uint32_t MIN_BATCH_CAPACITY = 16;
+
+// Uploads smaller than this are copied on the calling thread, splitting them
+// into jobs would cost more than it saves
+const VkDeviceSize MIN_PARALLEL_UPLOAD_SIZE = 256 * 1024;
+
+InstanceRenderer::InstanceRenderer() :
+	device(VK_NULL_HANDLE),
+	allocator(nullptr),
+	jobSystem(nullptr),
+	deletionQueue(nullptr),
+	trace(nullptr),
+	maxInstances(0),
+	bufferCapacity(0),
+	isStagingCoherent(true),
+	instanceBuffer(VK_NULL_HANDLE),
+	instanceMemory(VK_NULL_HANDLE),
+	isDrawOrderDirty(false),
+	drawVersion(0),
+	instanceCount(0),
+	allocatedInstances(0),
+	copyDestination(nullptr)
+{
+	memoryProperties = {};
+}
+
+InstanceRenderer::~InstanceRenderer()
+{
+	destroy();
+}
+
+void InstanceRenderer::initialize(
+	const VulkanContext &context,
+	uint32_t initialInstances,
+	uint32_t maxInstances,
+	JobSystem &jobSystem,
+	DeletionQueue &deletionQueue)
+{
+	assert(initialInstances > 0 && initialInstances <= maxInstances,
+		"The instance buffer needs room for at least one instance.");
+
+	device = context.device;
+	allocator = context.allocator;
+	memoryProperties = context.physicalDeviceMemoryProperties;
+	this->jobSystem = &jobSystem;
+	this->deletionQueue = &deletionQueue;
+	this->maxInstances = maxInstances;
+
+	stagingBuffers.resize(context.framesInFlight);
+	stagingMemory.resize(context.framesInFlight);
+	stagingData.resize(context.framesInFlight);
+
+	createBuffers(initialInstances);
+}
+
+void InstanceRenderer::createBuffers(uint32_t capacity)
+{
+	bufferCapacity = capacity;
+
+	VkDeviceSize bufferSize = sizeof(InstanceData) * capacity;
+
+	Utility::createBuffer(
+		device,
+		allocator,
+		memoryProperties,
+		bufferSize,
+		VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+		VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+		instanceBuffer,
+		instanceMemory);
+
+	for (uint32_t i = 0; i < stagingBuffers.size(); ++i)
+	{
+		Utility::createBuffer(
+			device,
+			allocator,
+			memoryProperties,
+			bufferSize,
+			VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+			VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT,
+			stagingBuffers[i],
+			stagingMemory[i]);
+
+		// Stays mapped for the lifetime of the buffer
+		VkResult result = vkMapMemory(
+			device,
+			stagingMemory[i],
+			0,
+			VK_WHOLE_SIZE,
+			0,
+			&stagingData[i]);
+
+		Utility::checkVulkanResult(result, "Failed to map an instance staging buffer.");
+	}
+
+	// All staging buffers use the same memory type
+	VkMemoryRequirements memoryRequirements = {};
+	vkGetBufferMemoryRequirements(device, stagingBuffers[0], &memoryRequirements);
+
+	uint32_t memoryTypeIndex = 0;
+	Utility::findMemoryType(
+		memoryProperties,
+		memoryRequirements.memoryTypeBits,
+		VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT,
+		memoryTypeIndex);
+
+	isStagingCoherent =
+		(memoryProperties.memoryTypes[memoryTypeIndex].propertyFlags &
+		VK_MEMORY_PROPERTY_HOST_COHERENT_BIT) != 0;
+}
+
+void InstanceRenderer::growBuffers(uint32_t requiredInstances)
+{
+	uint32_t capacity = bufferCapacity;
+	while (capacity < requiredInstances && capacity < maxInstances)
+		capacity *= 2;
+
+	// Frames in flight may still copy from the staging buffers and draw from
+	// the instance buffer, freeing memory also unmaps it
+	for (uint32_t i = 0; i < stagingBuffers.size(); ++i)
+	{
+		deletionQueue->retire(VK_OBJECT_TYPE_BUFFER, reinterpret_cast<uint64_t>(stagingBuffers[i]));
+		deletionQueue->retire(VK_OBJECT_TYPE_DEVICE_MEMORY, reinterpret_cast<uint64_t>(stagingMemory[i]));
+	}
+
+	deletionQueue->retire(VK_OBJECT_TYPE_BUFFER, reinterpret_cast<uint64_t>(instanceBuffer));
+	deletionQueue->retire(VK_OBJECT_TYPE_DEVICE_MEMORY, reinterpret_cast<uint64_t>(instanceMemory));
+
+	createBuffers(std::min(capacity, maxInstances));
+
+	// The draws have to bind the new buffer
+	++drawVersion;
+}
+
+void InstanceRenderer::destroy()
+{
+	if (device == VK_NULL_HANDLE)
+		return;
+
+	for (uint32_t i = 0; i < stagingBuffers.size(); ++i)
+	{
+		vkUnmapMemory(device, stagingMemory[i]);
+		vkDestroyBuffer(device, stagingBuffers[i], allocator);
+		vkFreeMemory(device, stagingMemory[i], allocator);
+	}
+
+	vkDestroyBuffer(device, instanceBuffer, allocator);
+	vkFreeMemory(device, instanceMemory, allocator);
+
+	stagingBuffers.clear();
+	stagingMemory.clear();
+	stagingData.clear();
+	device = VK_NULL_HANDLE;
+}
+
+MeshId InstanceRenderer::addMesh(const InstanceMesh &mesh)
+{
+	meshes.push_back(mesh);
+	MeshId meshId = static_cast<MeshId>(meshes.size() - 1);
+
+	if (trace)
+		trace->addMesh(meshId, mesh);
+
+	return meshId;
+}
+
+MaterialId InstanceRenderer::addMaterial(const InstanceMaterial &material)
+{
+	materials.push_back(material);
+	MaterialId materialId = static_cast<MaterialId>(materials.size() - 1);
+
+	if (trace)
+		trace->addMaterial(materialId);
+
+	return materialId;
+}
+
+InstanceId InstanceRenderer::addInstance(
+	MeshId mesh,
+	MaterialId material,
+	const InstanceData &data)
+{
+	assert(mesh < meshes.size() && material < materials.size(),
+		"Unknown mesh or material.");
+
+	uint32_t batchIndex = findOrCreateBatch(mesh, material);
+
+	if (batches[batchIndex].instances.size() == batches[batchIndex].capacity)
+		growBatch(batchIndex);
+
+	// Reuse the IDs of removed instances
+	InstanceId instance;
+	if (!freeInstanceIds.empty())
+	{
+		instance = freeInstanceIds.back();
+		freeInstanceIds.pop_back();
+	}
+	else
+	{
+		instance = static_cast<InstanceId>(locations.size());
+		locations.push_back(InstanceLocation());
+	}
+
+	InstanceBatch &batch = batches[batchIndex];
+	uint32_t index = static_cast<uint32_t>(batch.instances.size());
+
+	batch.instances.push_back(data);
+	batch.owners.push_back(instance);
+	markDirty(batch, index, index + 1);
+
+	locations[instance].batch = batchIndex;
+	locations[instance].index = index;
+	++instanceCount;
+
+	// The instance count of the batch changed, and maybe its location
+	++drawVersion;
+
+	if (trace)
+		trace->addInstance(instance, mesh, material, data);
+
+	return instance;
+}
+
+void InstanceRenderer::updateInstance(InstanceId instance, const InstanceData &data)
+{
+	InstanceLocation location = locations[instance];
+	InstanceBatch &batch = batches[location.batch];
+
+	batch.instances[location.index] = data;
+	markDirty(batch, location.index, location.index + 1);
+
+	if (trace)
+		trace->updateInstance(instance, data);
+}
+
+void InstanceRenderer::removeInstance(InstanceId instance)
+{
+	InstanceLocation location = locations[instance];
+	InstanceBatch &batch = batches[location.batch];
+
+	// Move the last instance into the hole, so the batch stays contiguous
+	uint32_t lastIndex = static_cast<uint32_t>(batch.instances.size() - 1);
+	if (location.index != lastIndex)
+	{
+		batch.instances[location.index] = batch.instances[lastIndex];
+		batch.owners[location.index] = batch.owners[lastIndex];
+		locations[batch.owners[location.index]].index = location.index;
+
+		markDirty(batch, location.index, location.index + 1);
+	}
+
+	batch.instances.pop_back();
+	batch.owners.pop_back();
+
+	freeInstanceIds.push_back(instance);
+	--instanceCount;
+	++drawVersion;
+
+	if (trace)
+		trace->removeInstance(instance);
+}
+
+void InstanceRenderer::recordUploads(VkCommandBuffer commandBuffer, uint32_t frameSlot)
+{
+	copyRegions.clear();
+	copySources.clear();
+
+	VkDeviceSize uploadSize = 0;
+
+	for (auto &batch : batches)
+	{
+		if (batch.dirtyBegin >= batch.dirtyEnd)
+			continue;
+
+		// Removing instances can leave the dirty range past the end
+		uint32_t dirtyEnd = std::min(
+			batch.dirtyEnd,
+			static_cast<uint32_t>(batch.instances.size()));
+
+		if (batch.dirtyBegin < dirtyEnd)
+		{
+			// The staging buffer mirrors the layout of the instance buffer
+			VkBufferCopy region = {};
+			region.srcOffset = sizeof(InstanceData) * (batch.firstInstance + batch.dirtyBegin);
+			region.dstOffset = region.srcOffset;
+			region.size = sizeof(InstanceData) * (dirtyEnd - batch.dirtyBegin);
+
+			copyRegions.push_back(region);
+			copySources.push_back(&batch.instances[batch.dirtyBegin]);
+			uploadSize += region.size;
+		}
+
+		batch.dirtyBegin = UINT32_MAX;
+		batch.dirtyEnd = 0;
+	}
+
+	if (copyRegions.empty())
+		return;
+
+	// Fill the staging buffer, one job per batch for large uploads
+	copyDestination = static_cast<uint8_t *>(stagingData[frameSlot]);
+	uint32_t regionCount = static_cast<uint32_t>(copyRegions.size());
+
+	if (uploadSize >= MIN_PARALLEL_UPLOAD_SIZE && regionCount > 1)
+	{
+		JobCounter counter;
+		jobSystem->parallelFor(copyInstancesJob, this, regionCount, 1, counter);
+		jobSystem->wait(counter);
+	}
+	else
+	{
+		copyInstancesJob(this, 0, regionCount);
+	}
+
+	if (!isStagingCoherent)
+	{
+		VkMappedMemoryRange range = {};
+		range.sType = VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE;
+		range.memory = stagingMemory[frameSlot];
+		range.offset = 0;
+		range.size = VK_WHOLE_SIZE;
+		vkFlushMappedMemoryRanges(device, 1, &range);
+	}
+
+	// Previous frames may still be reading instances while drawing
+	VkBufferMemoryBarrier bufferBarrier = {};
+	bufferBarrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+	bufferBarrier.srcAccessMask = VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT;
+	bufferBarrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+	bufferBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	bufferBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	bufferBarrier.buffer = instanceBuffer;
+	bufferBarrier.offset = 0;
+	bufferBarrier.size = VK_WHOLE_SIZE;
+
+	vkCmdPipelineBarrier(
+		commandBuffer,
+		VK_PIPELINE_STAGE_VERTEX_INPUT_BIT,
+		VK_PIPELINE_STAGE_TRANSFER_BIT,
+		0,
+		0, nullptr,
+		1, &bufferBarrier,
+		0, nullptr);
+
+	vkCmdCopyBuffer(
+		commandBuffer,
+		stagingBuffers[frameSlot],
+		instanceBuffer,
+		static_cast<uint32_t>(copyRegions.size()),
+		copyRegions.data());
+
+	bufferBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+	bufferBarrier.dstAccessMask = VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT;
+
+	vkCmdPipelineBarrier(
+		commandBuffer,
+		VK_PIPELINE_STAGE_TRANSFER_BIT,
+		VK_PIPELINE_STAGE_VERTEX_INPUT_BIT,
+		0,
+		0, nullptr,
+		1, &bufferBarrier,
+		0, nullptr);
+}
+
+void InstanceRenderer::copyInstancesJob(void *data, uint32_t begin, uint32_t end)
+{
+	InstanceRenderer *renderer = static_cast<InstanceRenderer *>(data);
+
+	for (uint32_t i = begin; i < end; ++i)
+	{
+		const VkBufferCopy &region = renderer->copyRegions[i];
+
+		memcpy(
+			renderer->copyDestination + region.srcOffset,
+			renderer->copySources[i],
+			static_cast<size_t>(region.size));
+	}
+}
+
+void InstanceRenderer::recordDraws(VkCommandBuffer commandBuffer)
+{
+	if (isDrawOrderDirty)
+		sortBatches();
+
+	VkPipeline boundPipeline = VK_NULL_HANDLE;
+	VkDescriptorSet boundDescriptorSet = VK_NULL_HANDLE;
+
+	for (uint32_t batchIndex : drawOrder)
+	{
+		const InstanceBatch &batch = batches[batchIndex];
+		if (batch.instances.empty())
+			continue;
+
+		const InstanceMaterial &material = materials[batch.material];
+		const InstanceMesh &mesh = meshes[batch.mesh];
+
+		// Batches are sorted by material, so state only changes when needed
+		if (material.pipeline != boundPipeline)
+		{
+			vkCmdBindPipeline(
+				commandBuffer,
+				VK_PIPELINE_BIND_POINT_GRAPHICS,
+				material.pipeline);
+
+			boundPipeline = material.pipeline;
+		}
+
+		if (material.descriptorSet != VK_NULL_HANDLE &&
+			material.descriptorSet != boundDescriptorSet)
+		{
+			vkCmdBindDescriptorSets(
+				commandBuffer,
+				VK_PIPELINE_BIND_POINT_GRAPHICS,
+				material.pipelineLayout,
+				0,
+				1, &material.descriptorSet,
+				0, nullptr);
+
+			boundDescriptorSet = material.descriptorSet;
+		}
+
+		VkBuffer vertexBuffers[] = { mesh.vertexBuffer, instanceBuffer };
+		VkDeviceSize offsets[] = { 0, 0 };
+		vkCmdBindVertexBuffers(commandBuffer, 0, 2, vertexBuffers, offsets);
+
+		uint32_t batchInstanceCount = static_cast<uint32_t>(batch.instances.size());
+
+		if (mesh.indexBuffer != VK_NULL_HANDLE)
+		{
+			vkCmdBindIndexBuffer(commandBuffer, mesh.indexBuffer, 0, VK_INDEX_TYPE_UINT32);
+			vkCmdDrawIndexed(
+				commandBuffer,
+				mesh.indexCount,
+				batchInstanceCount,
+				0,
+				0,
+				batch.firstInstance);
+		}
+		else
+		{
+			vkCmdDraw(
+				commandBuffer,
+				mesh.vertexCount,
+				batchInstanceCount,
+				0,
+				batch.firstInstance);
+		}
+	}
+}
+
+void InstanceRenderer::setTrace(TraceWriter *trace)
+{
+	this->trace = trace;
+
+	if (!trace)
+		return;
+
+	// The replay has to start from the same state
+	for (MeshId i = 0; i < meshes.size(); ++i)
+		trace->addMesh(i, meshes[i]);
+
+	for (MaterialId i = 0; i < materials.size(); ++i)
+		trace->addMaterial(i);
+
+	std::vector<bool> isFree(locations.size(), false);
+	for (InstanceId instance : freeInstanceIds)
+		isFree[instance] = true;
+
+	for (InstanceId i = 0; i < locations.size(); ++i)
+	{
+		if (isFree[i])
+			continue;
+
+		const InstanceBatch &batch = batches[locations[i].batch];
+		trace->addInstance(i, batch.mesh, batch.material, batch.instances[locations[i].index]);
+	}
+}
+
+uint32_t InstanceRenderer::getInstanceCount() const
+{
+	return instanceCount;
+}
+
+uint32_t InstanceRenderer::getDrawCount() const
+{
+	uint32_t drawCount = 0;
+	for (const auto &batch : batches)
+	{
+		if (!batch.instances.empty())
+			++drawCount;
+	}
+
+	return drawCount;
+}
+
+uint32_t InstanceRenderer::getBufferCapacity() const
+{
+	return bufferCapacity;
+}
+
+uint64_t InstanceRenderer::getDrawVersion() const
+{
+	return drawVersion;
+}
+
+void InstanceRenderer::getVertexInputDescription(
+	VkVertexInputBindingDescription bindings[2],
+	VkVertexInputAttributeDescription attributes[5])
+{
+	bindings[0].binding = 0;
+	bindings[0].stride = sizeof(Vertex);
+	bindings[0].inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
+
+	bindings[1].binding = 1;
+	bindings[1].stride = sizeof(InstanceData);
+	bindings[1].inputRate = VK_VERTEX_INPUT_RATE_INSTANCE;
+
+	// Vertex position
+	attributes[0].location = 0;
+	attributes[0].binding = 0;
+	attributes[0].format = VK_FORMAT_R32G32B32_SFLOAT;
+	attributes[0].offset = 0;
+
+	// The three rows of the transform and the color
+	for (uint32_t i = 0; i < 4; ++i)
+	{
+		attributes[i + 1].location = i + 1;
+		attributes[i + 1].binding = 1;
+		attributes[i + 1].format = VK_FORMAT_R32G32B32A32_SFLOAT;
+		attributes[i + 1].offset = sizeof(float) * 4 * i;
+	}
+}
+
+uint32_t InstanceRenderer::findOrCreateBatch(MeshId mesh, MaterialId material)
+{
+	for (uint32_t i = 0; i < batches.size(); ++i)
+	{
+		if (batches[i].mesh == mesh && batches[i].material == material)
+			return i;
+	}
+
+	InstanceBatch batch;
+	batch.mesh = mesh;
+	batch.material = material;
+	batch.firstInstance = 0;
+	batch.capacity = 0;
+	batch.dirtyBegin = UINT32_MAX;
+	batch.dirtyEnd = 0;
+
+	batches.push_back(batch);
+	isDrawOrderDirty = true;
+
+	return static_cast<uint32_t>(batches.size() - 1);
+}
+
+void InstanceRenderer::growBatch(uint32_t batchIndex)
+{
+	InstanceBatch &batch = batches[batchIndex];
+	uint32_t newCapacity = std::max(batch.capacity * 2, MIN_BATCH_CAPACITY);
+
+	// Move the batch to the end of the buffer if it still fits there,
+	// otherwise pack all batches again
+	if (allocatedInstances + newCapacity <= bufferCapacity)
+	{
+		batch.firstInstance = allocatedInstances;
+		batch.capacity = newCapacity;
+		allocatedInstances += newCapacity;
+
+		markDirty(batch, 0, static_cast<uint32_t>(batch.instances.size()));
+	}
+	else
+	{
+		batch.capacity = newCapacity;
+		relayoutBatches();
+	}
+}
+
+void InstanceRenderer::relayoutBatches()
+{
+	uint32_t requiredInstances = 0;
+	for (const auto &batch : batches)
+		requiredInstances += batch.capacity;
+
+	// Every batch is uploaded again after the relayout, so a larger buffer
+	// needs none of the old contents
+	if (requiredInstances > bufferCapacity && bufferCapacity < maxInstances)
+		growBuffers(requiredInstances);
+
+	// Without enough room for the spare capacity, every batch only keeps room
+	// for a single extra instance
+	bool shrinkBatches = requiredInstances > bufferCapacity;
+
+	allocatedInstances = 0;
+
+	for (auto &batch : batches)
+	{
+		uint32_t size = static_cast<uint32_t>(batch.instances.size());
+
+		if (shrinkBatches)
+			batch.capacity = size + 1;
+
+		batch.firstInstance = allocatedInstances;
+		allocatedInstances += batch.capacity;
+
+		markDirty(batch, 0, size);
+	}
+
+	assert(allocatedInstances <= bufferCapacity,
+		"Exceeded the maximum number of instances.");
+}
+
+void InstanceRenderer::markDirty(InstanceBatch &batch, uint32_t begin, uint32_t end)
+{
+	batch.dirtyBegin = std::min(batch.dirtyBegin, begin);
+	batch.dirtyEnd = std::max(batch.dirtyEnd, end);
+}
+
+void InstanceRenderer::sortBatches()
+{
+	drawOrder.resize(batches.size());
+	for (uint32_t i = 0; i < drawOrder.size(); ++i)
+		drawOrder[i] = i;
+
+	// Sort by material first, pipeline changes are the most expensive
+	std::sort(drawOrder.begin(), drawOrder.end(), [this](uint32_t a, uint32_t b)
+	{
+		if (batches[a].material != batches[b].material)
+			return batches[a].material < batches[b].material;
+
+		return batches[a].mesh < batches[b].mesh;
+	});
+
+	isDrawOrderDirty = false;
+}
\ No newline at end of file
@@ -0,0 +1,270 @@
+#include "LearningVulkan/JobSystem.hpp"
+
+#include <algorithm>
+#include <assert.h>
+#include <chrono>
+
+// Jobs every worker can have queued or running at the same time, has to be a
+// power of two
+static const uint32_t MAX_JOBS_PER_WORKER = 4096;
+
+// How long an idle worker sleeps before looking for work again, in case it
+// missed a wake up
+static const std::chrono::milliseconds IDLE_INTERVAL(1);
+
+static std::atomic<uint32_t> nextJobSystemId(0);
+
+// Worker the current thread belongs to
+struct CurrentWorker
+{
+	uint32_t jobSystemId;
+	uint32_t workerIndex;
+};
+
+static thread_local CurrentWorker currentWorker = { UINT32_MAX, 0 };
+
+JobSystem::JobSystem() :
+	id(nextJobSystemId++),
+	stopWorkers(false),
+	queuedJobs(0)
+{
+}
+
+JobSystem::~JobSystem()
+{
+	destroy();
+}
+
+void JobSystem::initialize(uint32_t workerCount)
+{
+	if (workerCount == 0)
+		workerCount = std::max(std::thread::hardware_concurrency(), 1u);
+
+	stopWorkers = false;
+	queuedJobs = 0;
+
+	for (uint32_t i = 0; i < workerCount; ++i)
+	{
+		std::unique_ptr<Worker> worker(new Worker());
+		worker->jobPool.reset(new Job[MAX_JOBS_PER_WORKER]);
+		worker->allocatedJobs = 0;
+		worker->deque.reset(new std::atomic<Job *>[MAX_JOBS_PER_WORKER]);
+		worker->top = 0;
+		worker->bottom = 0;
+		worker->stealIndex = i;
+
+		workers.push_back(std::move(worker));
+	}
+
+	// The calling thread is worker 0
+	currentWorker.jobSystemId = id;
+	currentWorker.workerIndex = 0;
+
+	for (uint32_t i = 1; i < workerCount; ++i)
+		workers[i]->thread = std::thread(&JobSystem::runWorker, this, i);
+}
+
+void JobSystem::destroy()
+{
+	if (workers.empty())
+		return;
+
+	stopWorkers = true;
+	sleepCondition.notify_all();
+
+	for (uint32_t i = 1; i < workers.size(); ++i)
+		workers[i]->thread.join();
+
+	workers.clear();
+}
+
+void JobSystem::run(JobFunction function, void *data, uint32_t begin, uint32_t end, JobCounter &counter)
+{
+	Worker *worker = getCurrentWorker();
+	assert(worker != nullptr, "Jobs can only be submitted from worker threads.");
+
+	// With every slot of the pool or the deque taken the job runs right away,
+	// which only costs parallelism. The oldest slot is checked, as jobs can
+	// finish out of order on other workers.
+	Job *job = &worker->jobPool[worker->allocatedJobs & (MAX_JOBS_PER_WORKER - 1)];
+	int64_t queued = worker->bottom.load(std::memory_order_relaxed) - worker->top.load(std::memory_order_relaxed);
+
+	if (job->isPending.load(std::memory_order_acquire) || queued >= MAX_JOBS_PER_WORKER)
+	{
+		function(data, begin, end);
+		return;
+	}
+
+	++worker->allocatedJobs;
+	job->isPending.store(true, std::memory_order_relaxed);
+	job->function = function;
+	job->data = data;
+	job->begin = begin;
+	job->end = end;
+	job->counter = &counter;
+
+	counter.value.fetch_add(1, std::memory_order_relaxed);
+
+	push(*worker, job);
+	++queuedJobs;
+
+	sleepCondition.notify_one();
+}
+
+void JobSystem::parallelFor(JobFunction function, void *data, uint32_t count, uint32_t batchSize, JobCounter &counter)
+{
+	batchSize = std::max(batchSize, 1u);
+
+	for (uint32_t begin = 0; begin < count; begin += batchSize)
+		run(function, data, begin, std::min(begin + batchSize, count), counter);
+}
+
+void JobSystem::wait(JobCounter &counter)
+{
+	Worker *worker = getCurrentWorker();
+	assert(worker != nullptr, "Only worker threads can wait for jobs.");
+
+	// Help out instead of blocking, this also runs the jobs the counter is
+	// waiting for if nobody else picked them up yet
+	while (counter.value.load(std::memory_order_acquire) != 0)
+	{
+		Job *job = findJob(*worker);
+
+		if (job)
+			execute(job);
+		else
+			std::this_thread::yield();
+	}
+}
+
+uint32_t JobSystem::getWorkerCount() const
+{
+	return static_cast<uint32_t>(workers.size());
+}
+
+uint32_t JobSystem::getCurrentWorkerIndex() const
+{
+	return currentWorker.workerIndex;
+}
+
+JobSystem::Worker *JobSystem::getCurrentWorker()
+{
+	if (currentWorker.jobSystemId != id)
+		return nullptr;
+
+	return workers[currentWorker.workerIndex].get();
+}
+
+void JobSystem::push(Worker &worker, Job *job)
+{
+	int64_t bottom = worker.bottom.load(std::memory_order_relaxed);
+	worker.deque[bottom & (MAX_JOBS_PER_WORKER - 1)].store(job, std::memory_order_relaxed);
+
+	// The job has to be visible before thieves can see the new bottom
+	std::atomic_thread_fence(std::memory_order_release);
+	worker.bottom.store(bottom + 1, std::memory_order_relaxed);
+}
+
+JobSystem::Job *JobSystem::pop(Worker &worker)
+{
+	int64_t bottom = worker.bottom.load(std::memory_order_relaxed) - 1;
+	worker.bottom.store(bottom, std::memory_order_relaxed);
+
+	std::atomic_thread_fence(std::memory_order_seq_cst);
+	int64_t top = worker.top.load(std::memory_order_relaxed);
+
+	if (top > bottom)
+	{
+		// The deque was empty
+		worker.bottom.store(bottom + 1, std::memory_order_relaxed);
+		return nullptr;
+	}
+
+	Job *job = worker.deque[bottom & (MAX_JOBS_PER_WORKER - 1)].load(std::memory_order_relaxed);
+
+	if (top == bottom)
+	{
+		// Last job, race the thieves for it
+		if (!worker.top.compare_exchange_strong(top, top + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+			job = nullptr;
+
+		worker.bottom.store(bottom + 1, std::memory_order_relaxed);
+	}
+
+	return job;
+}
+
+JobSystem::Job *JobSystem::steal(Worker &worker)
+{
+	int64_t top = worker.top.load(std::memory_order_acquire);
+	std::atomic_thread_fence(std::memory_order_seq_cst);
+	int64_t bottom = worker.bottom.load(std::memory_order_acquire);
+
+	if (top >= bottom)
+		return nullptr;
+
+	Job *job = worker.deque[top & (MAX_JOBS_PER_WORKER - 1)].load(std::memory_order_relaxed);
+
+	// Another thief or the owner got there first
+	if (!worker.top.compare_exchange_strong(top, top + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+		return nullptr;
+
+	return job;
+}
+
+JobSystem::Job *JobSystem::findJob(Worker &worker)
+{
+	Job *job = pop(worker);
+
+	// Start with a different victim every time, so thieves spread out
+	uint32_t workerCount = static_cast<uint32_t>(workers.size());
+
+	for (uint32_t i = 1; i < workerCount && !job; ++i)
+	{
+		Worker &victim = *workers[(worker.stealIndex + i) % workerCount];
+		if (&victim != &worker)
+			job = steal(victim);
+	}
+
+	++worker.stealIndex;
+
+	if (job)
+		--queuedJobs;
+
+	return job;
+}
+
+void JobSystem::execute(Job *job)
+{
+	JobCounter *counter = job->counter;
+	job->function(job->data, job->begin, job->end);
+
+	// The owner may reuse the job as soon as it is no longer pending
+	job->isPending.store(false, std::memory_order_release);
+	counter->value.fetch_sub(1, std::memory_order_release);
+}
+
+void JobSystem::runWorker(uint32_t workerIndex)
+{
+	currentWorker.jobSystemId = id;
+	currentWorker.workerIndex = workerIndex;
+
+	Worker &worker = *workers[workerIndex];
+
+	while (!stopWorkers)
+	{
+		Job *job = findJob(worker);
+
+		if (job)
+		{
+			execute(job);
+			continue;
+		}
+
+		std::unique_lock<std::mutex> lock(sleepMutex);
+		sleepCondition.wait_for(lock, IDLE_INTERVAL, [this]()
+		{
+			return stopWorkers || queuedJobs > 0;
+		});
+	}
+}
\ No newline at end of file
@@ -0,0 +1,415 @@
+#include "LearningVulkan/LevelOfDetail.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <queue>
+
+// Symmetric 4x4 matrix that measures the squared distance of a point to a
+// set of planes
+struct Quadric
+{
+	double a00, a01, a02, a03;
+	double a11, a12, a13;
+	double a22, a23;
+	double a33;
+};
+
+struct EdgeCollapse
+{
+	double cost;
+	uint32_t keep;
+	uint32_t remove;
+	uint32_t keepVersion;
+	uint32_t removeVersion;
+	Vertex position;
+
+	// The priority queue pops the largest element, the cheapest collapse
+	// should come first
+	bool operator<(const EdgeCollapse &other) const
+	{
+		return cost > other.cost;
+	}
+};
+
+static void addPlane(Quadric &quadric, double a, double b, double c, double d)
+{
+	quadric.a00 += a * a; quadric.a01 += a * b; quadric.a02 += a * c; quadric.a03 += a * d;
+	quadric.a11 += b * b; quadric.a12 += b * c; quadric.a13 += b * d;
+	quadric.a22 += c * c; quadric.a23 += c * d;
+	quadric.a33 += d * d;
+}
+
+static void addQuadric(Quadric &quadric, const Quadric &other)
+{
+	quadric.a00 += other.a00; quadric.a01 += other.a01; quadric.a02 += other.a02; quadric.a03 += other.a03;
+	quadric.a11 += other.a11; quadric.a12 += other.a12; quadric.a13 += other.a13;
+	quadric.a22 += other.a22; quadric.a23 += other.a23;
+	quadric.a33 += other.a33;
+}
+
+static double evaluateQuadric(const Quadric &q, const Vertex &v)
+{
+	double x = v.x;
+	double y = v.y;
+	double z = v.z;
+
+	return	q.a00 * x * x + 2.0 * q.a01 * x * y + 2.0 * q.a02 * x * z + 2.0 * q.a03 * x +
+			q.a11 * y * y + 2.0 * q.a12 * y * z + 2.0 * q.a13 * y +
+			q.a22 * z * z + 2.0 * q.a23 * z +
+			q.a33;
+}
+
+static void computeNormal(const Vertex &a, const Vertex &b, const Vertex &c, double normal[3])
+{
+	double ux = b.x - a.x, uy = b.y - a.y, uz = b.z - a.z;
+	double vx = c.x - a.x, vy = c.y - a.y, vz = c.z - a.z;
+
+	normal[0] = uy * vz - uz * vy;
+	normal[1] = uz * vx - ux * vz;
+	normal[2] = ux * vy - uy * vx;
+}
+
+// Picks the cheapest of both end points and the midpoint, which avoids
+// having to invert the quadric
+static EdgeCollapse evaluateCollapse(
+	uint32_t keep,
+	uint32_t remove,
+	const std::vector<Vertex> &positions,
+	const std::vector<Quadric> &quadrics,
+	const std::vector<uint32_t> &versions)
+{
+	Quadric combined = quadrics[keep];
+	addQuadric(combined, quadrics[remove]);
+
+	const Vertex &a = positions[keep];
+	const Vertex &b = positions[remove];
+	Vertex midpoint = { (a.x + b.x) * 0.5f, (a.y + b.y) * 0.5f, (a.z + b.z) * 0.5f };
+
+	Vertex candidates[] = { a, b, midpoint };
+
+	EdgeCollapse collapse = {};
+	collapse.cost = HUGE_VAL;
+	collapse.keep = keep;
+	collapse.remove = remove;
+	collapse.keepVersion = versions[keep];
+	collapse.removeVersion = versions[remove];
+
+	for (const Vertex &candidate : candidates)
+	{
+		double cost = evaluateQuadric(combined, candidate);
+		if (cost < collapse.cost)
+		{
+			collapse.cost = cost;
+			collapse.position = candidate;
+		}
+	}
+
+	// Rounding can make the cost slightly negative
+	collapse.cost = std::max(collapse.cost, 0.0);
+	return collapse;
+}
+
+LodLevel simplifyMesh(const Mesh &mesh, uint32_t targetTriangleCount)
+{
+	uint32_t vertexCount = static_cast<uint32_t>(mesh.vertices.size());
+	uint32_t triangleCount = static_cast<uint32_t>(mesh.indices.size() / 3);
+
+	std::vector<Vertex> positions = mesh.vertices;
+	std::vector<uint32_t> triangles = mesh.indices;
+	std::vector<bool> isTriangleRemoved(triangleCount, false);
+	std::vector<bool> isVertexRemoved(vertexCount, false);
+	std::vector<uint32_t> versions(vertexCount, 0);
+	std::vector<Quadric> quadrics(vertexCount, Quadric());
+	std::vector<std::vector<uint32_t>> vertexTriangles(vertexCount);
+
+	// Every vertex starts out with the planes of the triangles around it
+	for (uint32_t t = 0; t < triangleCount; ++t)
+	{
+		const uint32_t *triangle = &triangles[t * 3];
+
+		double normal[3];
+		computeNormal(
+			positions[triangle[0]],
+			positions[triangle[1]],
+			positions[triangle[2]],
+			normal);
+
+		double length = std::sqrt(normal[0] * normal[0] + normal[1] * normal[1] + normal[2] * normal[2]);
+		if (length > 0.0)
+		{
+			double a = normal[0] / length;
+			double b = normal[1] / length;
+			double c = normal[2] / length;
+			double d = -(a * positions[triangle[0]].x + b * positions[triangle[0]].y + c * positions[triangle[0]].z);
+
+			for (uint32_t i = 0; i < 3; ++i)
+				addPlane(quadrics[triangle[i]], a, b, c, d);
+		}
+
+		for (uint32_t i = 0; i < 3; ++i)
+			vertexTriangles[triangle[i]].push_back(t);
+	}
+
+	std::priority_queue<EdgeCollapse> collapses;
+
+	for (uint32_t t = 0; t < triangleCount; ++t)
+	{
+		for (uint32_t i = 0; i < 3; ++i)
+		{
+			uint32_t a = triangles[t * 3 + i];
+			uint32_t b = triangles[t * 3 + (i + 1) % 3];
+
+			// Every interior edge is shared by two triangles, only add it once
+			if (a < b)
+				collapses.push(evaluateCollapse(a, b, positions, quadrics, versions));
+		}
+	}
+
+	uint32_t liveTriangleCount = triangleCount;
+	double maxError = 0.0;
+
+	while (liveTriangleCount > targetTriangleCount && !collapses.empty())
+	{
+		EdgeCollapse collapse = collapses.top();
+		collapses.pop();
+
+		// Skip collapses of vertices that changed since they were queued
+		if (isVertexRemoved[collapse.keep] || isVertexRemoved[collapse.remove] ||
+			versions[collapse.keep] != collapse.keepVersion ||
+			versions[collapse.remove] != collapse.removeVersion)
+		{
+			continue;
+		}
+
+		// Do not collapse if that would flip any of the remaining triangles
+		bool flipsTriangle = false;
+		for (uint32_t endpoint : { collapse.keep, collapse.remove })
+		{
+			for (uint32_t t : vertexTriangles[endpoint])
+			{
+				if (isTriangleRemoved[t])
+					continue;
+
+				uint32_t *triangle = &triangles[t * 3];
+				bool containsKeep = false;
+				bool containsRemove = false;
+
+				Vertex moved[3];
+				for (uint32_t i = 0; i < 3; ++i)
+				{
+					containsKeep |= (triangle[i] == collapse.keep);
+					containsRemove |= (triangle[i] == collapse.remove);
+
+					bool isEndpoint = (triangle[i] == collapse.keep || triangle[i] == collapse.remove);
+					moved[i] = isEndpoint ? collapse.position : positions[triangle[i]];
+				}
+
+				// Triangles on the edge itself disappear
+				if (containsKeep && containsRemove)
+					continue;
+
+				double before[3];
+				double after[3];
+				computeNormal(positions[triangle[0]], positions[triangle[1]], positions[triangle[2]], before);
+				computeNormal(moved[0], moved[1], moved[2], after);
+
+				if (before[0] * after[0] + before[1] * after[1] + before[2] * after[2] <= 0.0)
+				{
+					flipsTriangle = true;
+					break;
+				}
+			}
+
+			if (flipsTriangle)
+				break;
+		}
+
+		if (flipsTriangle)
+			continue;
+
+		// Move all triangles of the removed vertex over to the kept vertex
+		positions[collapse.keep] = collapse.position;
+		addQuadric(quadrics[collapse.keep], quadrics[collapse.remove]);
+		isVertexRemoved[collapse.remove] = true;
+		++versions[collapse.keep];
+
+		for (uint32_t t : vertexTriangles[collapse.remove])
+		{
+			if (isTriangleRemoved[t])
+				continue;
+
+			uint32_t *triangle = &triangles[t * 3];
+			for (uint32_t i = 0; i < 3; ++i)
+			{
+				if (triangle[i] == collapse.remove)
+					triangle[i] = collapse.keep;
+			}
+
+			if (triangle[0] == triangle[1] ||
+				triangle[1] == triangle[2] ||
+				triangle[2] == triangle[0])
+			{
+				isTriangleRemoved[t] = true;
+				--liveTriangleCount;
+			}
+			else
+			{
+				vertexTriangles[collapse.keep].push_back(t);
+			}
+		}
+
+		vertexTriangles[collapse.remove].clear();
+		maxError = std::max(maxError, collapse.cost);
+
+		// Drop triangles that no longer exist and queue the edges around the
+		// kept vertex with their new cost
+		std::vector<uint32_t> &keptTriangles = vertexTriangles[collapse.keep];
+		keptTriangles.erase(
+			std::remove_if(keptTriangles.begin(), keptTriangles.end(), [&](uint32_t t)
+			{
+				return isTriangleRemoved[t];
+			}),
+			keptTriangles.end());
+
+		for (uint32_t t : keptTriangles)
+		{
+			for (uint32_t i = 0; i < 3; ++i)
+			{
+				uint32_t neighbor = triangles[t * 3 + i];
+				if (neighbor != collapse.keep)
+					collapses.push(evaluateCollapse(collapse.keep, neighbor, positions, quadrics, versions));
+			}
+		}
+	}
+
+	// Copy the remaining triangles into a compact mesh
+	LodLevel level;
+	level.geometricError = static_cast<float>(std::sqrt(maxError));
+
+	std::vector<uint32_t> remap(vertexCount, UINT32_MAX);
+
+	for (uint32_t t = 0; t < triangleCount; ++t)
+	{
+		if (isTriangleRemoved[t])
+			continue;
+
+		for (uint32_t i = 0; i < 3; ++i)
+		{
+			uint32_t vertex = triangles[t * 3 + i];
+
+			if (remap[vertex] == UINT32_MAX)
+			{
+				remap[vertex] = static_cast<uint32_t>(level.mesh.vertices.size());
+				level.mesh.vertices.push_back(positions[vertex]);
+			}
+
+			level.mesh.indices.push_back(remap[vertex]);
+		}
+	}
+
+	return level;
+}
+
+LodChain buildLodChain(const Mesh &mesh, uint32_t levelCount, float reduction)
+{
+	LodChain chain;
+
+	LodLevel fullResolution;
+	fullResolution.mesh = mesh;
+	fullResolution.geometricError = 0.0f;
+	chain.push_back(fullResolution);
+
+	for (uint32_t i = 1; i < levelCount; ++i)
+	{
+		const LodLevel &previous = chain.back();
+		uint32_t previousTriangleCount = static_cast<uint32_t>(previous.mesh.indices.size() / 3);
+		uint32_t targetTriangleCount = static_cast<uint32_t>(previousTriangleCount * reduction);
+
+		// Every level is simplified from the one before it, so the errors add
+		// up (which overestimates, but never underestimates)
+		LodLevel level = simplifyMesh(previous.mesh, targetTriangleCount);
+		level.geometricError += previous.geometricError;
+
+		// Stop once the simplifier cannot remove anything else
+		if (level.mesh.indices.size() >= previous.mesh.indices.size())
+			break;
+
+		chain.push_back(level);
+	}
+
+	return chain;
+}
+
+LodSelector::LodSelector()
+{
+	settings.projectionScale = 1.0f;
+	settings.pixelThreshold = 1.0f;
+	settings.hysteresis = 0.1f;
+}
+
+LodSelector::~LodSelector()
+{
+}
+
+void LodSelector::setSettings(const LodSettings &settings)
+{
+	this->settings = settings;
+}
+
+void LodSelector::setObjectCount(uint32_t objectCount)
+{
+	currentLevels.resize(objectCount, 0);
+}
+
+uint32_t LodSelector::selectLevel(uint32_t object, const LodChain &chain, float distance)
+{
+	if (object >= currentLevels.size())
+		currentLevels.resize(object + 1, 0);
+
+	uint32_t levelCount = static_cast<uint32_t>(chain.size());
+	uint32_t current = std::min(currentLevels[object], levelCount - 1);
+
+	// Coarsest level that is still below the threshold
+	float lowerThreshold = settings.pixelThreshold * (1.0f - settings.hysteresis);
+	float upperThreshold = settings.pixelThreshold * (1.0f + settings.hysteresis);
+
+	uint32_t ideal = 0;
+	for (uint32_t i = 0; i < levelCount; ++i)
+	{
+		if (getScreenSpaceError(chain[i], distance) <= settings.pixelThreshold)
+			ideal = i;
+	}
+
+	uint32_t selected = current;
+
+	if (ideal > current)
+	{
+		// Only switch to a coarser level once it is well below the threshold
+		for (uint32_t i = ideal; i > current; --i)
+		{
+			if (getScreenSpaceError(chain[i], distance) <= lowerThreshold)
+			{
+				selected = i;
+				break;
+			}
+		}
+	}
+	else if (ideal < current)
+	{
+		// Only switch to a finer level once the current one is well above it
+		if (getScreenSpaceError(chain[current], distance) > upperThreshold)
+			selected = ideal;
+	}
+
+	currentLevels[object] = selected;
+	return selected;
+}
+
+float LodSelector::getScreenSpaceError(const LodLevel &level, float distance) const
+{
+	// Objects that touch the camera always use full detail
+	if (distance <= 0.0f)
+		return level.geometricError > 0.0f ? HUGE_VALF : 0.0f;
+
+	return level.geometricError * settings.projectionScale / distance;
+}
\ No newline at end of file
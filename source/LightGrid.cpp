@@ -0,0 +1,1223 @@
+#include "LearningVulkan/LightGrid.hpp"
+#include "LearningVulkan/JobSystem.hpp"
+#include "LearningVulkan/Renderer.hpp"
+#include "LearningVulkan/Utility.hpp"
+#include "LearningVulkan/WorkloadTrace.hpp"
+
+#include <algorithm>
+#include <assert.h>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+
+// View space bounds of a light: x, y, depth and radius
+const uint32_t LIGHT_BOUNDS_SIZE = 4;
+
+// Lights, cluster ranges, light indices, cluster edges and counters
+static const uint32_t LIGHT_BIN_BINDING_COUNT = 5;
+
+// Edges of the slices and tiles of a view, every cluster is the box around
+// the frustum cell between two of each
+struct ClusterEdges
+{
+	std::vector<float> depths;	// slices + 1 depths, near to far
+	std::vector<float> tanX;	// tilesX + 1 slopes, left to right
+	std::vector<float> tanY;	// tilesY + 1 slopes, top to bottom
+};
+
+static void computeClusterEdges(
+	const LightGridView &view,
+	const LightGridSettings &settings,
+	ClusterEdges &edges)
+{
+	edges.depths.resize(settings.slices + 1);
+	edges.tanX.resize(settings.tilesX + 1);
+	edges.tanY.resize(settings.tilesY + 1);
+
+	float depthRatio = view.farPlane / view.nearPlane;
+	for (uint32_t k = 0; k <= settings.slices; ++k)
+		edges.depths[k] = view.nearPlane * powf(depthRatio, static_cast<float>(k) / settings.slices);
+
+	for (uint32_t i = 0; i <= settings.tilesX; ++i)
+		edges.tanX[i] = (2.0f * i / settings.tilesX - 1.0f) * view.tanHalfFovX;
+
+	// Tiles count from the top of the screen, where y is largest
+	for (uint32_t j = 0; j <= settings.tilesY; ++j)
+		edges.tanY[j] = (1.0f - 2.0f * j / settings.tilesY) * view.tanHalfFovY;
+}
+
+// Range a slice covers between two slopes, the cell widens with the depth
+static void sliceRange(float tanBegin, float tanEnd, float nearDepth, float farDepth, float &low, float &high)
+{
+	low = std::min(tanBegin * nearDepth, tanBegin * farDepth);
+	high = std::max(tanEnd * nearDepth, tanEnd * farDepth);
+}
+
+static float distanceOutside(float value, float low, float high)
+{
+	if (value < low)
+		return low - value;
+
+	if (value > high)
+		return value - high;
+
+	return 0.0f;
+}
+
+static bool sphereIntersectsCluster(
+	const float bounds[LIGHT_BOUNDS_SIZE],
+	const ClusterEdges &edges,
+	uint32_t i,
+	uint32_t j,
+	uint32_t k)
+{
+	float nearDepth = edges.depths[k];
+	float farDepth = edges.depths[k + 1];
+
+	float lowX, highX, lowY, highY;
+	sliceRange(edges.tanX[i], edges.tanX[i + 1], nearDepth, farDepth, lowX, highX);
+	sliceRange(edges.tanY[j + 1], edges.tanY[j], nearDepth, farDepth, lowY, highY);
+
+	float dx = distanceOutside(bounds[0], lowX, highX);
+	float dy = distanceOutside(bounds[1], lowY, highY);
+	float dz = distanceOutside(bounds[2], nearDepth, farDepth);
+
+	return dx * dx + dy * dy + dz * dz <= bounds[3] * bounds[3];
+}
+
+static void transformLight(const PointLight &light, const LightGridView &view, float bounds[LIGHT_BOUNDS_SIZE])
+{
+	const float *m = view.viewMatrix;
+	const float *p = light.position;
+
+	bounds[0] = m[0] * p[0] + m[1] * p[1] + m[2] * p[2] + m[3];
+	bounds[1] = m[4] * p[0] + m[5] * p[1] + m[6] * p[2] + m[7];
+
+	// The camera looks down -z, depth grows away from it
+	bounds[2] = -(m[8] * p[0] + m[9] * p[1] + m[10] * p[2] + m[11]);
+	bounds[3] = light.radius;
+}
+
+void binLightsReference(
+	const std::vector<PointLight> &lights,
+	const LightGridView &view,
+	const LightGridSettings &settings,
+	LightGridData &data)
+{
+	ClusterEdges edges;
+	computeClusterEdges(view, settings, edges);
+
+	data.clusters.clear();
+	data.lightIndices.clear();
+	data.overflowCount = 0;
+
+	for (uint32_t k = 0; k < settings.slices; ++k)
+	{
+		for (uint32_t j = 0; j < settings.tilesY; ++j)
+		{
+			for (uint32_t i = 0; i < settings.tilesX; ++i)
+			{
+				ClusterRange cluster;
+				cluster.offset = static_cast<uint32_t>(data.lightIndices.size());
+				cluster.count = 0;
+
+				for (uint32_t l = 0; l < lights.size(); ++l)
+				{
+					float bounds[LIGHT_BOUNDS_SIZE];
+					transformLight(lights[l], view, bounds);
+
+					if (!sphereIntersectsCluster(bounds, edges, i, j, k))
+						continue;
+
+					if (cluster.count == settings.maxLightsPerCluster)
+					{
+						++data.overflowCount;
+						continue;
+					}
+
+					data.lightIndices.push_back(l);
+					++cluster.count;
+				}
+
+				data.clusters.push_back(cluster);
+			}
+		}
+	}
+}
+
+// What the slice jobs share
+struct LightBinningJob
+{
+	LightGrid *grid;
+	ClusterEdges edges;
+};
+
+LightGrid::LightGrid() :
+	device(VK_NULL_HANDLE),
+	allocator(nullptr),
+	jobSystem(nullptr),
+	maxLights(0),
+	isStagingCoherent(true),
+	isReadbackCoherent(true),
+	supportsTimestamps(false),
+	timestampPeriod(0.0f),
+	lightBuffer(VK_NULL_HANDLE),
+	lightMemory(VK_NULL_HANDLE),
+	clusterBuffer(VK_NULL_HANDLE),
+	clusterMemory(VK_NULL_HANDLE),
+	indexBuffer(VK_NULL_HANDLE),
+	indexMemory(VK_NULL_HANDLE),
+	viewBuffer(VK_NULL_HANDLE),
+	viewMemory(VK_NULL_HANDLE),
+	edgeBuffer(VK_NULL_HANDLE),
+	edgeMemory(VK_NULL_HANDLE),
+	counterBuffer(VK_NULL_HANDLE),
+	counterMemory(VK_NULL_HANDLE),
+	gridReadbackBuffer(VK_NULL_HANDLE),
+	gridReadbackMemory(VK_NULL_HANDLE),
+	gridReadbackData(nullptr),
+	isReadbackRequested(false),
+	hasGridReadback(false),
+	timestampQueryPool(VK_NULL_HANDLE),
+	descriptorSetLayout(VK_NULL_HANDLE),
+	descriptorPool(VK_NULL_HANDLE),
+	descriptorSet(VK_NULL_HANDLE),
+	pipelineLayout(VK_NULL_HANDLE),
+	binPipeline(VK_NULL_HANDLE),
+	hasView(false),
+	isDirty(false),
+	trace(nullptr),
+	buildVersion(0),
+	uploadedVersion(0)
+{
+	memoryProperties = {};
+	settings = {};
+	view = {};
+	data.overflowCount = 0;
+	statistics = {};
+}
+
+LightGrid::~LightGrid()
+{
+	destroy();
+}
+
+void LightGrid::initialize(
+	const VulkanContext &context,
+	const LightGridSettings &settings,
+	uint32_t maxLights,
+	JobSystem &jobSystem)
+{
+	assert(settings.tilesX > 0 && settings.tilesY > 0 && settings.slices > 0,
+		"The light grid needs at least one cluster.");
+
+	device = context.device;
+	allocator = context.allocator;
+	memoryProperties = context.physicalDeviceMemoryProperties;
+	this->jobSystem = &jobSystem;
+	this->settings = settings;
+	this->maxLights = maxLights;
+
+	// The binning pass is timed where the queue supports it
+	supportsTimestamps = context.supportsTimestamps;
+	timestampPeriod = context.physicalDeviceProperties.limits.timestampPeriod;
+
+	uint32_t clusterCount = settings.tilesX * settings.tilesY * settings.slices;
+	VkDeviceSize lightSize = sizeof(PointLight) * maxLights;
+	VkDeviceSize clusterSize = sizeof(ClusterRange) * clusterCount;
+	VkDeviceSize indexSize = sizeof(uint32_t) * clusterCount * settings.maxLightsPerCluster;
+
+	clusterLights.resize(clusterCount * settings.maxLightsPerCluster);
+	clusterCounts.resize(clusterCount);
+	sliceOverflowCounts.resize(settings.slices);
+
+	Utility::createBuffer(
+		device,
+		allocator,
+		context.physicalDeviceMemoryProperties,
+		lightSize,
+		VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+		VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+		lightBuffer,
+		lightMemory);
+
+	Utility::createBuffer(
+		device,
+		allocator,
+		context.physicalDeviceMemoryProperties,
+		clusterSize,
+		VK_BUFFER_USAGE_STORAGE_BUFFER_BIT |
+		VK_BUFFER_USAGE_TRANSFER_SRC_BIT |
+		VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+		VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+		clusterBuffer,
+		clusterMemory);
+
+	Utility::createBuffer(
+		device,
+		allocator,
+		context.physicalDeviceMemoryProperties,
+		indexSize,
+		VK_BUFFER_USAGE_STORAGE_BUFFER_BIT |
+		VK_BUFFER_USAGE_TRANSFER_SRC_BIT |
+		VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+		VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+		indexBuffer,
+		indexMemory);
+
+	Utility::createBuffer(
+		device,
+		allocator,
+		context.physicalDeviceMemoryProperties,
+		sizeof(LightGridShadingView),
+		VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+		VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+		viewBuffer,
+		viewMemory);
+
+	stagingBuffers.resize(context.framesInFlight);
+	stagingMemory.resize(context.framesInFlight);
+	stagingData.resize(context.framesInFlight);
+
+	for (uint32_t i = 0; i < context.framesInFlight; ++i)
+	{
+		Utility::createBuffer(
+			device,
+			allocator,
+			context.physicalDeviceMemoryProperties,
+			lightSize + clusterSize + indexSize + sizeof(LightGridShadingView),
+			VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+			VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT,
+			stagingBuffers[i],
+			stagingMemory[i]);
+
+		// Stays mapped for the lifetime of the buffer
+		VkResult result = vkMapMemory(
+			device,
+			stagingMemory[i],
+			0,
+			VK_WHOLE_SIZE,
+			0,
+			&stagingData[i]);
+
+		Utility::checkVulkanResult(result, "Failed to map a light grid staging buffer.");
+	}
+
+	// All staging buffers use the same memory type
+	VkMemoryRequirements memoryRequirements = {};
+	vkGetBufferMemoryRequirements(device, stagingBuffers[0], &memoryRequirements);
+
+	uint32_t memoryTypeIndex = 0;
+	Utility::findMemoryType(
+		context.physicalDeviceMemoryProperties,
+		memoryRequirements.memoryTypeBits,
+		VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT,
+		memoryTypeIndex);
+
+	isStagingCoherent =
+		(context.physicalDeviceMemoryProperties.memoryTypes[memoryTypeIndex].propertyFlags &
+		VK_MEMORY_PROPERTY_HOST_COHERENT_BIT) != 0;
+}
+
+void LightGrid::destroy()
+{
+	if (device == VK_NULL_HANDLE)
+		return;
+
+	for (uint32_t i = 0; i < stagingBuffers.size(); ++i)
+	{
+		vkUnmapMemory(device, stagingMemory[i]);
+		vkDestroyBuffer(device, stagingBuffers[i], allocator);
+		vkFreeMemory(device, stagingMemory[i], allocator);
+	}
+
+	vkDestroyBuffer(device, lightBuffer, allocator);
+	vkFreeMemory(device, lightMemory, allocator);
+	vkDestroyBuffer(device, clusterBuffer, allocator);
+	vkFreeMemory(device, clusterMemory, allocator);
+	vkDestroyBuffer(device, indexBuffer, allocator);
+	vkFreeMemory(device, indexMemory, allocator);
+	vkDestroyBuffer(device, viewBuffer, allocator);
+	vkFreeMemory(device, viewMemory, allocator);
+
+	// Only created for binning on the GPU
+	for (uint32_t i = 0; i < readbackBuffers.size(); ++i)
+	{
+		vkUnmapMemory(device, readbackMemory[i]);
+		vkDestroyBuffer(device, readbackBuffers[i], allocator);
+		vkFreeMemory(device, readbackMemory[i], allocator);
+	}
+
+	if (gridReadbackData)
+		vkUnmapMemory(device, gridReadbackMemory);
+
+	vkDestroyBuffer(device, gridReadbackBuffer, allocator);
+	vkFreeMemory(device, gridReadbackMemory, allocator);
+	vkDestroyBuffer(device, edgeBuffer, allocator);
+	vkFreeMemory(device, edgeMemory, allocator);
+	vkDestroyBuffer(device, counterBuffer, allocator);
+	vkFreeMemory(device, counterMemory, allocator);
+	vkDestroyQueryPool(device, timestampQueryPool, allocator);
+	vkDestroyPipeline(device, binPipeline, allocator);
+	vkDestroyPipelineLayout(device, pipelineLayout, allocator);
+	vkDestroyDescriptorPool(device, descriptorPool, allocator);
+	vkDestroyDescriptorSetLayout(device, descriptorSetLayout, allocator);
+
+	stagingBuffers.clear();
+	stagingMemory.clear();
+	stagingData.clear();
+	readbackBuffers.clear();
+	readbackMemory.clear();
+	readbackData.clear();
+	hasReadback.clear();
+	gridReadbackData = nullptr;
+	binPipeline = VK_NULL_HANDLE;
+	device = VK_NULL_HANDLE;
+}
+
+void LightGrid::createPipelines(const LightGridShaders &shaders, VkPipelineCache pipelineCache)
+{
+	assert(binPipeline == VK_NULL_HANDLE, "The light binning pipeline was created already.");
+
+	uint32_t framesInFlight = static_cast<uint32_t>(stagingBuffers.size());
+	uint32_t clusterCount = settings.tilesX * settings.tilesY * settings.slices;
+	uint32_t edgeCount = settings.slices + settings.tilesX + settings.tilesY + 3;
+	VkDeviceSize clusterSize = sizeof(ClusterRange) * clusterCount;
+	VkDeviceSize indexSize = sizeof(uint32_t) * clusterCount * settings.maxLightsPerCluster;
+
+	Utility::createBuffer(
+		device,
+		allocator,
+		memoryProperties,
+		sizeof(float) * edgeCount,
+		VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+		VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+		edgeBuffer,
+		edgeMemory);
+
+	Utility::createBuffer(
+		device,
+		allocator,
+		memoryProperties,
+		sizeof(LightBinCounters),
+		VK_BUFFER_USAGE_STORAGE_BUFFER_BIT |
+		VK_BUFFER_USAGE_TRANSFER_SRC_BIT |
+		VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+		VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+		counterBuffer,
+		counterMemory);
+
+	readbackBuffers.resize(framesInFlight);
+	readbackMemory.resize(framesInFlight);
+	readbackData.resize(framesInFlight);
+	hasReadback.assign(framesInFlight, false);
+
+	for (uint32_t i = 0; i < framesInFlight; ++i)
+	{
+		Utility::createBuffer(
+			device,
+			allocator,
+			memoryProperties,
+			sizeof(LightBinCounters),
+			VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+			VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT,
+			readbackBuffers[i],
+			readbackMemory[i]);
+
+		VkResult result = vkMapMemory(device, readbackMemory[i], 0, VK_WHOLE_SIZE, 0, &readbackData[i]);
+		Utility::checkVulkanResult(result, "Failed to map a light grid readback buffer.");
+	}
+
+	// The clusters, then the indices, then the counters
+	Utility::createBuffer(
+		device,
+		allocator,
+		memoryProperties,
+		clusterSize + indexSize + sizeof(LightBinCounters),
+		VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+		VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT,
+		gridReadbackBuffer,
+		gridReadbackMemory);
+
+	VkResult result = vkMapMemory(device, gridReadbackMemory, 0, VK_WHOLE_SIZE, 0, &gridReadbackData);
+	Utility::checkVulkanResult(result, "Failed to map the light grid readback buffer.");
+
+	// All readback buffers use the same memory type
+	VkMemoryRequirements memoryRequirements = {};
+	vkGetBufferMemoryRequirements(device, gridReadbackBuffer, &memoryRequirements);
+
+	uint32_t memoryTypeIndex = 0;
+	Utility::findMemoryType(
+		memoryProperties,
+		memoryRequirements.memoryTypeBits,
+		VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT,
+		memoryTypeIndex);
+
+	isReadbackCoherent =
+		(memoryProperties.memoryTypes[memoryTypeIndex].propertyFlags &
+		VK_MEMORY_PROPERTY_HOST_COHERENT_BIT) != 0;
+
+	// Start and end of the binning pass of every frame slot
+	if (supportsTimestamps)
+	{
+		VkQueryPoolCreateInfo queryPoolCreateInfo = {};
+		queryPoolCreateInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+		queryPoolCreateInfo.queryType = VK_QUERY_TYPE_TIMESTAMP;
+		queryPoolCreateInfo.queryCount = framesInFlight * 2;
+
+		result = vkCreateQueryPool(device, &queryPoolCreateInfo, allocator, &timestampQueryPool);
+		Utility::checkVulkanResult(result, "Failed to create the light binning query pool.");
+	}
+
+	VkDescriptorSetLayoutBinding bindings[LIGHT_BIN_BINDING_COUNT] = {};
+	for (uint32_t i = 0; i < LIGHT_BIN_BINDING_COUNT; ++i)
+	{
+		bindings[i].binding = i;
+		bindings[i].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+		bindings[i].descriptorCount = 1;
+		bindings[i].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+	}
+
+	VkDescriptorSetLayoutCreateInfo setLayoutCreateInfo = {};
+	setLayoutCreateInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+	setLayoutCreateInfo.bindingCount = LIGHT_BIN_BINDING_COUNT;
+	setLayoutCreateInfo.pBindings = bindings;
+
+	result = vkCreateDescriptorSetLayout(device, &setLayoutCreateInfo, allocator, &descriptorSetLayout);
+	Utility::checkVulkanResult(result, "Failed to create the light binning descriptor set layout.");
+
+	VkDescriptorPoolSize poolSize = {};
+	poolSize.type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+	poolSize.descriptorCount = LIGHT_BIN_BINDING_COUNT;
+
+	VkDescriptorPoolCreateInfo poolCreateInfo = {};
+	poolCreateInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+	poolCreateInfo.maxSets = 1;
+	poolCreateInfo.poolSizeCount = 1;
+	poolCreateInfo.pPoolSizes = &poolSize;
+
+	result = vkCreateDescriptorPool(device, &poolCreateInfo, allocator, &descriptorPool);
+	Utility::checkVulkanResult(result, "Failed to create the light binning descriptor pool.");
+
+	VkDescriptorSetAllocateInfo setAllocateInfo = {};
+	setAllocateInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+	setAllocateInfo.descriptorPool = descriptorPool;
+	setAllocateInfo.descriptorSetCount = 1;
+	setAllocateInfo.pSetLayouts = &descriptorSetLayout;
+
+	result = vkAllocateDescriptorSets(device, &setAllocateInfo, &descriptorSet);
+	Utility::checkVulkanResult(result, "Failed to allocate the light binning descriptor set.");
+
+	VkBuffer buffers[LIGHT_BIN_BINDING_COUNT] = { lightBuffer, clusterBuffer, indexBuffer, edgeBuffer, counterBuffer };
+
+	VkDescriptorBufferInfo bufferInfos[LIGHT_BIN_BINDING_COUNT] = {};
+	for (uint32_t i = 0; i < LIGHT_BIN_BINDING_COUNT; ++i)
+	{
+		bufferInfos[i].buffer = buffers[i];
+		bufferInfos[i].range = VK_WHOLE_SIZE;
+	}
+
+	VkWriteDescriptorSet descriptorWrite = {};
+	descriptorWrite.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+	descriptorWrite.dstSet = descriptorSet;
+	descriptorWrite.dstBinding = 0;
+	descriptorWrite.descriptorCount = LIGHT_BIN_BINDING_COUNT;
+	descriptorWrite.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+	descriptorWrite.pBufferInfo = bufferInfos;
+
+	vkUpdateDescriptorSets(device, 1, &descriptorWrite, 0, nullptr);
+
+	VkPushConstantRange pushConstantRange = {};
+	pushConstantRange.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+	pushConstantRange.offset = 0;
+	pushConstantRange.size = sizeof(LightBinStep);
+
+	VkPipelineLayoutCreateInfo layoutCreateInfo = {};
+	layoutCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+	layoutCreateInfo.setLayoutCount = 1;
+	layoutCreateInfo.pSetLayouts = &descriptorSetLayout;
+	layoutCreateInfo.pushConstantRangeCount = 1;
+	layoutCreateInfo.pPushConstantRanges = &pushConstantRange;
+
+	result = vkCreatePipelineLayout(device, &layoutCreateInfo, allocator, &pipelineLayout);
+	Utility::checkVulkanResult(result, "Failed to create the light binning pipeline layout.");
+
+	VkShaderModuleCreateInfo moduleCreateInfo = {};
+	moduleCreateInfo.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
+	moduleCreateInfo.codeSize = sizeof(uint32_t) * shaders.bin.size();
+	moduleCreateInfo.pCode = shaders.bin.data();
+
+	VkShaderModule binModule = VK_NULL_HANDLE;
+	result = vkCreateShaderModule(device, &moduleCreateInfo, allocator, &binModule);
+	Utility::checkVulkanResult(result, "Failed to create the light binning shader module.");
+
+	VkComputePipelineCreateInfo pipelineCreateInfo = {};
+	pipelineCreateInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+	pipelineCreateInfo.stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+	pipelineCreateInfo.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+	pipelineCreateInfo.stage.module = binModule;
+	pipelineCreateInfo.stage.pName = "main";
+	pipelineCreateInfo.layout = pipelineLayout;
+
+	result = vkCreateComputePipelines(device, pipelineCache, 1, &pipelineCreateInfo, allocator, &binPipeline);
+	Utility::checkVulkanResult(result, "Failed to create the light binning pipeline.");
+
+	// The pipeline keeps what it needs from the module
+	vkDestroyShaderModule(device, binModule, allocator);
+
+	// The next build is binned on the GPU
+	isDirty = true;
+}
+
+void LightGrid::setLights(const PointLight *lights, uint32_t lightCount)
+{
+	assert(lightCount <= maxLights, "Exceeded the maximum number of lights.");
+
+	this->lights.assign(lights, lights + lightCount);
+	isDirty = true;
+
+	if (trace)
+		trace->setLights(lights, lightCount);
+}
+
+void LightGrid::setView(const LightGridView &view)
+{
+	assert(view.nearPlane > 0.0f && view.farPlane > view.nearPlane,
+		"The light grid needs a near plane in front of the far plane.");
+
+	// Static cameras keep the grid of the last frame
+	if (hasView && memcmp(&this->view, &view, sizeof(view)) == 0)
+		return;
+
+	this->view = view;
+	hasView = true;
+	isDirty = true;
+
+	if (trace)
+		trace->setLightView(view);
+}
+
+void LightGrid::setTrace(TraceWriter *trace)
+{
+	this->trace = trace;
+
+	if (!trace)
+		return;
+
+	// The replay has to start from the same lights and camera
+	trace->setLights(lights.data(), static_cast<uint32_t>(lights.size()));
+
+	if (hasView)
+		trace->setLightView(view);
+}
+
+void LightGrid::build()
+{
+	if (!isDirty || !hasView)
+		return;
+
+	typedef std::chrono::steady_clock Clock;
+	Clock::time_point buildStart = Clock::now();
+
+	uint32_t lightCount = static_cast<uint32_t>(lights.size());
+
+	// The binning pass runs while the frame is recorded, its counters
+	// arrive with the frame
+	if (binPipeline != VK_NULL_HANDLE)
+	{
+		isDirty = false;
+		++buildVersion;
+
+		statistics.binTime = std::chrono::duration<double, std::milli>(Clock::now() - buildStart).count();
+		statistics.lightCount = lightCount;
+		return;
+	}
+
+	viewSpaceLights.resize(lightCount * LIGHT_BOUNDS_SIZE);
+	for (uint32_t l = 0; l < lightCount; ++l)
+		transformLight(lights[l], view, &viewSpaceLights[l * LIGHT_BOUNDS_SIZE]);
+
+	LightBinningJob job;
+	job.grid = this;
+	computeClusterEdges(view, settings, job.edges);
+
+	// Every slice only writes its own clusters
+	JobCounter counter;
+	jobSystem->parallelFor(binSlicesJob, &job, settings.slices, 1, counter);
+	jobSystem->wait(counter);
+
+	// Pack the clusters into one list, in the same order as the reference
+	uint32_t clusterCount = static_cast<uint32_t>(clusterCounts.size());
+	data.clusters.resize(clusterCount);
+	data.lightIndices.clear();
+	data.overflowCount = 0;
+
+	statistics = {};
+
+	for (uint32_t c = 0; c < clusterCount; ++c)
+	{
+		uint32_t count = clusterCounts[c];
+		const uint32_t *clusterBegin = &clusterLights[c * settings.maxLightsPerCluster];
+
+		data.clusters[c].offset = static_cast<uint32_t>(data.lightIndices.size());
+		data.clusters[c].count = count;
+		data.lightIndices.insert(data.lightIndices.end(), clusterBegin, clusterBegin + count);
+
+		if (count > 0)
+			++statistics.occupiedClusterCount;
+
+		statistics.maxClusterLightCount = std::max(statistics.maxClusterLightCount, count);
+	}
+
+	for (uint32_t overflowCount : sliceOverflowCounts)
+		data.overflowCount += overflowCount;
+
+	isDirty = false;
+	++buildVersion;
+
+	statistics.binTime = std::chrono::duration<double, std::milli>(Clock::now() - buildStart).count();
+	statistics.lightCount = lightCount;
+	statistics.lightIndexCount = static_cast<uint32_t>(data.lightIndices.size());
+	statistics.overflowCount = data.overflowCount;
+}
+
+void LightGrid::binSlicesJob(void *data, uint32_t begin, uint32_t end)
+{
+	LightBinningJob &job = *static_cast<LightBinningJob *>(data);
+	LightGrid &grid = *job.grid;
+	const ClusterEdges &edges = job.edges;
+	const LightGridSettings &settings = grid.settings;
+
+	uint32_t lightCount = static_cast<uint32_t>(grid.lights.size());
+	uint32_t clustersPerSlice = settings.tilesX * settings.tilesY;
+
+	for (uint32_t k = begin; k < end; ++k)
+	{
+		uint32_t *counts = &grid.clusterCounts[k * clustersPerSlice];
+		uint32_t *sliceLights = &grid.clusterLights[k * clustersPerSlice * settings.maxLightsPerCluster];
+		uint32_t overflowCount = 0;
+
+		std::fill(counts, counts + clustersPerSlice, 0);
+
+		float nearDepth = edges.depths[k];
+		float farDepth = edges.depths[k + 1];
+
+		for (uint32_t l = 0; l < lightCount; ++l)
+		{
+			const float *bounds = &grid.viewSpaceLights[l * LIGHT_BOUNDS_SIZE];
+			float radius = bounds[3];
+
+			if (bounds[2] + radius < nearDepth || bounds[2] - radius > farDepth)
+				continue;
+
+			// Columns and rows whose slab of the slice the light's box
+			// touches, the exact test below rejects the corners
+			uint32_t beginX = settings.tilesX, endX = 0;
+			for (uint32_t i = 0; i < settings.tilesX; ++i)
+			{
+				float low, high;
+				sliceRange(edges.tanX[i], edges.tanX[i + 1], nearDepth, farDepth, low, high);
+
+				if (bounds[0] + radius >= low && bounds[0] - radius <= high)
+				{
+					beginX = std::min(beginX, i);
+					endX = i + 1;
+				}
+			}
+
+			uint32_t beginY = settings.tilesY, endY = 0;
+			for (uint32_t j = 0; j < settings.tilesY; ++j)
+			{
+				float low, high;
+				sliceRange(edges.tanY[j + 1], edges.tanY[j], nearDepth, farDepth, low, high);
+
+				if (bounds[1] + radius >= low && bounds[1] - radius <= high)
+				{
+					beginY = std::min(beginY, j);
+					endY = j + 1;
+				}
+			}
+
+			for (uint32_t j = beginY; j < endY; ++j)
+			{
+				for (uint32_t i = beginX; i < endX; ++i)
+				{
+					if (!sphereIntersectsCluster(bounds, edges, i, j, k))
+						continue;
+
+					uint32_t cluster = j * settings.tilesX + i;
+					if (counts[cluster] == settings.maxLightsPerCluster)
+					{
+						++overflowCount;
+						continue;
+					}
+
+					sliceLights[cluster * settings.maxLightsPerCluster + counts[cluster]++] = l;
+				}
+			}
+		}
+
+		grid.sliceOverflowCounts[k] = overflowCount;
+	}
+}
+
+void LightGrid::recordUploads(VkCommandBuffer commandBuffer, uint32_t frameSlot)
+{
+	if (binPipeline != VK_NULL_HANDLE)
+	{
+		// The fence of the slot means its counters and timestamps are ready
+		readCounters(frameSlot);
+
+		if (uploadedVersion != buildVersion)
+			recordBinning(commandBuffer, frameSlot);
+
+		if (isReadbackRequested && uploadedVersion != 0)
+			recordGridReadback(commandBuffer);
+
+		return;
+	}
+
+	// The buffers are shared by all frame slots and already hold this build
+	if (uploadedVersion == buildVersion)
+		return;
+
+	uint32_t clusterCount = static_cast<uint32_t>(data.clusters.size());
+	VkDeviceSize lightSize = sizeof(PointLight) * maxLights;
+	VkDeviceSize clusterSize = sizeof(ClusterRange) * clusterCount;
+
+	// Same layout as the staging buffer, only the used part is copied
+	VkBufferCopy regions[4] = {};
+	regions[0].srcOffset = 0;
+	regions[0].size = sizeof(PointLight) * lights.size();
+	regions[1].srcOffset = lightSize;
+	regions[1].size = clusterSize;
+	regions[2].srcOffset = lightSize + clusterSize;
+	regions[2].size = sizeof(uint32_t) * data.lightIndices.size();
+	regions[3].srcOffset = getViewStagingOffset();
+	regions[3].size = sizeof(LightGridShadingView);
+
+	LightGridShadingView shadingView;
+	getShadingView(shadingView);
+
+	uint8_t *staging = static_cast<uint8_t *>(stagingData[frameSlot]);
+	memcpy(staging + regions[0].srcOffset, lights.data(), static_cast<size_t>(regions[0].size));
+	memcpy(staging + regions[1].srcOffset, data.clusters.data(), static_cast<size_t>(regions[1].size));
+	memcpy(staging + regions[2].srcOffset, data.lightIndices.data(), static_cast<size_t>(regions[2].size));
+	memcpy(staging + regions[3].srcOffset, &shadingView, sizeof(shadingView));
+
+	if (!isStagingCoherent)
+	{
+		VkMappedMemoryRange range = {};
+		range.sType = VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE;
+		range.memory = stagingMemory[frameSlot];
+		range.offset = 0;
+		range.size = VK_WHOLE_SIZE;
+		vkFlushMappedMemoryRanges(device, 1, &range);
+	}
+
+	VkBuffer destinations[4] = { lightBuffer, clusterBuffer, indexBuffer, viewBuffer };
+
+	// Previous frames may still be shading with the old grid
+	VkBufferMemoryBarrier bufferBarriers[4] = {};
+	for (uint32_t i = 0; i < 4; ++i)
+	{
+		bufferBarriers[i].sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+		bufferBarriers[i].srcAccessMask = VK_ACCESS_SHADER_READ_BIT;
+		bufferBarriers[i].dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+		bufferBarriers[i].srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		bufferBarriers[i].dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		bufferBarriers[i].buffer = destinations[i];
+		bufferBarriers[i].offset = 0;
+		bufferBarriers[i].size = VK_WHOLE_SIZE;
+	}
+
+	vkCmdPipelineBarrier(
+		commandBuffer,
+		VK_PIPELINE_STAGE_VERTEX_SHADER_BIT | VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
+		VK_PIPELINE_STAGE_TRANSFER_BIT,
+		0,
+		0, nullptr,
+		4, bufferBarriers,
+		0, nullptr);
+
+	for (uint32_t i = 0; i < 4; ++i)
+	{
+		if (regions[i].size == 0)
+			continue;
+
+		VkBufferCopy region = regions[i];
+		region.dstOffset = 0;
+		vkCmdCopyBuffer(commandBuffer, stagingBuffers[frameSlot], destinations[i], 1, &region);
+	}
+
+	for (uint32_t i = 0; i < 4; ++i)
+	{
+		bufferBarriers[i].srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+		bufferBarriers[i].dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+	}
+
+	vkCmdPipelineBarrier(
+		commandBuffer,
+		VK_PIPELINE_STAGE_TRANSFER_BIT,
+		VK_PIPELINE_STAGE_VERTEX_SHADER_BIT | VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
+		0,
+		0, nullptr,
+		4, bufferBarriers,
+		0, nullptr);
+
+	uploadedVersion = buildVersion;
+}
+
+void LightGrid::recordBinning(VkCommandBuffer commandBuffer, uint32_t frameSlot)
+{
+	uint32_t clusterCount = settings.tilesX * settings.tilesY * settings.slices;
+	VkDeviceSize lightSize = sizeof(PointLight) * maxLights;
+
+	ClusterEdges edges;
+	computeClusterEdges(view, settings, edges);
+
+	// The edges go where the clusters of a CPU build would
+	VkBufferCopy lightRegion = {};
+	lightRegion.size = sizeof(PointLight) * lights.size();
+
+	VkBufferCopy edgeRegion = {};
+	edgeRegion.srcOffset = lightSize;
+	edgeRegion.size = sizeof(float) * (edges.depths.size() + edges.tanX.size() + edges.tanY.size());
+
+	VkBufferCopy viewRegion = {};
+	viewRegion.srcOffset = getViewStagingOffset();
+	viewRegion.size = sizeof(LightGridShadingView);
+
+	LightGridShadingView shadingView;
+	getShadingView(shadingView);
+
+	uint8_t *staging = static_cast<uint8_t *>(stagingData[frameSlot]);
+	float *stagingEdges = reinterpret_cast<float *>(staging + edgeRegion.srcOffset);
+
+	memcpy(staging, lights.data(), static_cast<size_t>(lightRegion.size));
+	memcpy(staging + viewRegion.srcOffset, &shadingView, sizeof(shadingView));
+	std::copy(edges.depths.begin(), edges.depths.end(), stagingEdges);
+	std::copy(edges.tanX.begin(), edges.tanX.end(), stagingEdges + edges.depths.size());
+	std::copy(edges.tanY.begin(), edges.tanY.end(), stagingEdges + edges.depths.size() + edges.tanX.size());
+
+	if (!isStagingCoherent)
+	{
+		VkMappedMemoryRange range = {};
+		range.sType = VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE;
+		range.memory = stagingMemory[frameSlot];
+		range.offset = 0;
+		range.size = VK_WHOLE_SIZE;
+		vkFlushMappedMemoryRanges(device, 1, &range);
+	}
+
+	// Previous frames may still be shading with the old grid, binning it or
+	// copying it back
+	VkMemoryBarrier uploadBarrier = {};
+	uploadBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+	uploadBarrier.srcAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT | VK_ACCESS_TRANSFER_READ_BIT;
+	uploadBarrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+
+	vkCmdPipelineBarrier(
+		commandBuffer,
+		VK_PIPELINE_STAGE_VERTEX_SHADER_BIT |
+		VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT |
+		VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT |
+		VK_PIPELINE_STAGE_TRANSFER_BIT,
+		VK_PIPELINE_STAGE_TRANSFER_BIT,
+		0,
+		1, &uploadBarrier,
+		0, nullptr,
+		0, nullptr);
+
+	if (lightRegion.size > 0)
+		vkCmdCopyBuffer(commandBuffer, stagingBuffers[frameSlot], lightBuffer, 1, &lightRegion);
+
+	edgeRegion.dstOffset = 0;
+	vkCmdCopyBuffer(commandBuffer, stagingBuffers[frameSlot], edgeBuffer, 1, &edgeRegion);
+
+	viewRegion.dstOffset = 0;
+	vkCmdCopyBuffer(commandBuffer, stagingBuffers[frameSlot], viewBuffer, 1, &viewRegion);
+	vkCmdFillBuffer(commandBuffer, counterBuffer, 0, sizeof(LightBinCounters), 0);
+
+	// The view is read by the materials, everything else by the binning
+	VkMemoryBarrier binBarrier = {};
+	binBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+	binBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+	binBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+
+	vkCmdPipelineBarrier(
+		commandBuffer,
+		VK_PIPELINE_STAGE_TRANSFER_BIT,
+		VK_PIPELINE_STAGE_VERTEX_SHADER_BIT |
+		VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT |
+		VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+		0,
+		1, &binBarrier,
+		0, nullptr,
+		0, nullptr);
+
+	if (timestampQueryPool != VK_NULL_HANDLE)
+	{
+		vkCmdResetQueryPool(commandBuffer, timestampQueryPool, frameSlot * 2, 2);
+		vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, timestampQueryPool, frameSlot * 2);
+	}
+
+	LightBinStep step = {};
+	memcpy(step.viewMatrix, view.viewMatrix, sizeof(step.viewMatrix));
+	step.tilesX = settings.tilesX;
+	step.tilesY = settings.tilesY;
+	step.slices = settings.slices;
+	step.maxLightsPerCluster = settings.maxLightsPerCluster;
+	step.lightCount = static_cast<uint32_t>(lights.size());
+
+	vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, binPipeline);
+
+	vkCmdBindDescriptorSets(
+		commandBuffer,
+		VK_PIPELINE_BIND_POINT_COMPUTE,
+		pipelineLayout,
+		0,
+		1,
+		&descriptorSet,
+		0,
+		nullptr);
+
+	vkCmdPushConstants(
+		commandBuffer,
+		pipelineLayout,
+		VK_SHADER_STAGE_COMPUTE_BIT,
+		0,
+		sizeof(LightBinStep),
+		&step);
+
+	vkCmdDispatch(commandBuffer, (clusterCount + LIGHT_BIN_GROUP_SIZE - 1) / LIGHT_BIN_GROUP_SIZE, 1, 1);
+
+	if (timestampQueryPool != VK_NULL_HANDLE)
+		vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, timestampQueryPool, frameSlot * 2 + 1);
+
+	// Fragments shade with the grid, the counters and the grid may be copied
+	// back
+	VkMemoryBarrier shadeBarrier = {};
+	shadeBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+	shadeBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+	shadeBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_TRANSFER_READ_BIT;
+
+	vkCmdPipelineBarrier(
+		commandBuffer,
+		VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+		VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT,
+		0,
+		1, &shadeBarrier,
+		0, nullptr,
+		0, nullptr);
+
+	VkBufferCopy counterRegion = {};
+	counterRegion.size = sizeof(LightBinCounters);
+	vkCmdCopyBuffer(commandBuffer, counterBuffer, readbackBuffers[frameSlot], 1, &counterRegion);
+
+	VkMemoryBarrier readbackBarrier = {};
+	readbackBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+	readbackBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+	readbackBarrier.dstAccessMask = VK_ACCESS_HOST_READ_BIT;
+
+	vkCmdPipelineBarrier(
+		commandBuffer,
+		VK_PIPELINE_STAGE_TRANSFER_BIT,
+		VK_PIPELINE_STAGE_HOST_BIT,
+		0,
+		1, &readbackBarrier,
+		0, nullptr,
+		0, nullptr);
+
+	hasReadback[frameSlot] = true;
+	uploadedVersion = buildVersion;
+}
+
+void LightGrid::recordGridReadback(VkCommandBuffer commandBuffer)
+{
+	uint32_t clusterCount = settings.tilesX * settings.tilesY * settings.slices;
+	VkDeviceSize clusterSize = sizeof(ClusterRange) * clusterCount;
+	VkDeviceSize indexSize = sizeof(uint32_t) * clusterCount * settings.maxLightsPerCluster;
+
+	// The barrier after the binning pass already covers these copies
+	VkBufferCopy regions[3] = {};
+	regions[0].size = clusterSize;
+	regions[1].dstOffset = clusterSize;
+	regions[1].size = indexSize;
+	regions[2].dstOffset = clusterSize + indexSize;
+	regions[2].size = sizeof(LightBinCounters);
+
+	vkCmdCopyBuffer(commandBuffer, clusterBuffer, gridReadbackBuffer, 1, &regions[0]);
+	vkCmdCopyBuffer(commandBuffer, indexBuffer, gridReadbackBuffer, 1, &regions[1]);
+	vkCmdCopyBuffer(commandBuffer, counterBuffer, gridReadbackBuffer, 1, &regions[2]);
+
+	VkMemoryBarrier readbackBarrier = {};
+	readbackBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+	readbackBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+	readbackBarrier.dstAccessMask = VK_ACCESS_HOST_READ_BIT;
+
+	vkCmdPipelineBarrier(
+		commandBuffer,
+		VK_PIPELINE_STAGE_TRANSFER_BIT,
+		VK_PIPELINE_STAGE_HOST_BIT,
+		0,
+		1, &readbackBarrier,
+		0, nullptr,
+		0, nullptr);
+
+	isReadbackRequested = false;
+	hasGridReadback = true;
+}
+
+void LightGrid::getShadingView(LightGridShadingView &shadingView) const
+{
+	memcpy(shadingView.viewMatrix, view.viewMatrix, sizeof(shadingView.viewMatrix));
+	shadingView.tanHalfFovX = view.tanHalfFovX;
+	shadingView.tanHalfFovY = view.tanHalfFovY;
+	shadingView.nearPlane = view.nearPlane;
+	shadingView.farPlane = view.farPlane;
+	shadingView.tilesX = settings.tilesX;
+	shadingView.tilesY = settings.tilesY;
+	shadingView.slices = settings.slices;
+	shadingView.lightCount = static_cast<uint32_t>(lights.size());
+}
+
+VkDeviceSize LightGrid::getViewStagingOffset() const
+{
+	uint32_t clusterCount = settings.tilesX * settings.tilesY * settings.slices;
+
+	return
+		sizeof(PointLight) * maxLights +
+		sizeof(ClusterRange) * clusterCount +
+		sizeof(uint32_t) * clusterCount * settings.maxLightsPerCluster;
+}
+
+void LightGrid::readCounters(uint32_t frameSlot)
+{
+	if (!hasReadback[frameSlot])
+		return;
+
+	if (!isReadbackCoherent)
+	{
+		VkMappedMemoryRange range = {};
+		range.sType = VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE;
+		range.memory = readbackMemory[frameSlot];
+		range.offset = 0;
+		range.size = VK_WHOLE_SIZE;
+		vkInvalidateMappedMemoryRanges(device, 1, &range);
+	}
+
+	LightBinCounters counters;
+	memcpy(&counters, readbackData[frameSlot], sizeof(counters));
+
+	statistics.lightIndexCount = counters.lightIndexCount;
+	statistics.occupiedClusterCount = counters.occupiedClusterCount;
+	statistics.maxClusterLightCount = counters.maxClusterLightCount;
+	statistics.overflowCount = counters.overflowCount;
+
+	if (timestampQueryPool != VK_NULL_HANDLE)
+	{
+		uint64_t timestamps[2] = {};
+		vkGetQueryPoolResults(
+			device,
+			timestampQueryPool,
+			frameSlot * 2,
+			2,
+			sizeof(timestamps),
+			timestamps,
+			sizeof(uint64_t),
+			VK_QUERY_RESULT_64_BIT);
+
+		// The timestamp period is the number of nanoseconds per tick
+		statistics.gpuBinTime = static_cast<double>(timestamps[1] - timestamps[0]) * timestampPeriod / 1000000.0;
+	}
+
+	hasReadback[frameSlot] = false;
+}
+
+void LightGrid::requestReadback()
+{
+	isReadbackRequested = true;
+}
+
+bool LightGrid::getGpuData(LightGridData &data) const
+{
+	if (!hasGridReadback)
+		return false;
+
+	if (!isReadbackCoherent)
+	{
+		VkMappedMemoryRange range = {};
+		range.sType = VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE;
+		range.memory = gridReadbackMemory;
+		range.offset = 0;
+		range.size = VK_WHOLE_SIZE;
+		vkInvalidateMappedMemoryRanges(device, 1, &range);
+	}
+
+	uint32_t clusterCount = settings.tilesX * settings.tilesY * settings.slices;
+	const ClusterRange *clusters = static_cast<const ClusterRange *>(gridReadbackData);
+	const uint32_t *indices = reinterpret_cast<const uint32_t *>(clusters + clusterCount);
+
+	LightBinCounters counters;
+	memcpy(&counters, indices + clusterCount * settings.maxLightsPerCluster, sizeof(counters));
+
+	// Every cluster has a fixed number of slots on the GPU, the CPU build
+	// packs them
+	data.clusters.resize(clusterCount);
+	data.lightIndices.clear();
+	data.overflowCount = counters.overflowCount;
+
+	for (uint32_t c = 0; c < clusterCount; ++c)
+	{
+		const uint32_t *clusterBegin = indices + clusters[c].offset;
+
+		data.clusters[c].offset = static_cast<uint32_t>(data.lightIndices.size());
+		data.clusters[c].count = clusters[c].count;
+		data.lightIndices.insert(data.lightIndices.end(), clusterBegin, clusterBegin + clusters[c].count);
+	}
+
+	return true;
+}
+
+bool LightGrid::usesGpuBinning() const
+{
+	return binPipeline != VK_NULL_HANDLE;
+}
+
+void LightGrid::getBufferInfos(VkDescriptorBufferInfo bufferInfos[4]) const
+{
+	VkBuffer buffers[4] = { lightBuffer, clusterBuffer, indexBuffer, viewBuffer };
+
+	for (uint32_t i = 0; i < 4; ++i)
+	{
+		bufferInfos[i].buffer = buffers[i];
+		bufferInfos[i].offset = 0;
+		bufferInfos[i].range = VK_WHOLE_SIZE;
+	}
+}
+
+const std::vector<PointLight> &LightGrid::getLights() const
+{
+	return lights;
+}
+
+const LightGridView &LightGrid::getView() const
+{
+	return view;
+}
+
+const LightGridSettings &LightGrid::getSettings() const
+{
+	return settings;
+}
+
+const LightGridData &LightGrid::getData() const
+{
+	return data;
+}
+
+LightGridStatistics LightGrid::getStatistics() const
+{
+	return statistics;
+}
\ No newline at end of file
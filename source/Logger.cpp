@@ -0,0 +1,306 @@
+#include "LearningVulkan/Logger.hpp"
+
+#include <cstdarg>
+#include <cstring>
+
+// Longest message that is kept, anything beyond it is cut off
+static const size_t MAX_MESSAGE_LENGTH = 1024;
+
+// Entries per thread, has to be a power of two
+static const uint32_t QUEUE_SIZE = 128;
+
+// Recently written messages every thread remembers for deduplication
+static const uint32_t RECENT_MESSAGE_COUNT = 64;
+static const std::chrono::milliseconds REPEAT_INTERVAL(1000);
+
+// How long the writer sleeps when there is nothing to write
+static const std::chrono::milliseconds WRITER_INTERVAL(10);
+
+static std::atomic<uint32_t> nextLoggerId(0);
+
+struct LogEntry
+{
+	LogSeverity severity;
+	uint32_t repeatCount;	// Times the message was suppressed before this one
+	std::chrono::steady_clock::time_point time;
+	char message[MAX_MESSAGE_LENGTH];
+};
+
+struct RecentMessage
+{
+	uint64_t hash;
+	std::chrono::steady_clock::time_point lastWritten;
+	uint32_t suppressedCount;
+};
+
+// Single producer, single consumer ring buffer. Only the owning thread pushes
+// and touches the recent messages, only the writer thread pops.
+struct Logger::ThreadQueue
+{
+	std::thread::id thread;
+
+	LogEntry entries[QUEUE_SIZE];
+	std::atomic<uint32_t> head;
+	std::atomic<uint32_t> tail;
+
+	RecentMessage recentMessages[RECENT_MESSAGE_COUNT];
+
+	std::atomic<uint64_t> droppedCount;
+	std::atomic<uint64_t> suppressedCount;
+};
+
+// Remembers the queue of the last logger this thread used, so the lookup is
+// only needed when switching between loggers
+struct ThreadQueueCache
+{
+	uint32_t loggerId;
+	void *queue;
+};
+
+static thread_local ThreadQueueCache threadQueueCache = { UINT32_MAX, nullptr };
+
+static uint64_t hashMessage(const char *message)
+{
+	// FNV-1a
+	uint64_t hash = 14695981039346656037ull;
+
+	for (const char *c = message; *c; ++c)
+	{
+		hash ^= static_cast<uint8_t>(*c);
+		hash *= 1099511628211ull;
+	}
+
+	return hash;
+}
+
+static const char *getSeverityName(LogSeverity severity)
+{
+	switch (severity)
+	{
+	case LogSeverity::Verbose:
+		return "verbose";
+	case LogSeverity::Info:
+		return "info";
+	case LogSeverity::Warning:
+		return "warning";
+	case LogSeverity::Error:
+		return "error";
+	default:
+		return "unknown";
+	}
+}
+
+Logger::Logger() :
+	id(nextLoggerId++),
+	output(nullptr),
+	minimumSeverity(static_cast<uint32_t>(LogSeverity::Info)),
+	stopWriter(false),
+	writtenCount(0),
+	startTime(std::chrono::steady_clock::now())
+{
+}
+
+Logger::~Logger()
+{
+	stop();
+}
+
+void Logger::start(FILE *output, LogSeverity minimumSeverity)
+{
+	this->output = output;
+	setMinimumSeverity(minimumSeverity);
+
+	stopWriter = false;
+	writerThread = std::thread(&Logger::runWriter, this);
+}
+
+void Logger::stop()
+{
+	if (!writerThread.joinable())
+		return;
+
+	{
+		std::lock_guard<std::mutex> lock(writerMutex);
+		stopWriter = true;
+	}
+
+	writerCondition.notify_one();
+	writerThread.join();
+}
+
+void Logger::setMinimumSeverity(LogSeverity severity)
+{
+	minimumSeverity = static_cast<uint32_t>(severity);
+}
+
+bool Logger::isEnabled(LogSeverity severity) const
+{
+	return static_cast<uint32_t>(severity) >= minimumSeverity.load(std::memory_order_relaxed);
+}
+
+void Logger::log(LogSeverity severity, const char *format, ...)
+{
+	// Filter before paying for the formatting
+	if (!isEnabled(severity))
+		return;
+
+	char message[MAX_MESSAGE_LENGTH];
+
+	va_list arguments;
+	va_start(arguments, format);
+	vsnprintf(message, sizeof(message), format, arguments);
+	va_end(arguments);
+
+	write(severity, message);
+}
+
+void Logger::write(LogSeverity severity, const char *message)
+{
+	if (!isEnabled(severity))
+		return;
+
+	ThreadQueue *queue = getThreadQueue();
+	std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+
+	// Drop the message if this thread wrote the same one recently
+	uint64_t hash = hashMessage(message);
+	RecentMessage &recent = queue->recentMessages[hash % RECENT_MESSAGE_COUNT];
+
+	if (recent.hash == hash && now - recent.lastWritten < REPEAT_INTERVAL)
+	{
+		++recent.suppressedCount;
+		++queue->suppressedCount;
+		return;
+	}
+
+	uint32_t repeatCount = (recent.hash == hash) ? recent.suppressedCount : 0;
+
+	// Never block the calling thread, a full queue loses the message
+	uint32_t tail = queue->tail.load(std::memory_order_relaxed);
+	if (tail - queue->head.load(std::memory_order_acquire) == QUEUE_SIZE)
+	{
+		++queue->droppedCount;
+		return;
+	}
+
+	LogEntry &entry = queue->entries[tail & (QUEUE_SIZE - 1)];
+	entry.severity = severity;
+	entry.repeatCount = repeatCount;
+	entry.time = now;
+	strncpy(entry.message, message, MAX_MESSAGE_LENGTH - 1);
+	entry.message[MAX_MESSAGE_LENGTH - 1] = '\0';
+
+	queue->tail.store(tail + 1, std::memory_order_release);
+
+	recent.hash = hash;
+	recent.lastWritten = now;
+	recent.suppressedCount = 0;
+}
+
+LogStatistics Logger::getStatistics() const
+{
+	LogStatistics statistics = {};
+	statistics.writtenCount = writtenCount;
+
+	std::lock_guard<std::mutex> lock(queueMutex);
+
+	for (const std::unique_ptr<ThreadQueue> &queue : queues)
+	{
+		statistics.droppedCount += queue->droppedCount;
+		statistics.suppressedCount += queue->suppressedCount;
+	}
+
+	return statistics;
+}
+
+Logger::ThreadQueue *Logger::getThreadQueue()
+{
+	if (threadQueueCache.loggerId == id)
+		return static_cast<ThreadQueue *>(threadQueueCache.queue);
+
+	// Only the first message of a thread (or after switching loggers) gets here
+	std::lock_guard<std::mutex> lock(queueMutex);
+	std::thread::id thread = std::this_thread::get_id();
+
+	ThreadQueue *threadQueue = nullptr;
+
+	for (const std::unique_ptr<ThreadQueue> &queue : queues)
+	{
+		if (queue->thread == thread)
+			threadQueue = queue.get();
+	}
+
+	if (!threadQueue)
+	{
+		threadQueue = new ThreadQueue();
+		threadQueue->thread = thread;
+		threadQueue->head = 0;
+		threadQueue->tail = 0;
+		threadQueue->droppedCount = 0;
+		threadQueue->suppressedCount = 0;
+
+		for (RecentMessage &recent : threadQueue->recentMessages)
+		{
+			recent.hash = 0;
+			recent.suppressedCount = 0;
+		}
+
+		queues.push_back(std::unique_ptr<ThreadQueue>(threadQueue));
+	}
+
+	threadQueueCache.loggerId = id;
+	threadQueueCache.queue = threadQueue;
+
+	return threadQueue;
+}
+
+void Logger::drainQueues()
+{
+	std::lock_guard<std::mutex> lock(queueMutex);
+	bool wroteMessage = false;
+
+	for (const std::unique_ptr<ThreadQueue> &queue : queues)
+	{
+		uint32_t head = queue->head.load(std::memory_order_relaxed);
+		uint32_t tail = queue->tail.load(std::memory_order_acquire);
+
+		for (; head != tail; ++head)
+		{
+			const LogEntry &entry = queue->entries[head & (QUEUE_SIZE - 1)];
+			double time = std::chrono::duration<double>(entry.time - startTime).count();
+
+			fprintf(output, "[%10.3f] %-7s %s", time, getSeverityName(entry.severity), entry.message);
+
+			if (entry.repeatCount != 0)
+				fprintf(output, " (repeated %u times)", entry.repeatCount);
+
+			fputc('\n', output);
+
+			++writtenCount;
+			wroteMessage = true;
+		}
+
+		queue->head.store(head, std::memory_order_release);
+	}
+
+	if (wroteMessage)
+		fflush(output);
+}
+
+void Logger::runWriter()
+{
+	std::unique_lock<std::mutex> lock(writerMutex);
+
+	while (!stopWriter)
+	{
+		// Producers never signal, so they do not have to take a lock
+		writerCondition.wait_for(lock, WRITER_INTERVAL);
+
+		lock.unlock();
+		drainQueues();
+		lock.lock();
+	}
+
+	lock.unlock();
+	drainQueues();
+}
\ No newline at end of file
@@ -1,7 +1,11 @@
 #include <Windows.h>
+#include <cstdlib>
+#include <cstring>
 #include "LearningVulkan/Renderer.hpp"
 
 bool shouldRender = false;
+bool shouldCapture = false;
+bool shouldLogCounters = false;
 
 LRESULT CALLBACK windowProc(HWND hwnd, UINT uMsg, WPARAM wParam, LPARAM lParam) {
 	switch (uMsg)
@@ -18,6 +22,19 @@ LRESULT CALLBACK windowProc(HWND hwnd, UINT uMsg, WPARAM wParam, LPARAM lParam)
 		break;
 	}
 
+	case WM_KEYDOWN:
+	{
+		// F12 saves a screenshot of the next frame
+		if (wParam == VK_F12)
+			shouldCapture = true;
+
+		// F11 writes the GPU counters of every pass to the log
+		if (wParam == VK_F11)
+			shouldLogCounters = true;
+
+		break;
+	}
+
 	default:
 	{
 		break;
@@ -28,8 +45,35 @@ LRESULT CALLBACK windowProc(HWND hwnd, UINT uMsg, WPARAM wParam, LPARAM lParam)
 	return DefWindowProc(hwnd, uMsg, wParam, lParam);
 }
 
-int main()
+int main(int argc, char **argv)
 {
+	// Multi-GPU rendering has to be requested explicitly
+	MultiGpuMode multiGpuMode = MultiGpuMode::Disabled;
+
+	// Frames are not paced unless a rate or an interval of display refreshes
+	// is given
+	double targetFrameRate = 0.0;
+	uint32_t presentInterval = 0;
+
+	// The resolution is only scaled with a GPU frame budget in milliseconds
+	double gpuBudget = 0.0;
+
+	for (int i = 1; i < argc; ++i)
+	{
+		bool hasValue = (i + 1 < argc);
+
+		if (strcmp(argv[i], "--afr") == 0)
+			multiGpuMode = MultiGpuMode::AlternateFrame;
+		else if (strcmp(argv[i], "--sfr") == 0)
+			multiGpuMode = MultiGpuMode::SplitFrame;
+		else if (strcmp(argv[i], "--fps") == 0 && hasValue)
+			targetFrameRate = strtod(argv[++i], nullptr);
+		else if (strcmp(argv[i], "--present-interval") == 0 && hasValue)
+			presentInterval = strtoul(argv[++i], nullptr, 10);
+		else if (strcmp(argv[i], "--gpu-budget") == 0 && hasValue)
+			gpuBudget = strtod(argv[++i], nullptr);
+	}
+
 	WNDCLASSEX windowClass = {};
 	windowClass.cbSize = sizeof(WNDCLASSEX);
 	windowClass.style = CS_OWNDC | CS_VREDRAW | CS_HREDRAW;
@@ -58,7 +102,32 @@ int main()
 	GetClientRect(windowHandle, &rect);
 
 	Renderer vulkanRenderer;
-	vulkanRenderer.initialize(rect.right, rect.bottom, windowHandle);
+
+	DynamicResolutionSettings resolutionSettings = {};
+	resolutionSettings.targetFrameTime = gpuBudget;
+	resolutionSettings.minScale = 0.5f;
+	resolutionSettings.maxScale = 1.0f;
+	resolutionSettings.scaleStep = 0.05f;
+	resolutionSettings.headroom = 0.15f;
+	resolutionSettings.settleFrames = 3;
+	vulkanRenderer.setDynamicResolution(resolutionSettings);
+
+	vulkanRenderer.initialize(rect.right, rect.bottom, windowHandle, multiGpuMode);
+
+	if (presentInterval != 0)
+	{
+		DEVMODE displayMode = {};
+		displayMode.dmSize = sizeof(displayMode);
+		EnumDisplaySettings(nullptr, ENUM_CURRENT_SETTINGS, &displayMode);
+
+		// Some drivers report 0 or 1 for the default refresh rate
+		double refreshRate = displayMode.dmDisplayFrequency > 1 ? displayMode.dmDisplayFrequency : 60.0;
+		vulkanRenderer.getFramePacer().setPresentInterval(presentInterval, refreshRate);
+	}
+	else
+	{
+		vulkanRenderer.getFramePacer().setTargetFrameRate(targetFrameRate);
+	}
 
 	while (!done)
 	{
@@ -74,6 +143,18 @@ int main()
 			DispatchMessage(&msg);
 		}
 
+		if (shouldCapture)
+		{
+			vulkanRenderer.captureFrame("screenshot");
+			shouldCapture = false;
+		}
+
+		if (shouldLogCounters)
+		{
+			vulkanRenderer.logGpuCounters();
+			shouldLogCounters = false;
+		}
+
 		if (shouldRender)
 		{
 			vulkanRenderer.render();
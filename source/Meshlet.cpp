@@ -0,0 +1,419 @@
+#include "LearningVulkan/Meshlet.hpp"
+
+#include <algorithm>
+#include <assert.h>
+#include <cmath>
+
+// Below this the normals spread over more than about 84 degrees, and the
+// cone would practically never cull anything
+static const float MIN_CONE_SPREAD = 0.1f;
+
+// Column lengths of a uniformly scaled transform may differ by this much
+static const float UNIFORM_SCALE_TOLERANCE = 0.01f;
+
+// Triangles of every vertex, in compressed rows
+struct VertexAdjacency
+{
+	std::vector<uint32_t> offsets;
+	std::vector<uint32_t> triangles;
+};
+
+static VertexAdjacency buildAdjacency(const Mesh &mesh)
+{
+	VertexAdjacency adjacency;
+	adjacency.offsets.assign(mesh.vertices.size() + 1, 0);
+
+	for (uint32_t index : mesh.indices)
+		++adjacency.offsets[index + 1];
+
+	for (size_t i = 1; i < adjacency.offsets.size(); ++i)
+		adjacency.offsets[i] += adjacency.offsets[i - 1];
+
+	std::vector<uint32_t> fill(adjacency.offsets.begin(), adjacency.offsets.end() - 1);
+	adjacency.triangles.resize(mesh.indices.size());
+
+	for (size_t i = 0; i < mesh.indices.size(); ++i)
+		adjacency.triangles[fill[mesh.indices[i]]++] = static_cast<uint32_t>(i / 3);
+
+	return adjacency;
+}
+
+static void computeTriangleNormal(const Vertex &a, const Vertex &b, const Vertex &c, float normal[3])
+{
+	float ux = b.x - a.x, uy = b.y - a.y, uz = b.z - a.z;
+	float vx = c.x - a.x, vy = c.y - a.y, vz = c.z - a.z;
+
+	normal[0] = uy * vz - uz * vy;
+	normal[1] = uz * vx - ux * vz;
+	normal[2] = ux * vy - uy * vx;
+}
+
+// Bounding sphere around the center of the bounding box, and the cone of the
+// triangle normals around their average
+static void computeBounds(MeshletMesh &result, Meshlet &meshlet)
+{
+	float minimum[3] = { INFINITY, INFINITY, INFINITY };
+	float maximum[3] = { -INFINITY, -INFINITY, -INFINITY };
+
+	for (uint32_t i = 0; i < meshlet.vertexCount; ++i)
+	{
+		const Vertex &vertex = result.vertices[result.meshletVertices[meshlet.vertexOffset + i]];
+		float position[3] = { vertex.x, vertex.y, vertex.z };
+
+		for (int axis = 0; axis < 3; ++axis)
+		{
+			minimum[axis] = std::min(minimum[axis], position[axis]);
+			maximum[axis] = std::max(maximum[axis], position[axis]);
+		}
+	}
+
+	float radiusSquared = 0.0f;
+
+	for (int axis = 0; axis < 3; ++axis)
+		meshlet.center[axis] = (minimum[axis] + maximum[axis]) * 0.5f;
+
+	for (uint32_t i = 0; i < meshlet.vertexCount; ++i)
+	{
+		const Vertex &vertex = result.vertices[result.meshletVertices[meshlet.vertexOffset + i]];
+		float dx = vertex.x - meshlet.center[0];
+		float dy = vertex.y - meshlet.center[1];
+		float dz = vertex.z - meshlet.center[2];
+
+		radiusSquared = std::max(radiusSquared, dx * dx + dy * dy + dz * dz);
+	}
+
+	meshlet.radius = sqrtf(radiusSquared);
+
+	// Normalized normals of the non-degenerate triangles
+	std::vector<float> normals;
+	normals.reserve(meshlet.triangleCount * 3);
+
+	float axis[3] = {};
+
+	for (uint32_t i = 0; i < meshlet.triangleCount; ++i)
+	{
+		const uint32_t *triangle = &result.indices[(meshlet.triangleOffset + i) * 3];
+
+		float normal[3];
+		computeTriangleNormal(
+			result.vertices[triangle[0]],
+			result.vertices[triangle[1]],
+			result.vertices[triangle[2]],
+			normal);
+
+		float length = sqrtf(normal[0] * normal[0] + normal[1] * normal[1] + normal[2] * normal[2]);
+		if (length == 0.0f)
+			continue;
+
+		for (int k = 0; k < 3; ++k)
+		{
+			normals.push_back(normal[k] / length);
+			axis[k] += normal[k] / length;
+		}
+	}
+
+	float axisLength = sqrtf(axis[0] * axis[0] + axis[1] * axis[1] + axis[2] * axis[2]);
+
+	meshlet.coneAxis[0] = 0.0f;
+	meshlet.coneAxis[1] = 0.0f;
+	meshlet.coneAxis[2] = 0.0f;
+	meshlet.coneCutoff = 1.0f;
+
+	if (axisLength == 0.0f)
+		return;
+
+	for (int k = 0; k < 3; ++k)
+		meshlet.coneAxis[k] = axis[k] / axisLength;
+
+	float minimumDot = 1.0f;
+
+	for (size_t i = 0; i < normals.size(); i += 3)
+	{
+		float dot =
+			normals[i] * meshlet.coneAxis[0] +
+			normals[i + 1] * meshlet.coneAxis[1] +
+			normals[i + 2] * meshlet.coneAxis[2];
+
+		minimumDot = std::min(minimumDot, dot);
+	}
+
+	// The cutoff is the sine of the cone angle, which is what the test
+	// against the bounding sphere needs
+	if (minimumDot >= MIN_CONE_SPREAD)
+		meshlet.coneCutoff = sqrtf(1.0f - minimumDot * minimumDot);
+}
+
+MeshletMesh buildMeshlets(const Mesh &mesh, uint32_t maxVertices, uint32_t maxTriangles)
+{
+	assert(maxVertices >= 3 && maxVertices <= 255, "Local indices have to fit in a byte, 0xFF marks vertices outside of the meshlet.");
+	assert(maxTriangles >= 1, "Meshlets need at least one triangle.");
+
+	MeshletMesh result;
+	result.vertices = mesh.vertices;
+
+	uint32_t triangleCount = static_cast<uint32_t>(mesh.indices.size() / 3);
+	VertexAdjacency adjacency = buildAdjacency(mesh);
+
+	std::vector<bool> isTriangleUsed(triangleCount, false);
+
+	// Local index of every global vertex in the current meshlet, 0xFF if it
+	// is not part of it
+	std::vector<uint8_t> localIndices(mesh.vertices.size(), 0xFF);
+
+	uint32_t nextSeed = 0;
+
+	while (true)
+	{
+		while (nextSeed < triangleCount && isTriangleUsed[nextSeed])
+			++nextSeed;
+
+		if (nextSeed == triangleCount)
+			break;
+
+		Meshlet meshlet = {};
+		meshlet.vertexOffset = static_cast<uint32_t>(result.meshletVertices.size());
+		meshlet.triangleOffset = static_cast<uint32_t>(result.meshletTriangles.size() / 3);
+
+		// Running sum of the vertex positions, keeps the meshlet round
+		float centroid[3] = {};
+		uint32_t triangle = nextSeed;
+
+		while (true)
+		{
+			const uint32_t *indices = &mesh.indices[triangle * 3];
+
+			for (int k = 0; k < 3; ++k)
+			{
+				uint32_t vertex = indices[k];
+
+				if (localIndices[vertex] == 0xFF)
+				{
+					localIndices[vertex] = static_cast<uint8_t>(meshlet.vertexCount++);
+					result.meshletVertices.push_back(vertex);
+
+					centroid[0] += mesh.vertices[vertex].x;
+					centroid[1] += mesh.vertices[vertex].y;
+					centroid[2] += mesh.vertices[vertex].z;
+				}
+
+				result.meshletTriangles.push_back(localIndices[vertex]);
+				result.indices.push_back(vertex);
+			}
+
+			isTriangleUsed[triangle] = true;
+			++meshlet.triangleCount;
+
+			if (meshlet.triangleCount == maxTriangles)
+				break;
+
+			float center[3] =
+			{
+				centroid[0] / meshlet.vertexCount,
+				centroid[1] / meshlet.vertexCount,
+				centroid[2] / meshlet.vertexCount
+			};
+
+			// Neighbours of the meshlet that still fit, fewest new vertices
+			// first, then closest to the center
+			uint32_t bestTriangle = UINT32_MAX;
+			uint32_t bestNewVertices = 4;
+			float bestDistance = INFINITY;
+
+			for (uint32_t i = 0; i < meshlet.vertexCount; ++i)
+			{
+				uint32_t vertex = result.meshletVertices[meshlet.vertexOffset + i];
+
+				for (uint32_t j = adjacency.offsets[vertex]; j < adjacency.offsets[vertex + 1]; ++j)
+				{
+					uint32_t candidate = adjacency.triangles[j];
+					if (isTriangleUsed[candidate])
+						continue;
+
+					const uint32_t *candidateIndices = &mesh.indices[candidate * 3];
+
+					uint32_t newVertices =
+						(localIndices[candidateIndices[0]] == 0xFF ? 1 : 0) +
+						(localIndices[candidateIndices[1]] == 0xFF ? 1 : 0) +
+						(localIndices[candidateIndices[2]] == 0xFF ? 1 : 0);
+
+					if (meshlet.vertexCount + newVertices > maxVertices || newVertices > bestNewVertices)
+						continue;
+
+					float distance = 0.0f;
+
+					for (int k = 0; k < 3; ++k)
+					{
+						const Vertex &position = mesh.vertices[candidateIndices[k]];
+						float dx = position.x - center[0];
+						float dy = position.y - center[1];
+						float dz = position.z - center[2];
+
+						distance += dx * dx + dy * dy + dz * dz;
+					}
+
+					if (newVertices < bestNewVertices || distance < bestDistance)
+					{
+						bestTriangle = candidate;
+						bestNewVertices = newVertices;
+						bestDistance = distance;
+					}
+				}
+			}
+
+			// Jumping to a disconnected triangle would only loosen the bounds
+			if (bestTriangle == UINT32_MAX)
+				break;
+
+			triangle = bestTriangle;
+		}
+
+		for (uint32_t i = 0; i < meshlet.vertexCount; ++i)
+			localIndices[result.meshletVertices[meshlet.vertexOffset + i]] = 0xFF;
+
+		computeBounds(result, meshlet);
+		result.meshlets.push_back(meshlet);
+	}
+
+	return result;
+}
+
+CullingView makeCullingView(const float viewProjection[16], const float cameraPosition[3])
+{
+	const float *row0 = &viewProjection[0];
+	const float *row1 = &viewProjection[4];
+	const float *row2 = &viewProjection[8];
+	const float *row3 = &viewProjection[12];
+
+	CullingView view = {};
+
+	for (int k = 0; k < 4; ++k)
+	{
+		view.planes[0][k] = row3[k] + row0[k];	// Left, -w <= x
+		view.planes[1][k] = row3[k] - row0[k];	// Right, x <= w
+		view.planes[2][k] = row3[k] + row1[k];	// Top, -w <= y
+		view.planes[3][k] = row3[k] - row1[k];	// Bottom, y <= w
+		view.planes[4][k] = row2[k];			// Near, 0 <= z
+		view.planes[5][k] = row3[k] - row2[k];	// Far, z <= w
+	}
+
+	// Normalized, so the plane equation gives the distance to the plane
+	for (int i = 0; i < 6; ++i)
+	{
+		float *plane = view.planes[i];
+		float length = sqrtf(plane[0] * plane[0] + plane[1] * plane[1] + plane[2] * plane[2]);
+
+		for (int k = 0; k < 4; ++k)
+			plane[k] /= length;
+	}
+
+	view.cameraPosition[0] = cameraPosition[0];
+	view.cameraPosition[1] = cameraPosition[1];
+	view.cameraPosition[2] = cameraPosition[2];
+
+	return view;
+}
+
+uint32_t cullMeshlets(
+	const MeshletMesh &mesh,
+	const float transform[12],
+	const CullingView &view,
+	uint32_t firstInstance,
+	VkDrawIndexedIndirectCommand *commands,
+	MeshletCullStatistics &statistics)
+{
+	// The radius grows with the largest scale of the transform
+	float scales[3];
+
+	for (int column = 0; column < 3; ++column)
+	{
+		scales[column] = sqrtf(
+			transform[column] * transform[column] +
+			transform[4 + column] * transform[4 + column] +
+			transform[8 + column] * transform[8 + column]);
+	}
+
+	float maxScale = std::max(scales[0], std::max(scales[1], scales[2]));
+	float minScale = std::min(scales[0], std::min(scales[1], scales[2]));
+
+	// Normals only transform like positions without non-uniform scaling
+	bool canCullBackfaces = (maxScale - minScale) <= maxScale * UNIFORM_SCALE_TOLERANCE;
+
+	uint32_t commandCount = 0;
+
+	for (const Meshlet &meshlet : mesh.meshlets)
+	{
+		++statistics.meshletCount;
+		statistics.triangleCount += meshlet.triangleCount;
+
+		float center[3];
+
+		for (int row = 0; row < 3; ++row)
+		{
+			const float *matrixRow = &transform[row * 4];
+
+			center[row] =
+				matrixRow[0] * meshlet.center[0] +
+				matrixRow[1] * meshlet.center[1] +
+				matrixRow[2] * meshlet.center[2] +
+				matrixRow[3];
+		}
+
+		float radius = meshlet.radius * maxScale;
+
+		bool isOutside = false;
+
+		for (int i = 0; i < 6 && !isOutside; ++i)
+		{
+			const float *plane = view.planes[i];
+			float distance = plane[0] * center[0] + plane[1] * center[1] + plane[2] * center[2] + plane[3];
+
+			isOutside = (distance < -radius);
+		}
+
+		if (isOutside)
+		{
+			++statistics.frustumCulledCount;
+			continue;
+		}
+
+		// Every triangle faces away from the camera if the direction to the
+		// sphere is inside the cone widened by the sphere
+		if (canCullBackfaces && meshlet.coneCutoff < 1.0f)
+		{
+			float axis[3];
+
+			for (int row = 0; row < 3; ++row)
+			{
+				const float *matrixRow = &transform[row * 4];
+
+				axis[row] = (
+					matrixRow[0] * meshlet.coneAxis[0] +
+					matrixRow[1] * meshlet.coneAxis[1] +
+					matrixRow[2] * meshlet.coneAxis[2]) / maxScale;
+			}
+
+			float dx = center[0] - view.cameraPosition[0];
+			float dy = center[1] - view.cameraPosition[1];
+			float dz = center[2] - view.cameraPosition[2];
+			float distance = sqrtf(dx * dx + dy * dy + dz * dz);
+
+			if (dx * axis[0] + dy * axis[1] + dz * axis[2] >= meshlet.coneCutoff * distance + radius)
+			{
+				++statistics.backfaceCulledCount;
+				continue;
+			}
+		}
+
+		VkDrawIndexedIndirectCommand &command = commands[commandCount++];
+		command.indexCount = meshlet.triangleCount * 3;
+		command.instanceCount = 1;
+		command.firstIndex = meshlet.triangleOffset * 3;
+		command.vertexOffset = 0;
+		command.firstInstance = firstInstance;
+
+		++statistics.visibleMeshletCount;
+		statistics.visibleTriangleCount += meshlet.triangleCount;
+	}
+
+	return commandCount;
+}
\ No newline at end of file
@@ -0,0 +1,820 @@
+#include "LearningVulkan/MeshletRenderer.hpp"
+#include "LearningVulkan/Renderer.hpp"
+#include "LearningVulkan/Utility.hpp"
+
+#include <algorithm>
+#include <assert.h>
+#include <cstring>
+
+// Meshlets, objects, draw commands, counters, meshlet vertices, meshlet
+// triangles, vertices and the view projection
+static const uint32_t MESHLET_BINDING_COUNT = 8;
+
+MeshletRenderer::MeshletRenderer() :
+	device(VK_NULL_HANDLE),
+	allocator(nullptr),
+	maxObjects(0),
+	maxDrawIndirectCount(1),
+	cullStages(VK_SHADER_STAGE_COMPUTE_BIT),
+	hasMeshShaders(false),
+	meshletBuffer(VK_NULL_HANDLE),
+	meshletMemory(VK_NULL_HANDLE),
+	meshletVertexBuffer(VK_NULL_HANDLE),
+	meshletVertexMemory(VK_NULL_HANDLE),
+	meshletTriangleBuffer(VK_NULL_HANDLE),
+	meshletTriangleMemory(VK_NULL_HANDLE),
+	vertexBuffer(VK_NULL_HANDLE),
+	vertexMemory(VK_NULL_HANDLE),
+	indexBuffer(VK_NULL_HANDLE),
+	indexMemory(VK_NULL_HANDLE),
+	meshletCount(0),
+	objectBuffer(VK_NULL_HANDLE),
+	objectMemory(VK_NULL_HANDLE),
+	drawBuffer(VK_NULL_HANDLE),
+	drawMemory(VK_NULL_HANDLE),
+	counterBuffer(VK_NULL_HANDLE),
+	counterMemory(VK_NULL_HANDLE),
+	viewBuffer(VK_NULL_HANDLE),
+	viewMemory(VK_NULL_HANDLE),
+	isStagingCoherent(true),
+	isReadbackCoherent(true),
+	descriptorSetLayout(VK_NULL_HANDLE),
+	descriptorPool(VK_NULL_HANDLE),
+	descriptorSet(VK_NULL_HANDLE),
+	pipelineLayout(VK_NULL_HANDLE),
+	cullPipeline(VK_NULL_HANDLE),
+#ifdef VK_EXT_mesh_shader
+	fpVkCmdDrawMeshTasksEXT(nullptr),
+#endif
+	objectVersion(0),
+	uploadedObjectVersion(0),
+	hasView(false),
+	hasMaterial(false),
+	isReadbackPending(false),
+	drawVersion(0)
+{
+	memoryProperties = {};
+	step = {};
+	memset(viewProjection, 0, sizeof(viewProjection));
+	material = {};
+	statistics = {};
+}
+
+MeshletRenderer::~MeshletRenderer()
+{
+	destroy();
+}
+
+void MeshletRenderer::initialize(const VulkanContext &context, uint32_t maxObjects)
+{
+	device = context.device;
+	allocator = context.allocator;
+	memoryProperties = context.physicalDeviceMemoryProperties;
+	this->maxObjects = maxObjects;
+
+	// Without multiDrawIndirect every command is its own draw
+	maxDrawIndirectCount = context.enabledFeatures.multiDrawIndirect ?
+		context.physicalDeviceProperties.limits.maxDrawIndirectCount : 1;
+
+#ifdef VK_EXT_mesh_shader
+	if (context.supportsMeshShaders)
+	{
+		hasMeshShaders = true;
+		cullStages |= VK_SHADER_STAGE_TASK_BIT_EXT | VK_SHADER_STAGE_MESH_BIT_EXT;
+		fpVkCmdDrawMeshTasksEXT = (PFN_vkCmdDrawMeshTasksEXT)vkGetDeviceProcAddr(device, "vkCmdDrawMeshTasksEXT");
+	}
+#endif
+
+	Utility::createBuffer(
+		device,
+		allocator,
+		memoryProperties,
+		sizeof(MeshletObject) * maxObjects,
+		VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+		VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+		objectBuffer,
+		objectMemory);
+
+	Utility::createBuffer(
+		device,
+		allocator,
+		memoryProperties,
+		sizeof(MeshletCullCounters),
+		VK_BUFFER_USAGE_STORAGE_BUFFER_BIT |
+		VK_BUFFER_USAGE_TRANSFER_SRC_BIT |
+		VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+		VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+		counterBuffer,
+		counterMemory);
+
+	Utility::createBuffer(
+		device,
+		allocator,
+		memoryProperties,
+		sizeof(viewProjection),
+		VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+		VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+		viewBuffer,
+		viewMemory);
+
+	stagingBuffers.resize(context.framesInFlight);
+	stagingMemory.resize(context.framesInFlight);
+	stagingData.resize(context.framesInFlight);
+	readbackBuffers.resize(context.framesInFlight);
+	readbackMemory.resize(context.framesInFlight);
+	readbackData.resize(context.framesInFlight);
+	readbackCulls.assign(context.framesInFlight, 0);
+
+	for (uint32_t i = 0; i < context.framesInFlight; ++i)
+	{
+		Utility::createBuffer(
+			device,
+			allocator,
+			memoryProperties,
+			sizeof(MeshletObject) * maxObjects,
+			VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+			VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT,
+			stagingBuffers[i],
+			stagingMemory[i]);
+
+		Utility::createBuffer(
+			device,
+			allocator,
+			memoryProperties,
+			sizeof(MeshletCullCounters),
+			VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+			VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT,
+			readbackBuffers[i],
+			readbackMemory[i]);
+
+		// Both stay mapped for the lifetime of the buffers
+		VkResult result = vkMapMemory(device, stagingMemory[i], 0, VK_WHOLE_SIZE, 0, &stagingData[i]);
+		Utility::checkVulkanResult(result, "Failed to map a meshlet staging buffer.");
+
+		result = vkMapMemory(device, readbackMemory[i], 0, VK_WHOLE_SIZE, 0, &readbackData[i]);
+		Utility::checkVulkanResult(result, "Failed to map a meshlet readback buffer.");
+	}
+
+	// All staging and readback buffers use the same memory types
+	VkBuffer hostBuffers[2] = { stagingBuffers[0], readbackBuffers[0] };
+	bool isCoherent[2] = {};
+
+	for (uint32_t i = 0; i < 2; ++i)
+	{
+		VkMemoryRequirements memoryRequirements = {};
+		vkGetBufferMemoryRequirements(device, hostBuffers[i], &memoryRequirements);
+
+		uint32_t memoryTypeIndex = 0;
+		Utility::findMemoryType(
+			memoryProperties,
+			memoryRequirements.memoryTypeBits,
+			VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT,
+			memoryTypeIndex);
+
+		isCoherent[i] =
+			(memoryProperties.memoryTypes[memoryTypeIndex].propertyFlags &
+			VK_MEMORY_PROPERTY_HOST_COHERENT_BIT) != 0;
+	}
+
+	isStagingCoherent = isCoherent[0];
+	isReadbackCoherent = isCoherent[1];
+
+	VkDescriptorSetLayoutBinding bindings[MESHLET_BINDING_COUNT] = {};
+	for (uint32_t i = 0; i < MESHLET_BINDING_COUNT; ++i)
+	{
+		bindings[i].binding = i;
+		bindings[i].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+		bindings[i].descriptorCount = 1;
+		bindings[i].stageFlags = cullStages;
+	}
+
+	VkDescriptorSetLayoutCreateInfo setLayoutCreateInfo = {};
+	setLayoutCreateInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+	setLayoutCreateInfo.bindingCount = MESHLET_BINDING_COUNT;
+	setLayoutCreateInfo.pBindings = bindings;
+
+	VkResult result = vkCreateDescriptorSetLayout(device, &setLayoutCreateInfo, allocator, &descriptorSetLayout);
+	Utility::checkVulkanResult(result, "Failed to create the meshlet descriptor set layout.");
+
+	VkDescriptorPoolSize poolSize = {};
+	poolSize.type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+	poolSize.descriptorCount = MESHLET_BINDING_COUNT;
+
+	VkDescriptorPoolCreateInfo poolCreateInfo = {};
+	poolCreateInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+	poolCreateInfo.maxSets = 1;
+	poolCreateInfo.poolSizeCount = 1;
+	poolCreateInfo.pPoolSizes = &poolSize;
+
+	result = vkCreateDescriptorPool(device, &poolCreateInfo, allocator, &descriptorPool);
+	Utility::checkVulkanResult(result, "Failed to create the meshlet descriptor pool.");
+
+	VkDescriptorSetAllocateInfo setAllocateInfo = {};
+	setAllocateInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+	setAllocateInfo.descriptorPool = descriptorPool;
+	setAllocateInfo.descriptorSetCount = 1;
+	setAllocateInfo.pSetLayouts = &descriptorSetLayout;
+
+	result = vkAllocateDescriptorSets(device, &setAllocateInfo, &descriptorSet);
+	Utility::checkVulkanResult(result, "Failed to allocate the meshlet descriptor set.");
+
+	VkPushConstantRange pushConstantRange = {};
+	pushConstantRange.stageFlags = cullStages;
+	pushConstantRange.offset = 0;
+	pushConstantRange.size = sizeof(MeshletCullStep);
+
+	VkPipelineLayoutCreateInfo layoutCreateInfo = {};
+	layoutCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+	layoutCreateInfo.setLayoutCount = 1;
+	layoutCreateInfo.pSetLayouts = &descriptorSetLayout;
+	layoutCreateInfo.pushConstantRangeCount = 1;
+	layoutCreateInfo.pPushConstantRanges = &pushConstantRange;
+
+	result = vkCreatePipelineLayout(device, &layoutCreateInfo, allocator, &pipelineLayout);
+	Utility::checkVulkanResult(result, "Failed to create the meshlet pipeline layout.");
+}
+
+void MeshletRenderer::destroy()
+{
+	if (device == VK_NULL_HANDLE)
+		return;
+
+	vkDestroyPipeline(device, cullPipeline, allocator);
+	vkDestroyPipelineLayout(device, pipelineLayout, allocator);
+	vkDestroyDescriptorPool(device, descriptorPool, allocator);
+	vkDestroyDescriptorSetLayout(device, descriptorSetLayout, allocator);
+
+	for (uint32_t i = 0; i < stagingBuffers.size(); ++i)
+	{
+		vkUnmapMemory(device, stagingMemory[i]);
+		vkDestroyBuffer(device, stagingBuffers[i], allocator);
+		vkFreeMemory(device, stagingMemory[i], allocator);
+
+		vkUnmapMemory(device, readbackMemory[i]);
+		vkDestroyBuffer(device, readbackBuffers[i], allocator);
+		vkFreeMemory(device, readbackMemory[i], allocator);
+	}
+
+	VkBuffer buffers[] =
+	{
+		meshletBuffer, meshletVertexBuffer, meshletTriangleBuffer, vertexBuffer, indexBuffer,
+		objectBuffer, drawBuffer, counterBuffer, viewBuffer
+	};
+
+	VkDeviceMemory memory[] =
+	{
+		meshletMemory, meshletVertexMemory, meshletTriangleMemory, vertexMemory, indexMemory,
+		objectMemory, drawMemory, counterMemory, viewMemory
+	};
+
+	for (uint32_t i = 0; i < sizeof(buffers) / sizeof(buffers[0]); ++i)
+	{
+		vkDestroyBuffer(device, buffers[i], allocator);
+		vkFreeMemory(device, memory[i], allocator);
+	}
+
+	cullPipeline = VK_NULL_HANDLE;
+	meshletBuffer = VK_NULL_HANDLE;
+	meshletCount = 0;
+	stagingBuffers.clear();
+	stagingMemory.clear();
+	stagingData.clear();
+	readbackBuffers.clear();
+	readbackMemory.clear();
+	readbackData.clear();
+	readbackCulls.clear();
+	device = VK_NULL_HANDLE;
+}
+
+void MeshletRenderer::createPipelines(const MeshletShaders &shaders, VkPipelineCache pipelineCache)
+{
+	assert(cullPipeline == VK_NULL_HANDLE, "The meshlet pipelines were created already.");
+
+	VkShaderModule cullModule = createShaderModule(shaders.cull);
+	cullPipeline = createComputePipeline(cullModule, pipelineCache);
+
+	// The pipeline keeps what it needs from the module
+	vkDestroyShaderModule(device, cullModule, allocator);
+}
+
+void MeshletRenderer::setMesh(const MeshletMesh &mesh)
+{
+	assert(meshletBuffer == VK_NULL_HANDLE, "The meshlet mesh was set already.");
+
+	meshletCount = static_cast<uint32_t>(mesh.meshlets.size());
+
+	// Storage buffers are read as uints, so the triangle bytes are padded to
+	// whole uints
+	std::vector<uint8_t> triangles(mesh.meshletTriangles);
+	triangles.resize((triangles.size() + 3) & ~static_cast<size_t>(3));
+
+	createMeshBuffer(
+		mesh.meshlets.data(),
+		sizeof(Meshlet) * mesh.meshlets.size(),
+		VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+		meshletBuffer,
+		meshletMemory);
+
+	createMeshBuffer(
+		mesh.meshletVertices.data(),
+		sizeof(uint32_t) * mesh.meshletVertices.size(),
+		VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+		meshletVertexBuffer,
+		meshletVertexMemory);
+
+	createMeshBuffer(
+		triangles.data(),
+		triangles.size(),
+		VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+		meshletTriangleBuffer,
+		meshletTriangleMemory);
+
+	createMeshBuffer(
+		mesh.vertices.data(),
+		sizeof(Vertex) * mesh.vertices.size(),
+		VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
+		vertexBuffer,
+		vertexMemory);
+
+	createMeshBuffer(
+		mesh.indices.data(),
+		sizeof(uint32_t) * mesh.indices.size(),
+		VK_BUFFER_USAGE_INDEX_BUFFER_BIT,
+		indexBuffer,
+		indexMemory);
+
+	// One command for every meshlet of every object
+	Utility::createBuffer(
+		device,
+		allocator,
+		memoryProperties,
+		sizeof(VkDrawIndexedIndirectCommand) * meshletCount * maxObjects,
+		VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT,
+		VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+		drawBuffer,
+		drawMemory);
+
+	VkBuffer buffers[MESHLET_BINDING_COUNT] =
+	{
+		meshletBuffer, objectBuffer, drawBuffer, counterBuffer,
+		meshletVertexBuffer, meshletTriangleBuffer, vertexBuffer, viewBuffer
+	};
+
+	VkDescriptorBufferInfo bufferInfos[MESHLET_BINDING_COUNT] = {};
+	for (uint32_t i = 0; i < MESHLET_BINDING_COUNT; ++i)
+	{
+		bufferInfos[i].buffer = buffers[i];
+		bufferInfos[i].range = VK_WHOLE_SIZE;
+	}
+
+	VkWriteDescriptorSet descriptorWrite = {};
+	descriptorWrite.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+	descriptorWrite.dstSet = descriptorSet;
+	descriptorWrite.dstBinding = 0;
+	descriptorWrite.descriptorCount = MESHLET_BINDING_COUNT;
+	descriptorWrite.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+	descriptorWrite.pBufferInfo = bufferInfos;
+
+	vkUpdateDescriptorSets(device, 1, &descriptorWrite, 0, nullptr);
+
+	step.meshletCount = meshletCount;
+	++drawVersion;
+}
+
+void MeshletRenderer::setObjects(const MeshletObject *objects, uint32_t objectCount)
+{
+	assert(objectCount <= maxObjects, "Too many meshlet objects.");
+
+	// The draw covers the commands of every object
+	if (objectCount != this->objects.size())
+		++drawVersion;
+
+	this->objects.assign(objects, objects + objectCount);
+	step.objectCount = objectCount;
+	++objectVersion;
+}
+
+void MeshletRenderer::setView(const CullingView &view)
+{
+	memcpy(step.planes, view.planes, sizeof(step.planes));
+	memcpy(step.cameraPosition, view.cameraPosition, sizeof(step.cameraPosition));
+	hasView = true;
+}
+
+void MeshletRenderer::setViewProjection(const float viewProjection[16])
+{
+	memcpy(this->viewProjection, viewProjection, sizeof(this->viewProjection));
+}
+
+void MeshletRenderer::setMaterial(const MeshletMaterial &material)
+{
+	assert(!material.usesMeshShaders || supportsMeshShaders(),
+		"Mesh shader materials need VK_EXT_mesh_shader.");
+
+	this->material = material;
+	hasMaterial = material.pipeline != VK_NULL_HANDLE;
+	++drawVersion;
+}
+
+void MeshletRenderer::recordCulling(VkCommandBuffer commandBuffer, uint32_t frameSlot)
+{
+	// The fence of the slot means its copy of the counters is done
+	readCounters(frameSlot);
+
+	if (meshletCount == 0 || objects.empty() || !hasView)
+		return;
+
+	// Task shaders cull while drawing, so there is nothing to cull without a
+	// material that draws
+	bool isMeshShaderCull = usesMeshShaders();
+	if (!isMeshShaderCull && cullPipeline == VK_NULL_HANDLE)
+		return;
+
+	VkPipelineStageFlags cullStage = VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
+#ifdef VK_EXT_mesh_shader
+	if (isMeshShaderCull)
+		cullStage = VK_PIPELINE_STAGE_TASK_SHADER_BIT_EXT | VK_PIPELINE_STAGE_MESH_SHADER_BIT_EXT;
+#endif
+
+	// The previous frame may still read the objects and counters, or copy
+	// the counters back
+	VkMemoryBarrier transferBarrier = {};
+	transferBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+	transferBarrier.srcAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+	transferBarrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT | VK_ACCESS_TRANSFER_WRITE_BIT;
+
+	vkCmdPipelineBarrier(
+		commandBuffer,
+		VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT |
+		VK_PIPELINE_STAGE_VERTEX_SHADER_BIT |
+		VK_PIPELINE_STAGE_TRANSFER_BIT |
+		cullStage,
+		VK_PIPELINE_STAGE_TRANSFER_BIT,
+		0,
+		1, &transferBarrier,
+		0, nullptr,
+		0, nullptr);
+
+	// The buffer is shared by all frame slots and already holds the objects
+	if (uploadedObjectVersion != objectVersion)
+	{
+		VkDeviceSize objectSize = sizeof(MeshletObject) * objects.size();
+		memcpy(stagingData[frameSlot], objects.data(), static_cast<size_t>(objectSize));
+
+		if (!isStagingCoherent)
+		{
+			VkMappedMemoryRange range = {};
+			range.sType = VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE;
+			range.memory = stagingMemory[frameSlot];
+			range.offset = 0;
+			range.size = VK_WHOLE_SIZE;
+			vkFlushMappedMemoryRanges(device, 1, &range);
+		}
+
+		VkBufferCopy copyRegion = {};
+		copyRegion.size = objectSize;
+
+		vkCmdCopyBuffer(commandBuffer, stagingBuffers[frameSlot], objectBuffer, 1, &copyRegion);
+		uploadedObjectVersion = objectVersion;
+	}
+
+	// The mesh shaders of the draw project with the view of this frame
+	if (isMeshShaderCull)
+		vkCmdUpdateBuffer(commandBuffer, viewBuffer, 0, sizeof(viewProjection), viewProjection);
+
+	vkCmdFillBuffer(commandBuffer, counterBuffer, 0, sizeof(MeshletCullCounters), 0);
+
+	VkMemoryBarrier cullBarrier = {};
+	cullBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+	cullBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+	cullBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+
+	vkCmdPipelineBarrier(
+		commandBuffer,
+		VK_PIPELINE_STAGE_TRANSFER_BIT,
+		cullStage | VK_PIPELINE_STAGE_VERTEX_SHADER_BIT,
+		0,
+		1, &cullBarrier,
+		0, nullptr,
+		0, nullptr);
+
+	if (!isMeshShaderCull)
+	{
+		// The last draw reads the commands this cull overwrites
+		VkMemoryBarrier drawBarrier = {};
+		drawBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+		drawBarrier.srcAccessMask = 0;
+		drawBarrier.dstAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+
+		vkCmdPipelineBarrier(
+			commandBuffer,
+			VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT,
+			VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+			0,
+			1, &drawBarrier,
+			0, nullptr,
+			0, nullptr);
+
+		vkCmdBindDescriptorSets(
+			commandBuffer,
+			VK_PIPELINE_BIND_POINT_COMPUTE,
+			pipelineLayout,
+			0,
+			1,
+			&descriptorSet,
+			0,
+			nullptr);
+
+		vkCmdPushConstants(
+			commandBuffer,
+			pipelineLayout,
+			cullStages,
+			0,
+			sizeof(MeshletCullStep),
+			&step);
+
+		uint32_t groupCount = (meshletCount * step.objectCount + MESHLET_GROUP_SIZE - 1) / MESHLET_GROUP_SIZE;
+
+		vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, cullPipeline);
+		vkCmdDispatch(commandBuffer, groupCount, 1, 1);
+
+		// The draw reads the commands
+		VkMemoryBarrier commandBarrier = {};
+		commandBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+		commandBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+		commandBarrier.dstAccessMask = VK_ACCESS_INDIRECT_COMMAND_READ_BIT | VK_ACCESS_TRANSFER_READ_BIT;
+
+		vkCmdPipelineBarrier(
+			commandBuffer,
+			VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+			VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT,
+			0,
+			1, &commandBarrier,
+			0, nullptr,
+			0, nullptr);
+
+		// Copied back right away, the draw does not touch the counters
+		recordCounterReadback(commandBuffer, frameSlot);
+		readbackCulls[frameSlot] = statistics.cullCount + 1;
+	}
+
+	++statistics.cullCount;
+	statistics.usesMeshShaders = isMeshShaderCull;
+	isReadbackPending = isMeshShaderCull;
+}
+
+void MeshletRenderer::recordDraws(VkCommandBuffer commandBuffer)
+{
+	if (!hasMaterial || meshletCount == 0 || objects.empty())
+		return;
+
+	uint32_t drawCount = meshletCount * step.objectCount;
+
+	vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, material.pipeline);
+
+#ifdef VK_EXT_mesh_shader
+	if (usesMeshShaders())
+	{
+		vkCmdBindDescriptorSets(
+			commandBuffer,
+			VK_PIPELINE_BIND_POINT_GRAPHICS,
+			pipelineLayout,
+			0,
+			1,
+			&descriptorSet,
+			0,
+			nullptr);
+
+		// The view changes every frame, but the push constants are part of
+		// the cached commands, so the task shaders read the step of the
+		// frame the commands were recorded in. Mesh shader materials are
+		// drawn from fresh commands whenever the view changed.
+		vkCmdPushConstants(
+			commandBuffer,
+			pipelineLayout,
+			cullStages,
+			0,
+			sizeof(MeshletCullStep),
+			&step);
+
+		fpVkCmdDrawMeshTasksEXT(commandBuffer, (drawCount + MESHLET_GROUP_SIZE - 1) / MESHLET_GROUP_SIZE, 1, 1);
+		return;
+	}
+#endif
+
+	if (material.descriptorSet != VK_NULL_HANDLE)
+	{
+		vkCmdBindDescriptorSets(
+			commandBuffer,
+			VK_PIPELINE_BIND_POINT_GRAPHICS,
+			material.pipelineLayout,
+			0,
+			1,
+			&material.descriptorSet,
+			0,
+			nullptr);
+	}
+
+	VkDeviceSize offset = 0;
+	vkCmdBindVertexBuffers(commandBuffer, 0, 1, &vertexBuffer, &offset);
+	vkCmdBindIndexBuffer(commandBuffer, indexBuffer, 0, VK_INDEX_TYPE_UINT32);
+
+	// Culled meshlets keep their command with no instances, so the draw
+	// count never depends on what the GPU found visible
+	for (uint32_t first = 0; first < drawCount; first += maxDrawIndirectCount)
+	{
+		vkCmdDrawIndexedIndirect(
+			commandBuffer,
+			drawBuffer,
+			sizeof(VkDrawIndexedIndirectCommand) * first,
+			std::min(maxDrawIndirectCount, drawCount - first),
+			sizeof(VkDrawIndexedIndirectCommand));
+	}
+}
+
+void MeshletRenderer::recordReadback(VkCommandBuffer commandBuffer, uint32_t frameSlot)
+{
+	if (!isReadbackPending)
+		return;
+
+	// The task shaders of the draw wrote the counters
+	VkPipelineStageFlags taskStage = VK_PIPELINE_STAGE_VERTEX_SHADER_BIT;
+#ifdef VK_EXT_mesh_shader
+	taskStage = VK_PIPELINE_STAGE_TASK_SHADER_BIT_EXT;
+#endif
+
+	VkMemoryBarrier counterBarrier = {};
+	counterBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+	counterBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+	counterBarrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+
+	vkCmdPipelineBarrier(
+		commandBuffer,
+		taskStage,
+		VK_PIPELINE_STAGE_TRANSFER_BIT,
+		0,
+		1, &counterBarrier,
+		0, nullptr,
+		0, nullptr);
+
+	recordCounterReadback(commandBuffer, frameSlot);
+	readbackCulls[frameSlot] = statistics.cullCount;
+	isReadbackPending = false;
+}
+
+void MeshletRenderer::collectStatistics()
+{
+	for (uint32_t i = 0; i < readbackCulls.size(); ++i)
+		readCounters(i);
+}
+
+bool MeshletRenderer::supportsMeshShaders() const
+{
+	return hasMeshShaders;
+}
+
+VkDescriptorSetLayout MeshletRenderer::getDescriptorSetLayout() const
+{
+	return descriptorSetLayout;
+}
+
+VkPipelineLayout MeshletRenderer::getPipelineLayout() const
+{
+	return pipelineLayout;
+}
+
+VkDescriptorBufferInfo MeshletRenderer::getObjectBufferInfo() const
+{
+	VkDescriptorBufferInfo bufferInfo = {};
+	bufferInfo.buffer = objectBuffer;
+	bufferInfo.offset = 0;
+	bufferInfo.range = VK_WHOLE_SIZE;
+
+	return bufferInfo;
+}
+
+MeshletRendererStatistics MeshletRenderer::getStatistics() const
+{
+	return statistics;
+}
+
+uint64_t MeshletRenderer::getDrawVersion() const
+{
+	// Task shaders take the view from the push constants of the draw
+	if (usesMeshShaders())
+		return drawVersion + statistics.cullCount;
+
+	return drawVersion;
+}
+
+bool MeshletRenderer::usesMeshShaders() const
+{
+	return hasMaterial && material.usesMeshShaders;
+}
+
+void MeshletRenderer::recordCounterReadback(VkCommandBuffer commandBuffer, uint32_t frameSlot)
+{
+	VkBufferCopy copyRegion = {};
+	copyRegion.size = sizeof(MeshletCullCounters);
+
+	vkCmdCopyBuffer(commandBuffer, counterBuffer, readbackBuffers[frameSlot], 1, &copyRegion);
+
+	// The fill of the next cull has to wait for the copy as well
+	VkMemoryBarrier readbackBarrier = {};
+	readbackBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+	readbackBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT | VK_ACCESS_TRANSFER_READ_BIT;
+	readbackBarrier.dstAccessMask = VK_ACCESS_HOST_READ_BIT | VK_ACCESS_TRANSFER_WRITE_BIT;
+
+	vkCmdPipelineBarrier(
+		commandBuffer,
+		VK_PIPELINE_STAGE_TRANSFER_BIT,
+		VK_PIPELINE_STAGE_HOST_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT,
+		0,
+		1, &readbackBarrier,
+		0, nullptr,
+		0, nullptr);
+}
+
+void MeshletRenderer::readCounters(uint32_t frameSlot)
+{
+	if (readbackCulls[frameSlot] <= statistics.countersCull)
+		return;
+
+	if (!isReadbackCoherent)
+	{
+		VkMappedMemoryRange range = {};
+		range.sType = VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE;
+		range.memory = readbackMemory[frameSlot];
+		range.offset = 0;
+		range.size = VK_WHOLE_SIZE;
+
+		vkInvalidateMappedMemoryRanges(device, 1, &range);
+	}
+
+	memcpy(&statistics.counters, readbackData[frameSlot], sizeof(MeshletCullCounters));
+	statistics.countersCull = readbackCulls[frameSlot];
+}
+
+VkShaderModule MeshletRenderer::createShaderModule(const std::vector<uint32_t> &code)
+{
+	VkShaderModuleCreateInfo moduleCreateInfo = {};
+	moduleCreateInfo.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
+	moduleCreateInfo.codeSize = sizeof(uint32_t) * code.size();
+	moduleCreateInfo.pCode = code.data();
+
+	VkShaderModule shaderModule = VK_NULL_HANDLE;
+	VkResult result = vkCreateShaderModule(device, &moduleCreateInfo, allocator, &shaderModule);
+	Utility::checkVulkanResult(result, "Failed to create a meshlet shader module.");
+
+	return shaderModule;
+}
+
+VkPipeline MeshletRenderer::createComputePipeline(VkShaderModule shaderModule, VkPipelineCache pipelineCache)
+{
+	VkComputePipelineCreateInfo pipelineCreateInfo = {};
+	pipelineCreateInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+	pipelineCreateInfo.stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+	pipelineCreateInfo.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+	pipelineCreateInfo.stage.module = shaderModule;
+	pipelineCreateInfo.stage.pName = "main";
+	pipelineCreateInfo.layout = pipelineLayout;
+
+	VkPipeline pipeline = VK_NULL_HANDLE;
+	VkResult result = vkCreateComputePipelines(
+		device,
+		pipelineCache,
+		1,
+		&pipelineCreateInfo,
+		allocator,
+		&pipeline);
+
+	Utility::checkVulkanResult(result, "Failed to create the meshlet cull pipeline.");
+
+	return pipeline;
+}
+
+void MeshletRenderer::createMeshBuffer(
+	const void *data,
+	VkDeviceSize size,
+	VkBufferUsageFlags usage,
+	VkBuffer &buffer,
+	VkDeviceMemory &memory)
+{
+	// Written once, coherent memory saves the flush
+	Utility::createBuffer(
+		device,
+		allocator,
+		memoryProperties,
+		size,
+		usage,
+		VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+		buffer,
+		memory);
+
+	void *mapped = nullptr;
+	VkResult result = vkMapMemory(device, memory, 0, VK_WHOLE_SIZE, 0, &mapped);
+	Utility::checkVulkanResult(result, "Failed to map a meshlet buffer.");
+
+	memcpy(mapped, data, static_cast<size_t>(size));
+	vkUnmapMemory(device, memory);
+}
\ No newline at end of file
@@ -0,0 +1,786 @@
+#include "LearningVulkan/MultiviewPass.hpp"
+#include "LearningVulkan/Renderer.hpp"
+#include "LearningVulkan/Utility.hpp"
+
+#include <assert.h>
+#include <cfloat>
+#include <cmath>
+#include <cstring>
+
+const VkFormat MULTIVIEW_DEPTH_FORMAT = VK_FORMAT_D16_UNORM;
+
+// Planes of two views count as the same if they differ by less than this
+const float SHARED_PLANE_TOLERANCE = 1e-4f;
+
+static float planeDistance(const float plane[4], const float point[3])
+{
+	return plane[0] * point[0] + plane[1] * point[1] + plane[2] * point[2] + plane[3];
+}
+
+static bool arePlanesShared(const CullingView *views, uint32_t viewCount, uint32_t planeIndex)
+{
+	const float *first = views[0].planes[planeIndex];
+
+	for (uint32_t i = 1; i < viewCount; ++i)
+	{
+		const float *plane = views[i].planes[planeIndex];
+
+		// The distance is compared relative to its size, far planes are far
+		float distanceTolerance = SHARED_PLANE_TOLERANCE * fmaxf(1.0f, fabsf(first[3]));
+
+		if (fabsf(plane[0] - first[0]) > SHARED_PLANE_TOLERANCE ||
+			fabsf(plane[1] - first[1]) > SHARED_PLANE_TOLERANCE ||
+			fabsf(plane[2] - first[2]) > SHARED_PLANE_TOLERANCE ||
+			fabsf(plane[3] - first[3]) > distanceTolerance)
+		{
+			return false;
+		}
+	}
+
+	return true;
+}
+
+// Point where three planes meet, false if two of them are parallel
+static bool intersectPlanes(const float *a, const float *b, const float *c, float point[3])
+{
+	float bc[3] = { b[1] * c[2] - b[2] * c[1], b[2] * c[0] - b[0] * c[2], b[0] * c[1] - b[1] * c[0] };
+	float ca[3] = { c[1] * a[2] - c[2] * a[1], c[2] * a[0] - c[0] * a[2], c[0] * a[1] - c[1] * a[0] };
+	float ab[3] = { a[1] * b[2] - a[2] * b[1], a[2] * b[0] - a[0] * b[2], a[0] * b[1] - a[1] * b[0] };
+
+	float determinant = a[0] * bc[0] + a[1] * bc[1] + a[2] * bc[2];
+	if (fabsf(determinant) < 1e-6f)
+		return false;
+
+	for (int k = 0; k < 3; ++k)
+		point[k] = -(a[3] * bc[k] + b[3] * ca[k] + c[3] * ab[k]) / determinant;
+
+	return true;
+}
+
+MultiviewCullingView makeMultiviewCullingView(const CullingView *views, uint32_t viewCount)
+{
+	assert(viewCount != 0 && viewCount <= MAX_MULTIVIEW_VIEWS, "Unsupported number of views.");
+
+	MultiviewCullingView view = {};
+	view.viewCount = viewCount;
+	memcpy(view.views, views, sizeof(CullingView) * viewCount);
+
+	for (uint32_t i = 0; i < 6; ++i)
+	{
+		if (arePlanesShared(views, viewCount, i))
+			memcpy(view.sharedPlanes[view.sharedPlaneCount++], views[0].planes[i], sizeof(float) * 4);
+		else
+			view.viewPlanes[view.viewPlaneCount++] = i;
+	}
+
+	// Sphere around the corners of every frustum, left or right, top or
+	// bottom, near or far
+	float corners[MAX_MULTIVIEW_VIEWS * 8][3];
+	uint32_t cornerCount = 0;
+	bool isBounded = true;
+
+	for (uint32_t i = 0; i < viewCount && isBounded; ++i)
+	{
+		for (uint32_t corner = 0; corner < 8 && isBounded; ++corner)
+		{
+			isBounded = intersectPlanes(
+				views[i].planes[corner & 1],
+				views[i].planes[2 + ((corner >> 1) & 1)],
+				views[i].planes[4 + (corner >> 2)],
+				corners[cornerCount++]);
+		}
+	}
+
+	// Without bounds the sphere test passes everything
+	view.boundsRadius = FLT_MAX;
+	if (!isBounded)
+		return view;
+
+	for (uint32_t i = 0; i < cornerCount; ++i)
+	{
+		for (int k = 0; k < 3; ++k)
+			view.boundsCenter[k] += corners[i][k] / cornerCount;
+	}
+
+	float radiusSquared = 0.0f;
+	for (uint32_t i = 0; i < cornerCount; ++i)
+	{
+		float dx = corners[i][0] - view.boundsCenter[0];
+		float dy = corners[i][1] - view.boundsCenter[1];
+		float dz = corners[i][2] - view.boundsCenter[2];
+
+		radiusSquared = fmaxf(radiusSquared, dx * dx + dy * dy + dz * dz);
+	}
+
+	view.boundsRadius = sqrtf(radiusSquared);
+	return view;
+}
+
+uint32_t cullSphereMultiview(const MultiviewCullingView &view, const float center[3], float radius)
+{
+	if (view.boundsRadius != FLT_MAX)
+	{
+		float dx = center[0] - view.boundsCenter[0];
+		float dy = center[1] - view.boundsCenter[1];
+		float dz = center[2] - view.boundsCenter[2];
+		float reach = view.boundsRadius + radius;
+
+		if (dx * dx + dy * dy + dz * dz > reach * reach)
+			return 0;
+	}
+
+	for (uint32_t i = 0; i < view.sharedPlaneCount; ++i)
+	{
+		if (planeDistance(view.sharedPlanes[i], center) < -radius)
+			return 0;
+	}
+
+	uint32_t viewMask = 0;
+
+	for (uint32_t i = 0; i < view.viewCount; ++i)
+	{
+		bool isVisible = true;
+
+		for (uint32_t j = 0; j < view.viewPlaneCount && isVisible; ++j)
+			isVisible = planeDistance(view.views[i].planes[view.viewPlanes[j]], center) >= -radius;
+
+		if (isVisible)
+			viewMask |= 1u << i;
+	}
+
+	return viewMask;
+}
+
+uint32_t cullSpherePerView(const CullingView *views, uint32_t viewCount, const float center[3], float radius)
+{
+	uint32_t viewMask = 0;
+
+	for (uint32_t i = 0; i < viewCount; ++i)
+	{
+		bool isVisible = true;
+
+		for (uint32_t j = 0; j < 6 && isVisible; ++j)
+			isVisible = planeDistance(views[i].planes[j], center) >= -radius;
+
+		if (isVisible)
+			viewMask |= 1u << i;
+	}
+
+	return viewMask;
+}
+
+void makeCubeViewProjections(
+	const float position[3],
+	float nearPlane,
+	float farPlane,
+	float viewProjections[6][16])
+{
+	// Directions of the texture coordinates s and t and of the major axis
+	// of every face, as the cube map lookup defines them. Clip space x goes
+	// along s and y along t, so no face has to be flipped.
+	static const float faces[6][3][3] =
+	{
+		{ { 0.0f, 0.0f, -1.0f }, { 0.0f, -1.0f, 0.0f }, { 1.0f, 0.0f, 0.0f } },
+		{ { 0.0f, 0.0f, 1.0f }, { 0.0f, -1.0f, 0.0f }, { -1.0f, 0.0f, 0.0f } },
+		{ { 1.0f, 0.0f, 0.0f }, { 0.0f, 0.0f, 1.0f }, { 0.0f, 1.0f, 0.0f } },
+		{ { 1.0f, 0.0f, 0.0f }, { 0.0f, 0.0f, -1.0f }, { 0.0f, -1.0f, 0.0f } },
+		{ { 1.0f, 0.0f, 0.0f }, { 0.0f, -1.0f, 0.0f }, { 0.0f, 0.0f, 1.0f } },
+		{ { -1.0f, 0.0f, 0.0f }, { 0.0f, -1.0f, 0.0f }, { 0.0f, 0.0f, -1.0f } }
+	};
+
+	// Depth goes from 0 at the near plane to 1 at the far plane, with a
+	// field of view of 90 degrees the focal length is 1
+	float depthScale = farPlane / (farPlane - nearPlane);
+	float depthOffset = -farPlane * nearPlane / (farPlane - nearPlane);
+
+	for (uint32_t face = 0; face < 6; ++face)
+	{
+		const float *s = faces[face][0];
+		const float *t = faces[face][1];
+		const float *forward = faces[face][2];
+		float *matrix = viewProjections[face];
+
+		for (int k = 0; k < 3; ++k)
+		{
+			matrix[0 + k] = s[k];
+			matrix[4 + k] = t[k];
+			matrix[8 + k] = forward[k] * depthScale;
+			matrix[12 + k] = forward[k];
+		}
+
+		float forwardOffset = -(forward[0] * position[0] + forward[1] * position[1] + forward[2] * position[2]);
+
+		matrix[3] = -(s[0] * position[0] + s[1] * position[1] + s[2] * position[2]);
+		matrix[7] = -(t[0] * position[0] + t[1] * position[1] + t[2] * position[2]);
+		matrix[11] = forwardOffset * depthScale + depthOffset;
+		matrix[15] = forwardOffset;
+	}
+}
+
+MultiviewPass::MultiviewPass() :
+	device(VK_NULL_HANDLE),
+	allocator(nullptr),
+	useMultiview(false),
+	isStagingCoherent(true),
+	colorImage(VK_NULL_HANDLE),
+	colorMemory(VK_NULL_HANDLE),
+	colorView(VK_NULL_HANDLE),
+	depthImage(VK_NULL_HANDLE),
+	depthMemory(VK_NULL_HANDLE),
+	renderPass(VK_NULL_HANDLE),
+	viewBuffer(VK_NULL_HANDLE),
+	viewMemory(VK_NULL_HANDLE),
+	drawFunction(nullptr),
+	drawData(nullptr),
+	viewVersion(0),
+	uploadedVersion(0)
+{
+	settings = {};
+	cullingView = {};
+	statistics = {};
+	memset(views, 0, sizeof(views));
+}
+
+MultiviewPass::~MultiviewPass()
+{
+	destroy();
+}
+
+void MultiviewPass::initialize(const VulkanContext &context, const MultiviewSettings &settings)
+{
+	assert(settings.viewCount != 0 && settings.viewCount <= MAX_MULTIVIEW_VIEWS,
+		"Unsupported number of views.");
+	assert(!settings.isCubeMap || (settings.viewCount == 6 && settings.width == settings.height),
+		"Cube maps need six square views.");
+
+	device = context.device;
+	allocator = context.allocator;
+	this->settings = settings;
+
+	// Falls back to a pass per view if the device cannot render all at once
+	useMultiview =
+		context.supportsMultiview &&
+		!settings.forcePerView &&
+		settings.viewCount <= context.maxMultiviewViewCount;
+
+	createImage(
+		context,
+		settings.colorFormat,
+		VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT,
+		VK_IMAGE_ASPECT_COLOR_BIT,
+		colorImage,
+		colorMemory);
+
+	createImage(
+		context,
+		MULTIVIEW_DEPTH_FORMAT,
+		VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT,
+		VK_IMAGE_ASPECT_DEPTH_BIT,
+		depthImage,
+		depthMemory);
+
+	colorView = createImageView(
+		colorImage,
+		settings.isCubeMap ? VK_IMAGE_VIEW_TYPE_CUBE : VK_IMAGE_VIEW_TYPE_2D_ARRAY,
+		settings.colorFormat,
+		VK_IMAGE_ASPECT_COLOR_BIT,
+		0,
+		settings.viewCount);
+
+	createRenderPass();
+
+	// Multiview renders into every layer through a single framebuffer
+	uint32_t framebufferCount = useMultiview ? 1 : settings.viewCount;
+	framebuffers.resize(framebufferCount);
+
+	for (uint32_t i = 0; i < framebufferCount; ++i)
+	{
+		uint32_t layerCount = useMultiview ? settings.viewCount : 1;
+
+		VkImageView attachments[2];
+		attachments[0] = createImageView(
+			colorImage,
+			VK_IMAGE_VIEW_TYPE_2D_ARRAY,
+			settings.colorFormat,
+			VK_IMAGE_ASPECT_COLOR_BIT,
+			i,
+			layerCount);
+
+		attachments[1] = createImageView(
+			depthImage,
+			VK_IMAGE_VIEW_TYPE_2D_ARRAY,
+			MULTIVIEW_DEPTH_FORMAT,
+			VK_IMAGE_ASPECT_DEPTH_BIT,
+			i,
+			layerCount);
+
+		attachmentViews.push_back(attachments[0]);
+		attachmentViews.push_back(attachments[1]);
+
+		VkFramebufferCreateInfo framebufferCreateInfo = {};
+		framebufferCreateInfo.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
+		framebufferCreateInfo.renderPass = renderPass;
+		framebufferCreateInfo.attachmentCount = 2;
+		framebufferCreateInfo.pAttachments = attachments;
+		framebufferCreateInfo.width = settings.width;
+		framebufferCreateInfo.height = settings.height;
+		framebufferCreateInfo.layers = 1;
+
+		VkResult result = vkCreateFramebuffer(device, &framebufferCreateInfo, allocator, &framebuffers[i]);
+		Utility::checkVulkanResult(result, "Failed to create a multiview framebuffer.");
+	}
+
+	VkDeviceSize viewSize = sizeof(MultiviewViewData) * settings.viewCount;
+
+	// Room for the most views, so shaders can declare a fixed array
+	Utility::createBuffer(
+		device,
+		allocator,
+		context.physicalDeviceMemoryProperties,
+		sizeof(MultiviewViewData) * MAX_MULTIVIEW_VIEWS,
+		VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+		VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+		viewBuffer,
+		viewMemory);
+
+	stagingBuffers.resize(context.framesInFlight);
+	stagingMemory.resize(context.framesInFlight);
+	stagingData.resize(context.framesInFlight);
+
+	for (uint32_t i = 0; i < context.framesInFlight; ++i)
+	{
+		Utility::createBuffer(
+			device,
+			allocator,
+			context.physicalDeviceMemoryProperties,
+			viewSize,
+			VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+			VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT,
+			stagingBuffers[i],
+			stagingMemory[i]);
+
+		// Stays mapped for the lifetime of the buffer
+		VkResult result = vkMapMemory(
+			device,
+			stagingMemory[i],
+			0,
+			VK_WHOLE_SIZE,
+			0,
+			&stagingData[i]);
+
+		Utility::checkVulkanResult(result, "Failed to map a multiview staging buffer.");
+	}
+
+	// All staging buffers use the same memory type
+	VkMemoryRequirements memoryRequirements = {};
+	vkGetBufferMemoryRequirements(device, stagingBuffers[0], &memoryRequirements);
+
+	uint32_t memoryTypeIndex = 0;
+	Utility::findMemoryType(
+		context.physicalDeviceMemoryProperties,
+		memoryRequirements.memoryTypeBits,
+		VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT,
+		memoryTypeIndex);
+
+	isStagingCoherent =
+		(context.physicalDeviceMemoryProperties.memoryTypes[memoryTypeIndex].propertyFlags &
+		VK_MEMORY_PROPERTY_HOST_COHERENT_BIT) != 0;
+
+	cullingView.viewCount = settings.viewCount;
+	cullingView.boundsRadius = FLT_MAX;
+}
+
+void MultiviewPass::destroy()
+{
+	if (device == VK_NULL_HANDLE)
+		return;
+
+	for (uint32_t i = 0; i < stagingBuffers.size(); ++i)
+	{
+		vkUnmapMemory(device, stagingMemory[i]);
+		vkDestroyBuffer(device, stagingBuffers[i], allocator);
+		vkFreeMemory(device, stagingMemory[i], allocator);
+	}
+
+	vkDestroyBuffer(device, viewBuffer, allocator);
+	vkFreeMemory(device, viewMemory, allocator);
+
+	for (VkFramebuffer framebuffer : framebuffers)
+		vkDestroyFramebuffer(device, framebuffer, allocator);
+
+	for (VkImageView view : attachmentViews)
+		vkDestroyImageView(device, view, allocator);
+
+	vkDestroyRenderPass(device, renderPass, allocator);
+
+	vkDestroyImageView(device, colorView, allocator);
+	vkDestroyImage(device, colorImage, allocator);
+	vkFreeMemory(device, colorMemory, allocator);
+	vkDestroyImage(device, depthImage, allocator);
+	vkFreeMemory(device, depthMemory, allocator);
+
+	framebuffers.clear();
+	attachmentViews.clear();
+	stagingBuffers.clear();
+	stagingMemory.clear();
+	stagingData.clear();
+	device = VK_NULL_HANDLE;
+}
+
+void MultiviewPass::setDrawFunction(MultiviewDrawFunction drawFunction, void *data)
+{
+	this->drawFunction = drawFunction;
+	drawData = data;
+}
+
+void MultiviewPass::setViews(const MultiviewViewData *views)
+{
+	memcpy(this->views, views, sizeof(MultiviewViewData) * settings.viewCount);
+
+	CullingView cullingViews[MAX_MULTIVIEW_VIEWS];
+	for (uint32_t i = 0; i < settings.viewCount; ++i)
+		cullingViews[i] = makeCullingView(views[i].viewProjection, views[i].cameraPosition);
+
+	cullingView = makeMultiviewCullingView(cullingViews, settings.viewCount);
+	++viewVersion;
+}
+
+void MultiviewPass::recordPass(VkCommandBuffer commandBuffer, uint32_t frameSlot)
+{
+	if (device == VK_NULL_HANDLE)
+		return;
+
+	uploadViews(commandBuffer, frameSlot);
+
+	// Both images are cleared, earlier frames only have to be done reading
+	// the color image
+	VkImageMemoryBarrier barriers[2] = {};
+	barriers[0].sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+	barriers[0].srcAccessMask = 0;
+	barriers[0].dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+	barriers[0].oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+	barriers[0].newLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+	barriers[0].srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	barriers[0].dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	barriers[0].image = colorImage;
+	barriers[0].subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+	barriers[0].subresourceRange.baseMipLevel = 0;
+	barriers[0].subresourceRange.levelCount = 1;
+	barriers[0].subresourceRange.baseArrayLayer = 0;
+	barriers[0].subresourceRange.layerCount = settings.viewCount;
+
+	barriers[1] = barriers[0];
+	barriers[1].srcAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+	barriers[1].dstAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+	barriers[1].newLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+	barriers[1].image = depthImage;
+	barriers[1].subresourceRange.aspectMask = VK_IMAGE_ASPECT_DEPTH_BIT;
+
+	vkCmdPipelineBarrier(
+		commandBuffer,
+		VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT,
+		VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT,
+		0,
+		0, nullptr,
+		0, nullptr,
+		2, barriers);
+
+	VkClearValue clearValues[2] = {};
+	clearValues[0].color = { { 0.0f, 0.0f, 0.0f, 1.0f } };
+	clearValues[1].depthStencil = { 1.0f, 0 };
+
+	VkRenderPassBeginInfo renderPassBeginInfo = {};
+	renderPassBeginInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+	renderPassBeginInfo.renderPass = renderPass;
+	renderPassBeginInfo.renderArea.offset = { 0, 0 };
+	renderPassBeginInfo.renderArea.extent = { settings.width, settings.height };
+	renderPassBeginInfo.clearValueCount = 2;
+	renderPassBeginInfo.pClearValues = clearValues;
+
+	VkViewport viewport = {};
+	viewport.width = static_cast<float>(settings.width);
+	viewport.height = static_cast<float>(settings.height);
+	viewport.maxDepth = 1.0f;
+
+	VkRect2D scissor = renderPassBeginInfo.renderArea;
+
+	for (uint32_t i = 0; i < framebuffers.size(); ++i)
+	{
+		renderPassBeginInfo.framebuffer = framebuffers[i];
+		vkCmdBeginRenderPass(commandBuffer, &renderPassBeginInfo, VK_SUBPASS_CONTENTS_INLINE);
+
+		vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
+		vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
+
+		if (drawFunction)
+		{
+			MultiviewDraw draw = {};
+			draw.viewMask = useMultiview ? (1u << settings.viewCount) - 1 : 1u << i;
+			draw.viewIndex = i;
+			draw.isMultiview = useMultiview;
+			draw.cullingView = &cullingView;
+
+			drawFunction(drawData, commandBuffer, draw);
+		}
+
+		vkCmdEndRenderPass(commandBuffer);
+	}
+
+	barriers[0].srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+	barriers[0].dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+	barriers[0].oldLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+	barriers[0].newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+
+	vkCmdPipelineBarrier(
+		commandBuffer,
+		VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
+		VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
+		0,
+		0, nullptr,
+		0, nullptr,
+		1, barriers);
+
+	statistics.renderPassCount = static_cast<uint32_t>(framebuffers.size());
+	statistics.totalRenderPassCount += framebuffers.size();
+	++statistics.recordCount;
+}
+
+bool MultiviewPass::isMultiview() const
+{
+	return useMultiview;
+}
+
+const MultiviewSettings &MultiviewPass::getSettings() const
+{
+	return settings;
+}
+
+VkRenderPass MultiviewPass::getRenderPass() const
+{
+	return renderPass;
+}
+
+VkDescriptorImageInfo MultiviewPass::getColorImageInfo() const
+{
+	VkDescriptorImageInfo imageInfo = {};
+	imageInfo.sampler = VK_NULL_HANDLE;
+	imageInfo.imageView = colorView;
+	imageInfo.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+
+	return imageInfo;
+}
+
+VkDescriptorBufferInfo MultiviewPass::getViewBufferInfo() const
+{
+	VkDescriptorBufferInfo bufferInfo = {};
+	bufferInfo.buffer = viewBuffer;
+	bufferInfo.offset = 0;
+	bufferInfo.range = VK_WHOLE_SIZE;
+
+	return bufferInfo;
+}
+
+const MultiviewCullingView &MultiviewPass::getCullingView() const
+{
+	return cullingView;
+}
+
+MultiviewStatistics MultiviewPass::getStatistics() const
+{
+	return statistics;
+}
+
+void MultiviewPass::createImage(
+	const VulkanContext &context,
+	VkFormat format,
+	VkImageUsageFlags usage,
+	VkImageAspectFlags aspectMask,
+	VkImage &image,
+	VkDeviceMemory &memory)
+{
+	VkImageCreateInfo imageCreateInfo = {};
+	imageCreateInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+	imageCreateInfo.imageType = VK_IMAGE_TYPE_2D;
+	imageCreateInfo.format = format;
+	imageCreateInfo.extent.width = settings.width;
+	imageCreateInfo.extent.height = settings.height;
+	imageCreateInfo.extent.depth = 1;
+	imageCreateInfo.mipLevels = 1;
+	imageCreateInfo.arrayLayers = settings.viewCount;
+	imageCreateInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+	imageCreateInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+	imageCreateInfo.usage = usage;
+	imageCreateInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+	imageCreateInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+
+	// Only the color image is sampled
+	if (settings.isCubeMap && aspectMask == VK_IMAGE_ASPECT_COLOR_BIT)
+		imageCreateInfo.flags = VK_IMAGE_CREATE_CUBE_COMPATIBLE_BIT;
+
+	VkResult result = vkCreateImage(device, &imageCreateInfo, allocator, &image);
+	Utility::checkVulkanResult(result, "Failed to create a multiview image.");
+
+	VkMemoryRequirements memoryRequirements = {};
+	vkGetImageMemoryRequirements(device, image, &memoryRequirements);
+
+	VkMemoryAllocateInfo allocateInfo = {};
+	allocateInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+	allocateInfo.allocationSize = memoryRequirements.size;
+
+	bool hasMemoryType = Utility::findMemoryType(
+		context.physicalDeviceMemoryProperties,
+		memoryRequirements.memoryTypeBits,
+		VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+		allocateInfo.memoryTypeIndex);
+
+	assert(hasMemoryType, "No device local memory for the multiview images.");
+
+	result = vkAllocateMemory(device, &allocateInfo, allocator, &memory);
+	Utility::checkVulkanResult(result, "Failed to allocate memory for a multiview image.");
+
+	result = vkBindImageMemory(device, image, memory, 0);
+	Utility::checkVulkanResult(result, "Failed to bind memory for a multiview image.");
+}
+
+VkImageView MultiviewPass::createImageView(
+	VkImage image,
+	VkImageViewType viewType,
+	VkFormat format,
+	VkImageAspectFlags aspectMask,
+	uint32_t baseLayer,
+	uint32_t layerCount)
+{
+	VkImageViewCreateInfo viewCreateInfo = {};
+	viewCreateInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+	viewCreateInfo.image = image;
+	viewCreateInfo.viewType = viewType;
+	viewCreateInfo.format = format;
+	viewCreateInfo.subresourceRange.aspectMask = aspectMask;
+	viewCreateInfo.subresourceRange.baseMipLevel = 0;
+	viewCreateInfo.subresourceRange.levelCount = 1;
+	viewCreateInfo.subresourceRange.baseArrayLayer = baseLayer;
+	viewCreateInfo.subresourceRange.layerCount = layerCount;
+
+	VkImageView view = VK_NULL_HANDLE;
+	VkResult result = vkCreateImageView(device, &viewCreateInfo, allocator, &view);
+	Utility::checkVulkanResult(result, "Failed to create a multiview image view.");
+
+	return view;
+}
+
+void MultiviewPass::createRenderPass()
+{
+	VkAttachmentDescription passAttachments[2] = {};
+	passAttachments[0].format = settings.colorFormat;
+	passAttachments[0].samples = VK_SAMPLE_COUNT_1_BIT;
+	passAttachments[0].loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+	passAttachments[0].storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+	passAttachments[0].stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+	passAttachments[0].stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+	passAttachments[0].initialLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+	passAttachments[0].finalLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+
+	passAttachments[1].format = MULTIVIEW_DEPTH_FORMAT;
+	passAttachments[1].samples = VK_SAMPLE_COUNT_1_BIT;
+	passAttachments[1].loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+	passAttachments[1].storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+	passAttachments[1].stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+	passAttachments[1].stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+	passAttachments[1].initialLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+	passAttachments[1].finalLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+
+	VkAttachmentReference colorAttachmentReference = {};
+	colorAttachmentReference.attachment = 0;
+	colorAttachmentReference.layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+
+	VkAttachmentReference depthAttachmentReference = {};
+	depthAttachmentReference.attachment = 1;
+	depthAttachmentReference.layout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+
+	VkSubpassDescription subpass = {};
+	subpass.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
+	subpass.colorAttachmentCount = 1;
+	subpass.pColorAttachments = &colorAttachmentReference;
+	subpass.pDepthStencilAttachment = &depthAttachmentReference;
+
+	VkRenderPassCreateInfo renderPassCreateInfo = {};
+	renderPassCreateInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
+	renderPassCreateInfo.attachmentCount = 2;
+	renderPassCreateInfo.pAttachments = passAttachments;
+	renderPassCreateInfo.subpassCount = 1;
+	renderPassCreateInfo.pSubpasses = &subpass;
+
+	// The subpass is broadcast to every view, and the views are close enough
+	// to each other for the driver to share work between them
+	uint32_t viewMask = (1u << settings.viewCount) - 1;
+
+	VkRenderPassMultiviewCreateInfo multiviewCreateInfo = {};
+	multiviewCreateInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_MULTIVIEW_CREATE_INFO;
+	multiviewCreateInfo.subpassCount = 1;
+	multiviewCreateInfo.pViewMasks = &viewMask;
+	multiviewCreateInfo.correlationMaskCount = 1;
+	multiviewCreateInfo.pCorrelationMasks = &viewMask;
+
+	if (useMultiview)
+		renderPassCreateInfo.pNext = &multiviewCreateInfo;
+
+	VkResult result = vkCreateRenderPass(device, &renderPassCreateInfo, allocator, &renderPass);
+	Utility::checkVulkanResult(result, "Failed to create the multiview render pass.");
+}
+
+void MultiviewPass::uploadViews(VkCommandBuffer commandBuffer, uint32_t frameSlot)
+{
+	if (uploadedVersion == viewVersion)
+		return;
+
+	VkBufferCopy region = {};
+	region.size = sizeof(MultiviewViewData) * settings.viewCount;
+
+	memcpy(stagingData[frameSlot], views, static_cast<size_t>(region.size));
+
+	if (!isStagingCoherent)
+	{
+		VkMappedMemoryRange range = {};
+		range.sType = VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE;
+		range.memory = stagingMemory[frameSlot];
+		range.offset = 0;
+		range.size = VK_WHOLE_SIZE;
+		vkFlushMappedMemoryRanges(device, 1, &range);
+	}
+
+	// Previous frames may still be drawing with the old views
+	VkBufferMemoryBarrier bufferBarrier = {};
+	bufferBarrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+	bufferBarrier.srcAccessMask = VK_ACCESS_UNIFORM_READ_BIT;
+	bufferBarrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+	bufferBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	bufferBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	bufferBarrier.buffer = viewBuffer;
+	bufferBarrier.offset = 0;
+	bufferBarrier.size = VK_WHOLE_SIZE;
+
+	vkCmdPipelineBarrier(
+		commandBuffer,
+		VK_PIPELINE_STAGE_VERTEX_SHADER_BIT | VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
+		VK_PIPELINE_STAGE_TRANSFER_BIT,
+		0,
+		0, nullptr,
+		1, &bufferBarrier,
+		0, nullptr);
+
+	vkCmdCopyBuffer(commandBuffer, stagingBuffers[frameSlot], viewBuffer, 1, &region);
+
+	bufferBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+	bufferBarrier.dstAccessMask = VK_ACCESS_UNIFORM_READ_BIT;
+
+	vkCmdPipelineBarrier(
+		commandBuffer,
+		VK_PIPELINE_STAGE_TRANSFER_BIT,
+		VK_PIPELINE_STAGE_VERTEX_SHADER_BIT | VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
+		0,
+		0, nullptr,
+		1, &bufferBarrier,
+		0, nullptr);
+
+	uploadedVersion = viewVersion;
+}
\ No newline at end of file
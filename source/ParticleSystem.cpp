@@ -0,0 +1,768 @@
+#include "LearningVulkan/ParticleSystem.hpp"
+#include "LearningVulkan/Renderer.hpp"
+#include "LearningVulkan/Utility.hpp"
+#include "LearningVulkan/WorkloadTrace.hpp"
+
+#include <algorithm>
+#include <assert.h>
+#include <cmath>
+#include <cstddef>
+#include <cstring>
+
+const float PARTICLE_PI = 3.14159265358979f;
+
+uint32_t particleHash(uint32_t value)
+{
+	uint32_t state = value * 747796405u + 2891336453u;
+	uint32_t word = ((state >> ((state >> 28u) + 4u)) ^ state) * 277803737u;
+	return (word >> 22u) ^ word;
+}
+
+float particleRandom(uint32_t seed, uint32_t index, uint32_t channel)
+{
+	// 24 bits are all a float holds below one
+	uint32_t bits = particleHash(seed ^ particleHash(index * 8 + channel));
+	return static_cast<float>(bits >> 8) * (1.0f / 16777216.0f);
+}
+
+// Direction that is uniform on the unit sphere
+static void randomDirection(const ParticleStep &step, uint32_t index, uint32_t channel, float direction[3])
+{
+	float z = 1.0f - 2.0f * particleRandom(step.seed, index, channel);
+	float ring = sqrtf(std::max(0.0f, 1.0f - z * z));
+	float angle = 2.0f * PARTICLE_PI * particleRandom(step.seed, index, channel + 1);
+
+	direction[0] = ring * cosf(angle);
+	direction[1] = ring * sinf(angle);
+	direction[2] = z;
+}
+
+void emitParticleReference(const ParticleStep &step, uint32_t index, Particle &particle)
+{
+	float offset[3];
+	randomDirection(step, index, 0, offset);
+	float distance = step.radius * particleRandom(step.seed, index, 2);
+
+	float spread[3];
+	randomDirection(step, index, 3, spread);
+	float speed = step.velocitySpread * particleRandom(step.seed, index, 5);
+
+	for (uint32_t i = 0; i < 3; ++i)
+	{
+		particle.position[i] = step.position[i] + offset[i] * distance;
+		particle.velocity[i] = step.velocity[i] + spread[i] * speed;
+	}
+
+	particle.age = 0.0f;
+	particle.lifetime = step.minLifetime +
+		(step.maxLifetime - step.minLifetime) * particleRandom(step.seed, index, 6);
+}
+
+void simulateParticlesReference(const ParticleStep &step, std::vector<Particle> &particles)
+{
+	float damping = std::max(0.0f, 1.0f - step.drag * step.deltaTime);
+
+	for (Particle &particle : particles)
+	{
+		for (uint32_t i = 0; i < 3; ++i)
+		{
+			particle.velocity[i] = (particle.velocity[i] + step.gravity[i] * step.deltaTime) * damping;
+			particle.position[i] += particle.velocity[i] * step.deltaTime;
+		}
+
+		particle.age += step.deltaTime;
+	}
+
+	// New particles go behind the live ones and are not moved until the
+	// next step
+	uint32_t liveCount = std::min(static_cast<uint32_t>(particles.size()), step.maxParticles);
+	uint32_t emitCount = std::min(step.emitCount, step.maxParticles - liveCount);
+
+	particles.resize(liveCount + emitCount);
+	for (uint32_t j = 0; j < emitCount; ++j)
+		emitParticleReference(step, j, particles[liveCount + j]);
+
+	particles.erase(
+		std::remove_if(particles.begin(), particles.end(), [](const Particle &particle)
+		{
+			return particle.age >= particle.lifetime;
+		}),
+		particles.end());
+}
+
+ParticleSystem::ParticleSystem() :
+	device(VK_NULL_HANDLE),
+	allocator(nullptr),
+	maxParticles(0),
+	particleBuffer(VK_NULL_HANDLE),
+	particleMemory(VK_NULL_HANDLE),
+	scratchBuffer(VK_NULL_HANDLE),
+	scratchMemory(VK_NULL_HANDLE),
+	counterBuffer(VK_NULL_HANDLE),
+	counterMemory(VK_NULL_HANDLE),
+	isReadbackCoherent(true),
+	particleReadbackBuffer(VK_NULL_HANDLE),
+	particleReadbackMemory(VK_NULL_HANDLE),
+	particleReadbackData(nullptr),
+	isReadbackRequested(false),
+	hasParticleReadback(false),
+	descriptorSetLayout(VK_NULL_HANDLE),
+	descriptorPool(VK_NULL_HANDLE),
+	descriptorSet(VK_NULL_HANDLE),
+	pipelineLayout(VK_NULL_HANDLE),
+	emitPipeline(VK_NULL_HANDLE),
+	simulatePipeline(VK_NULL_HANDLE),
+	compactPipeline(VK_NULL_HANDLE),
+	hasMaterial(false),
+	drawVersion(0),
+	hasPendingStep(false),
+	areCountersCleared(false),
+	emitRemainder(0.0f),
+	trace(nullptr)
+{
+	memoryProperties = {};
+	material = {};
+	emitter = {};
+	step = {};
+	statistics = {};
+}
+
+ParticleSystem::~ParticleSystem()
+{
+	destroy();
+}
+
+void ParticleSystem::initialize(const VulkanContext &context, uint32_t maxParticles)
+{
+	device = context.device;
+	allocator = context.allocator;
+	memoryProperties = context.physicalDeviceMemoryProperties;
+	this->maxParticles = maxParticles;
+
+	VkDeviceSize particleSize = sizeof(Particle) * maxParticles;
+
+	Utility::createBuffer(
+		device,
+		allocator,
+		context.physicalDeviceMemoryProperties,
+		particleSize,
+		VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+		VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+		particleBuffer,
+		particleMemory);
+
+	Utility::createBuffer(
+		device,
+		allocator,
+		context.physicalDeviceMemoryProperties,
+		particleSize,
+		VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+		VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+		scratchBuffer,
+		scratchMemory);
+
+	Utility::createBuffer(
+		device,
+		allocator,
+		context.physicalDeviceMemoryProperties,
+		sizeof(ParticleCounters),
+		VK_BUFFER_USAGE_STORAGE_BUFFER_BIT |
+		VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT |
+		VK_BUFFER_USAGE_TRANSFER_SRC_BIT |
+		VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+		VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+		counterBuffer,
+		counterMemory);
+
+	readbackBuffers.resize(context.framesInFlight);
+	readbackMemory.resize(context.framesInFlight);
+	readbackData.resize(context.framesInFlight);
+	readbackSteps.assign(context.framesInFlight, 0);
+
+	for (uint32_t i = 0; i < context.framesInFlight; ++i)
+	{
+		Utility::createBuffer(
+			device,
+			allocator,
+			context.physicalDeviceMemoryProperties,
+			sizeof(ParticleCounters),
+			VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+			VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT,
+			readbackBuffers[i],
+			readbackMemory[i]);
+
+		// Stays mapped for the lifetime of the buffer
+		VkResult result = vkMapMemory(
+			device,
+			readbackMemory[i],
+			0,
+			VK_WHOLE_SIZE,
+			0,
+			&readbackData[i]);
+
+		Utility::checkVulkanResult(result, "Failed to map a particle readback buffer.");
+	}
+
+	// All readback buffers use the same memory type
+	VkMemoryRequirements memoryRequirements = {};
+	vkGetBufferMemoryRequirements(device, readbackBuffers[0], &memoryRequirements);
+
+	uint32_t memoryTypeIndex = 0;
+	Utility::findMemoryType(
+		context.physicalDeviceMemoryProperties,
+		memoryRequirements.memoryTypeBits,
+		VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT,
+		memoryTypeIndex);
+
+	isReadbackCoherent =
+		(context.physicalDeviceMemoryProperties.memoryTypes[memoryTypeIndex].propertyFlags &
+		VK_MEMORY_PROPERTY_HOST_COHERENT_BIT) != 0;
+
+	// Live particles, scratch particles and counters
+	VkDescriptorSetLayoutBinding bindings[3] = {};
+	for (uint32_t i = 0; i < 3; ++i)
+	{
+		bindings[i].binding = i;
+		bindings[i].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+		bindings[i].descriptorCount = 1;
+		bindings[i].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+	}
+
+	VkDescriptorSetLayoutCreateInfo setLayoutCreateInfo = {};
+	setLayoutCreateInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+	setLayoutCreateInfo.bindingCount = 3;
+	setLayoutCreateInfo.pBindings = bindings;
+
+	VkResult result = vkCreateDescriptorSetLayout(device, &setLayoutCreateInfo, allocator, &descriptorSetLayout);
+	Utility::checkVulkanResult(result, "Failed to create the particle descriptor set layout.");
+
+	VkDescriptorPoolSize poolSize = {};
+	poolSize.type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+	poolSize.descriptorCount = 3;
+
+	VkDescriptorPoolCreateInfo poolCreateInfo = {};
+	poolCreateInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+	poolCreateInfo.maxSets = 1;
+	poolCreateInfo.poolSizeCount = 1;
+	poolCreateInfo.pPoolSizes = &poolSize;
+
+	result = vkCreateDescriptorPool(device, &poolCreateInfo, allocator, &descriptorPool);
+	Utility::checkVulkanResult(result, "Failed to create the particle descriptor pool.");
+
+	VkDescriptorSetAllocateInfo setAllocateInfo = {};
+	setAllocateInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+	setAllocateInfo.descriptorPool = descriptorPool;
+	setAllocateInfo.descriptorSetCount = 1;
+	setAllocateInfo.pSetLayouts = &descriptorSetLayout;
+
+	result = vkAllocateDescriptorSets(device, &setAllocateInfo, &descriptorSet);
+	Utility::checkVulkanResult(result, "Failed to allocate the particle descriptor set.");
+
+	VkDescriptorBufferInfo bufferInfos[3] = {};
+	bufferInfos[0].buffer = particleBuffer;
+	bufferInfos[0].range = VK_WHOLE_SIZE;
+	bufferInfos[1].buffer = scratchBuffer;
+	bufferInfos[1].range = VK_WHOLE_SIZE;
+	bufferInfos[2].buffer = counterBuffer;
+	bufferInfos[2].range = VK_WHOLE_SIZE;
+
+	VkWriteDescriptorSet descriptorWrite = {};
+	descriptorWrite.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+	descriptorWrite.dstSet = descriptorSet;
+	descriptorWrite.dstBinding = 0;
+	descriptorWrite.descriptorCount = 3;
+	descriptorWrite.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+	descriptorWrite.pBufferInfo = bufferInfos;
+
+	vkUpdateDescriptorSets(device, 1, &descriptorWrite, 0, nullptr);
+
+	VkPushConstantRange pushConstantRange = {};
+	pushConstantRange.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+	pushConstantRange.offset = 0;
+	pushConstantRange.size = sizeof(ParticleStep);
+
+	VkPipelineLayoutCreateInfo layoutCreateInfo = {};
+	layoutCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+	layoutCreateInfo.setLayoutCount = 1;
+	layoutCreateInfo.pSetLayouts = &descriptorSetLayout;
+	layoutCreateInfo.pushConstantRangeCount = 1;
+	layoutCreateInfo.pPushConstantRanges = &pushConstantRange;
+
+	result = vkCreatePipelineLayout(device, &layoutCreateInfo, allocator, &pipelineLayout);
+	Utility::checkVulkanResult(result, "Failed to create the particle pipeline layout.");
+}
+
+void ParticleSystem::destroy()
+{
+	if (device == VK_NULL_HANDLE)
+		return;
+
+	vkDestroyPipeline(device, emitPipeline, allocator);
+	vkDestroyPipeline(device, simulatePipeline, allocator);
+	vkDestroyPipeline(device, compactPipeline, allocator);
+	vkDestroyPipelineLayout(device, pipelineLayout, allocator);
+	vkDestroyDescriptorPool(device, descriptorPool, allocator);
+	vkDestroyDescriptorSetLayout(device, descriptorSetLayout, allocator);
+
+	for (uint32_t i = 0; i < readbackBuffers.size(); ++i)
+	{
+		vkUnmapMemory(device, readbackMemory[i]);
+		vkDestroyBuffer(device, readbackBuffers[i], allocator);
+		vkFreeMemory(device, readbackMemory[i], allocator);
+	}
+
+	if (particleReadbackData)
+		vkUnmapMemory(device, particleReadbackMemory);
+
+	vkDestroyBuffer(device, particleReadbackBuffer, allocator);
+	vkFreeMemory(device, particleReadbackMemory, allocator);
+
+	vkDestroyBuffer(device, particleBuffer, allocator);
+	vkFreeMemory(device, particleMemory, allocator);
+	vkDestroyBuffer(device, scratchBuffer, allocator);
+	vkFreeMemory(device, scratchMemory, allocator);
+	vkDestroyBuffer(device, counterBuffer, allocator);
+	vkFreeMemory(device, counterMemory, allocator);
+
+	emitPipeline = VK_NULL_HANDLE;
+	simulatePipeline = VK_NULL_HANDLE;
+	compactPipeline = VK_NULL_HANDLE;
+	readbackBuffers.clear();
+	readbackMemory.clear();
+	readbackData.clear();
+	readbackSteps.clear();
+	particleReadbackBuffer = VK_NULL_HANDLE;
+	particleReadbackMemory = VK_NULL_HANDLE;
+	particleReadbackData = nullptr;
+	isReadbackRequested = false;
+	hasParticleReadback = false;
+	device = VK_NULL_HANDLE;
+}
+
+void ParticleSystem::createPipelines(const ParticleShaders &shaders, VkPipelineCache pipelineCache)
+{
+	assert(simulatePipeline == VK_NULL_HANDLE, "The particle pipelines were created already.");
+
+	VkShaderModule emitModule = createShaderModule(shaders.emit);
+	VkShaderModule simulateModule = createShaderModule(shaders.simulate);
+	VkShaderModule compactModule = createShaderModule(shaders.compact);
+
+	emitPipeline = createComputePipeline(emitModule, pipelineCache);
+	simulatePipeline = createComputePipeline(simulateModule, pipelineCache);
+	compactPipeline = createComputePipeline(compactModule, pipelineCache);
+
+	// Pipelines keep what they need from the modules
+	vkDestroyShaderModule(device, emitModule, allocator);
+	vkDestroyShaderModule(device, simulateModule, allocator);
+	vkDestroyShaderModule(device, compactModule, allocator);
+}
+
+void ParticleSystem::setEmitter(const ParticleEmitter &emitter)
+{
+	assert(emitter.minLifetime <= emitter.maxLifetime,
+		"The shortest particle lifetime has to be below the longest.");
+
+	this->emitter = emitter;
+
+	if (trace)
+		trace->setParticleEmitter(emitter);
+}
+
+void ParticleSystem::setMaterial(const ParticleMaterial &material)
+{
+	this->material = material;
+	hasMaterial = material.pipeline != VK_NULL_HANDLE;
+	++drawVersion;
+}
+
+void ParticleSystem::update(float deltaTime)
+{
+	if (!hasPendingStep)
+	{
+		step.deltaTime = 0.0f;
+		step.emitCount = 0;
+		step.seed = particleHash(static_cast<uint32_t>(statistics.stepCount));
+		step.maxParticles = maxParticles;
+	}
+
+	// Whole particles are emitted, the rest carries over to the next step
+	float emitted = emitter.emitRate * deltaTime + emitRemainder;
+	uint32_t emitCount = static_cast<uint32_t>(emitted);
+	emitRemainder = emitted - emitCount;
+
+	for (uint32_t i = 0; i < 3; ++i)
+	{
+		step.position[i] = emitter.position[i];
+		step.velocity[i] = emitter.velocity[i];
+		step.gravity[i] = emitter.gravity[i];
+	}
+
+	step.radius = emitter.radius;
+	step.velocitySpread = emitter.velocitySpread;
+	step.drag = emitter.drag;
+	step.minLifetime = emitter.minLifetime;
+	step.maxLifetime = emitter.maxLifetime;
+	step.deltaTime += deltaTime;
+	step.emitCount = std::min(step.emitCount + emitCount, maxParticles);
+
+	hasPendingStep = true;
+
+	if (trace)
+		trace->updateParticles(deltaTime);
+}
+
+const ParticleStep &ParticleSystem::getStep() const
+{
+	return step;
+}
+
+void ParticleSystem::setTrace(TraceWriter *trace)
+{
+	this->trace = trace;
+
+	// Without an emitter there is nothing to replay
+	if (trace && emitter.emitRate > 0.0f)
+		trace->setParticleEmitter(emitter);
+}
+
+void ParticleSystem::recordSimulation(VkCommandBuffer commandBuffer, uint32_t frameSlot)
+{
+	// The fence of the slot means its copy of the counters is done
+	if (readbackSteps[frameSlot] > statistics.liveCountStep)
+	{
+		if (!isReadbackCoherent)
+		{
+			VkMappedMemoryRange range = {};
+			range.sType = VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE;
+			range.memory = readbackMemory[frameSlot];
+			range.offset = 0;
+			range.size = VK_WHOLE_SIZE;
+
+			vkInvalidateMappedMemoryRanges(device, 1, &range);
+		}
+
+		const ParticleCounters *counters = static_cast<const ParticleCounters *>(readbackData[frameSlot]);
+		statistics.liveCount = counters->draw.instanceCount;
+		statistics.liveCountStep = readbackSteps[frameSlot];
+	}
+
+	// The draw can come before the first step, so it needs valid counters
+	if (!areCountersCleared)
+	{
+		ParticleCounters counters = {};
+		counters.draw.vertexCount = 6;
+
+		vkCmdUpdateBuffer(commandBuffer, counterBuffer, 0, sizeof(counters), &counters);
+
+		VkMemoryBarrier clearBarrier = {};
+		clearBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+		clearBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+		clearBarrier.dstAccessMask =
+			VK_ACCESS_SHADER_READ_BIT |
+			VK_ACCESS_SHADER_WRITE_BIT |
+			VK_ACCESS_INDIRECT_COMMAND_READ_BIT;
+
+		vkCmdPipelineBarrier(
+			commandBuffer,
+			VK_PIPELINE_STAGE_TRANSFER_BIT,
+			VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT,
+			0,
+			1, &clearBarrier,
+			0, nullptr,
+			0, nullptr);
+
+		areCountersCleared = true;
+	}
+
+	if (!hasPendingStep || simulatePipeline == VK_NULL_HANDLE)
+		return;
+
+	// The last draw reads the particles that compaction overwrites
+	VkMemoryBarrier drawBarrier = {};
+	drawBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+	drawBarrier.srcAccessMask = 0;
+	drawBarrier.dstAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+
+	vkCmdPipelineBarrier(
+		commandBuffer,
+		VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_VERTEX_SHADER_BIT,
+		VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+		0,
+		1, &drawBarrier,
+		0, nullptr,
+		0, nullptr);
+
+	vkCmdBindDescriptorSets(
+		commandBuffer,
+		VK_PIPELINE_BIND_POINT_COMPUTE,
+		pipelineLayout,
+		0,
+		1,
+		&descriptorSet,
+		0,
+		nullptr);
+
+	vkCmdPushConstants(
+		commandBuffer,
+		pipelineLayout,
+		VK_SHADER_STAGE_COMPUTE_BIT,
+		0,
+		sizeof(ParticleStep),
+		&step);
+
+	// The live count is only known on the GPU, so simulation and compaction
+	// cover the whole buffer and threads past the count return right away
+	uint32_t particleGroups = (maxParticles + PARTICLE_GROUP_SIZE - 1) / PARTICLE_GROUP_SIZE;
+	uint32_t emitGroups = (step.emitCount + PARTICLE_GROUP_SIZE - 1) / PARTICLE_GROUP_SIZE;
+
+	// Simulation and emission write different scratch particles
+	vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, simulatePipeline);
+	vkCmdDispatch(commandBuffer, particleGroups, 1, 1);
+
+	if (emitGroups > 0)
+	{
+		vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, emitPipeline);
+		vkCmdDispatch(commandBuffer, emitGroups, 1, 1);
+	}
+
+	// Compaction counts the live particles again from zero
+	VkMemoryBarrier resetBarrier = {};
+	resetBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+	resetBarrier.srcAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+	resetBarrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+
+	vkCmdPipelineBarrier(
+		commandBuffer,
+		VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+		VK_PIPELINE_STAGE_TRANSFER_BIT,
+		0,
+		1, &resetBarrier,
+		0, nullptr,
+		0, nullptr);
+
+	vkCmdFillBuffer(
+		commandBuffer,
+		counterBuffer,
+		offsetof(VkDrawIndirectCommand, instanceCount),
+		sizeof(uint32_t),
+		0);
+
+	VkMemoryBarrier compactBarrier = {};
+	compactBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+	compactBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT | VK_ACCESS_TRANSFER_WRITE_BIT;
+	compactBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+
+	vkCmdPipelineBarrier(
+		commandBuffer,
+		VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT,
+		VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+		0,
+		1, &compactBarrier,
+		0, nullptr,
+		0, nullptr);
+
+	vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, compactPipeline);
+	vkCmdDispatch(commandBuffer, particleGroups, 1, 1);
+
+	// The draw, the readback and the next step read what compaction wrote
+	VkMemoryBarrier resultBarrier = {};
+	resultBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+	resultBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+	resultBarrier.dstAccessMask =
+		VK_ACCESS_INDIRECT_COMMAND_READ_BIT |
+		VK_ACCESS_SHADER_READ_BIT |
+		VK_ACCESS_SHADER_WRITE_BIT |
+		VK_ACCESS_TRANSFER_READ_BIT;
+
+	vkCmdPipelineBarrier(
+		commandBuffer,
+		VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+		VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT |
+		VK_PIPELINE_STAGE_VERTEX_SHADER_BIT |
+		VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT |
+		VK_PIPELINE_STAGE_TRANSFER_BIT,
+		0,
+		1, &resultBarrier,
+		0, nullptr,
+		0, nullptr);
+
+	VkBufferCopy copyRegion = {};
+	copyRegion.size = sizeof(ParticleCounters);
+
+	vkCmdCopyBuffer(commandBuffer, counterBuffer, readbackBuffers[frameSlot], 1, &copyRegion);
+
+	if (isReadbackRequested)
+		recordParticleReadback(commandBuffer);
+
+	VkMemoryBarrier readbackBarrier = {};
+	readbackBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+	readbackBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+	readbackBarrier.dstAccessMask = VK_ACCESS_HOST_READ_BIT;
+
+	vkCmdPipelineBarrier(
+		commandBuffer,
+		VK_PIPELINE_STAGE_TRANSFER_BIT,
+		VK_PIPELINE_STAGE_HOST_BIT,
+		0,
+		1, &readbackBarrier,
+		0, nullptr,
+		0, nullptr);
+
+	++statistics.stepCount;
+	statistics.emittedCount += step.emitCount;
+	readbackSteps[frameSlot] = statistics.stepCount;
+	hasPendingStep = false;
+}
+
+void ParticleSystem::recordDraws(VkCommandBuffer commandBuffer)
+{
+	if (!hasMaterial)
+		return;
+
+	vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, material.pipeline);
+
+	if (material.descriptorSet != VK_NULL_HANDLE)
+	{
+		vkCmdBindDescriptorSets(
+			commandBuffer,
+			VK_PIPELINE_BIND_POINT_GRAPHICS,
+			material.pipelineLayout,
+			0,
+			1,
+			&material.descriptorSet,
+			0,
+			nullptr);
+	}
+
+	vkCmdDrawIndirect(commandBuffer, counterBuffer, 0, 1, sizeof(VkDrawIndirectCommand));
+}
+
+void ParticleSystem::requestReadback()
+{
+	if (particleReadbackBuffer == VK_NULL_HANDLE)
+	{
+		Utility::createBuffer(
+			device,
+			allocator,
+			memoryProperties,
+			sizeof(ParticleCounters) + sizeof(Particle) * maxParticles,
+			VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+			VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT,
+			particleReadbackBuffer,
+			particleReadbackMemory);
+
+		VkResult result = vkMapMemory(
+			device,
+			particleReadbackMemory,
+			0,
+			VK_WHOLE_SIZE,
+			0,
+			&particleReadbackData);
+
+		Utility::checkVulkanResult(result, "Failed to map the particle readback buffer.");
+	}
+
+	isReadbackRequested = true;
+}
+
+bool ParticleSystem::getGpuParticles(std::vector<Particle> &particles) const
+{
+	if (!hasParticleReadback)
+		return false;
+
+	// Uses the memory type of the counter readback buffers
+	if (!isReadbackCoherent)
+	{
+		VkMappedMemoryRange range = {};
+		range.sType = VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE;
+		range.memory = particleReadbackMemory;
+		range.offset = 0;
+		range.size = VK_WHOLE_SIZE;
+
+		vkInvalidateMappedMemoryRanges(device, 1, &range);
+	}
+
+	const uint8_t *data = static_cast<const uint8_t *>(particleReadbackData);
+
+	ParticleCounters counters;
+	memcpy(&counters, data, sizeof(counters));
+
+	particles.resize(std::min(counters.draw.instanceCount, maxParticles));
+	if (!particles.empty())
+		memcpy(particles.data(), data + sizeof(ParticleCounters), sizeof(Particle) * particles.size());
+
+	return true;
+}
+
+VkDescriptorBufferInfo ParticleSystem::getParticleBufferInfo() const
+{
+	VkDescriptorBufferInfo bufferInfo = {};
+	bufferInfo.buffer = particleBuffer;
+	bufferInfo.offset = 0;
+	bufferInfo.range = VK_WHOLE_SIZE;
+
+	return bufferInfo;
+}
+
+ParticleStatistics ParticleSystem::getStatistics() const
+{
+	return statistics;
+}
+
+uint64_t ParticleSystem::getDrawVersion() const
+{
+	return drawVersion;
+}
+
+VkShaderModule ParticleSystem::createShaderModule(const std::vector<uint32_t> &code)
+{
+	VkShaderModuleCreateInfo moduleCreateInfo = {};
+	moduleCreateInfo.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
+	moduleCreateInfo.codeSize = sizeof(uint32_t) * code.size();
+	moduleCreateInfo.pCode = code.data();
+
+	VkShaderModule shaderModule = VK_NULL_HANDLE;
+	VkResult result = vkCreateShaderModule(device, &moduleCreateInfo, allocator, &shaderModule);
+	Utility::checkVulkanResult(result, "Failed to create a particle shader module.");
+
+	return shaderModule;
+}
+
+void ParticleSystem::recordParticleReadback(VkCommandBuffer commandBuffer)
+{
+	// The barrier after compaction already covers these copies
+	VkBufferCopy regions[2] = {};
+	regions[0].size = sizeof(ParticleCounters);
+	regions[1].dstOffset = sizeof(ParticleCounters);
+	regions[1].size = sizeof(Particle) * maxParticles;
+
+	vkCmdCopyBuffer(commandBuffer, counterBuffer, particleReadbackBuffer, 1, &regions[0]);
+	vkCmdCopyBuffer(commandBuffer, particleBuffer, particleReadbackBuffer, 1, &regions[1]);
+
+	isReadbackRequested = false;
+	hasParticleReadback = true;
+}
+
+VkPipeline ParticleSystem::createComputePipeline(VkShaderModule shaderModule, VkPipelineCache pipelineCache)
+{
+	VkComputePipelineCreateInfo pipelineCreateInfo = {};
+	pipelineCreateInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+	pipelineCreateInfo.stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+	pipelineCreateInfo.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+	pipelineCreateInfo.stage.module = shaderModule;
+	pipelineCreateInfo.stage.pName = "main";
+	pipelineCreateInfo.layout = pipelineLayout;
+
+	VkPipeline pipeline = VK_NULL_HANDLE;
+	VkResult result = vkCreateComputePipelines(
+		device,
+		pipelineCache,
+		1,
+		&pipelineCreateInfo,
+		allocator,
+		&pipeline);
+
+	Utility::checkVulkanResult(result, "Failed to create a particle pipeline.");
+
+	return pipeline;
+}
\ No newline at end of file
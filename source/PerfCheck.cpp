@@ -0,0 +1,622 @@
+#include <cctype>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <string>
+#include <vector>
+
+// CTest counts tests that return this as skipped, it is returned when
+// nothing in the baseline applies to the run. Missing baselines fail.
+const int SKIP_RETURN_CODE = 77;
+
+enum class CheckMode
+{
+	Compare,
+	Update
+};
+
+struct CheckSettings
+{
+	const char *command;
+	const char *resultPath;
+	const char *baselinePath;	// The results of the other run for relative checks
+	const char *metric;			// Compared by relative checks
+	const char *check;
+	const char *tolerance;
+	const char *condition;		// Relative checks are skipped unless it is true
+	CheckMode mode;
+	uint32_t channelThreshold;	// Largest difference of a channel that still matches
+	double maxMismatch;			// Fraction of the pixels that may differ
+};
+
+// One line of a baseline file: "<metric> <check> <baseline> <tolerance>".
+// The check is <= for metrics that should not grow, >= for metrics that
+// should not shrink and == for metrics that must not change. A tolerance
+// ending in % is relative to the baseline, a baseline of - is not recorded
+// yet and fails until it is.
+struct BaselineEntry
+{
+	std::string metric;
+	std::string check;
+	std::string baseline;
+	std::string tolerance;
+};
+
+// Just enough JSON to read the benchmark results. Every number and boolean
+// is stored under its path, objects and arrays are joined with dots. Null
+// marks a metric that does not apply to the run and is stored as NaN.
+class JsonReader
+{
+public:
+	JsonReader(const char *text, std::map<std::string, double> &values) :
+		text(text),
+		values(values)
+	{
+	}
+
+	bool read()
+	{
+		return readValue("") && (skipSpace(), *text == '\0');
+	}
+
+private:
+	void skipSpace()
+	{
+		while (isspace(static_cast<unsigned char>(*text)))
+			++text;
+	}
+
+	bool readString(std::string &string)
+	{
+		if (*text != '"')
+			return false;
+
+		for (++text; *text != '"'; ++text)
+		{
+			if (*text == '\0')
+				return false;
+
+			// Escapes are kept as they are, names never need them
+			if (*text == '\\' && text[1] != '\0')
+				string += *text++;
+
+			string += *text;
+		}
+
+		++text;
+		return true;
+	}
+
+	bool readValue(const std::string &path)
+	{
+		skipSpace();
+
+		if (*text == '{' || *text == '[')
+		{
+			char end = (*text == '{') ? '}' : ']';
+			bool isObject = (*text == '{');
+			uint32_t index = 0;
+
+			++text;
+			skipSpace();
+
+			if (*text == end)
+			{
+				++text;
+				return true;
+			}
+
+			for (;;)
+			{
+				std::string name = std::to_string(index++);
+				if (isObject)
+				{
+					name.clear();
+					skipSpace();
+
+					if (!readString(name))
+						return false;
+
+					skipSpace();
+					if (*text++ != ':')
+						return false;
+				}
+
+				if (!readValue(path.empty() ? name : path + "." + name))
+					return false;
+
+				skipSpace();
+				if (*text == ',')
+				{
+					++text;
+					continue;
+				}
+
+				if (*text++ != end)
+					return false;
+
+				return true;
+			}
+		}
+
+		if (*text == '"')
+		{
+			std::string ignored;
+			return readString(ignored);
+		}
+
+		if (strncmp(text, "null", 4) == 0)
+		{
+			values[path] = NAN;
+			text += 4;
+			return true;
+		}
+
+		if (strncmp(text, "true", 4) == 0 || strncmp(text, "false", 5) == 0)
+		{
+			bool value = (*text == 't');
+			values[path] = value ? 1.0 : 0.0;
+			text += value ? 4 : 5;
+			return true;
+		}
+
+		char *end = nullptr;
+		double value = strtod(text, &end);
+		if (end == text)
+			return false;
+
+		values[path] = value;
+		text = end;
+		return true;
+	}
+
+private:
+	const char *text;
+	std::map<std::string, double> &values;
+};
+
+static bool readFile(const char *path, std::vector<char> &data)
+{
+	FILE *file = fopen(path, "rb");
+	if (!file)
+		return false;
+
+	fseek(file, 0, SEEK_END);
+	long size = ftell(file);
+	fseek(file, 0, SEEK_SET);
+
+	data.resize(size > 0 ? size : 0);
+	size_t readSize = data.empty() ? 0 : fread(data.data(), 1, data.size(), file);
+	fclose(file);
+
+	return readSize == data.size();
+}
+
+static bool writeFile(const char *path, const void *data, size_t size)
+{
+	FILE *file = fopen(path, "wb");
+	if (!file)
+		return false;
+
+	size_t writtenSize = fwrite(data, 1, size, file);
+	fclose(file);
+
+	return writtenSize == size;
+}
+
+static bool readBaseline(const char *path, std::vector<BaselineEntry> &entries)
+{
+	std::vector<char> data;
+	if (!readFile(path, data))
+		return false;
+
+	data.push_back('\0');
+
+	// Comments start with #, everything else has four columns
+	char *line = strtok(data.data(), "\r\n");
+	for (; line; line = strtok(nullptr, "\r\n"))
+	{
+		char metric[256], check[8], baseline[64], tolerance[64];
+
+		if (line[0] == '#' || sscanf(line, "%255s %7s %63s %63s", metric, check, baseline, tolerance) != 4)
+			continue;
+
+		BaselineEntry entry;
+		entry.metric = metric;
+		entry.check = check;
+		entry.baseline = baseline;
+		entry.tolerance = tolerance;
+		entries.push_back(entry);
+	}
+
+	return true;
+}
+
+static bool writeBaseline(const char *path, const std::vector<BaselineEntry> &entries)
+{
+	std::string text =
+		"# Written by LearningVulkanPerfCheck, the baselines can be edited by hand\n"
+		"# metric check baseline tolerance\n";
+
+	for (const BaselineEntry &entry : entries)
+		text += entry.metric + " " + entry.check + " " + entry.baseline + " " + entry.tolerance + "\n";
+
+	return writeFile(path, text.data(), text.size());
+}
+
+static bool readResults(const char *path, std::map<std::string, double> &values)
+{
+	std::vector<char> json;
+	if (!readFile(path, json))
+	{
+		fprintf(stderr, "Failed to read the results \"%s\".\n", path);
+		return false;
+	}
+
+	json.push_back('\0');
+
+	JsonReader reader(json.data(), values);
+
+	if (!reader.read())
+	{
+		fprintf(stderr, "The results \"%s\" are not valid JSON.\n", path);
+		return false;
+	}
+
+	return true;
+}
+
+// Whether a value passes a check against a baseline, a tolerance ending in %
+// is relative to the baseline. Returns false for unknown checks.
+static bool passesCheck(double value, const std::string &check, double baseline, const std::string &toleranceText, bool &passed, double &limit)
+{
+	double tolerance = strtod(toleranceText.c_str(), nullptr);
+
+	if (!toleranceText.empty() && toleranceText.back() == '%')
+		tolerance = fabs(baseline) * tolerance / 100.0;
+
+	if (check == "<=")
+	{
+		limit = baseline + tolerance;
+		passed = value <= limit;
+	}
+	else if (check == ">=")
+	{
+		limit = baseline - tolerance;
+		passed = value >= limit;
+	}
+	else if (check == "==")
+	{
+		limit = baseline;
+		passed = fabs(value - baseline) <= tolerance;
+	}
+	else
+		return false;
+
+	return true;
+}
+
+static int checkMetrics(const CheckSettings &settings)
+{
+	std::map<std::string, double> values;
+	if (!readResults(settings.resultPath, values))
+		return 1;
+
+	std::vector<BaselineEntry> entries;
+	if (!readBaseline(settings.baselinePath, entries))
+	{
+		fprintf(stderr, "Failed to read the baseline \"%s\".\n", settings.baselinePath);
+		return 1;
+	}
+
+	uint32_t failedCount = 0;
+	uint32_t missingCount = 0;
+	uint32_t checkedCount = 0;
+	uint32_t notApplicableCount = 0;
+
+	for (BaselineEntry &entry : entries)
+	{
+		auto value = values.find(entry.metric);
+		if (value == values.end())
+		{
+			printf("FAIL %s: not in the results\n", entry.metric.c_str());
+			++failedCount;
+			continue;
+		}
+
+		// The baseline is kept for the runs the metric applies to
+		if (std::isnan(value->second))
+		{
+			printf("SKIP %s: does not apply to this run\n", entry.metric.c_str());
+			++notApplicableCount;
+			continue;
+		}
+
+		if (settings.mode == CheckMode::Update)
+		{
+			char baseline[64];
+			snprintf(baseline, sizeof(baseline), "%.6g", value->second);
+			entry.baseline = baseline;
+
+			printf("RECORD %s = %s\n", entry.metric.c_str(), baseline);
+			continue;
+		}
+
+		if (entry.baseline == "-")
+		{
+			printf("FAIL %s: %.6g, no baseline recorded\n", entry.metric.c_str(), value->second);
+			++missingCount;
+			++failedCount;
+			continue;
+		}
+
+		double baseline = strtod(entry.baseline.c_str(), nullptr);
+		bool passed = false;
+		double limit = 0.0;
+
+		if (!passesCheck(value->second, entry.check, baseline, entry.tolerance, passed, limit))
+		{
+			printf("FAIL %s: unknown check \"%s\"\n", entry.metric.c_str(), entry.check.c_str());
+			++failedCount;
+			continue;
+		}
+
+		printf(
+			"%s %s: %.6g (baseline %.6g, %s %.6g)\n",
+			passed ? "PASS" : "FAIL",
+			entry.metric.c_str(),
+			value->second,
+			baseline,
+			entry.check.c_str(),
+			limit);
+
+		++checkedCount;
+		if (!passed)
+			++failedCount;
+	}
+
+	if (settings.mode == CheckMode::Update && !writeBaseline(settings.baselinePath, entries))
+	{
+		fprintf(stderr, "Failed to write the baseline \"%s\".\n", settings.baselinePath);
+		return 1;
+	}
+
+	// A suite without baselines would pass on any machine, so they have to
+	// be recorded where the tests run
+	if (missingCount > 0)
+	{
+		printf(
+			"%u of %u metrics have no baseline yet, record them with --update on the test machine\n",
+			missingCount,
+			static_cast<uint32_t>(entries.size()));
+	}
+
+	if (failedCount > 0)
+		return 1;
+
+	if (notApplicableCount > 0)
+		printf("%u of %u metrics do not apply to this run\n", notApplicableCount, static_cast<uint32_t>(entries.size()));
+
+	return checkedCount == 0 ? SKIP_RETURN_CODE : 0;
+}
+
+// Checks a metric of one run against the same metric of another run, for
+// example that a faster path stays faster than the one it replaces
+static int checkRelative(const CheckSettings &settings)
+{
+	std::map<std::string, double> values;
+	std::map<std::string, double> referenceValues;
+
+	if (!readResults(settings.resultPath, values) || !readResults(settings.baselinePath, referenceValues))
+		return 1;
+
+	if (settings.condition)
+	{
+		auto condition = values.find(settings.condition);
+		if (condition == values.end() || std::isnan(condition->second) || condition->second == 0.0)
+		{
+			printf("SKIP %s: %s is not true in this run\n", settings.metric, settings.condition);
+			return SKIP_RETURN_CODE;
+		}
+	}
+
+	auto value = values.find(settings.metric);
+	auto reference = referenceValues.find(settings.metric);
+
+	if (value == values.end() || reference == referenceValues.end())
+	{
+		printf("FAIL %s: not in both results\n", settings.metric);
+		return 1;
+	}
+
+	bool passed = false;
+	double limit = 0.0;
+
+	if (!passesCheck(value->second, settings.check, reference->second, settings.tolerance, passed, limit))
+	{
+		printf("FAIL %s: unknown check \"%s\"\n", settings.metric, settings.check);
+		return 1;
+	}
+
+	printf(
+		"%s %s: %.6g (other run %.6g, %s %.6g)\n",
+		passed ? "PASS" : "FAIL",
+		settings.metric,
+		value->second,
+		reference->second,
+		settings.check,
+		limit);
+
+	return passed ? 0 : 1;
+}
+
+static int checkImage(const CheckSettings &settings)
+{
+	std::vector<char> frame;
+	if (!readFile(settings.resultPath, frame))
+	{
+		fprintf(stderr, "Failed to read the frame \"%s\".\n", settings.resultPath);
+		return 1;
+	}
+
+	if (settings.mode == CheckMode::Update)
+	{
+		if (!writeFile(settings.baselinePath, frame.data(), frame.size()))
+		{
+			fprintf(stderr, "Failed to write the golden image \"%s\".\n", settings.baselinePath);
+			return 1;
+		}
+
+		printf("RECORD %s\n", settings.baselinePath);
+		return 0;
+	}
+
+	std::vector<char> golden;
+	if (!readFile(settings.baselinePath, golden))
+	{
+		printf("FAIL: no golden image \"%s\", record it with --update on the test machine\n", settings.baselinePath);
+		return 1;
+	}
+
+	// Raw captures have four bytes per pixel and nothing else
+	if (frame.size() != golden.size() || frame.size() % 4 != 0)
+	{
+		printf("FAIL: %zu bytes, the golden image has %zu\n", frame.size(), golden.size());
+		return 1;
+	}
+
+	// Differing pixels are white in the diff, the others black
+	size_t pixelCount = frame.size() / 4;
+	size_t mismatchCount = 0;
+	uint32_t maxDifference = 0;
+	std::vector<uint8_t> diff(frame.size(), 0);
+
+	for (size_t i = 0; i < pixelCount; ++i)
+	{
+		uint32_t pixelDifference = 0;
+		for (size_t c = 0; c < 4; ++c)
+		{
+			int a = static_cast<uint8_t>(frame[i * 4 + c]);
+			int b = static_cast<uint8_t>(golden[i * 4 + c]);
+			uint32_t difference = static_cast<uint32_t>(abs(a - b));
+
+			if (difference > pixelDifference)
+				pixelDifference = difference;
+		}
+
+		if (pixelDifference > maxDifference)
+			maxDifference = pixelDifference;
+
+		if (pixelDifference > settings.channelThreshold)
+		{
+			memset(&diff[i * 4], 0xFF, 4);
+			++mismatchCount;
+		}
+	}
+
+	double mismatch = pixelCount ? static_cast<double>(mismatchCount) / pixelCount : 0.0;
+	bool passed = mismatch <= settings.maxMismatch;
+
+	printf(
+		"%s: %zu of %zu pixels differ (%.4f%%, allowed %.4f%%), largest difference %u\n",
+		passed ? "PASS" : "FAIL",
+		mismatchCount,
+		pixelCount,
+		mismatch * 100.0,
+		settings.maxMismatch * 100.0,
+		maxDifference);
+
+	if (!passed)
+	{
+		std::string diffPath = std::string(settings.resultPath) + ".diff.raw";
+		if (writeFile(diffPath.c_str(), diff.data(), diff.size()))
+			printf("Wrote the differences to \"%s\"\n", diffPath.c_str());
+	}
+
+	return passed ? 0 : 1;
+}
+
+void printUsage()
+{
+	printf(
+		"Usage: LearningVulkanPerfCheck metrics <results.json> <baseline> [options]\n"
+		"       LearningVulkanPerfCheck image <frame.raw> <golden.raw> [options]\n"
+		"       LearningVulkanPerfCheck relative <results.json> <other.json> <metric> <check> <tolerance> [options]\n"
+		"  --update                   Record the results as the new baseline or golden image\n"
+		"  --threshold <value>        Largest channel difference of matching pixels (default 2)\n"
+		"  --max-mismatch <fraction>  Fraction of the pixels that may differ (default 0.001)\n"
+		"  --only-if <metric>         Skip the relative check unless the metric is true\n"
+		"Returns %d if nothing in the baseline applies to the run. Missing baselines fail.\n",
+		SKIP_RETURN_CODE);
+}
+
+bool parseArguments(int argc, char **argv, CheckSettings &settings)
+{
+	if (argc < 4)
+		return false;
+
+	settings.command = argv[1];
+	settings.resultPath = argv[2];
+	settings.baselinePath = argv[3];
+
+	// The metric, check and tolerance come before the options
+	int firstOption = 4;
+	if (strcmp(settings.command, "relative") == 0)
+	{
+		if (argc < 7)
+			return false;
+
+		settings.metric = argv[4];
+		settings.check = argv[5];
+		settings.tolerance = argv[6];
+		firstOption = 7;
+	}
+
+	for (int i = firstOption; i < argc; ++i)
+	{
+		bool hasValue = (i + 1 < argc);
+
+		if (strcmp(argv[i], "--update") == 0)
+			settings.mode = CheckMode::Update;
+		else if (strcmp(argv[i], "--compare") == 0)
+			settings.mode = CheckMode::Compare;
+		else if (strcmp(argv[i], "--threshold") == 0 && hasValue)
+			settings.channelThreshold = strtoul(argv[++i], nullptr, 10);
+		else if (strcmp(argv[i], "--max-mismatch") == 0 && hasValue)
+			settings.maxMismatch = strtod(argv[++i], nullptr);
+		else if (strcmp(argv[i], "--only-if") == 0 && hasValue)
+			settings.condition = argv[++i];
+		else
+			return false;
+	}
+
+	return
+		strcmp(settings.command, "metrics") == 0 ||
+		strcmp(settings.command, "image") == 0 ||
+		strcmp(settings.command, "relative") == 0;
+}
+
+int main(int argc, char **argv)
+{
+	CheckSettings settings = {};
+	settings.mode = CheckMode::Compare;
+	settings.channelThreshold = 2;
+	settings.maxMismatch = 0.001;
+
+	if (!parseArguments(argc, argv, settings))
+	{
+		printUsage();
+		return 1;
+	}
+
+	if (strcmp(settings.command, "metrics") == 0)
+		return checkMetrics(settings);
+
+	if (strcmp(settings.command, "relative") == 0)
+		return checkRelative(settings);
+
+	return checkImage(settings);
+}
\ No newline at end of file
@@ -1,1025 +1,3281 @@
 #include "LearningVulkan/Renderer.hpp"
+#include "LearningVulkan/TaskGraph.hpp"
 #include "LearningVulkan/Utility.hpp"
 
 #include "vulkan/vulkan.hpp"
+#ifdef VK_USE_PLATFORM_WIN32_KHR
 #include <Windows.h>
+#endif
 #include <assert.h>
+#include <chrono>
 
 // Extensions
-PFN_vkCreateDebugReportCallbackEXT fpVkCreateDebugReportCallbackEXT = nullptr;
-PFN_vkDestroyDebugReportCallbackEXT fpVkDestroyDebugReportCallbackEXT = nullptr;
-PFN_vkDebugReportMessageEXT fpVkDebugReportMessageEXT = nullptr;
+PFN_vkCreateDebugUtilsMessengerEXT fpVkCreateDebugUtilsMessengerEXT = nullptr;
+PFN_vkDestroyDebugUtilsMessengerEXT fpVkDestroyDebugUtilsMessengerEXT = nullptr;
+PFN_vkSetDebugUtilsObjectNameEXT fpVkSetDebugUtilsObjectNameEXT = nullptr;
+#ifdef VK_USE_PLATFORM_WIN32_KHR
 PFN_vkCreateWin32SurfaceKHR fpVkCreateWin32SurfaceKHR = nullptr;
+#endif
 
-// Callback for the debug report extension
-VKAPI_ATTR VkBool32 VKAPI_CALL debugReportCallback(
-	VkDebugReportFlagsEXT flags,
-	VkDebugReportObjectTypeEXT objectType,
-	uint64_t object,
-	size_t location,
-	int32_t messageCode,
-	const char *pLayerPrefix,
-	const char *pMessage,
+// Layers that are enabled when validation is requested
+const char *validationLayers[] = { "VK_LAYER_LUNARG_standard_validation" };
+
+void getSplitFrameStrip(
+	uint32_t height,
+	uint32_t deviceGroupSize,
+	uint32_t deviceIndex,
+	uint32_t &stripStart,
+	uint32_t &stripHeight)
+{
+	uint32_t fullStripHeight = height / deviceGroupSize;
+
+	stripStart = fullStripHeight * deviceIndex;
+	stripHeight = (deviceIndex == deviceGroupSize - 1) ? height - stripStart : fullStripHeight;
+}
+
+// Callback for the debug utils extension, runs on whatever thread made the
+// Vulkan call, so it only hands the message to the logger
+VKAPI_ATTR VkBool32 VKAPI_CALL debugUtilsCallback(
+	VkDebugUtilsMessageSeverityFlagBitsEXT messageSeverity,
+	VkDebugUtilsMessageTypeFlagsEXT messageTypes,
+	const VkDebugUtilsMessengerCallbackDataEXT *pCallbackData,
 	void *pUserData)
 {
-	printf("%s\t%s\n", pLayerPrefix, pMessage);
+	Logger *logger = static_cast<Logger *>(pUserData);
+
+	LogSeverity severity = LogSeverity::Verbose;
+	if (messageSeverity & VK_DEBUG_UTILS_MESSAGE_SEVERITY_ERROR_BIT_EXT)
+		severity = LogSeverity::Error;
+	else if (messageSeverity & VK_DEBUG_UTILS_MESSAGE_SEVERITY_WARNING_BIT_EXT)
+		severity = LogSeverity::Warning;
+	else if (messageSeverity & VK_DEBUG_UTILS_MESSAGE_SEVERITY_INFO_BIT_EXT)
+		severity = LogSeverity::Info;
+
+	if (!logger->isEnabled(severity))
+		return VK_FALSE;
+
+	// The names of the objects involved tell which resource a message is about
+	char objectNames[256] = "";
+	size_t length = 0;
+
+	for (uint32_t i = 0; i < pCallbackData->objectCount && length < sizeof(objectNames); ++i)
+	{
+		const char *name = pCallbackData->pObjects[i].pObjectName;
+
+		if (name)
+			length += snprintf(objectNames + length, sizeof(objectNames) - length, " \"%s\"", name);
+	}
+
+	logger->log(
+		severity,
+		"%s%s: %s",
+		pCallbackData->pMessageIdName ? pCallbackData->pMessageIdName : "Validation",
+		objectNames,
+		pCallbackData->pMessage);
+
 	return VK_FALSE;
 }
 
+// Properties that identify a physical device and its driver across runs
+static void getPhysicalDeviceIdentity(
+	VkPhysicalDevice physicalDevice,
+	VkPhysicalDeviceProperties2 &properties,
+	VkPhysicalDeviceIDProperties &idProperties)
+{
+	idProperties = {};
+	idProperties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_ID_PROPERTIES;
+
+	properties = {};
+	properties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2;
+	properties.pNext = &idProperties;
+
+	vkGetPhysicalDeviceProperties2(physicalDevice, &properties);
+}
+
 Renderer::Renderer()
 {
+	context = {};
+	context.allocator = hostAllocator.getCallbacks();
+
+#ifdef VK_USE_PLATFORM_WIN32_KHR
+	windowHandle = nullptr;
+#endif
+	capabilityCachePath = "capabilities.cache";
+	shaderCachePath = "shaders.cache";
+	startupTime = 0.0;
+	drawPass = 0;
+	drawScope = 0;
+	multiviewSettings = {};
+
+	// Standard error keeps the output of the benchmark machine-readable
+	logger.start(stderr, LogSeverity::Info);
 }
 
 Renderer::~Renderer()
 {
-	delete[] context.framebuffers;
-	delete[] context.presentImages;
-	
-	fpVkDestroyDebugReportCallbackEXT(
-		context.instance,
-		context.debugCallback,
-		nullptr);
-	
-	vkDestroyInstance(context.instance, nullptr);
+	stopTrace();
+
+	// Nothing can be destroyed while the GPU may still use it
+	if (context.device != VK_NULL_HANDLE)
+		vkDeviceWaitIdle(context.device);
+
+	if (!shaderCachePath.empty())
+		shaderPermutations.save(shaderCachePath.c_str());
+
+	shaderPermutations.destroy();
+	frameCapture.destroy();
+	gpuCounters.destroy();
+	commandBufferCache.destroy();
+	instanceRenderer.destroy();
+	lightGrid.destroy();
+	shadowAtlas.destroy();
+	particleSystem.destroy();
+	meshletRenderer.destroy();
+	multiviewPass.destroy();
+	deletionQueue.destroy();
+	jobSystem.destroy();
+
+	destroyDeviceObjects();
+
+	hostAllocator.freeArray(context.framebuffers);
+	hostAllocator.freeArray(context.presentImageViews);
+	hostAllocator.freeArray(context.offscreenImageMemory);
+	hostAllocator.freeArray(context.presentImages);
+
+	if (context.debugMessenger != VK_NULL_HANDLE)
+	{
+		fpVkDestroyDebugUtilsMessengerEXT(
+			context.instance,
+			context.debugMessenger,
+			context.allocator);
+	}
+
+	vkDestroyInstance(context.instance, context.allocator);
 }
 
-void Renderer::initialize(uint32_t width, uint32_t height, HWND windowHandle)
+#ifdef VK_USE_PLATFORM_WIN32_KHR
+void Renderer::initialize(
+	uint32_t width,
+	uint32_t height,
+	HWND windowHandle,
+	MultiGpuMode multiGpuMode)
 {
 	// Save the width and height for later use
 	context.width = width;
 	context.height = height;
+	context.renderWidth = width;
+	context.renderHeight = height;
 
-	// General information about this application
-	VkApplicationInfo applicationInfo = {};
-	applicationInfo.sType = VK_STRUCTURE_TYPE_APPLICATION_INFO;
-	applicationInfo.pNext = nullptr;
-	applicationInfo.pApplicationName = "Learning Vulkan";
-	applicationInfo.pEngineName = "Unknown";
-	applicationInfo.apiVersion = VK_MAKE_VERSION(1, 1, 82);
-	applicationInfo.engineVersion = 1;
-
-	// Information needed to create the Vulkan instance
-	VkInstanceCreateInfo instanceCreateInfo = {};
-	instanceCreateInfo.sType = VK_STRUCTURE_TYPE_INSTANCE_CREATE_INFO;
-	instanceCreateInfo.pApplicationInfo = &applicationInfo;
-	instanceCreateInfo.enabledLayerCount = 0;
-	instanceCreateInfo.ppEnabledLayerNames = nullptr;
-	instanceCreateInfo.enabledExtensionCount = 0;
-	instanceCreateInfo.ppEnabledExtensionNames = nullptr;
-
-	// Get the number of supported validation layers
-	uint32_t layerCount = 0;
-	vkEnumerateInstanceLayerProperties(&layerCount, nullptr);
+	context.headless = false;
+	context.enableValidation = true;
 
-	assert(layerCount != 0,
-		"Failed to find any validation layers on this system.");
+	// Without a device group only a single GPU is used
+	context.multiGpuMode = multiGpuMode;
+	context.deviceGroupSize = 1;
+	context.frameIndex = 0;
+	context.framesInFlight = 2;
 
-	VkLayerProperties *availableLayers = new VkLayerProperties[layerCount];
-	vkEnumerateInstanceLayerProperties(&layerCount, availableLayers);
-
-	bool foundValidationLayer = false;
-	for (uint32_t i = 0; i < layerCount; ++i)
+	// Every GPU would scale up the whole image instead of its own strip
+	context.dynamicResolution = resolutionController.isEnabled();
+	if (context.dynamicResolution && multiGpuMode == MultiGpuMode::SplitFrame)
 	{
-		// Look for the LunarG validation layer
-		if (strcmp(availableLayers[i].layerName,
-			"VK_LAYER_LUNARG_standard_validation") == 0)
-		{
-			foundValidationLayer = true;
-		}
+		logger.log(LogSeverity::Warning, "Dynamic resolution is not supported with split frame rendering.");
+		context.dynamicResolution = false;
 	}
 
-	assert(foundValidationLayer,
-		"Failed to find the \"VK_LAYER_LUNARG_standard_validation\"validation layer.");
-
-	const char *layers[] = { "VK_LAYER_LUNARG_standard_validation" };
+	this->windowHandle = windowHandle;
 
-	delete[] availableLayers;
+	jobSystem.initialize(0);
+	runStartup();
+}
+#endif
+
+void Renderer::initializeHeadless(
+	uint32_t width,
+	uint32_t height,
+	uint32_t framesInFlight,
+	bool enableValidation,
+	uint32_t workerCount,
+	MultiGpuMode multiGpuMode)
+{
+	assert(framesInFlight != 0 && framesInFlight <= MAX_FRAMES_IN_FLIGHT,
+		"Unsupported number of frames in flight.");
 
-	instanceCreateInfo.enabledLayerCount = 1;
-	instanceCreateInfo.ppEnabledLayerNames = layers;
+	context.width = width;
+	context.height = height;
+	context.renderWidth = width;
+	context.renderHeight = height;
 
-	// Get the number of supported extensions
-	uint32_t extensionCount = 0;
-	vkEnumerateInstanceExtensionProperties(nullptr, &extensionCount, nullptr);
+	context.headless = true;
+	context.enableValidation = enableValidation;
 
-	assert(extensionCount != 0, "Failed to find any extensions on this system.");
-	VkExtensionProperties *availableExtensions = new VkExtensionProperties[extensionCount];
-	vkEnumerateInstanceExtensionProperties(nullptr, &extensionCount, availableExtensions);
-	
-	// Extensions that are needed for this application
-	const char *extensions[] =
-	{
-		"VK_KHR_surface",
-		"VK_KHR_win32_surface",
-		"VK_EXT_debug_report"
-	};
-	const uint32_t requiredNumberOfExtensions = sizeof(extensions) / sizeof(char *);
-	uint32_t numberOfExtensionsFound = 0;
+	// Without a swap chain the frames of a device group are only read back,
+	// which is what tells apart whether both modes render the same image
+	context.multiGpuMode = multiGpuMode;
+	context.deviceGroupSize = 1;
+	context.frameIndex = 0;
+	context.framesInFlight = framesInFlight;
 
-	for (uint32_t i = 0; i < extensionCount; ++i)
+	context.dynamicResolution = resolutionController.isEnabled();
+	if (context.dynamicResolution && multiGpuMode == MultiGpuMode::SplitFrame)
 	{
-		for (auto & extension : extensions)
-		// Found one of the required extensions
-		if (strcmp(availableExtensions[i].extensionName, extension) == 0)
-		{
-			++numberOfExtensionsFound;
-		}
+		logger.log(LogSeverity::Warning, "Dynamic resolution is not supported with split frame rendering.");
+		context.dynamicResolution = false;
 	}
-	
-	assert(numberOfExtensionsFound == requiredNumberOfExtensions,
-		"Failed to find all required extensions.");
 
-	delete[] availableExtensions;
+#ifdef VK_USE_PLATFORM_WIN32_KHR
+	windowHandle = nullptr;
+#endif
 
-	instanceCreateInfo.enabledExtensionCount = requiredNumberOfExtensions;
-	instanceCreateInfo.ppEnabledExtensionNames = extensions;
+	jobSystem.initialize(workerCount);
+	runStartup();
+}
 
-	VkResult result;
+void Renderer::addStartupTask(
+	const char *name,
+	StartupTaskFunction function,
+	void *data,
+	StartupStage stage)
+{
+	StartupTask task = {};
+	task.name = name;
+	task.function = function;
+	task.data = data;
+	task.stage = stage;
+	task.renderer = this;
+
+	startupTasks.push_back(task);
+}
 
-	// Create the Vulkan instance and check for errors
-	result = vkCreateInstance(&instanceCreateInfo, nullptr, &context.instance);
-	Utility::checkVulkanResult(result, "Failed to create a Vulkan instance.");
+void Renderer::setCapabilityCachePath(const char *path)
+{
+	capabilityCachePath = path ? path : "";
+}
 
-	// Load the extensions that were checked for above
-	loadExtensions();
+void Renderer::setShaderCachePath(const char *path)
+{
+	shaderCachePath = path ? path : "";
+}
 
-	// Setup the debug callback
-	VkDebugReportCallbackCreateInfoEXT callbackCreateInfoEXT = {};
-	callbackCreateInfoEXT.sType = VK_STRUCTURE_TYPE_DEBUG_REPORT_CREATE_INFO_EXT;
-	callbackCreateInfoEXT.flags =	VK_DEBUG_REPORT_ERROR_BIT_EXT |
-									VK_DEBUG_REPORT_WARNING_BIT_EXT |
-									VK_DEBUG_REPORT_PERFORMANCE_WARNING_BIT_EXT;
-	callbackCreateInfoEXT.pfnCallback = &debugReportCallback;
-	callbackCreateInfoEXT.pUserData = nullptr;
+void Renderer::setDynamicResolution(const DynamicResolutionSettings &settings)
+{
+	resolutionController.setSettings(settings);
+}
 
-	result = fpVkCreateDebugReportCallbackEXT(
-		context.instance,
-		&callbackCreateInfoEXT,
-		nullptr,
-		&context.debugCallback);
+const ResolutionController &Renderer::getResolutionController() const
+{
+	return resolutionController;
+}
 
-	Utility::checkVulkanResult(
-		result,
-		"Failed to create the debug report extension callback.");
+void Renderer::setMultiview(const MultiviewSettings &settings)
+{
+	multiviewSettings = settings;
+}
 
-	// Create a Windows surface
-	VkWin32SurfaceCreateInfoKHR surfaceCreateInfo = {};
-	surfaceCreateInfo.sType = VK_STRUCTURE_TYPE_WIN32_SURFACE_CREATE_INFO_KHR;
-	surfaceCreateInfo.hinstance = GetModuleHandle(nullptr);
-	surfaceCreateInfo.hwnd = windowHandle;
+uint32_t Renderer::getCapabilityCacheHits() const
+{
+	return capabilityCache.getHitCount();
+}
 
-	result = vkCreateWin32SurfaceKHR(
-		context.instance,
-		&surfaceCreateInfo,
-		nullptr,
-		&context.surface);
+uint32_t Renderer::getCapabilityCacheMisses() const
+{
+	return capabilityCache.getMissCount();
+}
 
-	Utility::checkVulkanResult(result, "Failed to create a Windows surface.");
+const std::vector<TaskTiming> &Renderer::getStartupTimeline() const
+{
+	return startupTimeline;
+}
 
-	// Find a suitable physical device (for now, just use the first one that
-	// supports rendering)
-	uint32_t physicalDeviceCount = 0;
-	vkEnumeratePhysicalDevices(context.instance, &physicalDeviceCount, nullptr);
+double Renderer::getStartupTime() const
+{
+	return startupTime;
+}
 
-	assert(physicalDeviceCount != 0,
-		"Failed to find any physical devices on this machine.");
+MultiGpuMode Renderer::getMultiGpuMode() const
+{
+	return context.multiGpuMode;
+}
 
-	auto *physicalDevices = new VkPhysicalDevice[physicalDeviceCount];
-	vkEnumeratePhysicalDevices(
-		context.instance,
-		&physicalDeviceCount,
-		physicalDevices);
-	
-	for (uint32_t i = 0; i < physicalDeviceCount; ++i)
+uint32_t Renderer::getDeviceGroupSize() const
+{
+	return context.deviceGroupSize;
+}
+
+void Renderer::runStartup()
+{
+	// Every step is a task that starts as soon as the steps it needs are done.
+	// Steps that record into the setup command buffer or submit to the queue
+	// depend on each other, so they never run at the same time.
+	TaskGraph graph;
+
+	// Runs a task that was added by the application
+	TaskFunction runStartupTask = [](void *data)
 	{
-		// Get the properties of this physical device
-		VkPhysicalDeviceProperties physicalDeviceProperties = {};
-		vkGetPhysicalDeviceProperties(
-			physicalDevices[i],
-			&physicalDeviceProperties);
+		StartupTask *task = static_cast<StartupTask *>(data);
+		task->function(task->data, task->renderer->context);
+	};
 
-		uint32_t queueFamilyCount = 0;
-		vkGetPhysicalDeviceQueueFamilyProperties(
-			physicalDevices[i],
-			&queueFamilyCount,
-			nullptr);
+	// File I/O and asset decoding do not need a device, so they start right away
+	for (StartupTask &task : startupTasks)
+	{
+		if (task.stage == StartupStage::Immediate)
+			graph.addTask(task.name, runStartupTask, &task);
+	}
 
-		VkQueueFamilyProperties *queueFamilyProperties = new VkQueueFamilyProperties[queueFamilyCount];
-		vkGetPhysicalDeviceQueueFamilyProperties(
-			physicalDevices[i],
-			&queueFamilyCount,
-			queueFamilyProperties);
+	TaskId instance = graph.addTask("Create instance", [](void *data)
+	{
+		static_cast<Renderer *>(data)->createInstance();
+	}, this);
 
-		// Check whether at least one of the queue families supports presenting
-		for (uint32_t j = 0; j < queueFamilyCount; ++j)
+	TaskId physicalDevice;
+
+	if (context.headless)
+	{
+		physicalDevice = graph.addTask("Select physical device", [](void *data)
 		{
-			VkBool32 supportsPresent = false;
-			vkGetPhysicalDeviceSurfaceSupportKHR(
-				physicalDevices[i],
-				j,
-				context.surface,
-				&supportsPresent);
+			static_cast<Renderer *>(data)->selectPhysicalDevice();
+		}, this);
 
-			if (supportsPresent &&
-				(queueFamilyProperties[j].queueFlags & VK_QUEUE_GRAPHICS_BIT))
-			{
-				context.physicalDevice = physicalDevices[i];
-				context.physicalDeviceProperties = physicalDeviceProperties;
-				context.presentQueueIndex = j;
-				break;
-			}
-		}
+		graph.addDependency(physicalDevice, instance);
+	}
+#ifdef VK_USE_PLATFORM_WIN32_KHR
+	else
+	{
+		// Selecting a device checks whether it can present to the surface
+		TaskId surface = graph.addTask("Create surface", [](void *data)
+		{
+			Renderer *renderer = static_cast<Renderer *>(data);
+			renderer->createSurface(renderer->windowHandle);
+		}, this);
 
-		delete[] queueFamilyProperties;
+		graph.addDependency(surface, instance);
 
-		// A physical device has already been found, no need to loop again
-		if (context.physicalDevice)
-			break;
+		physicalDevice = graph.addTask("Select physical device", [](void *data)
+		{
+			static_cast<Renderer *>(data)->selectPhysicalDevice();
+		}, this);
+
+		graph.addDependency(physicalDevice, surface);
 	}
+#endif
 
-	delete[] physicalDevices;
+	TaskId device = graph.addTask("Create device", [](void *data)
+	{
+		Renderer *renderer = static_cast<Renderer *>(data);
+		renderer->createDevice();
+		renderer->deletionQueue.initialize(renderer->context.device, renderer->context.allocator);
+	}, this);
 
-	assert(context.physicalDevice,
-		"Failed to detect any physical device that can render and present.");
+	graph.addDependency(device, physicalDevice);
 
-	// Fill up the physical device memory properties
-	vkGetPhysicalDeviceMemoryProperties(
-		context.physicalDevice,
-		&context.physicalDeviceMemoryProperties);
+	// Programs are added by the application, after the cache is loaded
+	TaskId shaderCache = graph.addTask("Load shader cache", [](void *data)
+	{
+		Renderer *renderer = static_cast<Renderer *>(data);
+		renderer->shaderPermutations.initialize(renderer->context, renderer->jobSystem);
+		renderer->shaderPermutations.load(
+			renderer->shaderCachePath.empty() ? nullptr : renderer->shaderCachePath.c_str());
+	}, this);
 
-	// Information for accessing one of the rendering queues of this device
-	VkDeviceQueueCreateInfo queueCreateInfo = {};
-	queueCreateInfo.sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO;
-	queueCreateInfo.queueFamilyIndex = context.presentQueueIndex;
-	queueCreateInfo.queueCount = 1;
-	float queuePriorities[] = { 1.0f };	// Ask for the highest priority (0 to 1)
-	queueCreateInfo.pQueuePriorities = queuePriorities;
+	graph.addDependency(shaderCache, device);
 
-	// Logical device information
-	VkDeviceCreateInfo deviceCreateInfo = {};
-	deviceCreateInfo.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
-	deviceCreateInfo.queueCreateInfoCount = 1;
-	deviceCreateInfo.pQueueCreateInfos = &queueCreateInfo;
-	deviceCreateInfo.enabledLayerCount = 1;
-	deviceCreateInfo.ppEnabledLayerNames = layers;
+	TaskId shadowSetup = graph.addTask("Initialize shadow atlas", [](void *data)
+	{
+		Renderer *renderer = static_cast<Renderer *>(data);
 
-	// Swap chain extension is required
-	const char *deviceExtensions[] = { "VK_KHR_swapchain" };
-	deviceCreateInfo.enabledExtensionCount = 1;
-	deviceCreateInfo.ppEnabledExtensionNames = deviceExtensions;
+		// Cube faces from 64 to 512 texels, a 4096 atlas holds 8 of the
+		// largest tiles
+		ShadowAtlasSettings settings = {};
+		settings.atlasSize = 4096;
+		settings.minFaceSize = 64;
+		settings.maxFaceSize = 512;
+		settings.maxShadowedLights = 64;
 
-	VkPhysicalDeviceFeatures physicalDeviceFeatures = {};
-	physicalDeviceFeatures.shaderClipDistance = VK_TRUE;
+		renderer->shadowAtlas.initialize(renderer->context, settings, MAX_LIGHTS);
+	}, this);
 
-	deviceCreateInfo.pEnabledFeatures = &physicalDeviceFeatures;
+	graph.addDependency(shadowSetup, device);
 
-	// Create the logical device
-	result = vkCreateDevice(
-		context.physicalDevice,
-		&deviceCreateInfo,
-		nullptr,
-		&context.device);
+	TaskId particleSetup = graph.addTask("Initialize particle system", [](void *data)
+	{
+		Renderer *renderer = static_cast<Renderer *>(data);
+		renderer->particleSystem.initialize(renderer->context, MAX_PARTICLES);
+	}, this);
 
-	Utility::checkVulkanResult(result, "Failed to create a logical device.");
+	graph.addDependency(particleSetup, device);
 
-	// Set the color format and color space for the swap chain (created down below)
-	uint32_t colorFormatCount = 0;
-	vkGetPhysicalDeviceSurfaceFormatsKHR(
-		context.physicalDevice,
-		context.surface,
-		&colorFormatCount,
-		nullptr);
+	TaskId meshletSetup = graph.addTask("Initialize meshlet renderer", [](void *data)
+	{
+		Renderer *renderer = static_cast<Renderer *>(data);
+		renderer->meshletRenderer.initialize(renderer->context, MAX_MESHLET_OBJECTS);
+	}, this);
 
-	assert(colorFormatCount != 0, "Failed to find any color formats.");
+	graph.addDependency(meshletSetup, device);
 
-	VkSurfaceFormatKHR *surfaceFormats = new VkSurfaceFormatKHR[colorFormatCount];
-	vkGetPhysicalDeviceSurfaceFormatsKHR(
-		context.physicalDevice,
-		context.surface,
-		&colorFormatCount,
-		surfaceFormats);
+	TaskId lightGridSetup = graph.addTask("Initialize light grid", [](void *data)
+	{
+		Renderer *renderer = static_cast<Renderer *>(data);
 
-	VkFormat surfaceColorFormat;
-	VkColorSpaceKHR surfaceColorSpace;
+		// 16:9 tiles of 120 pixels at 1080p, finer slices near the camera
+		LightGridSettings settings = {};
+		settings.tilesX = 16;
+		settings.tilesY = 9;
+		settings.slices = 24;
+		settings.maxLightsPerCluster = 128;
 
-	// If the array of formats only contain one entry of VK_FORMAT_UNDEFINED,
-	// it means that the surface has no preferred formats
-	if (colorFormatCount == 0 &&
-		surfaceFormats[0].format == VK_FORMAT_UNDEFINED)
+		renderer->lightGrid.initialize(renderer->context, settings, MAX_LIGHTS, renderer->jobSystem);
+	}, this);
+
+	graph.addDependency(lightGridSetup, device);
+
+	TaskId multiviewSetup = graph.addTask("Initialize multiview pass", [](void *data)
 	{
-		// Use this as the default format
-		surfaceColorFormat = VK_FORMAT_R8G8B8A8_UNORM;
+		Renderer *renderer = static_cast<Renderer *>(data);
+		const MultiviewSettings &settings = renderer->multiviewSettings;
+
+		if (settings.viewCount == 0)
+			return;
+
+		renderer->multiviewPass.initialize(renderer->context, settings);
+
+		if (!renderer->multiviewPass.isMultiview() && !settings.forcePerView)
+		{
+			renderer->logger.log(
+				LogSeverity::Warning,
+				"Multiview with %u views is not supported, rendering every view on its own.",
+				settings.viewCount);
+		}
+	}, this);
+
+	graph.addDependency(multiviewSetup, device);
+
+	TaskId colorImages;
+
+	if (context.headless)
+	{
+		colorImages = graph.addTask("Create offscreen images", [](void *data)
+		{
+			static_cast<Renderer *>(data)->createOffscreenImages();
+		}, this);
 	}
 	else
 	{
-		// Use whatever format the surface prefers
-		surfaceColorFormat = surfaceFormats[0].format;
+		colorImages = graph.addTask("Create swap chain", [](void *data)
+		{
+			static_cast<Renderer *>(data)->createSwapChain();
+		}, this);
 	}
 
-	// Use the first available color space
-	surfaceColorSpace = surfaceFormats[0].colorSpace;
+	graph.addDependency(colorImages, device);
 
-	delete[] surfaceFormats;
+	TaskId commandBuffers = graph.addTask("Create command buffers", [](void *data)
+	{
+		static_cast<Renderer *>(data)->createCommandBuffers();
+	}, this);
 
-	VkSurfaceCapabilitiesKHR surfaceCapabilities = {};
-	vkGetPhysicalDeviceSurfaceCapabilitiesKHR(
-		context.physicalDevice,
-		context.surface,
-		&surfaceCapabilities);
+	graph.addDependency(commandBuffers, device);
 
-	// If surfaceCapabilities.maxImageCount == 0, then there is no limit on the
-	// number of images (no idea why you would ever need 4+ images, though...)
-	uint32_t desiredImageCount = 2;	// Double-buffering
-	
-	// Adjust the desired image count if the current value is not supported
-	if (desiredImageCount < surfaceCapabilities.minImageCount)
+	TaskId transition = graph.addTask("Transition color images", [](void *data)
 	{
-		// Cannot use less than the minimum number of images supported
-		desiredImageCount = surfaceCapabilities.minImageCount;
-	}
-	else if (surfaceCapabilities.maxImageCount != 0 &&
-			 desiredImageCount > surfaceCapabilities.maxImageCount)
+		static_cast<Renderer *>(data)->transitionPresentImages();
+	}, this);
+
+	graph.addDependency(transition, colorImages);
+	graph.addDependency(transition, commandBuffers);
+
+	// Also uses the setup command buffer
+	TaskId depthImage = graph.addTask("Create depth image", [](void *data)
 	{
-		// Cannot use more than the maximum number of images supported
-		desiredImageCount = surfaceCapabilities.maxImageCount;
-	}
+		static_cast<Renderer *>(data)->createDepthImage();
+	}, this);
 
-	// If surfaceCapabilities.currentExtent has -1 for either the width or
-	// height, it means that the values can be set to any value. Otherwise,
-	// those non-zero values will have to be matched exactly.
-	VkExtent2D surfaceResolution = surfaceCapabilities.currentExtent;
+	graph.addDependency(depthImage, transition);
 
-	if (surfaceResolution.width == -1 ||
-		surfaceResolution.height == -1)
+	TaskId sceneImage = graph.addTask("Create scene image", [](void *data)
 	{
-		surfaceResolution.width = context.width;
-		surfaceResolution.height = context.height;
-	}
-	else
+		static_cast<Renderer *>(data)->createSceneImage();
+	}, this);
+
+	graph.addDependency(sceneImage, colorImages);
+
+	TaskId renderPass = graph.addTask("Create render pass", [](void *data)
 	{
-		// Surface resolution has to be matched exactly therefore, the
-		// dimensions of the context have to be updated
-		context.width = surfaceResolution.width;
-		context.height = surfaceResolution.height;
-	}
+		static_cast<Renderer *>(data)->createRenderPass();
+	}, this);
 
-	VkSurfaceTransformFlagBitsKHR preTransform = surfaceCapabilities.currentTransform;
+	graph.addDependency(renderPass, colorImages);
 
-	// No surface rotation
-	if (surfaceCapabilities.supportedTransforms &
-		VK_SURFACE_TRANSFORM_IDENTITY_BIT_KHR)
+	// Pipelines and other device objects of the application, graphics
+	// pipelines need the render pass
+	for (StartupTask &task : startupTasks)
 	{
-		preTransform = VK_SURFACE_TRANSFORM_IDENTITY_BIT_KHR;
+		if (task.stage == StartupStage::AfterDevice)
+		{
+			TaskId applicationTask = graph.addTask(task.name, runStartupTask, &task);
+			graph.addDependency(applicationTask, device);
+			graph.addDependency(applicationTask, renderPass);
+			graph.addDependency(applicationTask, shaderCache);
+			graph.addDependency(applicationTask, particleSetup);
+			graph.addDependency(applicationTask, meshletSetup);
+			graph.addDependency(applicationTask, lightGridSetup);
+			graph.addDependency(applicationTask, shadowSetup);
+			graph.addDependency(applicationTask, multiviewSetup);
+		}
 	}
 
-	// Get the supported present modes
-	uint32_t presentModeCount = 0;
-	vkGetPhysicalDeviceSurfacePresentModesKHR(
-		context.physicalDevice,
-		context.surface,
-		&presentModeCount,
-		nullptr);
+	TaskId framebuffers = graph.addTask("Create framebuffers", [](void *data)
+	{
+		static_cast<Renderer *>(data)->createFramebuffers();
+	}, this);
 
-	auto *presentModes = new VkPresentModeKHR[presentModeCount];
-	vkGetPhysicalDeviceSurfacePresentModesKHR(
-		context.physicalDevice,
-		context.surface,
-		&presentModeCount,
-		presentModes);
+	graph.addDependency(framebuffers, renderPass);
+	graph.addDependency(framebuffers, depthImage);
+	graph.addDependency(framebuffers, sceneImage);
 
-	// This is the default value that MUST be supported according to the Vulkan
-	// specification
-	VkPresentModeKHR presentationMode = VK_PRESENT_MODE_FIFO_KHR;
+	TaskId vertexBuffer = graph.addTask("Create vertex buffer", [](void *data)
+	{
+		static_cast<Renderer *>(data)->createVertexBuffer();
+	}, this);
 
-	// VK_PRESENT_MODE_MAILBOX_KHR is preferred, so use that if it is supported
-	for (uint32_t i = 0; i < presentModeCount; ++i)
+	graph.addDependency(vertexBuffer, device);
+
+	TaskId frameResources = graph.addTask("Create frame resources", [](void *data)
 	{
-		if (presentModes[i] == VK_PRESENT_MODE_MAILBOX_KHR)
+		static_cast<Renderer *>(data)->createFrameResources();
+	}, this);
+
+	graph.addDependency(frameResources, device);
+
+	// Captures complete a few frames after they were recorded
+	TaskId captureSetup = graph.addTask("Initialize frame capture", [](void *data)
+	{
+		Renderer *renderer = static_cast<Renderer *>(data);
+		renderer->frameCapture.initialize(renderer->context, renderer->context.framesInFlight + 2);
+	}, this);
+
+	graph.addDependency(captureSetup, colorImages);
+
+	TaskId instanceSetup = graph.addTask("Initialize instance renderer", [](void *data)
+	{
+		Renderer *renderer = static_cast<Renderer *>(data);
+		renderer->instanceRenderer.initialize(
+			renderer->context,
+			INITIAL_INSTANCES,
+			MAX_INSTANCES,
+			renderer->jobSystem,
+			renderer->deletionQueue);
+	}, this);
+
+	graph.addDependency(instanceSetup, device);
+
+	TaskId counterSetup = graph.addTask("Initialize GPU counters", [](void *data)
+	{
+		Renderer *renderer = static_cast<Renderer *>(data);
+		renderer->gpuCounters.initialize(renderer->context, MAX_COUNTER_SCOPES);
+		renderer->drawScope = renderer->gpuCounters.addScope("Draw instances");
+	}, this);
+
+	graph.addDependency(counterSetup, device);
+
+	// The draws are replayed from secondary command buffers while nothing
+	// they depend on changes
+	TaskId commandCacheSetup = graph.addTask("Initialize command buffer cache", [](void *data)
+	{
+		Renderer *renderer = static_cast<Renderer *>(data);
+		renderer->commandBufferCache.initialize(renderer->context, renderer->context.imageCount);
+		renderer->drawPass = renderer->commandBufferCache.addPass(
+			"Draw instances",
+			renderer->context.renderPass,
+			0,
+			recordDrawPass,
+			renderer);
+
+		// The counter queries of the draw pass stay active while it runs
+		if (renderer->context.enabledFeatures.inheritedQueries)
 		{
-			presentationMode = VK_PRESENT_MODE_MAILBOX_KHR;
-			break;
+			renderer->commandBufferCache.setInheritedQueries(
+				renderer->drawPass,
+				renderer->gpuCounters.getOcclusionControlFlags(),
+				renderer->gpuCounters.getPipelineStatisticFlags());
 		}
+	}, this);
+
+	graph.addDependency(commandCacheSetup, renderPass);
+	graph.addDependency(commandCacheSetup, counterSetup);
+
+	TaskId objectNames = graph.addTask("Name objects", [](void *data)
+	{
+		static_cast<Renderer *>(data)->nameObjects();
+	}, this);
+
+	graph.addDependency(objectNames, commandBuffers);
+	graph.addDependency(objectNames, framebuffers);
+	graph.addDependency(objectNames, vertexBuffer);
+	graph.addDependency(objectNames, frameResources);
+
+	capabilityCache.load(capabilityCachePath.c_str());
+
+	graph.execute(jobSystem);
+
+	// Only writes the file if something had to be probed
+	capabilityCache.save();
+
+	startupTimeline = graph.getTimeline();
+	startupTime = graph.getTotalTime();
+
+	logger.log(
+		LogSeverity::Verbose,
+		"Capability cache: %u hits, %u misses.",
+		capabilityCache.getHitCount(),
+		capabilityCache.getMissCount());
+
+	logger.log(LogSeverity::Info, "Startup took %.3f ms on %u workers.", startupTime, jobSystem.getWorkerCount());
+
+	for (const TaskTiming &timing : startupTimeline)
+	{
+		logger.log(
+			LogSeverity::Verbose,
+			"  %-30s %9.3f ms to %9.3f ms on worker %u",
+			timing.name,
+			timing.startTime,
+			timing.endTime,
+			timing.workerIndex);
 	}
-	
-	delete[] presentModes;
+}
 
-	// Create the swap chain
-	VkSwapchainCreateInfoKHR swapChainCreateInfo = {};
-	swapChainCreateInfo.sType = VK_STRUCTURE_TYPE_SWAPCHAIN_CREATE_INFO_KHR;
-	swapChainCreateInfo.surface = context.surface;
-	swapChainCreateInfo.minImageCount = desiredImageCount;
-	swapChainCreateInfo.imageFormat = surfaceColorFormat;
-	swapChainCreateInfo.imageColorSpace = surfaceColorSpace;
-	swapChainCreateInfo.imageExtent = surfaceResolution;
-	swapChainCreateInfo.imageArrayLayers = 1;
-	swapChainCreateInfo.imageUsage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT;
-	swapChainCreateInfo.imageSharingMode = VK_SHARING_MODE_EXCLUSIVE;
-	swapChainCreateInfo.preTransform = preTransform;
-	swapChainCreateInfo.compositeAlpha = VK_COMPOSITE_ALPHA_OPAQUE_BIT_KHR;
-	swapChainCreateInfo.presentMode = presentationMode;
-	swapChainCreateInfo.clipped = VK_TRUE;
+void Renderer::createInstance()
+{
+	// General information about this application
+	VkApplicationInfo applicationInfo = {};
+	applicationInfo.sType = VK_STRUCTURE_TYPE_APPLICATION_INFO;
+	applicationInfo.pNext = nullptr;
+	applicationInfo.pApplicationName = "Learning Vulkan";
+	applicationInfo.pEngineName = "Unknown";
+	applicationInfo.apiVersion = VK_MAKE_VERSION(1, 1, 82);
+	applicationInfo.engineVersion = 1;
 
-	result = vkCreateSwapchainKHR(
-		context.device,
-		&swapChainCreateInfo,
-		nullptr,
-		&context.swapChain);
+	// Information needed to create the Vulkan instance
+	VkInstanceCreateInfo instanceCreateInfo = {};
+	instanceCreateInfo.sType = VK_STRUCTURE_TYPE_INSTANCE_CREATE_INFO;
+	instanceCreateInfo.pApplicationInfo = &applicationInfo;
+	instanceCreateInfo.enabledLayerCount = 0;
+	instanceCreateInfo.ppEnabledLayerNames = nullptr;
+	instanceCreateInfo.enabledExtensionCount = 0;
+	instanceCreateInfo.ppEnabledExtensionNames = nullptr;
 
-	Utility::checkVulkanResult(result, "Failed to create the swap chain.");
+	// Layers and extensions this instance needs
+	uint32_t requiredCapabilities = 0;
 
-	// Get a handle to the present queue of this device
-	vkGetDeviceQueue(
-		context.device,
-		context.presentQueueIndex,
-		0,
-		&context.presentQueue);
+	if (!context.headless)
+		requiredCapabilities |= INSTANCE_CAPABILITY_SURFACE_EXTENSIONS;
 
-	VkCommandPoolCreateInfo commandPoolCreateInfo = {};
-	commandPoolCreateInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
-	commandPoolCreateInfo.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
-	commandPoolCreateInfo.queueFamilyIndex = context.presentQueueIndex;
+	if (context.enableValidation)
+		requiredCapabilities |= INSTANCE_CAPABILITY_VALIDATION_LAYER | INSTANCE_CAPABILITY_DEBUG_UTILS;
 
-	// Create the command pool (used to allocate command buffers)
-	VkCommandPool commandPool;
-	result = vkCreateCommandPool(
-		context.device,
-		&commandPoolCreateInfo,
-		nullptr,
-		&commandPool);
+	// The loader decides which layers and extensions are visible, so its
+	// version is part of the cache key
+	uint32_t loaderVersion = VK_API_VERSION_1_0;
+	vkEnumerateInstanceVersion(&loaderVersion);
 
-	Utility::checkVulkanResult(result, "Failed to create the command pool.");
+	bool isCached =
+		capabilityCache.matchesLoader(loaderVersion) &&
+		(capabilityCache.getCapabilities().instanceCapabilities & requiredCapabilities) == requiredCapabilities;
 
-	VkCommandBufferAllocateInfo commandBufferAllocationInfo = {};
-	commandBufferAllocationInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
-	commandBufferAllocationInfo.commandPool = commandPool;
-	commandBufferAllocationInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
-	commandBufferAllocationInfo.commandBufferCount = 1;
+	if (isCached)
+		capabilityCache.recordHit();
+	else
+		probeInstanceCapabilities(requiredCapabilities);
 
-	// Create the setup command buffer
-	result = vkAllocateCommandBuffers(
-		context.device,
-		&commandBufferAllocationInfo,
-		&context.setupCommandBuffer);
+	if (context.enableValidation)
+	{
+		instanceCreateInfo.enabledLayerCount = 1;
+		instanceCreateInfo.ppEnabledLayerNames = validationLayers;
+	}
 
-	Utility::checkVulkanResult(
-		result,
-		"Failed to allocate the setup command buffer.");
+	// Extensions that are needed for this application, a headless context
+	// only needs the debug utils extension (if validation is enabled)
+	const char *extensions[3];
+	uint32_t requiredNumberOfExtensions = 0;
 
-	// Create the draw command buffer
-	result = vkAllocateCommandBuffers(
-		context.device,
-		&commandBufferAllocationInfo,
-		&context.drawCommandBuffer);
+	if (!context.headless)
+	{
+		extensions[requiredNumberOfExtensions++] = "VK_KHR_surface";
+		extensions[requiredNumberOfExtensions++] = "VK_KHR_win32_surface";
+	}
 
-	Utility::checkVulkanResult(
-		result,
-		"Failed to allocate the draw command buffer");
+	if (context.enableValidation)
+	{
+		extensions[requiredNumberOfExtensions++] = "VK_EXT_debug_utils";
+	}
 
-	// Retrieve the swap chain images and store them for later use
-	uint32_t imageCount = 0;
-	vkGetSwapchainImagesKHR(
-		context.device,
-		context.swapChain,
-		&imageCount,
-		nullptr);
+	instanceCreateInfo.enabledExtensionCount = requiredNumberOfExtensions;
+	instanceCreateInfo.ppEnabledExtensionNames = extensions;
 
-	context.presentImages = new VkImage[imageCount];
-	vkGetSwapchainImagesKHR(
-		context.device,
-		context.swapChain,
-		&imageCount,
-		context.presentImages);
+	VkResult result;
 
-	VkImageViewCreateInfo presentImagesViewCreateInfo = {};
-	presentImagesViewCreateInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
-	presentImagesViewCreateInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
-	presentImagesViewCreateInfo.format = surfaceColorFormat;
-	presentImagesViewCreateInfo.components =
+	// Create the Vulkan instance and check for errors
+	result = vkCreateInstance(&instanceCreateInfo, context.allocator, &context.instance);
+
+	// A layer or extension went away without the loader changing, so the
+	// cache is stale and the probe has to run after all
+	if (result != VK_SUCCESS && isCached)
 	{
-		VK_COMPONENT_SWIZZLE_R,
-		VK_COMPONENT_SWIZZLE_G,
-		VK_COMPONENT_SWIZZLE_B,
-		VK_COMPONENT_SWIZZLE_A
-	};
-	presentImagesViewCreateInfo.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-	presentImagesViewCreateInfo.subresourceRange.baseMipLevel = 0;
-	presentImagesViewCreateInfo.subresourceRange.levelCount = 1;
-	presentImagesViewCreateInfo.subresourceRange.baseArrayLayer = 0;
-	presentImagesViewCreateInfo.subresourceRange.layerCount = 1;
+		logger.log(LogSeverity::Warning, "Cached instance capabilities are out of date, probing again.");
 
-	VkFenceCreateInfo fenceCreateInfo = {};
-	fenceCreateInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+		capabilityCache.invalidate();
+		capabilityCache.matchesLoader(loaderVersion);
+		probeInstanceCapabilities(requiredCapabilities);
+
+		result = vkCreateInstance(&instanceCreateInfo, context.allocator, &context.instance);
+	}
+
+	Utility::checkVulkanResult(result, "Failed to create a Vulkan instance.");
+
+	// Load the extensions that were checked for above
+	loadExtensions();
+
+	if (!context.enableValidation)
+		return;
+
+	// Setup the debug messenger
+	VkDebugUtilsMessengerCreateInfoEXT messengerCreateInfo = {};
+	messengerCreateInfo.sType = VK_STRUCTURE_TYPE_DEBUG_UTILS_MESSENGER_CREATE_INFO_EXT;
+	messengerCreateInfo.messageSeverity =	VK_DEBUG_UTILS_MESSAGE_SEVERITY_ERROR_BIT_EXT |
+											VK_DEBUG_UTILS_MESSAGE_SEVERITY_WARNING_BIT_EXT;
+	messengerCreateInfo.messageType =	VK_DEBUG_UTILS_MESSAGE_TYPE_GENERAL_BIT_EXT |
+										VK_DEBUG_UTILS_MESSAGE_TYPE_VALIDATION_BIT_EXT |
+										VK_DEBUG_UTILS_MESSAGE_TYPE_PERFORMANCE_BIT_EXT;
+	messengerCreateInfo.pfnUserCallback = &debugUtilsCallback;
+	messengerCreateInfo.pUserData = &logger;
+
+	result = fpVkCreateDebugUtilsMessengerEXT(
+		context.instance,
+		&messengerCreateInfo,
+		context.allocator,
+		&context.debugMessenger);
 
-	VkFence submitFence;
-	vkCreateFence(context.device, &fenceCreateInfo, nullptr, &submitFence);
+	Utility::checkVulkanResult(
+		result,
+		"Failed to create the debug utils messenger.");
+}
 
-	// Names such as "beginInfo" will be used further down in the code as well,
-	// hence this code block has been wrapped in a new scope
+void Renderer::probeInstanceCapabilities(uint32_t requiredCapabilities)
+{
+	if (requiredCapabilities & INSTANCE_CAPABILITY_VALIDATION_LAYER)
 	{
-		VkCommandBufferBeginInfo beginInfo = {};
-		beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
-		beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+		// Get the number of supported validation layers
+		uint32_t layerCount = 0;
+		vkEnumerateInstanceLayerProperties(&layerCount, nullptr);
 
-		// Loop through the present images and change their layout
-		auto *transitionedImages = new bool[imageCount];
-		memset(transitionedImages, 0, sizeof(bool) * imageCount);
-		uint32_t processedImageCount = 0;
+		assert(layerCount != 0,
+			"Failed to find any validation layers on this system.");
 
-		while (processedImageCount != imageCount)
+		VkLayerProperties *availableLayers = hostAllocator.allocateArray<VkLayerProperties>(layerCount);
+		vkEnumerateInstanceLayerProperties(&layerCount, availableLayers);
+
+		bool foundValidationLayer = false;
+		for (uint32_t i = 0; i < layerCount; ++i)
 		{
-			VkSemaphore presentCompleteSemaphore;
-
-			VkSemaphoreCreateInfo semaphoreCreateInfo = {};
-			semaphoreCreateInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
-			semaphoreCreateInfo.pNext = nullptr;
-			semaphoreCreateInfo.flags = 0;
-
-			vkCreateSemaphore(
-				context.device,
-				&semaphoreCreateInfo,
-				nullptr,
-				&presentCompleteSemaphore);
-
-			uint32_t nextImageIndex = 0;
-			vkAcquireNextImageKHR(
-				context.device,
-				context.swapChain,
-				UINT64_MAX,
-				presentCompleteSemaphore,
-				VK_NULL_HANDLE,
-				&nextImageIndex);
-
-			// Only try to transition the image if it has not been transitioned yet
-			if (!transitionedImages[nextImageIndex])
+			// Look for the LunarG validation layer
+			if (strcmp(availableLayers[i].layerName, validationLayers[0]) == 0)
 			{
-				// Start recording in the setup command buffer
-				vkBeginCommandBuffer(context.setupCommandBuffer, &beginInfo);
-
-				VkImageSubresourceRange resourceRange = {};
-				resourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-				resourceRange.baseMipLevel = 0;
-				resourceRange.levelCount = 1;
-				resourceRange.baseArrayLayer = 0;
-				resourceRange.layerCount = 1;
-
-				VkImageMemoryBarrier layoutTransitionBarrier = {};
-				layoutTransitionBarrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
-				layoutTransitionBarrier.srcAccessMask = 0;
-				layoutTransitionBarrier.dstAccessMask = VK_ACCESS_MEMORY_READ_BIT;
-				layoutTransitionBarrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-				layoutTransitionBarrier.newLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
-				layoutTransitionBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-				layoutTransitionBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-				layoutTransitionBarrier.image = context.presentImages[nextImageIndex];
-				layoutTransitionBarrier.subresourceRange = resourceRange;
-
-				// Apply the image layout transition barrier
-				vkCmdPipelineBarrier(
-					context.setupCommandBuffer,
-					VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
-					VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
-					0,
-					0, nullptr,
-					0, nullptr,
-					1, &layoutTransitionBarrier);
-
-				// Finished writing to this command buffer
-				vkEndCommandBuffer(context.setupCommandBuffer);
-
-				VkPipelineStageFlags waitStageMask[] =
-				{
-					VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT
-				};
-
-				VkSubmitInfo submitInfo = {};
-				submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
-				submitInfo.waitSemaphoreCount = 1;
-				submitInfo.pWaitSemaphores = &presentCompleteSemaphore;
-				submitInfo.pWaitDstStageMask = waitStageMask;
-				submitInfo.commandBufferCount = 1;
-				submitInfo.pCommandBuffers = &context.setupCommandBuffer;
-				submitInfo.signalSemaphoreCount = 0;
-				submitInfo.pSignalSemaphores = nullptr;
-
-				// Submit the commands to the setup queue
-				result = vkQueueSubmit(
-					context.presentQueue,
-					1,
-					&submitInfo,
-					submitFence);
-
-				Utility::checkVulkanResult(
-					result,
-					"Failed to submit present queue.");
-
-				// Wait for the commands to finish
-				vkWaitForFences(context.device, 1, &submitFence, VK_TRUE, UINT64_MAX);
-				vkResetFences(context.device, 1, &submitFence);
-
-				vkDestroySemaphore(context.device, presentCompleteSemaphore, nullptr);
-
-				vkResetCommandBuffer(context.setupCommandBuffer, 0);
-
-				transitionedImages[nextImageIndex] = true;
-				++processedImageCount;
+				foundValidationLayer = true;
 			}
+		}
 
-			VkPresentInfoKHR presentInfo = {};
-			presentInfo.sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR;
-			presentInfo.waitSemaphoreCount = 0;
-			presentInfo.pWaitSemaphores = nullptr;
-			presentInfo.swapchainCount = 1;
-			presentInfo.pSwapchains = &context.swapChain;
-			presentInfo.pImageIndices = &nextImageIndex;
+		assert(foundValidationLayer,
+			"Failed to find the \"VK_LAYER_LUNARG_standard_validation\"validation layer.");
 
-			vkQueuePresentKHR(context.presentQueue, &presentInfo);
-		}
+		hostAllocator.freeArray(availableLayers);
+	}
+
+	// Get the number of supported extensions
+	uint32_t extensionCount = 0;
+	vkEnumerateInstanceExtensionProperties(nullptr, &extensionCount, nullptr);
+
+	assert(extensionCount != 0, "Failed to find any extensions on this system.");
+	VkExtensionProperties *availableExtensions = hostAllocator.allocateArray<VkExtensionProperties>(extensionCount);
+	vkEnumerateInstanceExtensionProperties(nullptr, &extensionCount, availableExtensions);
 
-		delete[] transitionedImages;
+	const char *extensions[3];
+	uint32_t requiredNumberOfExtensions = 0;
+
+	if (requiredCapabilities & INSTANCE_CAPABILITY_SURFACE_EXTENSIONS)
+	{
+		extensions[requiredNumberOfExtensions++] = "VK_KHR_surface";
+		extensions[requiredNumberOfExtensions++] = "VK_KHR_win32_surface";
 	}
 
-	auto *presentImageViews = new VkImageView[imageCount];
-	for (uint32_t i = 0; i < imageCount; ++i)
+	if (requiredCapabilities & INSTANCE_CAPABILITY_DEBUG_UTILS)
 	{
-		presentImagesViewCreateInfo.image = context.presentImages[i];
+		extensions[requiredNumberOfExtensions++] = "VK_EXT_debug_utils";
+	}
 
-		result = vkCreateImageView(
-			context.device,
-			&presentImagesViewCreateInfo,
-			nullptr,
-			&presentImageViews[i]);
+	uint32_t numberOfExtensionsFound = 0;
 
-		Utility::checkVulkanResult(result, "Failed to create an image view.");
+	for (uint32_t i = 0; i < extensionCount; ++i)
+	{
+		for (uint32_t j = 0; j < requiredNumberOfExtensions; ++j)
+		// Found one of the required extensions
+		if (strcmp(availableExtensions[i].extensionName, extensions[j]) == 0)
+		{
+			++numberOfExtensionsFound;
+		}
 	}
 
-	// Create a depth image
-	VkImageCreateInfo imageCreateInfo = {};
-	imageCreateInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
-	imageCreateInfo.imageType = VK_IMAGE_TYPE_2D;
-	imageCreateInfo.format = VK_FORMAT_D16_UNORM;
-	imageCreateInfo.extent.width = context.width;
-	imageCreateInfo.extent.height = context.height;
-	imageCreateInfo.extent.depth = 1;
-	imageCreateInfo.mipLevels = 1;
-	imageCreateInfo.arrayLayers = 1;
-	imageCreateInfo.samples = VK_SAMPLE_COUNT_1_BIT;
-	imageCreateInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
-	imageCreateInfo.usage = VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT;
-	imageCreateInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
-	imageCreateInfo.queueFamilyIndexCount = 0;
-	imageCreateInfo.pQueueFamilyIndices = nullptr;
-	imageCreateInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+	assert(numberOfExtensionsFound == requiredNumberOfExtensions,
+		"Failed to find all required extensions.");
 
-	result = vkCreateImage(
-		context.device,
-		&imageCreateInfo,
-		nullptr,
-		&context.depthImage);
+	hostAllocator.freeArray(availableExtensions);
 
-	Utility::checkVulkanResult(result, "Failed to create the depth image.");
+	capabilityCache.editCapabilities().instanceCapabilities |= requiredCapabilities;
+	capabilityCache.recordMiss();
+}
 
-	VkMemoryRequirements memoryRequirements = {};
-	vkGetImageMemoryRequirements(
-		context.device,
-		context.depthImage,
-		&memoryRequirements);
+#ifdef VK_USE_PLATFORM_WIN32_KHR
+void Renderer::createSurface(HWND windowHandle)
+{
+	// Create a Windows surface
+	VkWin32SurfaceCreateInfoKHR surfaceCreateInfo = {};
+	surfaceCreateInfo.sType = VK_STRUCTURE_TYPE_WIN32_SURFACE_CREATE_INFO_KHR;
+	surfaceCreateInfo.hinstance = GetModuleHandle(nullptr);
+	surfaceCreateInfo.hwnd = windowHandle;
 
-	VkMemoryAllocateInfo imageAllocateInfo = {};
-	imageAllocateInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-	imageAllocateInfo.allocationSize = memoryRequirements.size;
+	VkResult result = vkCreateWin32SurfaceKHR(
+		context.instance,
+		&surfaceCreateInfo,
+		context.allocator,
+		&context.surface);
+
+	Utility::checkVulkanResult(result, "Failed to create a Windows surface.");
+}
+#endif
+
+void Renderer::selectPhysicalDevice()
+{
+	// Find a suitable physical device (for now, just use the first one that
+	// supports rendering)
+	uint32_t physicalDeviceCount = 0;
+	vkEnumeratePhysicalDevices(context.instance, &physicalDeviceCount, nullptr);
+
+	assert(physicalDeviceCount != 0,
+		"Failed to find any physical devices on this machine.");
+
+	auto *physicalDevices = hostAllocator.allocateArray<VkPhysicalDevice>(physicalDeviceCount);
+	vkEnumeratePhysicalDevices(
+		context.instance,
+		&physicalDeviceCount,
+		physicalDevices);
+
+	// The devices still have to be enumerated to get their handles, but the
+	// queue families of the device that was picked last time do not have to
+	// be searched again if its driver has not changed since
+	const CachedCapabilities &cached = capabilityCache.getCapabilities();
+
+	if (cached.hasDevice && cached.physicalDeviceIndex < physicalDeviceCount)
+	{
+		VkPhysicalDevice physicalDevice = physicalDevices[cached.physicalDeviceIndex];
+
+		VkPhysicalDeviceIDProperties idProperties = {};
+		VkPhysicalDeviceProperties2 physicalDeviceProperties = {};
+		getPhysicalDeviceIdentity(physicalDevice, physicalDeviceProperties, idProperties);
+
+		if (capabilityCache.matchesDevice(
+			physicalDeviceProperties.properties.driverVersion,
+			idProperties.deviceUUID))
+		{
+			// The surface is new every time, so check that the queue can
+			// still present to it
+			VkBool32 supportsPresent = context.headless;
+
+			if (!context.headless)
+			{
+				vkGetPhysicalDeviceSurfaceSupportKHR(
+					physicalDevice,
+					cached.queueFamilyIndex,
+					context.surface,
+					&supportsPresent);
+			}
+
+			if (supportsPresent)
+			{
+				context.physicalDevice = physicalDevice;
+				context.physicalDeviceProperties = physicalDeviceProperties.properties;
+				context.presentQueueIndex = cached.queueFamilyIndex;
+				context.supportsTimestamps = cached.supportsTimestamps;
+
+				capabilityCache.recordHit();
+			}
+			else
+			{
+				capabilityCache.invalidateDevice();
+			}
+		}
+	}
+
+	for (uint32_t i = 0; i < physicalDeviceCount && !context.physicalDevice; ++i)
+	{
+		// Get the properties of this physical device
+		VkPhysicalDeviceProperties physicalDeviceProperties = {};
+		vkGetPhysicalDeviceProperties(
+			physicalDevices[i],
+			&physicalDeviceProperties);
+
+		uint32_t queueFamilyCount = 0;
+		vkGetPhysicalDeviceQueueFamilyProperties(
+			physicalDevices[i],
+			&queueFamilyCount,
+			nullptr);
+
+		VkQueueFamilyProperties *queueFamilyProperties = hostAllocator.allocateArray<VkQueueFamilyProperties>(queueFamilyCount);
+		vkGetPhysicalDeviceQueueFamilyProperties(
+			physicalDevices[i],
+			&queueFamilyCount,
+			queueFamilyProperties);
+
+		// Check whether at least one of the queue families supports presenting
+		// (a headless context only needs to render)
+		for (uint32_t j = 0; j < queueFamilyCount; ++j)
+		{
+			VkBool32 supportsPresent = context.headless;
+
+			if (!context.headless)
+			{
+				vkGetPhysicalDeviceSurfaceSupportKHR(
+					physicalDevices[i],
+					j,
+					context.surface,
+					&supportsPresent);
+			}
+
+			if (supportsPresent &&
+				(queueFamilyProperties[j].queueFlags & VK_QUEUE_GRAPHICS_BIT))
+			{
+				context.physicalDevice = physicalDevices[i];
+				context.physicalDeviceProperties = physicalDeviceProperties;
+				context.presentQueueIndex = j;
+
+				// GPU frame times are only available if the queue can write
+				// timestamps
+				context.supportsTimestamps =
+					queueFamilyProperties[j].timestampValidBits != 0;
+
+				// Remember the choice for the next start
+				VkPhysicalDeviceIDProperties idProperties = {};
+				VkPhysicalDeviceProperties2 identity = {};
+				getPhysicalDeviceIdentity(physicalDevices[i], identity, idProperties);
+
+				capabilityCache.matchesDevice(identity.properties.driverVersion, idProperties.deviceUUID);
+
+				CachedCapabilities &capabilities = capabilityCache.editCapabilities();
+				capabilities.hasDevice = true;
+				capabilities.physicalDeviceIndex = i;
+				capabilities.queueFamilyIndex = j;
+				capabilities.supportsTimestamps = context.supportsTimestamps;
+
+				capabilityCache.recordMiss();
+				break;
+			}
+		}
+
+		hostAllocator.freeArray(queueFamilyProperties);
+	}
+
+	hostAllocator.freeArray(physicalDevices);
+
+	assert(context.physicalDevice,
+		"Failed to detect any physical device that can render and present.");
+
+	// Find the device group the selected physical device belongs to, multi-GPU
+	// rendering is only possible if that group contains more than one device
+	if (context.multiGpuMode != MultiGpuMode::Disabled)
+	{
+		uint32_t deviceGroupCount = 0;
+		vkEnumeratePhysicalDeviceGroups(context.instance, &deviceGroupCount, nullptr);
+
+		auto *deviceGroups = hostAllocator.allocateArray<VkPhysicalDeviceGroupProperties>(deviceGroupCount);
+		for (uint32_t i = 0; i < deviceGroupCount; ++i)
+		{
+			deviceGroups[i] = {};
+			deviceGroups[i].sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_GROUP_PROPERTIES;
+		}
+
+		vkEnumeratePhysicalDeviceGroups(
+			context.instance,
+			&deviceGroupCount,
+			deviceGroups);
+
+		for (uint32_t i = 0; i < deviceGroupCount; ++i)
+		{
+			if (deviceGroups[i].physicalDeviceCount < 2)
+				continue;
+
+			for (uint32_t j = 0; j < deviceGroups[i].physicalDeviceCount; ++j)
+			{
+				if (deviceGroups[i].physicalDevices[j] == context.physicalDevice)
+				{
+					context.deviceGroupSize = deviceGroups[i].physicalDeviceCount;
+					memcpy(
+						context.deviceGroupDevices,
+						deviceGroups[i].physicalDevices,
+						sizeof(VkPhysicalDevice) * context.deviceGroupSize);
+					break;
+				}
+			}
+		}
+
+		hostAllocator.freeArray(deviceGroups);
+
+		if (context.deviceGroupSize < 2)
+		{
+			logger.log(LogSeverity::Info, "No device group with multiple GPUs found, using a single GPU.");
+			context.multiGpuMode = MultiGpuMode::Disabled;
+		}
+	}
+
+	// Fill up the physical device memory properties
+	vkGetPhysicalDeviceMemoryProperties(
+		context.physicalDevice,
+		&context.physicalDeviceMemoryProperties);
+}
+
+void Renderer::createDevice()
+{
+	// Information for accessing one of the rendering queues of this device
+	VkDeviceQueueCreateInfo queueCreateInfo = {};
+	queueCreateInfo.sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO;
+	queueCreateInfo.queueFamilyIndex = context.presentQueueIndex;
+	queueCreateInfo.queueCount = 1;
+	float queuePriorities[] = { 1.0f };	// Ask for the highest priority (0 to 1)
+	queueCreateInfo.pQueuePriorities = queuePriorities;
+
+	// Logical device information
+	VkDeviceCreateInfo deviceCreateInfo = {};
+	deviceCreateInfo.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
+	deviceCreateInfo.queueCreateInfoCount = 1;
+	deviceCreateInfo.pQueueCreateInfos = &queueCreateInfo;
+
+	if (context.enableValidation)
+	{
+		deviceCreateInfo.enabledLayerCount = 1;
+		deviceCreateInfo.ppEnabledLayerNames = validationLayers;
+	}
+
+	// Swap chain extension is required, unless there is nothing to present to
+	const char *deviceExtensions[4];
+	uint32_t deviceExtensionCount = 0;
+
+	if (!context.headless)
+		deviceExtensions[deviceExtensionCount++] = "VK_KHR_swapchain";
+
+	// Mesh shaders are optional, the meshlets fall back to indirect draws.
+	// On Vulkan 1.1 they need SPIR-V 1.4 and its float controls as well.
+	const char *meshShaderExtensions[] = { "VK_EXT_mesh_shader", "VK_KHR_spirv_1_4", "VK_KHR_shader_float_controls" };
+	const uint32_t meshShaderExtensionCount = sizeof(meshShaderExtensions) / sizeof(meshShaderExtensions[0]);
+
+	uint32_t extensionCount = 0;
+	vkEnumerateDeviceExtensionProperties(context.physicalDevice, nullptr, &extensionCount, nullptr);
+
+	VkExtensionProperties *availableExtensions = hostAllocator.allocateArray<VkExtensionProperties>(extensionCount);
+	vkEnumerateDeviceExtensionProperties(context.physicalDevice, nullptr, &extensionCount, availableExtensions);
+
+	uint32_t meshShaderExtensionsFound = 0;
+	for (uint32_t i = 0; i < extensionCount; ++i)
+	{
+		for (uint32_t j = 0; j < meshShaderExtensionCount; ++j)
+		{
+			if (strcmp(availableExtensions[i].extensionName, meshShaderExtensions[j]) == 0)
+				++meshShaderExtensionsFound;
+		}
+	}
+
+	bool hasMeshShaderExtension = (meshShaderExtensionsFound == meshShaderExtensionCount);
+
+	hostAllocator.freeArray(availableExtensions);
+
+	VkPhysicalDeviceFeatures supportedFeatures = {};
+	vkGetPhysicalDeviceFeatures(context.physicalDevice, &supportedFeatures);
+
+	VkPhysicalDeviceFeatures physicalDeviceFeatures = {};
+	physicalDeviceFeatures.shaderClipDistance = VK_TRUE;
+
+	// The GPU counters are only used if the queries can stay active while
+	// the cached secondary command buffers are executed
+	physicalDeviceFeatures.pipelineStatisticsQuery = supportedFeatures.pipelineStatisticsQuery;
+	physicalDeviceFeatures.occlusionQueryPrecise = supportedFeatures.occlusionQueryPrecise;
+	physicalDeviceFeatures.inheritedQueries = supportedFeatures.inheritedQueries;
+
+	// All culled meshlets are drawn with one indirect draw
+	physicalDeviceFeatures.multiDrawIndirect = supportedFeatures.multiDrawIndirect;
+
+	deviceCreateInfo.pEnabledFeatures = &physicalDeviceFeatures;
+	context.enabledFeatures = physicalDeviceFeatures;
+
+	// Multiview is part of Vulkan 1.1, but still optional for the driver
+	VkPhysicalDeviceMultiviewFeatures supportedMultiviewFeatures = {};
+	supportedMultiviewFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MULTIVIEW_FEATURES;
+
+	VkPhysicalDeviceFeatures2 supportedFeatures2 = {};
+	supportedFeatures2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+	supportedFeatures2.pNext = &supportedMultiviewFeatures;
+	vkGetPhysicalDeviceFeatures2(context.physicalDevice, &supportedFeatures2);
+
+	VkPhysicalDeviceMultiviewProperties multiviewProperties = {};
+	multiviewProperties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MULTIVIEW_PROPERTIES;
+
+	VkPhysicalDeviceProperties2 properties2 = {};
+	properties2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2;
+	properties2.pNext = &multiviewProperties;
+	vkGetPhysicalDeviceProperties2(context.physicalDevice, &properties2);
+
+	VkPhysicalDeviceMultiviewFeatures multiviewFeatures = {};
+	multiviewFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MULTIVIEW_FEATURES;
+	multiviewFeatures.multiview = supportedMultiviewFeatures.multiview;
+
+	context.supportsMultiview = (supportedMultiviewFeatures.multiview == VK_TRUE);
+	context.maxMultiviewViewCount = context.supportsMultiview ? multiviewProperties.maxMultiviewViewCount : 0;
+
+	deviceCreateInfo.pNext = &multiviewFeatures;
+
+	context.supportsMeshShaders = false;
+
+#ifdef VK_EXT_mesh_shader
+	// Meshlets are culled in task shaders if both stages are supported
+	VkPhysicalDeviceMeshShaderFeaturesEXT meshShaderFeatures = {};
+	meshShaderFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MESH_SHADER_FEATURES_EXT;
+
+	if (hasMeshShaderExtension)
+	{
+		VkPhysicalDeviceMeshShaderFeaturesEXT supportedMeshShaderFeatures = {};
+		supportedMeshShaderFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MESH_SHADER_FEATURES_EXT;
+
+		supportedFeatures2.pNext = &supportedMeshShaderFeatures;
+		vkGetPhysicalDeviceFeatures2(context.physicalDevice, &supportedFeatures2);
+
+		if (supportedMeshShaderFeatures.taskShader && supportedMeshShaderFeatures.meshShader)
+		{
+			meshShaderFeatures.taskShader = VK_TRUE;
+			meshShaderFeatures.meshShader = VK_TRUE;
+			multiviewFeatures.pNext = &meshShaderFeatures;
+
+			for (uint32_t i = 0; i < meshShaderExtensionCount; ++i)
+				deviceExtensions[deviceExtensionCount++] = meshShaderExtensions[i];
+
+			context.supportsMeshShaders = true;
+		}
+	}
+#else
+	(void)hasMeshShaderExtension;
+#endif
+
+	deviceCreateInfo.enabledExtensionCount = deviceExtensionCount;
+	deviceCreateInfo.ppEnabledExtensionNames = deviceExtensionCount > 0 ? deviceExtensions : nullptr;
+
+	// Create the logical device from all physical devices in the group
+	VkDeviceGroupDeviceCreateInfo deviceGroupCreateInfo = {};
+	deviceGroupCreateInfo.sType = VK_STRUCTURE_TYPE_DEVICE_GROUP_DEVICE_CREATE_INFO;
+	deviceGroupCreateInfo.physicalDeviceCount = context.deviceGroupSize;
+	deviceGroupCreateInfo.pPhysicalDevices = context.deviceGroupDevices;
+
+	if (context.deviceGroupSize > 1)
+	{
+		deviceGroupCreateInfo.pNext = &multiviewFeatures;
+		deviceCreateInfo.pNext = &deviceGroupCreateInfo;
+	}
+
+	// Create the logical device
+	VkResult result = vkCreateDevice(
+		context.physicalDevice,
+		&deviceCreateInfo,
+		context.allocator,
+		&context.device);
+
+	Utility::checkVulkanResult(result, "Failed to create a logical device.");
+
+	// Get a handle to the present queue of this device
+	vkGetDeviceQueue(
+		context.device,
+		context.presentQueueIndex,
+		0,
+		&context.presentQueue);
+}
+
+void Renderer::createSwapChain()
+{
+	// The format and present mode only depend on the device and driver, so
+	// they can be taken from the cache without querying the surface
+	const CachedCapabilities &cached = capabilityCache.getCapabilities();
+
+	VkColorSpaceKHR surfaceColorSpace;
+	VkPresentModeKHR presentationMode;
+
+	if (cached.hasSurfaceFormat)
+	{
+		context.colorFormat = cached.colorFormat;
+		surfaceColorSpace = cached.colorSpace;
+		presentationMode = cached.presentMode;
+
+		capabilityCache.recordHit();
+	}
+	else
+	{
+		querySurfaceFormat(surfaceColorSpace, presentationMode);
+
+		CachedCapabilities &capabilities = capabilityCache.editCapabilities();
+		capabilities.hasSurfaceFormat = true;
+		capabilities.colorFormat = context.colorFormat;
+		capabilities.colorSpace = surfaceColorSpace;
+		capabilities.presentMode = presentationMode;
+
+		capabilityCache.recordMiss();
+	}
+
+	VkSurfaceCapabilitiesKHR surfaceCapabilities = {};
+	vkGetPhysicalDeviceSurfaceCapabilitiesKHR(
+		context.physicalDevice,
+		context.surface,
+		&surfaceCapabilities);
+
+	// If surfaceCapabilities.maxImageCount == 0, then there is no limit on the
+	// number of images (no idea why you would ever need 4+ images, though...)
+	uint32_t desiredImageCount = 2;	// Double-buffering
+
+	// Adjust the desired image count if the current value is not supported
+	if (desiredImageCount < surfaceCapabilities.minImageCount)
+	{
+		// Cannot use less than the minimum number of images supported
+		desiredImageCount = surfaceCapabilities.minImageCount;
+	}
+	else if (surfaceCapabilities.maxImageCount != 0 &&
+			 desiredImageCount > surfaceCapabilities.maxImageCount)
+	{
+		// Cannot use more than the maximum number of images supported
+		desiredImageCount = surfaceCapabilities.maxImageCount;
+	}
+
+	// If surfaceCapabilities.currentExtent has -1 for either the width or
+	// height, it means that the values can be set to any value. Otherwise,
+	// those non-zero values will have to be matched exactly.
+	VkExtent2D surfaceResolution = surfaceCapabilities.currentExtent;
+
+	if (surfaceResolution.width == -1 ||
+		surfaceResolution.height == -1)
+	{
+		surfaceResolution.width = context.width;
+		surfaceResolution.height = context.height;
+	}
+	else
+	{
+		// Surface resolution has to be matched exactly therefore, the
+		// dimensions of the context have to be updated
+		context.width = surfaceResolution.width;
+		context.height = surfaceResolution.height;
+	}
+
+	VkSurfaceTransformFlagBitsKHR preTransform = surfaceCapabilities.currentTransform;
+
+	// No surface rotation
+	if (surfaceCapabilities.supportedTransforms &
+		VK_SURFACE_TRANSFORM_IDENTITY_BIT_KHR)
+	{
+		preTransform = VK_SURFACE_TRANSFORM_IDENTITY_BIT_KHR;
+	}
+
+	// Pick the way the device group presents its images: alternate frame
+	// rendering presents from whichever GPU rendered the frame, split frame
+	// rendering sums the images of all GPUs (every GPU only writes its own
+	// strip, the rest of its image is cleared to zero)
+	context.deviceGroupPresentMode = VK_DEVICE_GROUP_PRESENT_MODE_LOCAL_BIT_KHR;
+
+	if (context.multiGpuMode != MultiGpuMode::Disabled)
+	{
+		VkDeviceGroupPresentCapabilitiesKHR presentCapabilities = {};
+		presentCapabilities.sType = VK_STRUCTURE_TYPE_DEVICE_GROUP_PRESENT_CAPABILITIES_KHR;
+		vkGetDeviceGroupPresentCapabilitiesKHR(context.device, &presentCapabilities);
+
+		VkDeviceGroupPresentModeFlagBitsKHR desiredPresentMode =
+			(context.multiGpuMode == MultiGpuMode::SplitFrame) ?
+			VK_DEVICE_GROUP_PRESENT_MODE_SUM_BIT_KHR :
+			VK_DEVICE_GROUP_PRESENT_MODE_REMOTE_BIT_KHR;
+
+		if (presentCapabilities.modes & desiredPresentMode)
+		{
+			context.deviceGroupPresentMode = desiredPresentMode;
+		}
+		else
+		{
+			logger.log(LogSeverity::Info, "The device group cannot present in the requested mode, using a single GPU.");
+			context.multiGpuMode = MultiGpuMode::Disabled;
+		}
+	}
+
+	// Create the swap chain
+	VkSwapchainCreateInfoKHR swapChainCreateInfo = {};
+	swapChainCreateInfo.sType = VK_STRUCTURE_TYPE_SWAPCHAIN_CREATE_INFO_KHR;
+	swapChainCreateInfo.surface = context.surface;
+	swapChainCreateInfo.minImageCount = desiredImageCount;
+	swapChainCreateInfo.imageFormat = context.colorFormat;
+	swapChainCreateInfo.imageColorSpace = surfaceColorSpace;
+	swapChainCreateInfo.imageExtent = surfaceResolution;
+	swapChainCreateInfo.imageArrayLayers = 1;
+	swapChainCreateInfo.imageUsage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT;
+	swapChainCreateInfo.imageSharingMode = VK_SHARING_MODE_EXCLUSIVE;
+	swapChainCreateInfo.preTransform = preTransform;
+	swapChainCreateInfo.compositeAlpha = VK_COMPOSITE_ALPHA_OPAQUE_BIT_KHR;
+	swapChainCreateInfo.presentMode = presentationMode;
+	swapChainCreateInfo.clipped = VK_TRUE;
+
+	VkDeviceGroupSwapchainCreateInfoKHR deviceGroupSwapChainCreateInfo = {};
+	deviceGroupSwapChainCreateInfo.sType = VK_STRUCTURE_TYPE_DEVICE_GROUP_SWAPCHAIN_CREATE_INFO_KHR;
+	deviceGroupSwapChainCreateInfo.modes = context.deviceGroupPresentMode;
+
+	if (context.multiGpuMode != MultiGpuMode::Disabled)
+	{
+		swapChainCreateInfo.pNext = &deviceGroupSwapChainCreateInfo;
+	}
+
+	// Split frame rendering clears the whole image before every GPU renders
+	// its own strip
+	if (context.multiGpuMode == MultiGpuMode::SplitFrame)
+	{
+		swapChainCreateInfo.imageUsage |= VK_IMAGE_USAGE_TRANSFER_DST_BIT;
+	}
+
+	// Dynamic resolution scales the rendered image up into the swap chain
+	// images
+	if (context.dynamicResolution)
+	{
+		if (surfaceCapabilities.supportedUsageFlags & VK_IMAGE_USAGE_TRANSFER_DST_BIT)
+		{
+			swapChainCreateInfo.imageUsage |= VK_IMAGE_USAGE_TRANSFER_DST_BIT;
+		}
+		else
+		{
+			logger.log(LogSeverity::Warning, "Dynamic resolution is not supported by the surface.");
+			context.dynamicResolution = false;
+		}
+	}
+
+	// Frame captures copy straight from the swap chain images
+	if (surfaceCapabilities.supportedUsageFlags & VK_IMAGE_USAGE_TRANSFER_SRC_BIT)
+	{
+		swapChainCreateInfo.imageUsage |= VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
+	}
+
+	VkResult result = vkCreateSwapchainKHR(
+		context.device,
+		&swapChainCreateInfo,
+		context.allocator,
+		&context.swapChain);
+
+	Utility::checkVulkanResult(result, "Failed to create the swap chain.");
+
+	// Retrieve the swap chain images and store them for later use
+	uint32_t imageCount = 0;
+	vkGetSwapchainImagesKHR(
+		context.device,
+		context.swapChain,
+		&imageCount,
+		nullptr);
+
+	context.presentImages = hostAllocator.allocateArray<VkImage>(imageCount);
+	vkGetSwapchainImagesKHR(
+		context.device,
+		context.swapChain,
+		&imageCount,
+		context.presentImages);
+
+	context.imageCount = imageCount;
+	context.finalLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+}
+
+void Renderer::querySurfaceFormat(VkColorSpaceKHR &colorSpace, VkPresentModeKHR &presentMode)
+{
+	// Pick the color format and color space for the swap chain
+	uint32_t colorFormatCount = 0;
+	vkGetPhysicalDeviceSurfaceFormatsKHR(
+		context.physicalDevice,
+		context.surface,
+		&colorFormatCount,
+		nullptr);
+
+	assert(colorFormatCount != 0, "Failed to find any color formats.");
+
+	VkSurfaceFormatKHR *surfaceFormats = hostAllocator.allocateArray<VkSurfaceFormatKHR>(colorFormatCount);
+	vkGetPhysicalDeviceSurfaceFormatsKHR(
+		context.physicalDevice,
+		context.surface,
+		&colorFormatCount,
+		surfaceFormats);
+
+	// If the array of formats only contain one entry of VK_FORMAT_UNDEFINED,
+	// it means that the surface has no preferred formats
+	if (colorFormatCount == 0 &&
+		surfaceFormats[0].format == VK_FORMAT_UNDEFINED)
+	{
+		// Use this as the default format
+		context.colorFormat = VK_FORMAT_R8G8B8A8_UNORM;
+	}
+	else
+	{
+		// Use whatever format the surface prefers
+		context.colorFormat = surfaceFormats[0].format;
+	}
+
+	// Use the first available color space
+	colorSpace = surfaceFormats[0].colorSpace;
+
+	hostAllocator.freeArray(surfaceFormats);
+
+	// Get the supported present modes
+	uint32_t presentModeCount = 0;
+	vkGetPhysicalDeviceSurfacePresentModesKHR(
+		context.physicalDevice,
+		context.surface,
+		&presentModeCount,
+		nullptr);
+
+	auto *presentModes = hostAllocator.allocateArray<VkPresentModeKHR>(presentModeCount);
+	vkGetPhysicalDeviceSurfacePresentModesKHR(
+		context.physicalDevice,
+		context.surface,
+		&presentModeCount,
+		presentModes);
+
+	// This is the default value that MUST be supported according to the Vulkan
+	// specification
+	presentMode = VK_PRESENT_MODE_FIFO_KHR;
+
+	// VK_PRESENT_MODE_MAILBOX_KHR is preferred, so use that if it is supported
+	for (uint32_t i = 0; i < presentModeCount; ++i)
+	{
+		if (presentModes[i] == VK_PRESENT_MODE_MAILBOX_KHR)
+		{
+			presentMode = VK_PRESENT_MODE_MAILBOX_KHR;
+			break;
+		}
+	}
+
+	hostAllocator.freeArray(presentModes);
+}
+
+void Renderer::createOffscreenImages()
+{
+	// Every frame in flight gets its own color image, so the GPU never waits
+	// for an image that is still in use by a previous frame
+	context.imageCount = context.framesInFlight;
+	context.colorFormat = VK_FORMAT_R8G8B8A8_UNORM;
+	context.finalLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+
+	context.presentImages = hostAllocator.allocateArray<VkImage>(context.imageCount);
+	context.offscreenImageMemory = hostAllocator.allocateArray<VkDeviceMemory>(context.imageCount);
+
+	VkImageCreateInfo imageCreateInfo = {};
+	imageCreateInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+	imageCreateInfo.imageType = VK_IMAGE_TYPE_2D;
+	imageCreateInfo.format = context.colorFormat;
+	imageCreateInfo.extent.width = context.width;
+	imageCreateInfo.extent.height = context.height;
+	imageCreateInfo.extent.depth = 1;
+	imageCreateInfo.mipLevels = 1;
+	imageCreateInfo.arrayLayers = 1;
+	imageCreateInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+	imageCreateInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+	imageCreateInfo.usage =	VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT |
+							VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
+	imageCreateInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+	imageCreateInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+
+	// Written by the upscale instead of the render pass, split frame
+	// rendering clears the image before every GPU renders its strip
+	if (context.dynamicResolution || context.multiGpuMode == MultiGpuMode::SplitFrame)
+		imageCreateInfo.usage |= VK_IMAGE_USAGE_TRANSFER_DST_BIT;
+
+	for (uint32_t i = 0; i < context.imageCount; ++i)
+	{
+		VkResult result = vkCreateImage(
+			context.device,
+			&imageCreateInfo,
+			context.allocator,
+			&context.presentImages[i]);
+
+		Utility::checkVulkanResult(result, "Failed to create an offscreen image.");
+
+		VkMemoryRequirements memoryRequirements = {};
+		vkGetImageMemoryRequirements(
+			context.device,
+			context.presentImages[i],
+			&memoryRequirements);
+
+		VkMemoryAllocateInfo imageAllocateInfo = {};
+		imageAllocateInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+		imageAllocateInfo.allocationSize = memoryRequirements.size;
+		imageAllocateInfo.memoryTypeIndex = findMemoryType(
+			memoryRequirements.memoryTypeBits,
+			VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+
+		result = vkAllocateMemory(
+			context.device,
+			&imageAllocateInfo,
+			context.allocator,
+			&context.offscreenImageMemory[i]);
+
+		Utility::checkVulkanResult(
+			result,
+			"Failed to allocate memory for an offscreen image.");
+
+		trackDeviceMemory(imageAllocateInfo.allocationSize);
+
+		result = vkBindImageMemory(
+			context.device,
+			context.presentImages[i],
+			context.offscreenImageMemory[i],
+			0);
+
+		Utility::checkVulkanResult(
+			result,
+			"Failed to bind memory for an offscreen image.");
+	}
+}
+
+void Renderer::createCommandBuffers()
+{
+	VkCommandPoolCreateInfo commandPoolCreateInfo = {};
+	commandPoolCreateInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+	commandPoolCreateInfo.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
+	commandPoolCreateInfo.queueFamilyIndex = context.presentQueueIndex;
+
+	// Create the command pool (used to allocate command buffers)
+	VkResult result = vkCreateCommandPool(
+		context.device,
+		&commandPoolCreateInfo,
+		context.allocator,
+		&context.commandPool);
+
+	Utility::checkVulkanResult(result, "Failed to create the command pool.");
+
+	VkCommandBufferAllocateInfo commandBufferAllocationInfo = {};
+	commandBufferAllocationInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+	commandBufferAllocationInfo.commandPool = context.commandPool;
+	commandBufferAllocationInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+	commandBufferAllocationInfo.commandBufferCount = 1;
+
+	// Create the setup command buffer
+	result = vkAllocateCommandBuffers(
+		context.device,
+		&commandBufferAllocationInfo,
+		&context.setupCommandBuffer);
+
+	Utility::checkVulkanResult(
+		result,
+		"Failed to allocate the setup command buffer.");
+
+	// Create one draw command buffer per frame in flight
+	for (uint32_t i = 0; i < context.framesInFlight; ++i)
+	{
+		result = vkAllocateCommandBuffers(
+			context.device,
+			&commandBufferAllocationInfo,
+			&context.frames[i].drawCommandBuffer);
+
+		Utility::checkVulkanResult(
+			result,
+			"Failed to allocate the draw command buffer");
+	}
+
+	VkFenceCreateInfo fenceCreateInfo = {};
+	fenceCreateInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+
+	result = vkCreateFence(
+		context.device,
+		&fenceCreateInfo,
+		context.allocator,
+		&context.setupFence);
+
+	Utility::checkVulkanResult(result, "Failed to create the setup fence.");
+}
+
+void Renderer::transitionPresentImages()
+{
+	VkResult result;
+
+	VkCommandBufferBeginInfo beginInfo = {};
+	beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+	beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+
+	VkImageSubresourceRange resourceRange = {};
+	resourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+	resourceRange.baseMipLevel = 0;
+	resourceRange.levelCount = 1;
+	resourceRange.baseArrayLayer = 0;
+	resourceRange.layerCount = 1;
+
+	VkImageMemoryBarrier layoutTransitionBarrier = {};
+	layoutTransitionBarrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+	layoutTransitionBarrier.srcAccessMask = 0;
+	layoutTransitionBarrier.dstAccessMask = VK_ACCESS_MEMORY_READ_BIT;
+	layoutTransitionBarrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+	layoutTransitionBarrier.newLayout = context.finalLayout;
+	layoutTransitionBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	layoutTransitionBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	layoutTransitionBarrier.subresourceRange = resourceRange;
+
+	// Offscreen images are owned by the application, so they can all be
+	// transitioned in one go
+	if (context.headless)
+	{
+		vkBeginCommandBuffer(context.setupCommandBuffer, &beginInfo);
+
+		for (uint32_t i = 0; i < context.imageCount; ++i)
+		{
+			layoutTransitionBarrier.image = context.presentImages[i];
+
+			vkCmdPipelineBarrier(
+				context.setupCommandBuffer,
+				VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
+				VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
+				0,
+				0, nullptr,
+				0, nullptr,
+				1, &layoutTransitionBarrier);
+		}
+
+		vkEndCommandBuffer(context.setupCommandBuffer);
+
+		VkSubmitInfo submitInfo = {};
+		submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+		submitInfo.commandBufferCount = 1;
+		submitInfo.pCommandBuffers = &context.setupCommandBuffer;
+
+		result = vkQueueSubmit(
+			context.presentQueue,
+			1,
+			&submitInfo,
+			context.setupFence);
+
+		Utility::checkVulkanResult(result, "Failed to submit present queue.");
+
+		vkWaitForFences(context.device, 1, &context.setupFence, VK_TRUE, UINT64_MAX);
+		vkResetFences(context.device, 1, &context.setupFence);
+		vkResetCommandBuffer(context.setupCommandBuffer, 0);
+
+		return;
+	}
+
+	// Loop through the present images and change their layout
+	auto *transitionedImages = hostAllocator.allocateArray<bool>(context.imageCount);
+	memset(transitionedImages, 0, sizeof(bool) * context.imageCount);
+	uint32_t processedImageCount = 0;
+
+	while (processedImageCount != context.imageCount)
+	{
+		VkSemaphore presentCompleteSemaphore;
+
+		VkSemaphoreCreateInfo semaphoreCreateInfo = {};
+		semaphoreCreateInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+		semaphoreCreateInfo.pNext = nullptr;
+		semaphoreCreateInfo.flags = 0;
+
+		vkCreateSemaphore(
+			context.device,
+			&semaphoreCreateInfo,
+			context.allocator,
+			&presentCompleteSemaphore);
+
+		uint32_t nextImageIndex = 0;
+		vkAcquireNextImageKHR(
+			context.device,
+			context.swapChain,
+			UINT64_MAX,
+			presentCompleteSemaphore,
+			VK_NULL_HANDLE,
+			&nextImageIndex);
+
+		// Only try to transition the image if it has not been transitioned yet
+		if (!transitionedImages[nextImageIndex])
+		{
+			// Start recording in the setup command buffer
+			vkBeginCommandBuffer(context.setupCommandBuffer, &beginInfo);
+
+			layoutTransitionBarrier.image = context.presentImages[nextImageIndex];
+
+			// Apply the image layout transition barrier
+			vkCmdPipelineBarrier(
+				context.setupCommandBuffer,
+				VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
+				VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
+				0,
+				0, nullptr,
+				0, nullptr,
+				1, &layoutTransitionBarrier);
+
+			// Finished writing to this command buffer
+			vkEndCommandBuffer(context.setupCommandBuffer);
+
+			VkPipelineStageFlags waitStageMask[] =
+			{
+				VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT
+			};
+
+			VkSubmitInfo submitInfo = {};
+			submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+			submitInfo.waitSemaphoreCount = 1;
+			submitInfo.pWaitSemaphores = &presentCompleteSemaphore;
+			submitInfo.pWaitDstStageMask = waitStageMask;
+			submitInfo.commandBufferCount = 1;
+			submitInfo.pCommandBuffers = &context.setupCommandBuffer;
+			submitInfo.signalSemaphoreCount = 0;
+			submitInfo.pSignalSemaphores = nullptr;
+
+			// Submit the commands to the setup queue
+			result = vkQueueSubmit(
+				context.presentQueue,
+				1,
+				&submitInfo,
+				context.setupFence);
+
+			Utility::checkVulkanResult(
+				result,
+				"Failed to submit present queue.");
+
+			// Wait for the commands to finish
+			vkWaitForFences(context.device, 1, &context.setupFence, VK_TRUE, UINT64_MAX);
+			vkResetFences(context.device, 1, &context.setupFence);
+
+			vkDestroySemaphore(context.device, presentCompleteSemaphore, context.allocator);
+
+			vkResetCommandBuffer(context.setupCommandBuffer, 0);
+
+			transitionedImages[nextImageIndex] = true;
+			++processedImageCount;
+		}
+
+		VkPresentInfoKHR presentInfo = {};
+		presentInfo.sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR;
+		presentInfo.waitSemaphoreCount = 0;
+		presentInfo.pWaitSemaphores = nullptr;
+		presentInfo.swapchainCount = 1;
+		presentInfo.pSwapchains = &context.swapChain;
+		presentInfo.pImageIndices = &nextImageIndex;
+
+		// The first device of the group presents the transitioned images
+		uint32_t presentDeviceMask = 1;
+		VkDeviceGroupPresentInfoKHR deviceGroupPresentInfo = {};
+		deviceGroupPresentInfo.sType = VK_STRUCTURE_TYPE_DEVICE_GROUP_PRESENT_INFO_KHR;
+		deviceGroupPresentInfo.swapchainCount = 1;
+		deviceGroupPresentInfo.pDeviceMasks = &presentDeviceMask;
+		deviceGroupPresentInfo.mode = context.deviceGroupPresentMode;
+
+		if (context.multiGpuMode != MultiGpuMode::Disabled)
+			presentInfo.pNext = &deviceGroupPresentInfo;
+
+		vkQueuePresentKHR(context.presentQueue, &presentInfo);
+	}
+
+	hostAllocator.freeArray(transitionedImages);
+}
+
+void Renderer::createDepthImage()
+{
+	VkResult result;
+
+	VkImageViewCreateInfo presentImagesViewCreateInfo = {};
+	presentImagesViewCreateInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+	presentImagesViewCreateInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+	presentImagesViewCreateInfo.format = context.colorFormat;
+	presentImagesViewCreateInfo.components =
+	{
+		VK_COMPONENT_SWIZZLE_R,
+		VK_COMPONENT_SWIZZLE_G,
+		VK_COMPONENT_SWIZZLE_B,
+		VK_COMPONENT_SWIZZLE_A
+	};
+	presentImagesViewCreateInfo.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+	presentImagesViewCreateInfo.subresourceRange.baseMipLevel = 0;
+	presentImagesViewCreateInfo.subresourceRange.levelCount = 1;
+	presentImagesViewCreateInfo.subresourceRange.baseArrayLayer = 0;
+	presentImagesViewCreateInfo.subresourceRange.layerCount = 1;
+
+	context.presentImageViews = hostAllocator.allocateArray<VkImageView>(context.imageCount);
+	for (uint32_t i = 0; i < context.imageCount; ++i)
+	{
+		presentImagesViewCreateInfo.image = context.presentImages[i];
+
+		result = vkCreateImageView(
+			context.device,
+			&presentImagesViewCreateInfo,
+			context.allocator,
+			&context.presentImageViews[i]);
+
+		Utility::checkVulkanResult(result, "Failed to create an image view.");
+	}
+
+	// Create a depth image
+	VkImageCreateInfo imageCreateInfo = {};
+	imageCreateInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+	imageCreateInfo.imageType = VK_IMAGE_TYPE_2D;
+	imageCreateInfo.format = VK_FORMAT_D16_UNORM;
+	imageCreateInfo.extent.width = context.width;
+	imageCreateInfo.extent.height = context.height;
+	imageCreateInfo.extent.depth = 1;
+	imageCreateInfo.mipLevels = 1;
+	imageCreateInfo.arrayLayers = 1;
+	imageCreateInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+	imageCreateInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+	imageCreateInfo.usage = VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT;
+	imageCreateInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+	imageCreateInfo.queueFamilyIndexCount = 0;
+	imageCreateInfo.pQueueFamilyIndices = nullptr;
+	imageCreateInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+
+	result = vkCreateImage(
+		context.device,
+		&imageCreateInfo,
+		context.allocator,
+		&context.depthImage);
+
+	Utility::checkVulkanResult(result, "Failed to create the depth image.");
+
+	VkMemoryRequirements memoryRequirements = {};
+	vkGetImageMemoryRequirements(
+		context.device,
+		context.depthImage,
+		&memoryRequirements);
+
+	VkMemoryAllocateInfo imageAllocateInfo = {};
+	imageAllocateInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+	imageAllocateInfo.allocationSize = memoryRequirements.size;
+	imageAllocateInfo.memoryTypeIndex = findMemoryType(
+		memoryRequirements.memoryTypeBits,
+		VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+
+	result = vkAllocateMemory(
+		context.device,
+		&imageAllocateInfo,
+		context.allocator,
+		&context.depthImageMemory);
+
+	Utility::checkVulkanResult(
+		result,
+		"Failed to allocate memory for the depth image.");
+
+	trackDeviceMemory(imageAllocateInfo.allocationSize);
+
+	result = vkBindImageMemory(
+		context.device,
+		context.depthImage,
+		context.depthImageMemory,
+		0);
+
+	Utility::checkVulkanResult(
+		result,
+		"Failed to bind memory for the depth image.");
+
+	VkCommandBufferBeginInfo beginInfo = {};
+	beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+	beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+
+	// Begin recording commands into the setup command buffer
+	vkBeginCommandBuffer(context.setupCommandBuffer, &beginInfo);
+
+	VkImageMemoryBarrier layoutTransitionBarrier = {};
+	layoutTransitionBarrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+	layoutTransitionBarrier.srcAccessMask = 0;
+
+	layoutTransitionBarrier.dstAccessMask =
+		VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT |
+		VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+
+	layoutTransitionBarrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+	layoutTransitionBarrier.newLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+	layoutTransitionBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	layoutTransitionBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	layoutTransitionBarrier.image = context.depthImage;
+
+	VkImageSubresourceRange resourceRange = {};
+	resourceRange.aspectMask = VK_IMAGE_ASPECT_DEPTH_BIT;
+	resourceRange.baseMipLevel = 0;
+	resourceRange.levelCount = 1;
+	resourceRange.baseArrayLayer = 0;
+	resourceRange.layerCount = 1;
+
+	layoutTransitionBarrier.subresourceRange = resourceRange;
+
+	vkCmdPipelineBarrier(context.setupCommandBuffer,
+		VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
+		VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
+		0,
+		0,
+		nullptr,
+		0,
+		nullptr,
+		1,
+		&layoutTransitionBarrier);
+
+	vkEndCommandBuffer(context.setupCommandBuffer);
+
+	VkPipelineStageFlags waitStageMask[] = { VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT };
+
+	VkSubmitInfo submitInfo = {};
+	submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+	submitInfo.waitSemaphoreCount = 0;
+	submitInfo.pWaitSemaphores = nullptr;
+	submitInfo.pWaitDstStageMask = waitStageMask;
+	submitInfo.commandBufferCount = 1;
+	submitInfo.pCommandBuffers = &context.setupCommandBuffer;
+	submitInfo.signalSemaphoreCount = 0;
+	submitInfo.pSignalSemaphores = nullptr;
+
+	result = vkQueueSubmit(context.presentQueue, 1, &submitInfo, context.setupFence);
+	Utility::checkVulkanResult(result, "Failed to submit present queue.");
+
+	vkWaitForFences(context.device, 1, &context.setupFence, VK_TRUE, UINT64_MAX);
+	vkResetFences(context.device, 1, &context.setupFence);
+	vkResetCommandBuffer(context.setupCommandBuffer, 0);
+
+	VkImageAspectFlags aspectMask = VK_IMAGE_ASPECT_DEPTH_BIT;
+	VkImageViewCreateInfo imageViewCreateInfo = {};
+	imageViewCreateInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+	imageViewCreateInfo.image = context.depthImage;
+	imageViewCreateInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+	imageViewCreateInfo.format = imageCreateInfo.format;
+	imageViewCreateInfo.components.r = VK_COMPONENT_SWIZZLE_IDENTITY;
+	imageViewCreateInfo.components.g = VK_COMPONENT_SWIZZLE_IDENTITY;
+	imageViewCreateInfo.components.b = VK_COMPONENT_SWIZZLE_IDENTITY;
+	imageViewCreateInfo.components.a = VK_COMPONENT_SWIZZLE_IDENTITY;
+	imageViewCreateInfo.subresourceRange.aspectMask = aspectMask;
+	imageViewCreateInfo.subresourceRange.baseMipLevel = 0;
+	imageViewCreateInfo.subresourceRange.levelCount = 1;
+	imageViewCreateInfo.subresourceRange.baseArrayLayer = 0;
+	imageViewCreateInfo.subresourceRange.layerCount = 1;
+
+	result = vkCreateImageView(
+		context.device,
+		&imageViewCreateInfo,
+		context.allocator,
+		&context.depthImageView);
+
+	Utility::checkVulkanResult(result, "Failed to create depth image view.");
+}
+
+void Renderer::createSceneImage()
+{
+	if (!context.dynamicResolution)
+		return;
+
+	// The controller needs the GPU time of every frame, and the scene is
+	// scaled up with a filtered blit
+	VkFormatProperties formatProperties = {};
+	vkGetPhysicalDeviceFormatProperties(
+		context.physicalDevice,
+		context.colorFormat,
+		&formatProperties);
+
+	VkFormatFeatureFlags blitFeatures =
+		VK_FORMAT_FEATURE_BLIT_SRC_BIT |
+		VK_FORMAT_FEATURE_BLIT_DST_BIT |
+		VK_FORMAT_FEATURE_SAMPLED_IMAGE_FILTER_LINEAR_BIT;
+
+	if (!context.supportsTimestamps ||
+		(formatProperties.optimalTilingFeatures & blitFeatures) != blitFeatures)
+	{
+		logger.log(LogSeverity::Warning, "Dynamic resolution is not supported on this device.");
+		context.dynamicResolution = false;
+		return;
+	}
+
+	// Large enough for the full resolution, lower resolutions only use a part
+	// of it, so changing the scale never creates anything
+	VkImageCreateInfo imageCreateInfo = {};
+	imageCreateInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+	imageCreateInfo.imageType = VK_IMAGE_TYPE_2D;
+	imageCreateInfo.format = context.colorFormat;
+	imageCreateInfo.extent.width = context.width;
+	imageCreateInfo.extent.height = context.height;
+	imageCreateInfo.extent.depth = 1;
+	imageCreateInfo.mipLevels = 1;
+	imageCreateInfo.arrayLayers = 1;
+	imageCreateInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+	imageCreateInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+	imageCreateInfo.usage =	VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT |
+							VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
+	imageCreateInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+	imageCreateInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+
+	VkResult result = vkCreateImage(
+		context.device,
+		&imageCreateInfo,
+		context.allocator,
+		&context.sceneImage);
+
+	Utility::checkVulkanResult(result, "Failed to create the scene image.");
+
+	VkMemoryRequirements memoryRequirements = {};
+	vkGetImageMemoryRequirements(
+		context.device,
+		context.sceneImage,
+		&memoryRequirements);
+
+	VkMemoryAllocateInfo imageAllocateInfo = {};
+	imageAllocateInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+	imageAllocateInfo.allocationSize = memoryRequirements.size;
+	imageAllocateInfo.memoryTypeIndex = findMemoryType(
+		memoryRequirements.memoryTypeBits,
+		VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+
+	result = vkAllocateMemory(
+		context.device,
+		&imageAllocateInfo,
+		context.allocator,
+		&context.sceneImageMemory);
+
+	Utility::checkVulkanResult(
+		result,
+		"Failed to allocate memory for the scene image.");
+
+	trackDeviceMemory(imageAllocateInfo.allocationSize);
+
+	result = vkBindImageMemory(
+		context.device,
+		context.sceneImage,
+		context.sceneImageMemory,
+		0);
+
+	Utility::checkVulkanResult(
+		result,
+		"Failed to bind memory for the scene image.");
+
+	VkImageViewCreateInfo imageViewCreateInfo = {};
+	imageViewCreateInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+	imageViewCreateInfo.image = context.sceneImage;
+	imageViewCreateInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+	imageViewCreateInfo.format = context.colorFormat;
+	imageViewCreateInfo.components.r = VK_COMPONENT_SWIZZLE_IDENTITY;
+	imageViewCreateInfo.components.g = VK_COMPONENT_SWIZZLE_IDENTITY;
+	imageViewCreateInfo.components.b = VK_COMPONENT_SWIZZLE_IDENTITY;
+	imageViewCreateInfo.components.a = VK_COMPONENT_SWIZZLE_IDENTITY;
+	imageViewCreateInfo.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+	imageViewCreateInfo.subresourceRange.baseMipLevel = 0;
+	imageViewCreateInfo.subresourceRange.levelCount = 1;
+	imageViewCreateInfo.subresourceRange.baseArrayLayer = 0;
+	imageViewCreateInfo.subresourceRange.layerCount = 1;
+
+	result = vkCreateImageView(
+		context.device,
+		&imageViewCreateInfo,
+		context.allocator,
+		&context.sceneImageView);
+
+	Utility::checkVulkanResult(result, "Failed to create the scene image view.");
+
+	resolutionController.getRenderExtent(
+		context.width,
+		context.height,
+		context.renderWidth,
+		context.renderHeight);
+}
+
+void Renderer::createRenderPass()
+{
+	VkAttachmentDescription passAttachments[2] = {};
+	passAttachments[0].format = context.colorFormat;
+	passAttachments[0].samples = VK_SAMPLE_COUNT_1_BIT;
+	passAttachments[0].loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+	passAttachments[0].storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+	passAttachments[0].stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+	passAttachments[0].stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+	passAttachments[0].initialLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+	passAttachments[0].finalLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+
+	passAttachments[1].format = VK_FORMAT_D16_UNORM;
+	passAttachments[1].samples = VK_SAMPLE_COUNT_1_BIT;
+	passAttachments[1].loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+	passAttachments[1].storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+	passAttachments[1].stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+	passAttachments[1].stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+	passAttachments[1].initialLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+	passAttachments[1].finalLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+
+	VkAttachmentReference colorAttachmentReference = {};
+	colorAttachmentReference.attachment = 0;
+	colorAttachmentReference.layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+
+	VkAttachmentReference depthAttachmentReference = {};
+	depthAttachmentReference.attachment = 1;
+	depthAttachmentReference.layout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+
+	VkSubpassDescription subpass = {};
+	subpass.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
+	subpass.colorAttachmentCount = 1;
+	subpass.pColorAttachments = &colorAttachmentReference;
+	subpass.pDepthStencilAttachment = &depthAttachmentReference;
+
+	// Every frame in flight uses the same depth image, so its clear has to
+	// wait for the depth tests of the frame before
+	VkSubpassDependency dependency = {};
+	dependency.srcSubpass = VK_SUBPASS_EXTERNAL;
+	dependency.dstSubpass = 0;
+	dependency.srcStageMask = VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+	dependency.dstStageMask =	VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT |
+								VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+	dependency.srcAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+	dependency.dstAccessMask =	VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT |
+								VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+
+	VkRenderPassCreateInfo renderPassCreateInfo = {};
+	renderPassCreateInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
+	renderPassCreateInfo.attachmentCount = 2;
+	renderPassCreateInfo.pAttachments = passAttachments;
+	renderPassCreateInfo.subpassCount = 1;
+	renderPassCreateInfo.pSubpasses = &subpass;
+	renderPassCreateInfo.dependencyCount = 1;
+	renderPassCreateInfo.pDependencies = &dependency;
+
+	VkResult result = vkCreateRenderPass(
+		context.device,
+		&renderPassCreateInfo,
+		context.allocator,
+		&context.renderPass);
+
+	Utility::checkVulkanResult(result, "Failed to create render pass.");
+}
+
+void Renderer::createFramebuffers()
+{
+	// Create the frame buffers that are compatible with this render pass
+	VkImageView frameBufferAttachments[2];
+	frameBufferAttachments[1] = context.depthImageView;
+
+	VkFramebufferCreateInfo framebufferCreateInfo = {};
+	framebufferCreateInfo.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
+	framebufferCreateInfo.renderPass = context.renderPass;
+	framebufferCreateInfo.attachmentCount = 2;
+	framebufferCreateInfo.pAttachments = frameBufferAttachments;
+	framebufferCreateInfo.width = context.width;
+	framebufferCreateInfo.height = context.height;
+	framebufferCreateInfo.layers = 1;
+
+	// Create one framebuffer per swap chain image view
+	context.framebuffers = hostAllocator.allocateArray<VkFramebuffer>(context.imageCount);
+	for (uint32_t i = 0; i < context.imageCount; ++i)
+	{
+		frameBufferAttachments[0] = context.presentImageViews[i];
+
+		VkResult result = vkCreateFramebuffer(
+			context.device,
+			&framebufferCreateInfo,
+			context.allocator,
+			&context.framebuffers[i]);
+
+		Utility::checkVulkanResult(result, "Failed to create framebuffer.");
+	}
+
+	// Shares the depth image with the other framebuffers
+	if (context.dynamicResolution)
+	{
+		frameBufferAttachments[0] = context.sceneImageView;
+
+		VkResult result = vkCreateFramebuffer(
+			context.device,
+			&framebufferCreateInfo,
+			context.allocator,
+			&context.sceneFramebuffer);
+
+		Utility::checkVulkanResult(result, "Failed to create the scene framebuffer.");
+	}
+}
+
+void Renderer::createVertexBuffer()
+{
+	// Create a vertex buffer for the triangle
+	VkBufferCreateInfo vertexInputBufferInfo = {};
+	vertexInputBufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+	vertexInputBufferInfo.size = sizeof(Vertex) * 3;
+	vertexInputBufferInfo.usage = VK_BUFFER_USAGE_VERTEX_BUFFER_BIT;
+	vertexInputBufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+	VkResult result = vkCreateBuffer(
+		context.device,
+		&vertexInputBufferInfo,
+		context.allocator,
+		&context.vertexInputBuffer);
+
+	Utility::checkVulkanResult(result, "Failed to create vertex input buffer.");
+
+	// Allocate the vertex input buffer
+	VkMemoryRequirements vertexBufferMemoryRequirements = {};
+	vkGetBufferMemoryRequirements(
+		context.device,
+		context.vertexInputBuffer,
+		&vertexBufferMemoryRequirements);
+
+	VkMemoryAllocateInfo bufferAllocateInfo = {};
+	bufferAllocateInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+	bufferAllocateInfo.allocationSize = vertexBufferMemoryRequirements.size;
+	bufferAllocateInfo.memoryTypeIndex = findMemoryType(
+		vertexBufferMemoryRequirements.memoryTypeBits,
+		VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT);
+
+	result = vkAllocateMemory(
+		context.device,
+		&bufferAllocateInfo,
+		context.allocator,
+		&context.vertexInputMemory);
+
+	Utility::checkVulkanResult(result, "Failed to allocate vertex buffer memory.");
+
+	trackDeviceMemory(bufferAllocateInfo.allocationSize);
+
+	void *mapped = nullptr;
+	result = vkMapMemory(context.device, context.vertexInputMemory, 0, VK_WHOLE_SIZE, 0, &mapped);
+	Utility::checkVulkanResult(result, "Failed to map vertex buffer memory.");
+
+	Vertex *triangle = (Vertex *)mapped;
+	Vertex vertex1 = { -1.0f, -1.0f, 0.0f };
+	Vertex vertex2 = {  1.0f, -1.0f, 0.0f };
+	Vertex vertex3 = {  0.0f,  1.0f, 0.0f };
+	triangle[0] = vertex1;
+	triangle[1] = vertex2;
+	triangle[2] = vertex3;
+
+	// Traces carry the geometry of the meshes they use
+	triangleGeometry.vertices = { vertex1, vertex2, vertex3 };
+
+	vkUnmapMemory(context.device, context.vertexInputMemory);
+
+	result = vkBindBufferMemory(
+		context.device,
+		context.vertexInputBuffer,
+		context.vertexInputMemory, 0);
+
+	Utility::checkVulkanResult(result, "Failed to bind vertex buffer memmory.");
+}
+
+void Renderer::createFrameResources()
+{
+	VkResult result;
+
+	// Synchronization objects used by the render loop, the fences start out
+	// signaled so the first frames do not wait on anything
+	VkSemaphoreCreateInfo semaphoreCreateInfo = {};
+	semaphoreCreateInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+
+	VkFenceCreateInfo renderFenceCreateInfo = {};
+	renderFenceCreateInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+	renderFenceCreateInfo.flags = VK_FENCE_CREATE_SIGNALED_BIT;
+
+	for (uint32_t i = 0; i < context.framesInFlight; ++i)
+	{
+		FrameResources &frame = context.frames[i];
+
+		result = vkCreateSemaphore(
+			context.device,
+			&semaphoreCreateInfo,
+			context.allocator,
+			&frame.imageAcquiredSemaphore);
+
+		Utility::checkVulkanResult(result, "Failed to create a semaphore.");
+
+		result = vkCreateSemaphore(
+			context.device,
+			&semaphoreCreateInfo,
+			context.allocator,
+			&frame.renderCompleteSemaphore);
+
+		Utility::checkVulkanResult(result, "Failed to create a semaphore.");
+
+		result = vkCreateFence(
+			context.device,
+			&renderFenceCreateInfo,
+			context.allocator,
+			&frame.renderFence);
+
+		Utility::checkVulkanResult(result, "Failed to create the render fence.");
+
+		frame.hasTimestamps = false;
+	}
+
+	if (!context.supportsTimestamps)
+		return;
+
+	// Two timestamps per frame in flight: start and end of the frame
+	VkQueryPoolCreateInfo queryPoolCreateInfo = {};
+	queryPoolCreateInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+	queryPoolCreateInfo.queryType = VK_QUERY_TYPE_TIMESTAMP;
+	queryPoolCreateInfo.queryCount = context.framesInFlight * 2;
+
+	result = vkCreateQueryPool(
+		context.device,
+		&queryPoolCreateInfo,
+		context.allocator,
+		&context.timestampQueryPool);
+
+	Utility::checkVulkanResult(result, "Failed to create the timestamp query pool.");
+}
+
+void Renderer::destroyDeviceObjects()
+{
+	if (context.device == VK_NULL_HANDLE)
+		return;
+
+	VkDevice device = context.device;
+	const VkAllocationCallbacks *allocator = context.allocator;
+
+	for (uint32_t i = 0; i < context.framesInFlight; ++i)
+	{
+		FrameResources &frame = context.frames[i];
+
+		vkDestroySemaphore(device, frame.imageAcquiredSemaphore, allocator);
+		vkDestroySemaphore(device, frame.renderCompleteSemaphore, allocator);
+		vkDestroyFence(device, frame.renderFence, allocator);
+	}
+
+	vkDestroyQueryPool(device, context.timestampQueryPool, allocator);
+
+	vkDestroyBuffer(device, context.vertexInputBuffer, allocator);
+	vkFreeMemory(device, context.vertexInputMemory, allocator);
+
+	if (context.framebuffers)
+	{
+		for (uint32_t i = 0; i < context.imageCount; ++i)
+			vkDestroyFramebuffer(device, context.framebuffers[i], allocator);
+	}
+
+	vkDestroyFramebuffer(device, context.sceneFramebuffer, allocator);
+	vkDestroyRenderPass(device, context.renderPass, allocator);
+
+	vkDestroyImageView(device, context.sceneImageView, allocator);
+	vkDestroyImage(device, context.sceneImage, allocator);
+	vkFreeMemory(device, context.sceneImageMemory, allocator);
+
+	vkDestroyImageView(device, context.depthImageView, allocator);
+	vkDestroyImage(device, context.depthImage, allocator);
+	vkFreeMemory(device, context.depthImageMemory, allocator);
+
+	if (context.presentImageViews)
+	{
+		for (uint32_t i = 0; i < context.imageCount; ++i)
+			vkDestroyImageView(device, context.presentImageViews[i], allocator);
+	}
+
+	// Offscreen images belong to the renderer, swap chain images to the
+	// swap chain
+	if (context.headless && context.presentImages)
+	{
+		for (uint32_t i = 0; i < context.imageCount; ++i)
+		{
+			vkDestroyImage(device, context.presentImages[i], allocator);
+			vkFreeMemory(device, context.offscreenImageMemory[i], allocator);
+		}
+	}
+
+	vkDestroySwapchainKHR(device, context.swapChain, allocator);
+
+	// Frees the command buffers as well
+	vkDestroyFence(device, context.setupFence, allocator);
+	vkDestroyCommandPool(device, context.commandPool, allocator);
+
+	vkDestroyDevice(device, allocator);
+	context.device = VK_NULL_HANDLE;
+
+	vkDestroySurfaceKHR(context.instance, context.surface, allocator);
+}
+
+void Renderer::render()
+{
+	// Time spent waiting for the pacer is not part of the frame
+	framePacer.waitForNextFrame();
+
+	if (!trace.isOpen())
+	{
+		renderFrame();
+	}
+	else
+	{
+		typedef std::chrono::high_resolution_clock Clock;
+
+		Clock::time_point frameStart = Clock::now();
+		renderFrame();
+
+		trace.frame(std::chrono::duration<double, std::milli>(Clock::now() - frameStart).count());
+	}
+
+	framePacer.endFrame();
+}
+
+bool Renderer::startTrace(const char *path)
+{
+	stopTrace();
+
+	if (!trace.open(path, context.width, context.height, context.framesInFlight))
+	{
+		logger.log(LogSeverity::Error, "Failed to open the trace \"%s\".", path);
+		return false;
+	}
+
+	instanceRenderer.setTrace(&trace);
+	lightGrid.setTrace(&trace);
+	particleSystem.setTrace(&trace);
+
+	return true;
+}
+
+void Renderer::stopTrace()
+{
+	if (!trace.isOpen())
+		return;
+
+	instanceRenderer.setTrace(nullptr);
+	lightGrid.setTrace(nullptr);
+	particleSystem.setTrace(nullptr);
+
+	logger.log(LogSeverity::Info, "Traced %u frames.", trace.getFrameCount());
+	trace.close();
+}
+
+void Renderer::renderFrame()
+{
+	uint32_t frameSlot = context.frameIndex % context.framesInFlight;
+	FrameResources &frame = context.frames[frameSlot];
+	VkCommandBuffer drawCommandBuffer = frame.drawCommandBuffer;
+
+	// Wait until the GPU is done with the resources of this frame slot
+	vkWaitForFences(context.device, 1, &frame.renderFence, VK_TRUE, UINT64_MAX);
+	vkResetFences(context.device, 1, &frame.renderFence);
+
+	// Frames finish in submission order, so the fence of this slot means
+	// every frame up to the last one in this slot is done
+	uint64_t completedFrameCount = 0;
+	if (context.frameIndex >= context.framesInFlight)
+		completedFrameCount = context.frameIndex - context.framesInFlight + 1;
+
+	deletionQueue.beginFrame(context.frameIndex, completedFrameCount);
+
+	// The fence guarantees the timestamps of this slot are available
+	if (frame.hasTimestamps)
+	{
+		uint64_t timestamps[2] = {};
+		vkGetQueryPoolResults(
+			context.device,
+			context.timestampQueryPool,
+			frameSlot * 2,
+			2,
+			sizeof(timestamps),
+			timestamps,
+			sizeof(uint64_t),
+			VK_QUERY_RESULT_64_BIT);
+
+		// The timestamp period is the number of nanoseconds per tick
+		context.lastGpuFrameTime =
+			static_cast<double>(timestamps[1] - timestamps[0]) *
+			context.physicalDeviceProperties.limits.timestampPeriod / 1000000.0;
+
+		// The scale of this frame follows from the last frame in this slot
+		if (context.dynamicResolution && resolutionController.update(context.lastGpuFrameTime))
+		{
+			resolutionController.getRenderExtent(
+				context.width,
+				context.height,
+				context.renderWidth,
+				context.renderHeight);
+		}
+	}
+
+	// Hand finished captures to the encoder, this never waits on the GPU
+	frameCapture.poll();
+
+	uint32_t deviceMask = getFrameDeviceMask();
+	uint32_t deviceIndex = 0;
+
+	// What the GPUs keep between frames, uploads, simulation and cached
+	// passes, is recorded for every GPU of the group, so with alternate
+	// frame rendering each of them sees the same data. Only the frame
+	// itself is left to the GPU whose turn it is.
+	uint32_t groupMask = (1u << context.deviceGroupSize) - 1;
+
+	if (context.multiGpuMode == MultiGpuMode::AlternateFrame)
+	{
+		deviceIndex = context.frameIndex % context.deviceGroupSize;
+	}
+
+	uint32_t nextImageIndex = 0;
+
+	// Get the next available image ID from the swapchain, a device group has
+	// to know which GPUs are going to use the image
+	if (context.headless)
+	{
+		nextImageIndex = frameSlot;
+	}
+	else if (context.multiGpuMode != MultiGpuMode::Disabled)
+	{
+		VkAcquireNextImageInfoKHR acquireInfo = {};
+		acquireInfo.sType = VK_STRUCTURE_TYPE_ACQUIRE_NEXT_IMAGE_INFO_KHR;
+		acquireInfo.swapchain = context.swapChain;
+		acquireInfo.timeout = UINT64_MAX;
+		acquireInfo.semaphore = frame.imageAcquiredSemaphore;
+		acquireInfo.fence = VK_NULL_HANDLE;
+		acquireInfo.deviceMask = deviceMask;
+
+		vkAcquireNextImage2KHR(context.device, &acquireInfo, &nextImageIndex);
+	}
+	else
+	{
+		vkAcquireNextImageKHR(
+			context.device,
+			context.swapChain,
+			UINT64_MAX,
+			frame.imageAcquiredSemaphore,
+			VK_NULL_HANDLE,
+			&nextImageIndex);
+	}
+
+	VkDeviceGroupCommandBufferBeginInfo deviceGroupBeginInfo = {};
+	deviceGroupBeginInfo.sType = VK_STRUCTURE_TYPE_DEVICE_GROUP_COMMAND_BUFFER_BEGIN_INFO;
+	deviceGroupBeginInfo.deviceMask = groupMask;
+
+	VkCommandBufferBeginInfo beginInfo = {};
+	beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+	beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+
+	if (context.multiGpuMode != MultiGpuMode::Disabled)
+		beginInfo.pNext = &deviceGroupBeginInfo;
+
+	// Everything between here and the end of the command buffer is the
+	// recording cost of the frame, without waiting for fences and images
+	typedef std::chrono::high_resolution_clock Clock;
+	Clock::time_point recordStart = Clock::now();
+
+	vkBeginCommandBuffer(drawCommandBuffer, &beginInfo);
+
+	if (context.supportsTimestamps)
+	{
+		vkCmdResetQueryPool(
+			drawCommandBuffer,
+			context.timestampQueryPool,
+			frameSlot * 2,
+			2);
+
+		vkCmdWriteTimestamp(
+			drawCommandBuffer,
+			VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
+			context.timestampQueryPool,
+			frameSlot * 2);
+	}
+
+	// Collects the counters of the last frame in this slot, without waiting
+	if (context.enabledFeatures.inheritedQueries)
+		gpuCounters.beginFrame(drawCommandBuffer, frameSlot, context.renderWidth, context.renderHeight);
+
+	// Only the instances that changed since the last frame are uploaded
+	instanceRenderer.recordUploads(drawCommandBuffer, frameSlot);
+
+	// Lights are binned again only when they or the camera moved
+	lightGrid.build();
+	lightGrid.recordUploads(drawCommandBuffer, frameSlot);
+
+	// Shadow tiles are only drawn again when something moved in them
+	const std::vector<PointLight> &lights = lightGrid.getLights();
+	const float *view = lightGrid.getView().viewMatrix;
+
+	float cameraPosition[3];
+	for (uint32_t i = 0; i < 3; ++i)
+		cameraPosition[i] = -(view[i] * view[3] + view[4 + i] * view[7] + view[8 + i] * view[11]);
+
+	shadowAtlas.update(lights.data(), static_cast<uint32_t>(lights.size()), cameraPosition);
+	shadowAtlas.recordUpdates(drawCommandBuffer, frameSlot);
+
+	// Particles only cost the push constants of a step on the CPU
+	particleSystem.recordSimulation(drawCommandBuffer, frameSlot);
+
+	// Meshlets are culled on the GPU, task shaders cull in the draw instead
+	meshletRenderer.recordCulling(drawCommandBuffer, frameSlot);
+
+	// Every view of a headset or cube map in one pass where multiview is
+	// supported, nothing without multiview settings
+	multiviewPass.recordPass(drawCommandBuffer, frameSlot);
+
+	if (context.multiGpuMode == MultiGpuMode::AlternateFrame)
+		vkCmdSetDeviceMask(drawCommandBuffer, deviceMask);
+
+	VkImageSubresourceRange resourceRange = {};
+	resourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+	resourceRange.baseMipLevel = 0;
+	resourceRange.levelCount = 1;
+	resourceRange.baseArrayLayer = 0;
+	resourceRange.layerCount = 1;
+
+	VkImageMemoryBarrier layoutTransitionBarrier = {};
+	layoutTransitionBarrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+	layoutTransitionBarrier.srcAccessMask = VK_ACCESS_MEMORY_READ_BIT;
+	layoutTransitionBarrier.dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+	layoutTransitionBarrier.oldLayout = context.finalLayout;
+	layoutTransitionBarrier.newLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+	layoutTransitionBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	layoutTransitionBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	layoutTransitionBarrier.image = context.presentImages[nextImageIndex];
+	layoutTransitionBarrier.subresourceRange = resourceRange;
+
+	if (context.dynamicResolution)
+	{
+		// The color image is only written by the upscale. The scene image is
+		// cleared, it only has to wait until the last upscale read it.
+		VkImageMemoryBarrier sceneBarrier = {};
+		sceneBarrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+		sceneBarrier.srcAccessMask = 0;
+		sceneBarrier.dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+		sceneBarrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+		sceneBarrier.newLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+		sceneBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		sceneBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		sceneBarrier.image = context.sceneImage;
+		sceneBarrier.subresourceRange = resourceRange;
+
+		vkCmdPipelineBarrier(
+			drawCommandBuffer,
+			VK_PIPELINE_STAGE_TRANSFER_BIT,
+			VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
+			0,
+			0, nullptr,
+			0, nullptr,
+			1, &sceneBarrier);
+	}
+	else if (context.multiGpuMode == MultiGpuMode::SplitFrame)
+	{
+		// The images of all GPUs are summed when presenting, so everything
+		// outside of the strip of a GPU has to be zero
+		layoutTransitionBarrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+		layoutTransitionBarrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+
+		vkCmdPipelineBarrier(
+			drawCommandBuffer,
+			VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
+			VK_PIPELINE_STAGE_TRANSFER_BIT,
+			0,
+			0, nullptr,
+			0, nullptr,
+			1, &layoutTransitionBarrier);
+
+		VkClearColorValue zeroColor = {};
+		vkCmdClearColorImage(
+			drawCommandBuffer,
+			context.presentImages[nextImageIndex],
+			VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+			&zeroColor,
+			1,
+			&resourceRange);
+
+		layoutTransitionBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+		layoutTransitionBarrier.dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+		layoutTransitionBarrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+		layoutTransitionBarrier.newLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+
+		vkCmdPipelineBarrier(
+			drawCommandBuffer,
+			VK_PIPELINE_STAGE_TRANSFER_BIT,
+			VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
+			0,
+			0, nullptr,
+			0, nullptr,
+			1, &layoutTransitionBarrier);
+	}
+	else
+	{
+		vkCmdPipelineBarrier(
+			drawCommandBuffer,
+			VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
+			VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
+			0,
+			0, nullptr,
+			0, nullptr,
+			1, &layoutTransitionBarrier);
+	}
+
+	VkClearValue clearValues[2] = {};
+	clearValues[0].color = { 0.1f, 0.1f, 0.1f, 1.0f };
+	clearValues[1].depthStencil = { 1.0f, 0 };
+
+	VkFramebuffer framebuffer = context.dynamicResolution ?
+		context.sceneFramebuffer :
+		context.framebuffers[nextImageIndex];
+
+	VkRenderPassBeginInfo renderPassBeginInfo = {};
+	renderPassBeginInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+	renderPassBeginInfo.renderPass = context.renderPass;
+	renderPassBeginInfo.framebuffer = framebuffer;
+	renderPassBeginInfo.renderArea.offset = { 0, 0 };
+	renderPassBeginInfo.renderArea.extent = { context.renderWidth, context.renderHeight };
+	renderPassBeginInfo.clearValueCount = 2;
+	renderPassBeginInfo.pClearValues = clearValues;
+
+	// Every GPU renders a horizontal strip, the last one takes the remainder
+	VkRect2D deviceRenderAreas[VK_MAX_DEVICE_GROUP_SIZE];
+	VkDeviceGroupRenderPassBeginInfo deviceGroupRenderPassBeginInfo = {};
+
+	if (context.multiGpuMode == MultiGpuMode::SplitFrame)
+	{
+		for (uint32_t i = 0; i < context.deviceGroupSize; ++i)
+		{
+			uint32_t stripStart = 0;
+			uint32_t stripHeight = 0;
+			getSplitFrameStrip(context.renderHeight, context.deviceGroupSize, i, stripStart, stripHeight);
+
+			deviceRenderAreas[i].offset = { 0, static_cast<int32_t>(stripStart) };
+			deviceRenderAreas[i].extent.width = context.renderWidth;
+			deviceRenderAreas[i].extent.height = stripHeight;
+		}
+
+		deviceGroupRenderPassBeginInfo.sType = VK_STRUCTURE_TYPE_DEVICE_GROUP_RENDER_PASS_BEGIN_INFO;
+		deviceGroupRenderPassBeginInfo.deviceMask = deviceMask;
+		deviceGroupRenderPassBeginInfo.deviceRenderAreaCount = context.deviceGroupSize;
+		deviceGroupRenderPassBeginInfo.pDeviceRenderAreas = deviceRenderAreas;
+
+		renderPassBeginInfo.pNext = &deviceGroupRenderPassBeginInfo;
+	}
+	else if (context.multiGpuMode == MultiGpuMode::AlternateFrame)
+	{
+		// Beginning a render pass sets the device mask to that of the pass,
+		// which would otherwise be every GPU of the command buffer
+		deviceGroupRenderPassBeginInfo.sType = VK_STRUCTURE_TYPE_DEVICE_GROUP_RENDER_PASS_BEGIN_INFO;
+		deviceGroupRenderPassBeginInfo.deviceMask = deviceMask;
+
+		renderPassBeginInfo.pNext = &deviceGroupRenderPassBeginInfo;
+	}
+
+	// The draws only change when instances are added or removed or the
+	// render area changes size, otherwise the commands recorded for this
+	// frame slot and image are used again. The particle and meshlet draws
+	// read their counts and commands on the GPU.
+	uint64_t drawDependencies[] =
+	{
+		instanceRenderer.getDrawVersion(),
+		particleSystem.getDrawVersion(),
+		meshletRenderer.getDrawVersion(),
+		(static_cast<uint64_t>(context.renderWidth) << 32) | context.renderHeight
+	};
+
+	VkCommandBuffer drawCommands = commandBufferCache.getCommandBuffer(
+		drawPass,
+		frameSlot,
+		nextImageIndex,
+		framebuffer,
+		drawDependencies,
+		4);
+
+	vkCmdBeginRenderPass(
+		drawCommandBuffer,
+		&renderPassBeginInfo,
+		VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS);
+
+	if (context.enabledFeatures.inheritedQueries)
+	{
+		gpuCounters.beginScope(drawCommandBuffer, drawScope);
+		vkCmdExecuteCommands(drawCommandBuffer, 1, &drawCommands);
+		gpuCounters.endScope(drawCommandBuffer, drawScope);
+	}
+	else
+	{
+		vkCmdExecuteCommands(drawCommandBuffer, 1, &drawCommands);
+	}
+
+	vkCmdEndRenderPass(drawCommandBuffer);
+
+	// Task shaders culled in the draw
+	meshletRenderer.recordReadback(drawCommandBuffer, frameSlot);
 
-	uint32_t memoryTypeBits = memoryRequirements.memoryTypeBits;
-	VkMemoryPropertyFlags desiredMemoryFlags = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
+	if (context.dynamicResolution)
+	{
+		recordUpscale(drawCommandBuffer, nextImageIndex);
+	}
+	else
+	{
+		// Hand the image back to the presentation engine (or whoever reads
+		// the offscreen image)
+		layoutTransitionBarrier.srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+		layoutTransitionBarrier.dstAccessMask = VK_ACCESS_MEMORY_READ_BIT;
+		layoutTransitionBarrier.oldLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+		layoutTransitionBarrier.newLayout = context.finalLayout;
+
+		vkCmdPipelineBarrier(
+			drawCommandBuffer,
+			VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
+			VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT,
+			0,
+			0, nullptr,
+			0, nullptr,
+			1, &layoutTransitionBarrier);
+	}
 
-	for (uint32_t i = 0; i < 32; ++i)
+	// With dynamic resolution the blit of the upscale is the last write
+	if (context.dynamicResolution)
 	{
-		VkMemoryType memoryType = context.physicalDeviceMemoryProperties.memoryTypes[i];
-		
-		if (memoryTypeBits & 1)
-		{
-			if ((memoryType.propertyFlags & desiredMemoryFlags) == desiredMemoryFlags)
-			{
-				imageAllocateInfo.memoryTypeIndex = i;
-				break;
-			}
-		}
+		frameCapture.recordCopy(
+			drawCommandBuffer,
+			context.presentImages[nextImageIndex],
+			context.finalLayout,
+			VK_PIPELINE_STAGE_TRANSFER_BIT,
+			VK_ACCESS_TRANSFER_WRITE_BIT);
+	}
+	else
+	{
+		frameCapture.recordCopy(
+			drawCommandBuffer,
+			context.presentImages[nextImageIndex],
+			context.finalLayout,
+			VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
+			VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT);
+	}
 
-		memoryTypeBits = memoryTypeBits >> 1;
+	if (context.supportsTimestamps)
+	{
+		vkCmdWriteTimestamp(
+			drawCommandBuffer,
+			VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT,
+			context.timestampQueryPool,
+			frameSlot * 2 + 1);
 	}
 
-	VkDeviceMemory imageMemory = {};
-	result = vkAllocateMemory(
-		context.device,
-		&imageAllocateInfo,
-		nullptr,
-		&imageMemory);
+	vkEndCommandBuffer(drawCommandBuffer);
 
-	Utility::checkVulkanResult(
-		result,
-		"Failed to allocate memory for the depth image.");
+	context.lastRecordTime = std::chrono::duration<double, std::milli>(Clock::now() - recordStart).count();
 
-	result = vkBindImageMemory(
-		context.device,
-		context.depthImage,
-		imageMemory,
-		0);
+	// With dynamic resolution the swap chain image is first written by the
+	// upscale
+	VkPipelineStageFlags waitStageMask[] =
+	{
+		context.dynamicResolution ?
+			static_cast<VkPipelineStageFlags>(VK_PIPELINE_STAGE_TRANSFER_BIT) :
+			static_cast<VkPipelineStageFlags>(VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT)
+	};
 
-	Utility::checkVulkanResult(
-		result,
-		"Failed to bind memory for the depth image.");
+	VkSubmitInfo submitInfo = {};
+	submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+	submitInfo.commandBufferCount = 1;
+	submitInfo.pCommandBuffers = &drawCommandBuffer;
 
+	// Offscreen images do not have to wait for (or signal) the presentation
+	// engine
+	if (!context.headless)
 	{
-		VkCommandBufferBeginInfo beginInfo = {};
-		beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
-		beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+		submitInfo.waitSemaphoreCount = 1;
+		submitInfo.pWaitSemaphores = &frame.imageAcquiredSemaphore;
+		submitInfo.pWaitDstStageMask = waitStageMask;
+		submitInfo.signalSemaphoreCount = 1;
+		submitInfo.pSignalSemaphores = &frame.renderCompleteSemaphore;
+	}
 
-		// Begin recording commands into the setup command buffer
-		vkBeginCommandBuffer(context.setupCommandBuffer, &beginInfo);
+	// Tell the device group which GPUs execute the command buffer and which
+	// GPU waits on and signals the semaphores, a headless frame has none
+	VkDeviceGroupSubmitInfo deviceGroupSubmitInfo = {};
+	deviceGroupSubmitInfo.sType = VK_STRUCTURE_TYPE_DEVICE_GROUP_SUBMIT_INFO;
+	deviceGroupSubmitInfo.waitSemaphoreCount = submitInfo.waitSemaphoreCount;
+	deviceGroupSubmitInfo.pWaitSemaphoreDeviceIndices = &deviceIndex;
+	deviceGroupSubmitInfo.commandBufferCount = 1;
+	deviceGroupSubmitInfo.pCommandBufferDeviceMasks = &groupMask;
+	deviceGroupSubmitInfo.signalSemaphoreCount = submitInfo.signalSemaphoreCount;
+	deviceGroupSubmitInfo.pSignalSemaphoreDeviceIndices = &deviceIndex;
 
-		VkImageMemoryBarrier layoutTransitionBarrier = {};
-		layoutTransitionBarrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
-		layoutTransitionBarrier.srcAccessMask = 0;
+	if (context.multiGpuMode != MultiGpuMode::Disabled)
+		submitInfo.pNext = &deviceGroupSubmitInfo;
 
-		layoutTransitionBarrier.dstAccessMask =
-			VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT |
-			VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+	VkResult result = vkQueueSubmit(
+		context.presentQueue,
+		1,
+		&submitInfo,
+		frame.renderFence);
 
-		layoutTransitionBarrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-		layoutTransitionBarrier.newLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
-		layoutTransitionBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-		layoutTransitionBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-		layoutTransitionBarrier.image = context.depthImage;
+	Utility::checkVulkanResult(result, "Failed to submit the draw command buffer.");
 
-		VkImageSubresourceRange resourceRange = {};
-		resourceRange.aspectMask = VK_IMAGE_ASPECT_DEPTH_BIT;
-		resourceRange.baseMipLevel = 0;
-		resourceRange.levelCount = 1;
-		resourceRange.baseArrayLayer = 0;
-		resourceRange.layerCount = 1;
+	frameCapture.submit(context.presentQueue);
 
-		layoutTransitionBarrier.subresourceRange = resourceRange;
+	frame.hasTimestamps = context.supportsTimestamps;
+	++context.frameIndex;
 
-		vkCmdPipelineBarrier(context.setupCommandBuffer,
-			VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
-			VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
-			0,
-			0,
-			nullptr,
-			0,
-			nullptr,
-			1,
-			&layoutTransitionBarrier);
+	if (context.headless)
+		return;
 
-		vkEndCommandBuffer(context.setupCommandBuffer);
+	VkPresentInfoKHR presentInfo = {};
+	presentInfo.sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR;
+	presentInfo.pNext = nullptr;
+	presentInfo.waitSemaphoreCount = 1;
+	presentInfo.pWaitSemaphores = &frame.renderCompleteSemaphore;
+	presentInfo.swapchainCount = 1;
+	presentInfo.pSwapchains = &context.swapChain;
+	presentInfo.pImageIndices = &nextImageIndex;
+	presentInfo.pResults = nullptr;
 
-		VkPipelineStageFlags waitStageMask[] = { VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT };
+	// Alternate frame rendering presents the image of the GPU that rendered
+	// it, split frame rendering merges the strips of all GPUs
+	VkDeviceGroupPresentInfoKHR deviceGroupPresentInfo = {};
+	deviceGroupPresentInfo.sType = VK_STRUCTURE_TYPE_DEVICE_GROUP_PRESENT_INFO_KHR;
+	deviceGroupPresentInfo.swapchainCount = 1;
+	deviceGroupPresentInfo.pDeviceMasks = &deviceMask;
+	deviceGroupPresentInfo.mode = context.deviceGroupPresentMode;
 
-		VkSubmitInfo submitInfo = {};
-		submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
-		submitInfo.waitSemaphoreCount = 0;
-		submitInfo.pWaitSemaphores = nullptr;
-		submitInfo.pWaitDstStageMask = waitStageMask;
-		submitInfo.commandBufferCount = 1;
-		submitInfo.pCommandBuffers = &context.setupCommandBuffer;
-		submitInfo.signalSemaphoreCount = 0;
-		submitInfo.pSignalSemaphores = nullptr;
+	if (context.multiGpuMode != MultiGpuMode::Disabled)
+		presentInfo.pNext = &deviceGroupPresentInfo;
 
-		result = vkQueueSubmit(context.presentQueue, 1, &submitInfo, submitFence);
-		Utility::checkVulkanResult(result, "Failed to submit present queue.");
+	vkQueuePresentKHR(context.presentQueue, &presentInfo);
+}
 
-		vkWaitForFences(context.device, 1, &submitFence, VK_TRUE, UINT64_MAX);
-		vkResetFences(context.device, 1, &submitFence);
-		vkResetCommandBuffer(context.setupCommandBuffer, 0);
+void Renderer::waitIdle()
+{
+	vkDeviceWaitIdle(context.device);
 
-		VkImageAspectFlags aspectMask = VK_IMAGE_ASPECT_DEPTH_BIT;
-		VkImageViewCreateInfo imageViewCreateInfo = {};
-		imageViewCreateInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
-		imageViewCreateInfo.image = context.depthImage;
-		imageViewCreateInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
-		imageViewCreateInfo.format = imageCreateInfo.format;
-		imageViewCreateInfo.components.r = VK_COMPONENT_SWIZZLE_IDENTITY;
-		imageViewCreateInfo.components.g = VK_COMPONENT_SWIZZLE_IDENTITY;
-		imageViewCreateInfo.components.b = VK_COMPONENT_SWIZZLE_IDENTITY;
-		imageViewCreateInfo.components.a = VK_COMPONENT_SWIZZLE_IDENTITY;
-		imageViewCreateInfo.subresourceRange.aspectMask = aspectMask;
-		imageViewCreateInfo.subresourceRange.baseMipLevel = 0;
-		imageViewCreateInfo.subresourceRange.levelCount = 1;
-		imageViewCreateInfo.subresourceRange.baseArrayLayer = 0;
-		imageViewCreateInfo.subresourceRange.layerCount = 1;
+	// Every submitted frame is done
+	meshletRenderer.collectStatistics();
+	deletionQueue.beginFrame(context.frameIndex, context.frameIndex);
+}
 
-		result = vkCreateImageView(
-			context.device,
-			&imageViewCreateInfo,
-			nullptr,
-			&context.depthImageView);
+DeletionQueue &Renderer::getDeletionQueue()
+{
+	return deletionQueue;
+}
 
-		Utility::checkVulkanResult(result, "Failed to create depth image view.");
+FrameStatistics Renderer::getFrameStatistics() const
+{
+	FrameStatistics statistics = {};
+	statistics.gpuFrameTime = context.lastGpuFrameTime;
+	statistics.cpuRecordTime = context.lastRecordTime;
+	statistics.deviceMemoryUsage = context.allocatedDeviceMemory;
+	statistics.renderWidth = context.renderWidth;
+	statistics.renderHeight = context.renderHeight;
+
+	return statistics;
+}
+
+const GpuCounters &Renderer::getGpuCounters() const
+{
+	return gpuCounters;
+}
+
+void Renderer::logGpuCounters()
+{
+	if (!context.enabledFeatures.inheritedQueries)
+	{
+		logger.log(LogSeverity::Info, "GPU counters are not supported on this device.");
+		return;
 	}
 
-	VkAttachmentDescription passAttachments[2] = {};
-	passAttachments[0].format = surfaceColorFormat;
-	passAttachments[0].samples = VK_SAMPLE_COUNT_1_BIT;
-	passAttachments[0].loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
-	passAttachments[0].storeOp = VK_ATTACHMENT_STORE_OP_STORE;
-	passAttachments[0].stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
-	passAttachments[0].stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
-	passAttachments[0].initialLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
-	passAttachments[0].finalLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+	gpuCounters.log(logger);
+}
 
-	passAttachments[1].format = VK_FORMAT_D16_UNORM;
-	passAttachments[1].samples = VK_SAMPLE_COUNT_1_BIT;
-	passAttachments[1].loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
-	passAttachments[1].storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
-	passAttachments[1].stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
-	passAttachments[1].stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
-	passAttachments[1].initialLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
-	passAttachments[1].finalLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+CommandCacheStatistics Renderer::getCommandCacheStatistics() const
+{
+	return commandBufferCache.getStatistics();
+}
 
-	VkAttachmentReference colorAttachmentReference = {};
-	colorAttachmentReference.attachment = 0;
-	colorAttachmentReference.layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+FramePacer &Renderer::getFramePacer()
+{
+	return framePacer;
+}
 
-	VkAttachmentReference depthAttachmentReference = {};
-	depthAttachmentReference.attachment = 1;
-	depthAttachmentReference.layout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+HostMemoryStatistics Renderer::getHostMemoryStatistics() const
+{
+	return hostAllocator.getStatistics();
+}
 
-	VkSubpassDescription subpass = {};
-	subpass.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
-	subpass.colorAttachmentCount = 1;
-	subpass.pColorAttachments = &colorAttachmentReference;
-	subpass.pDepthStencilAttachment = &depthAttachmentReference;
+void Renderer::captureFrame(const char *fileName, CaptureFormat format)
+{
+	frameCapture.requestCapture(fileName, format);
+}
 
-	VkRenderPassCreateInfo renderPassCreateInfo = {};
-	renderPassCreateInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
-	renderPassCreateInfo.attachmentCount = 2;
-	renderPassCreateInfo.pAttachments = passAttachments;
-	renderPassCreateInfo.subpassCount = 1;
-	renderPassCreateInfo.pSubpasses = &subpass;
+void Renderer::setContinuousCapture(const char *filePrefix, CaptureFormat format)
+{
+	frameCapture.setContinuousCapture(filePrefix, format);
+}
 
-	result = vkCreateRenderPass(
-		context.device,
-		&renderPassCreateInfo,
-		nullptr,
-		&context.renderPass);
+InstanceRenderer &Renderer::getInstanceRenderer()
+{
+	return instanceRenderer;
+}
 
-	Utility::checkVulkanResult(result, "Failed to create render pass.");
+LightGrid &Renderer::getLightGrid()
+{
+	return lightGrid;
+}
 
-	// Create the frame buffers that are compatible with this render pass
-	VkImageView frameBufferAttachments[2];
-	frameBufferAttachments[1] = context.depthImageView;
+ShadowAtlas &Renderer::getShadowAtlas()
+{
+	return shadowAtlas;
+}
 
-	VkFramebufferCreateInfo framebufferCreateInfo = {};
-	framebufferCreateInfo.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
-	framebufferCreateInfo.renderPass = context.renderPass;
-	framebufferCreateInfo.attachmentCount = 2;
-	framebufferCreateInfo.pAttachments = frameBufferAttachments;
-	framebufferCreateInfo.width = context.width;
-	framebufferCreateInfo.height = context.height;
-	framebufferCreateInfo.layers = 1;
+ParticleSystem &Renderer::getParticleSystem()
+{
+	return particleSystem;
+}
 
-	// Create one framebuffer per swap chain image view
-	context.framebuffers = new VkFramebuffer[imageCount];
-	for (uint32_t i = 0; i < imageCount; ++i)
+MeshletRenderer &Renderer::getMeshletRenderer()
+{
+	return meshletRenderer;
+}
+
+MultiviewPass &Renderer::getMultiviewPass()
+{
+	return multiviewPass;
+}
+
+ShaderPermutations &Renderer::getShaderPermutations()
+{
+	return shaderPermutations;
+}
+
+JobSystem &Renderer::getJobSystem()
+{
+	return jobSystem;
+}
+
+InstanceMesh Renderer::getTriangleMesh() const
+{
+	InstanceMesh mesh = {};
+	mesh.vertexBuffer = context.vertexInputBuffer;
+	mesh.vertexCount = 3;
+	mesh.geometry = &triangleGeometry;
+
+	return mesh;
+}
+
+uint32_t Renderer::getFrameDeviceMask() const
+{
+	switch (context.multiGpuMode)
 	{
-		frameBufferAttachments[0] = presentImageViews[i];
-		
-		result = vkCreateFramebuffer(
-			context.device,
-			&framebufferCreateInfo,
-			nullptr,
-			&context.framebuffers[i]);
+	case MultiGpuMode::AlternateFrame:
+		return 1u << (context.frameIndex % context.deviceGroupSize);
 
-		Utility::checkVulkanResult(result, "Failed to create framebuffer.");
+	case MultiGpuMode::SplitFrame:
+		return (1u << context.deviceGroupSize) - 1;
+
+	default:
+		return 1;
 	}
+}
 
-	// Create a vertex buffer for the triangle
-	VkBufferCreateInfo vertexInputBufferInfo = {};
-	vertexInputBufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
-	vertexInputBufferInfo.size = sizeof(Vertex) * 3;
-	vertexInputBufferInfo.usage = VK_BUFFER_USAGE_VERTEX_BUFFER_BIT;
-	vertexInputBufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+void Renderer::recordDrawPass(void *data, VkCommandBuffer commandBuffer)
+{
+	Renderer *renderer = static_cast<Renderer *>(data);
+	const VulkanContext &context = renderer->context;
 
-	result = vkCreateBuffer(
-		context.device,
-		&vertexInputBufferInfo,
-		nullptr,
-		&context.vertexInputBuffer);
+	// Secondary command buffers do not inherit dynamic state, and the render
+	// area is smaller than the framebuffer with dynamic resolution
+	VkViewport viewport = {};
+	viewport.width = static_cast<float>(context.renderWidth);
+	viewport.height = static_cast<float>(context.renderHeight);
+	viewport.maxDepth = 1.0f;
 
-	Utility::checkVulkanResult(result, "Failed to create vertex input buffer.");
+	VkRect2D scissor = {};
+	scissor.extent = { context.renderWidth, context.renderHeight };
 
-	// Allocate the vertex input buffer
-	VkMemoryRequirements vertexBufferMemoryRequirements = {};
-	vkGetBufferMemoryRequirements(
-		context.device,
-		context.vertexInputBuffer,
-		&vertexBufferMemoryRequirements);
+	vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
+	vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
 
-	VkMemoryAllocateInfo bufferAllocateInfo = {};
-	bufferAllocateInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-	bufferAllocateInfo.allocationSize = vertexBufferMemoryRequirements.size;
+	renderer->instanceRenderer.recordDraws(commandBuffer);
+	renderer->particleSystem.recordDraws(commandBuffer);
+	renderer->meshletRenderer.recordDraws(commandBuffer);
+}
+
+void Renderer::recordUpscale(VkCommandBuffer commandBuffer, uint32_t imageIndex)
+{
+	VkImageSubresourceRange resourceRange = {};
+	resourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+	resourceRange.baseMipLevel = 0;
+	resourceRange.levelCount = 1;
+	resourceRange.baseArrayLayer = 0;
+	resourceRange.layerCount = 1;
+
+	// The old contents of the color image are overwritten completely
+	VkImageMemoryBarrier barriers[2] = {};
+	barriers[0].sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+	barriers[0].srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+	barriers[0].dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+	barriers[0].oldLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+	barriers[0].newLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+	barriers[0].srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	barriers[0].dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	barriers[0].image = context.sceneImage;
+	barriers[0].subresourceRange = resourceRange;
+
+	barriers[1].sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+	barriers[1].srcAccessMask = 0;
+	barriers[1].dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+	barriers[1].oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+	barriers[1].newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+	barriers[1].srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	barriers[1].dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	barriers[1].image = context.presentImages[imageIndex];
+	barriers[1].subresourceRange = resourceRange;
+
+	vkCmdPipelineBarrier(
+		commandBuffer,
+		VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT,
+		VK_PIPELINE_STAGE_TRANSFER_BIT,
+		0,
+		0, nullptr,
+		0, nullptr,
+		2, barriers);
+
+	VkImageBlit blitRegion = {};
+	blitRegion.srcSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+	blitRegion.srcSubresource.layerCount = 1;
+	blitRegion.srcOffsets[1] = { static_cast<int32_t>(context.renderWidth), static_cast<int32_t>(context.renderHeight), 1 };
+	blitRegion.dstSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+	blitRegion.dstSubresource.layerCount = 1;
+	blitRegion.dstOffsets[1] = { static_cast<int32_t>(context.width), static_cast<int32_t>(context.height), 1 };
+
+	vkCmdBlitImage(
+		commandBuffer,
+		context.sceneImage,
+		VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+		context.presentImages[imageIndex],
+		VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+		1,
+		&blitRegion,
+		VK_FILTER_LINEAR);
+
+	// Hand the image back to the presentation engine (or whoever reads the
+	// offscreen image)
+	barriers[1].srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+	barriers[1].dstAccessMask = VK_ACCESS_MEMORY_READ_BIT;
+	barriers[1].oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+	barriers[1].newLayout = context.finalLayout;
+
+	vkCmdPipelineBarrier(
+		commandBuffer,
+		VK_PIPELINE_STAGE_TRANSFER_BIT,
+		VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT,
+		0,
+		0, nullptr,
+		0, nullptr,
+		1, &barriers[1]);
+}
+
+void Renderer::trackDeviceMemory(VkDeviceSize size)
+{
+	// Startup tasks allocate memory from several threads at once
+	std::lock_guard<std::mutex> lock(deviceMemoryMutex);
+	context.allocatedDeviceMemory += size;
+}
+
+uint32_t Renderer::findMemoryType(
+	uint32_t memoryTypeBits,
+	VkMemoryPropertyFlags desiredMemoryFlags) const
+{
+	uint32_t memoryTypeIndex = 0;
+	bool foundMemoryType = Utility::findMemoryType(
+		context.physicalDeviceMemoryProperties,
+		memoryTypeBits,
+		desiredMemoryFlags,
+		memoryTypeIndex);
+
+	assert(foundMemoryType, "Failed to find a suitable memory type.");
+	return memoryTypeIndex;
+}
+
+void Renderer::nameObjects()
+{
+	// Names are only visible to the validation layers
+	if (!context.enableValidation)
+		return;
+
+	char name[64];
 
-	uint32_t vertexMemoryTypeBits = vertexBufferMemoryRequirements.memoryTypeBits;
-	
-	VkMemoryPropertyFlags vertexDesiredMemoryFlags = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT;
-	for (uint32_t i = 0; i < 32; ++i)
+	for (uint32_t i = 0; i < context.imageCount; ++i)
 	{
-		VkMemoryType memoryType = context.physicalDeviceMemoryProperties.memoryTypes[i];
-		if (memoryTypeBits & 1)
-		{
-			if ((memoryType.propertyFlags & vertexDesiredMemoryFlags) == vertexDesiredMemoryFlags)
-			{
-				bufferAllocateInfo.memoryTypeIndex = i;
-				break;
-			}
-		}
+		snprintf(name, sizeof(name), "Color image %u", i);
+		setObjectName(VK_OBJECT_TYPE_IMAGE, (uint64_t)context.presentImages[i], name);
+
+		snprintf(name, sizeof(name), "Color image view %u", i);
+		setObjectName(VK_OBJECT_TYPE_IMAGE_VIEW, (uint64_t)context.presentImageViews[i], name);
 
-		vertexMemoryTypeBits = vertexMemoryTypeBits >> 1;
+		snprintf(name, sizeof(name), "Framebuffer %u", i);
+		setObjectName(VK_OBJECT_TYPE_FRAMEBUFFER, (uint64_t)context.framebuffers[i], name);
 	}
 
-	VkDeviceMemory vertexBufferMemory;
-	result = vkAllocateMemory(
-		context.device,
-		&bufferAllocateInfo,
-		nullptr,
-		&vertexBufferMemory);
+	for (uint32_t i = 0; i < context.framesInFlight; ++i)
+	{
+		const FrameResources &frame = context.frames[i];
 
-	Utility::checkVulkanResult(result, "Failed to allocate vertex buffer memory.");
+		snprintf(name, sizeof(name), "Frame %u command buffer", i);
+		setObjectName(VK_OBJECT_TYPE_COMMAND_BUFFER, (uint64_t)frame.drawCommandBuffer, name);
 
-	void *mapped = nullptr;
-	result = vkMapMemory(context.device, vertexBufferMemory, 0, VK_WHOLE_SIZE, 0, &mapped);
-	Utility::checkVulkanResult(result, "Failed to map vertex buffer memory.");
+		snprintf(name, sizeof(name), "Frame %u image acquired", i);
+		setObjectName(VK_OBJECT_TYPE_SEMAPHORE, (uint64_t)frame.imageAcquiredSemaphore, name);
 
-	Vertex *triangle = (Vertex *)mapped;
-	Vertex vertex1 = { -1.0f, -1.0f, 0.0f };
-	Vertex vertex2 = {  1.0f, -1.0f, 0.0f };
-	Vertex vertex3 = {  0.0f,  1.0f, 0.0f };
-	triangle[0] = vertex1;
-	triangle[1] = vertex2;
-	triangle[2] = vertex3;
+		snprintf(name, sizeof(name), "Frame %u render complete", i);
+		setObjectName(VK_OBJECT_TYPE_SEMAPHORE, (uint64_t)frame.renderCompleteSemaphore, name);
 
-	vkUnmapMemory(context.device, vertexBufferMemory);
+		snprintf(name, sizeof(name), "Frame %u render fence", i);
+		setObjectName(VK_OBJECT_TYPE_FENCE, (uint64_t)frame.renderFence, name);
+	}
 
-	result = vkBindBufferMemory(
-		context.device,
-		context.vertexInputBuffer,
-		vertexBufferMemory, 0);
+	setObjectName(VK_OBJECT_TYPE_IMAGE, (uint64_t)context.depthImage, "Depth image");
+	setObjectName(VK_OBJECT_TYPE_IMAGE_VIEW, (uint64_t)context.depthImageView, "Depth image view");
+	setObjectName(VK_OBJECT_TYPE_RENDER_PASS, (uint64_t)context.renderPass, "Main render pass");
+	setObjectName(VK_OBJECT_TYPE_BUFFER, (uint64_t)context.vertexInputBuffer, "Triangle vertex buffer");
+	setObjectName(VK_OBJECT_TYPE_COMMAND_POOL, (uint64_t)context.commandPool, "Command pool");
+	setObjectName(VK_OBJECT_TYPE_COMMAND_BUFFER, (uint64_t)context.setupCommandBuffer, "Setup command buffer");
+	setObjectName(VK_OBJECT_TYPE_FENCE, (uint64_t)context.setupFence, "Setup fence");
 
-	Utility::checkVulkanResult(result, "Failed to bind vertex buffer memmory.");
+	if (context.supportsTimestamps)
+		setObjectName(VK_OBJECT_TYPE_QUERY_POOL, (uint64_t)context.timestampQueryPool, "Timestamp query pool");
+
+	if (context.dynamicResolution)
+	{
+		setObjectName(VK_OBJECT_TYPE_IMAGE, (uint64_t)context.sceneImage, "Scene image");
+		setObjectName(VK_OBJECT_TYPE_IMAGE_VIEW, (uint64_t)context.sceneImageView, "Scene image view");
+		setObjectName(VK_OBJECT_TYPE_FRAMEBUFFER, (uint64_t)context.sceneFramebuffer, "Scene framebuffer");
+	}
 }
 
-void Renderer::render()
+void Renderer::setObjectName(VkObjectType type, uint64_t handle, const char *name)
 {
-	uint32_t nextImageIndex = 0;
-
-	// Get the next available image ID from the swapchain
-	vkAcquireNextImageKHR(
-		context.device,
-		context.swapChain,
-		UINT64_MAX,
-		VK_NULL_HANDLE,
-		VK_NULL_HANDLE,
-		&nextImageIndex);
+	if (!fpVkSetDebugUtilsObjectNameEXT || handle == 0)
+		return;
 
-	VkPresentInfoKHR presentInfo = {};
-	presentInfo.sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR;
-	presentInfo.pNext = nullptr;
-	presentInfo.waitSemaphoreCount = 0;
-	presentInfo.pWaitSemaphores = nullptr;
-	presentInfo.swapchainCount = 1;
-	presentInfo.pSwapchains = &context.swapChain;
-	presentInfo.pImageIndices = &nextImageIndex;
-	presentInfo.pResults = nullptr;
+	VkDebugUtilsObjectNameInfoEXT nameInfo = {};
+	nameInfo.sType = VK_STRUCTURE_TYPE_DEBUG_UTILS_OBJECT_NAME_INFO_EXT;
+	nameInfo.objectType = type;
+	nameInfo.objectHandle = handle;
+	nameInfo.pObjectName = name;
 
-	vkQueuePresentKHR(context.presentQueue, &presentInfo);
+	fpVkSetDebugUtilsObjectNameEXT(context.device, &nameInfo);
 }
 
 void Renderer::loadExtensions()
 {
 	PFN_vkVoidFunction functionPointer = nullptr;
-	
-	functionPointer = vkGetInstanceProcAddr(
-		context.instance,
-		"vkCreateDebugReportCallbackEXT");
-	assert(functionPointer != nullptr,
-		"Failed to load the \"vkCreateDebugReportCallbackEXT\" extension.");
-	fpVkCreateDebugReportCallbackEXT = reinterpret_cast<PFN_vkCreateDebugReportCallbackEXT>(functionPointer);
-	functionPointer = nullptr;
 
-	functionPointer = vkGetInstanceProcAddr(
-		context.instance,
-		"vkDestroyDebugReportCallbackEXT");
-	assert(functionPointer != nullptr,
-		"Failed to load the \"vkDestroyDebugReportCallbackEXT\" extension.");
-	fpVkDestroyDebugReportCallbackEXT = reinterpret_cast<PFN_vkDestroyDebugReportCallbackEXT>(functionPointer);
-	functionPointer = nullptr;
+	// The debug utils extension is only enabled together with validation
+	if (context.enableValidation)
+	{
+		functionPointer = vkGetInstanceProcAddr(
+			context.instance,
+			"vkCreateDebugUtilsMessengerEXT");
+		assert(functionPointer != nullptr,
+			"Failed to load the \"vkCreateDebugUtilsMessengerEXT\" extension.");
+		fpVkCreateDebugUtilsMessengerEXT = reinterpret_cast<PFN_vkCreateDebugUtilsMessengerEXT>(functionPointer);
+		functionPointer = nullptr;
+
+		functionPointer = vkGetInstanceProcAddr(
+			context.instance,
+			"vkDestroyDebugUtilsMessengerEXT");
+		assert(functionPointer != nullptr,
+			"Failed to load the \"vkDestroyDebugUtilsMessengerEXT\" extension.");
+		fpVkDestroyDebugUtilsMessengerEXT = reinterpret_cast<PFN_vkDestroyDebugUtilsMessengerEXT>(functionPointer);
+		functionPointer = nullptr;
+
+		functionPointer = vkGetInstanceProcAddr(
+			context.instance,
+			"vkSetDebugUtilsObjectNameEXT");
+		assert(functionPointer != nullptr,
+			"Failed to load the \"vkSetDebugUtilsObjectNameEXT\" extension.");
+		fpVkSetDebugUtilsObjectNameEXT = reinterpret_cast<PFN_vkSetDebugUtilsObjectNameEXT>(functionPointer);
+		functionPointer = nullptr;
+	}
 
-	functionPointer = vkGetInstanceProcAddr(
-		context.instance,
-		"vkDebugReportMessageEXT");
-	assert(functionPointer != nullptr,
-		"Failed to load the \"vkDebugReportMessageEXT\" extension.");
-	fpVkDebugReportMessageEXT = reinterpret_cast<PFN_vkDebugReportMessageEXT>(functionPointer);
-	functionPointer = nullptr;
+#ifdef VK_USE_PLATFORM_WIN32_KHR
+	// Only needed when rendering to a window
+	if (context.headless)
+		return;
 
 	functionPointer = vkGetInstanceProcAddr(
 		context.instance,
@@ -1028,4 +3284,5 @@ void Renderer::loadExtensions()
 		"Failed to load the \"vkCreateWin32SurfaceKHR\" extension.");
 	fpVkCreateWin32SurfaceKHR = reinterpret_cast<PFN_vkCreateWin32SurfaceKHR>(functionPointer);
 	functionPointer = nullptr;
+#endif
 }
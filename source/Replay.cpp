@@ -0,0 +1,432 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+#include "LearningVulkan/Renderer.hpp"
+#include "LearningVulkan/Utility.hpp"
+#include "LearningVulkan/WorkloadTrace.hpp"
+
+// IDs from the trace that could not be recreated
+const uint32_t INVALID_ID = UINT32_MAX;
+
+struct ReplaySettings
+{
+	const char *tracePath;
+	const char *shaderDirectory;
+	uint32_t workerCount;
+	bool enableValidation;
+	bool printFrames;
+};
+
+// Maps the IDs of the trace to the IDs of the replaying renderer, which only
+// differ if something could not be recreated
+struct ReplayState
+{
+	Renderer *renderer;
+	const VulkanContext *context;
+
+	std::vector<MeshId> meshes;
+	std::vector<MaterialId> materials;
+	std::vector<InstanceId> instances;
+
+	// Vertex and index buffers of the meshes in the trace
+	std::vector<VkBuffer> buffers;
+	std::vector<VkDeviceMemory> bufferMemory;
+
+	// Compute shaders of the traced effects, only with --shaders
+	LightGridShaders lightGridShaders;
+	ParticleShaders particleShaders;
+	bool hasShaders;
+
+	uint32_t skippedMeshCount;
+	uint32_t skippedMaterialCount;
+	uint32_t skippedInstanceCount;
+	uint32_t skippedParticleCount;
+};
+
+static void mapId(std::vector<uint32_t> &ids, uint32_t traceId, uint32_t replayId)
+{
+	if (traceId >= ids.size())
+		ids.resize(traceId + 1, INVALID_ID);
+
+	ids[traceId] = replayId;
+}
+
+static uint32_t findId(const std::vector<uint32_t> &ids, uint32_t traceId)
+{
+	return traceId < ids.size() ? ids[traceId] : INVALID_ID;
+}
+
+static bool loadSpirv(const char *directory, const char *name, std::vector<uint32_t> &code)
+{
+	std::string path = std::string(directory) + "/" + name;
+
+	FILE *file = fopen(path.c_str(), "rb");
+	if (!file)
+	{
+		fprintf(stderr, "Failed to open the shader \"%s\".\n", path.c_str());
+		return false;
+	}
+
+	fseek(file, 0, SEEK_END);
+	long size = ftell(file);
+	fseek(file, 0, SEEK_SET);
+
+	code.resize(size > 0 ? size / sizeof(uint32_t) : 0);
+	size_t readSize = code.empty() ? 0 : fread(code.data(), sizeof(uint32_t), code.size(), file);
+	fclose(file);
+
+	return !code.empty() && readSize == code.size();
+}
+
+// Keeps the context for the mesh buffers and bins lights and simulates
+// particles on the GPU like the traced application did, if the shaders were
+// given
+static void createReplayObjectsTask(void *data, const VulkanContext &context)
+{
+	ReplayState &state = *static_cast<ReplayState *>(data);
+	state.context = &context;
+
+	if (!state.hasShaders)
+		return;
+
+	VkPipelineCache pipelineCache = state.renderer->getShaderPermutations().getPipelineCache();
+	state.renderer->getLightGrid().createPipelines(state.lightGridShaders, pipelineCache);
+	state.renderer->getParticleSystem().createPipelines(state.particleShaders, pipelineCache);
+}
+
+// Host-visible is enough for geometry that is written once
+static VkBuffer createMeshBuffer(ReplayState &state, const void *data, VkDeviceSize size, VkBufferUsageFlags usage)
+{
+	const VulkanContext &context = *state.context;
+
+	VkBuffer buffer = VK_NULL_HANDLE;
+	VkDeviceMemory memory = VK_NULL_HANDLE;
+	Utility::createBuffer(
+		context.device,
+		context.allocator,
+		context.physicalDeviceMemoryProperties,
+		size,
+		usage,
+		VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+		buffer,
+		memory);
+
+	void *mapped = nullptr;
+	VkResult result = vkMapMemory(context.device, memory, 0, VK_WHOLE_SIZE, 0, &mapped);
+	Utility::checkVulkanResult(result, "Failed to map a mesh buffer.");
+
+	memcpy(mapped, data, size);
+	vkUnmapMemory(context.device, memory);
+
+	state.buffers.push_back(buffer);
+	state.bufferMemory.push_back(memory);
+	return buffer;
+}
+
+static MeshId addTracedMesh(ReplayState &state, const TraceRecord &record)
+{
+	if (!record.hasGeometry || record.vertexCount == 0)
+		return INVALID_ID;
+
+	InstanceMesh mesh = {};
+	mesh.vertexBuffer = createMeshBuffer(state, record.vertices.data(), sizeof(Vertex) * record.vertexCount, VK_BUFFER_USAGE_VERTEX_BUFFER_BIT);
+	mesh.vertexCount = record.vertexCount;
+
+	if (record.indexCount > 0)
+	{
+		mesh.indexBuffer = createMeshBuffer(state, record.indices.data(), sizeof(uint32_t) * record.indexCount, VK_BUFFER_USAGE_INDEX_BUFFER_BIT);
+		mesh.indexCount = record.indexCount;
+	}
+
+	return state.renderer->getInstanceRenderer().addMesh(mesh);
+}
+
+static void destroyMeshBuffers(ReplayState &state)
+{
+	for (size_t i = 0; i < state.buffers.size(); ++i)
+	{
+		vkDestroyBuffer(state.context->device, state.buffers[i], state.context->allocator);
+		vkFreeMemory(state.context->device, state.bufferMemory[i], state.context->allocator);
+	}
+
+	state.buffers.clear();
+	state.bufferMemory.clear();
+}
+
+void printUsage()
+{
+	printf(
+		"Usage: LearningVulkanReplay <trace> [options]\n"
+		"  --shaders <directory>      Compiled shaders, for traces that bin lights or simulate particles on the GPU\n"
+		"  --threads <count>          Worker threads for jobs (default 0, one per core)\n"
+		"  --validation               Enable the validation layers\n"
+		"  --frames                   List the CPU time of every frame\n");
+}
+
+bool parseArguments(int argc, char **argv, ReplaySettings &settings)
+{
+	for (int i = 1; i < argc; ++i)
+	{
+		bool hasValue = (i + 1 < argc);
+
+		if (strcmp(argv[i], "--validation") == 0)
+			settings.enableValidation = true;
+		else if (strcmp(argv[i], "--frames") == 0)
+			settings.printFrames = true;
+		else if (strcmp(argv[i], "--shaders") == 0 && hasValue)
+			settings.shaderDirectory = argv[++i];
+		else if (strcmp(argv[i], "--threads") == 0 && hasValue)
+			settings.workerCount = strtoul(argv[++i], nullptr, 10);
+		else if (argv[i][0] != '-' && !settings.tracePath)
+			settings.tracePath = argv[i];
+		else
+			return false;
+	}
+
+	return settings.tracePath != nullptr;
+}
+
+static double getPercentile(const std::vector<double> &sortedTimes, double percentile)
+{
+	if (sortedTimes.empty())
+		return 0.0;
+
+	size_t index = static_cast<size_t>(percentile * (sortedTimes.size() - 1) + 0.5);
+	return sortedTimes[index];
+}
+
+// Runs a workload recorded with Renderer::startTrace on a headless renderer,
+// as fast as possible, and reports how long every frame took to record and
+// submit compared to when it was recorded. Fails if any part of the trace
+// could not be recreated, the frames would not be the recorded workload.
+int main(int argc, char **argv)
+{
+	ReplaySettings settings = {};
+	settings.tracePath = nullptr;
+	settings.shaderDirectory = nullptr;
+	settings.workerCount = 0;
+	settings.enableValidation = false;
+	settings.printFrames = false;
+
+	if (!parseArguments(argc, argv, settings))
+	{
+		printUsage();
+		return 1;
+	}
+
+	TraceReader reader;
+	if (!reader.open(settings.tracePath))
+	{
+		fprintf(stderr, "Failed to open the trace \"%s\".\n", settings.tracePath);
+		return 1;
+	}
+
+	const TraceHeader &header = reader.getHeader();
+
+	Renderer vulkanRenderer;
+
+	ReplayState state = {};
+	state.renderer = &vulkanRenderer;
+	state.hasShaders = (settings.shaderDirectory != nullptr);
+
+	if (state.hasShaders &&
+		(!loadSpirv(settings.shaderDirectory, "LightBin.comp.spv", state.lightGridShaders.bin) ||
+		!loadSpirv(settings.shaderDirectory, "ParticleEmit.comp.spv", state.particleShaders.emit) ||
+		!loadSpirv(settings.shaderDirectory, "ParticleSimulate.comp.spv", state.particleShaders.simulate) ||
+		!loadSpirv(settings.shaderDirectory, "ParticleCompact.comp.spv", state.particleShaders.compact)))
+	{
+		return 1;
+	}
+
+	vulkanRenderer.addStartupTask("Create replay objects", createReplayObjectsTask, &state, StartupStage::AfterDevice);
+
+	vulkanRenderer.initializeHeadless(
+		header.width,
+		header.height,
+		header.framesInFlight,
+		settings.enableValidation,
+		settings.workerCount);
+
+	InstanceRenderer &instanceRenderer = vulkanRenderer.getInstanceRenderer();
+	LightGrid &lightGrid = vulkanRenderer.getLightGrid();
+	ParticleSystem &particleSystem = vulkanRenderer.getParticleSystem();
+
+	std::vector<double> recordedTimes;
+	std::vector<double> replayedTimes;
+
+	typedef std::chrono::high_resolution_clock Clock;
+	Clock::time_point replayStart = Clock::now();
+
+	TraceRecord record;
+	while (reader.read(record))
+	{
+		switch (record.command)
+		{
+		case TraceCommand::AddMesh:
+		{
+			MeshId mesh = addTracedMesh(state, record);
+			if (mesh == INVALID_ID)
+				++state.skippedMeshCount;
+
+			mapId(state.meshes, record.id, mesh);
+			break;
+		}
+
+		case TraceCommand::AddMaterial:
+		{
+			// Pipelines belong to the application and cannot be recreated
+			mapId(state.materials, record.id, INVALID_ID);
+			++state.skippedMaterialCount;
+			break;
+		}
+
+		case TraceCommand::AddInstance:
+		{
+			MeshId mesh = findId(state.meshes, record.mesh);
+			MaterialId material = findId(state.materials, record.material);
+			InstanceId instance = INVALID_ID;
+
+			if (mesh != INVALID_ID && material != INVALID_ID)
+				instance = instanceRenderer.addInstance(mesh, material, record.data);
+			else
+				++state.skippedInstanceCount;
+
+			mapId(state.instances, record.id, instance);
+			break;
+		}
+
+		case TraceCommand::UpdateInstance:
+		{
+			InstanceId instance = findId(state.instances, record.id);
+			if (instance != INVALID_ID)
+				instanceRenderer.updateInstance(instance, record.data);
+
+			break;
+		}
+
+		case TraceCommand::RemoveInstance:
+		{
+			InstanceId instance = findId(state.instances, record.id);
+			if (instance != INVALID_ID)
+				instanceRenderer.removeInstance(instance);
+
+			mapId(state.instances, record.id, INVALID_ID);
+			break;
+		}
+
+		case TraceCommand::SetLights:
+			lightGrid.setLights(record.lights.data(), static_cast<uint32_t>(record.lights.size()));
+			break;
+
+		case TraceCommand::SetLightView:
+			lightGrid.setView(record.lightView);
+			break;
+
+		case TraceCommand::SetParticleEmitter:
+		{
+			if (state.hasShaders)
+				particleSystem.setEmitter(record.emitter);
+			else
+				++state.skippedParticleCount;
+
+			break;
+		}
+
+		case TraceCommand::UpdateParticles:
+		{
+			if (state.hasShaders)
+				particleSystem.update(record.deltaTime);
+			else
+				++state.skippedParticleCount;
+
+			break;
+		}
+
+		case TraceCommand::Frame:
+		{
+			Clock::time_point frameStart = Clock::now();
+			vulkanRenderer.render();
+
+			replayedTimes.push_back(std::chrono::duration<double, std::milli>(Clock::now() - frameStart).count());
+			recordedTimes.push_back(record.cpuTime);
+			break;
+		}
+		}
+	}
+
+	vulkanRenderer.waitIdle();
+	destroyMeshBuffers(state);
+
+	double totalTime = std::chrono::duration<double>(Clock::now() - replayStart).count();
+
+	double recordedTotal = 0.0;
+	double replayedTotal = 0.0;
+
+	for (size_t i = 0; i < replayedTimes.size(); ++i)
+	{
+		recordedTotal += recordedTimes[i];
+		replayedTotal += replayedTimes[i];
+	}
+
+	std::vector<double> sortedTimes = replayedTimes;
+	std::sort(sortedTimes.begin(), sortedTimes.end());
+
+	size_t frameCount = replayedTimes.size();
+
+	uint32_t skippedCount =
+		state.skippedMeshCount +
+		state.skippedMaterialCount +
+		state.skippedInstanceCount +
+		state.skippedParticleCount;
+
+	bool isComplete = !reader.isTruncated() && skippedCount == 0;
+
+	// Machine-readable results, in the same spirit as the benchmark
+	printf("{\n");
+	printf("\t\"trace\": \"%s\",\n", settings.tracePath);
+	printf("\t\"width\": %u,\n", header.width);
+	printf("\t\"height\": %u,\n", header.height);
+	printf("\t\"framesInFlight\": %u,\n", header.framesInFlight);
+	printf("\t\"complete\": %s,\n", isComplete ? "true" : "false");
+	printf("\t\"truncated\": %s,\n", reader.isTruncated() ? "true" : "false");
+	printf("\t\"frames\": %u,\n", static_cast<uint32_t>(frameCount));
+	printf("\t\"framesPerSecond\": %.3f,\n", totalTime > 0.0 ? frameCount / totalTime : 0.0);
+	printf("\t\"recordedCpuFrameTimeMs\": %.6f,\n", frameCount ? recordedTotal / frameCount : 0.0);
+	printf("\t\"cpuFrameTimeMs\": %.6f,\n", frameCount ? replayedTotal / frameCount : 0.0);
+	printf("\t\"cpuFrameTimeMedianMs\": %.6f,\n", getPercentile(sortedTimes, 0.5));
+	printf("\t\"cpuFrameTime99thMs\": %.6f,\n", getPercentile(sortedTimes, 0.99));
+	printf("\t\"skippedMeshes\": %u,\n", state.skippedMeshCount);
+	printf("\t\"skippedMaterials\": %u,\n", state.skippedMaterialCount);
+	printf("\t\"skippedInstances\": %u,\n", state.skippedInstanceCount);
+	printf("\t\"skippedParticleCommands\": %u%s\n", state.skippedParticleCount, settings.printFrames ? "," : "");
+
+	if (settings.printFrames)
+	{
+		printf("\t\"frameTimes\": [\n");
+
+		for (size_t i = 0; i < frameCount; ++i)
+		{
+			printf(
+				"\t\t{ \"recordedMs\": %.6f, \"replayedMs\": %.6f }%s\n",
+				recordedTimes[i],
+				replayedTimes[i],
+				i + 1 < frameCount ? "," : "");
+		}
+
+		printf("\t]\n");
+	}
+
+	printf("}\n");
+
+	if (reader.isTruncated())
+		fprintf(stderr, "The trace ends in the middle of a command.\n");
+
+	if (skippedCount > 0)
+		fprintf(stderr, "%u commands of the trace could not be recreated, the replay is not the recorded workload.\n", skippedCount);
+
+	return isComplete ? 0 : 1;
+}
\ No newline at end of file
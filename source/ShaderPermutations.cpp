@@ -0,0 +1,558 @@
+#include "LearningVulkan/ShaderPermutations.hpp"
+#include "LearningVulkan/Renderer.hpp"
+#include "LearningVulkan/Utility.hpp"
+
+#include <assert.h>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+
+// Has to change whenever the layout of the file does
+static const uint32_t SHADER_CACHE_MAGIC = 0x4353564C;	// "LVSC"
+static const uint32_t SHADER_CACHE_VERSION = 2;
+
+struct ShaderCacheHeader
+{
+	uint32_t magic;
+	uint32_t version;
+	uint32_t spirvCount;
+	uint32_t compiledCodeCount;
+	uint32_t variantCount;
+	uint32_t pipelineCacheSize;
+};
+
+// FNV-1a, also used to tell SPIR-V apart, so it has to be stable across runs
+static uint64_t hashBytes(const void *data, size_t size, uint64_t hash = 14695981039346656037ull)
+{
+	const uint8_t *bytes = static_cast<const uint8_t *>(data);
+
+	for (size_t i = 0; i < size; ++i)
+	{
+		hash ^= bytes[i];
+		hash *= 1099511628211ull;
+	}
+
+	return hash;
+}
+
+// Includes the terminator, so "ab" + "c" and "a" + "bc" differ
+static uint64_t hashString(const char *string, uint64_t hash)
+{
+	return hashBytes(string, strlen(string) + 1, hash);
+}
+
+static uint64_t makeVariantKey(uint64_t program, uint32_t featureMask)
+{
+	return (program << 32) | featureMask;
+}
+
+static bool readBytes(FILE *file, void *data, size_t size)
+{
+	return fread(data, 1, size, file) == size;
+}
+
+ShaderPermutations::ShaderPermutations() :
+	device(VK_NULL_HANDLE),
+	allocator(nullptr),
+	jobSystem(nullptr),
+	pipelineCache(VK_NULL_HANDLE)
+{
+	statistics = {};
+}
+
+ShaderPermutations::~ShaderPermutations()
+{
+	destroy();
+}
+
+void ShaderPermutations::initialize(const VulkanContext &context, JobSystem &jobSystem)
+{
+	device = context.device;
+	allocator = context.allocator;
+	this->jobSystem = &jobSystem;
+}
+
+void ShaderPermutations::destroy()
+{
+	if (device == VK_NULL_HANDLE)
+		return;
+
+	for (Variant &variant : variants)
+		jobSystem->wait(variant.counter);
+
+	for (Variant &variant : variants)
+		vkDestroyPipeline(device, variant.pipeline, allocator);
+
+	for (auto &module : modules)
+		vkDestroyShaderModule(device, module.second, allocator);
+
+	vkDestroyPipelineCache(device, pipelineCache, allocator);
+
+	variants.clear();
+	variantIndices.clear();
+	programs.clear();
+	modules.clear();
+	pipelineCache = VK_NULL_HANDLE;
+	device = VK_NULL_HANDLE;
+}
+
+bool ShaderPermutations::load(const char *path)
+{
+	assert(programs.empty(), "The shader cache has to be loaded before adding programs.");
+
+	std::vector<uint8_t> pipelineCacheData;
+	bool isValid = false;
+
+	FILE *file = path ? fopen(path, "rb") : nullptr;
+	if (file)
+	{
+		ShaderCacheHeader header = {};
+		isValid =
+			readBytes(file, &header, sizeof(header)) &&
+			header.magic == SHADER_CACHE_MAGIC &&
+			header.version == SHADER_CACHE_VERSION;
+
+		for (uint32_t i = 0; isValid && i < header.spirvCount; ++i)
+		{
+			uint64_t hash = 0;
+			uint32_t wordCount = 0;
+			isValid =
+				readBytes(file, &hash, sizeof(hash)) &&
+				readBytes(file, &wordCount, sizeof(wordCount));
+
+			if (!isValid)
+				break;
+
+			std::vector<uint32_t> &code = spirv[hash];
+			code.resize(wordCount);
+			isValid = readBytes(file, code.data(), sizeof(uint32_t) * wordCount);
+		}
+
+		for (uint32_t i = 0; isValid && i < header.compiledCodeCount; ++i)
+		{
+			uint64_t entry[2] = {};
+			isValid = readBytes(file, entry, sizeof(entry));
+			compiledCode[entry[0]] = entry[1];
+		}
+
+		for (uint32_t i = 0; isValid && i < header.variantCount; ++i)
+		{
+			VariantKey key = {};
+			isValid =
+				readBytes(file, &key.layoutHash, sizeof(key.layoutHash)) &&
+				readBytes(file, &key.featureMask, sizeof(key.featureMask));
+
+			loadedVariants.push_back(key);
+		}
+
+		if (isValid)
+		{
+			pipelineCacheData.resize(header.pipelineCacheSize);
+			isValid = readBytes(file, pipelineCacheData.data(), pipelineCacheData.size());
+		}
+
+		fclose(file);
+	}
+
+	// A damaged file is thrown away as a whole
+	if (!isValid)
+	{
+		spirv.clear();
+		compiledCode.clear();
+		loadedVariants.clear();
+		pipelineCacheData.clear();
+	}
+
+	// The driver ignores pipeline cache data of another device or driver
+	VkPipelineCacheCreateInfo pipelineCacheCreateInfo = {};
+	pipelineCacheCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
+	pipelineCacheCreateInfo.initialDataSize = pipelineCacheData.size();
+	pipelineCacheCreateInfo.pInitialData = pipelineCacheData.empty() ? nullptr : pipelineCacheData.data();
+
+	VkResult result = vkCreatePipelineCache(
+		device,
+		&pipelineCacheCreateInfo,
+		allocator,
+		&pipelineCache);
+
+	Utility::checkVulkanResult(result, "Failed to create the pipeline cache.");
+
+	return isValid;
+}
+
+bool ShaderPermutations::save(const char *path)
+{
+	if (!path || pipelineCache == VK_NULL_HANDLE)
+		return false;
+
+	// Variants still being built would only add to the cache later
+	for (Variant &variant : variants)
+		jobSystem->wait(variant.counter);
+
+	size_t pipelineCacheSize = 0;
+	vkGetPipelineCacheData(device, pipelineCache, &pipelineCacheSize, nullptr);
+
+	std::vector<uint8_t> pipelineCacheData(pipelineCacheSize);
+	vkGetPipelineCacheData(device, pipelineCache, &pipelineCacheSize, pipelineCacheData.data());
+
+	// Variants of programs that were not added this time stay in the cache
+	std::vector<VariantKey> usedVariants = loadedVariants;
+	for (const Variant &variant : variants)
+	{
+		bool isKnown = false;
+
+		for (const VariantKey &loaded : loadedVariants)
+		{
+			isKnown = isKnown ||
+				(loaded.layoutHash == variant.program->layoutHash && loaded.featureMask == variant.featureMask);
+		}
+
+		if (!isKnown)
+		{
+			VariantKey usedVariant = { variant.program->layoutHash, variant.featureMask };
+			usedVariants.push_back(usedVariant);
+		}
+	}
+
+	FILE *file = fopen(path, "wb");
+	if (!file)
+		return false;
+
+	std::lock_guard<std::mutex> lock(mutex);
+
+	ShaderCacheHeader header = {};
+	header.magic = SHADER_CACHE_MAGIC;
+	header.version = SHADER_CACHE_VERSION;
+	header.spirvCount = static_cast<uint32_t>(spirv.size());
+	header.compiledCodeCount = static_cast<uint32_t>(compiledCode.size());
+	header.variantCount = static_cast<uint32_t>(usedVariants.size());
+	header.pipelineCacheSize = static_cast<uint32_t>(pipelineCacheSize);
+	fwrite(&header, sizeof(header), 1, file);
+
+	for (const auto &code : spirv)
+	{
+		uint32_t wordCount = static_cast<uint32_t>(code.second.size());
+		fwrite(&code.first, sizeof(code.first), 1, file);
+		fwrite(&wordCount, sizeof(wordCount), 1, file);
+		fwrite(code.second.data(), sizeof(uint32_t), wordCount, file);
+	}
+
+	for (const auto &entry : compiledCode)
+	{
+		uint64_t values[2] = { entry.first, entry.second };
+		fwrite(values, sizeof(values), 1, file);
+	}
+
+	for (const VariantKey &key : usedVariants)
+	{
+		fwrite(&key.layoutHash, sizeof(key.layoutHash), 1, file);
+		fwrite(&key.featureMask, sizeof(key.featureMask), 1, file);
+	}
+
+	fwrite(pipelineCacheData.data(), 1, pipelineCacheData.size(), file);
+	fclose(file);
+
+	return true;
+}
+
+ProgramId ShaderPermutations::addProgram(const ShaderProgramDescription &description)
+{
+	assert(description.features.size() <= MAX_SHADER_FEATURES,
+		"Too many features in a shader program.");
+	assert(description.compile && description.getSourceVersion && description.buildPipeline,
+		"Shader programs need a compile, a source version and a pipeline build function.");
+
+	Program program;
+	program.description = description;
+
+	// Renaming, reordering or editing anything makes the cached variants
+	// useless
+	uint64_t hash = hashString(description.name, 14695981039346656037ull);
+
+	for (const ShaderStageSource &stage : description.stages)
+	{
+		uint64_t version = description.getSourceVersion(description.compileData, stage.source);
+		program.sourceVersions.push_back(version);
+
+		hash = hashBytes(&stage.stage, sizeof(stage.stage), hash);
+		hash = hashString(stage.source, hash);
+		hash = hashBytes(&version, sizeof(version), hash);
+	}
+
+	for (const ShaderFeature &feature : description.features)
+	{
+		hash = hashString(feature.name, hash);
+		hash = hashBytes(&feature.binding, sizeof(feature.binding), hash);
+		hash = hashBytes(&feature.constantId, sizeof(feature.constantId), hash);
+	}
+
+	program.layoutHash = hash;
+	programs.push_back(program);
+
+	return static_cast<ProgramId>(programs.size() - 1);
+}
+
+VkPipeline ShaderPermutations::getPipeline(ProgramId program, uint32_t featureMask)
+{
+	bool isNew = false;
+	Variant &variant = findOrAddVariant(program, featureMask, isNew);
+
+	if (isNew)
+	{
+		// A single worker would only get to the job when something waits
+		if (jobSystem->getWorkerCount() > 1)
+			jobSystem->run(buildVariantJob, &variant, 0, 1, variant.counter);
+		else
+			buildVariant(variant);
+	}
+
+	if (variant.state.load(std::memory_order_acquire) != VARIANT_READY)
+		return VK_NULL_HANDLE;
+
+	return variant.pipeline;
+}
+
+VkPipeline ShaderPermutations::requirePipeline(ProgramId program, uint32_t featureMask)
+{
+	bool isNew = false;
+	Variant &variant = findOrAddVariant(program, featureMask, isNew);
+
+	// Waiting runs the build job if nobody picked it up yet
+	if (isNew)
+		buildVariant(variant);
+	else
+		jobSystem->wait(variant.counter);
+
+	if (variant.state.load(std::memory_order_acquire) != VARIANT_READY)
+		return VK_NULL_HANDLE;
+
+	return variant.pipeline;
+}
+
+void ShaderPermutations::prewarm()
+{
+	for (const VariantKey &key : loadedVariants)
+	{
+		for (ProgramId i = 0; i < programs.size(); ++i)
+		{
+			if (programs[i].layoutHash == key.layoutHash)
+				getPipeline(i, key.featureMask);
+		}
+	}
+}
+
+VkPipelineCache ShaderPermutations::getPipelineCache() const
+{
+	return pipelineCache;
+}
+
+ShaderCacheStatistics ShaderPermutations::getStatistics() const
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	return statistics;
+}
+
+ShaderPermutations::Variant &ShaderPermutations::findOrAddVariant(
+	ProgramId program,
+	uint32_t featureMask,
+	bool &isNew)
+{
+	assert(program < programs.size(), "Unknown shader program.");
+
+	uint64_t key = makeVariantKey(program, featureMask);
+	auto found = variantIndices.find(key);
+
+	isNew = (found == variantIndices.end());
+	if (!isNew)
+		return variants[found->second];
+
+	variants.emplace_back();
+	Variant &variant = variants.back();
+	variant.owner = this;
+	variant.program = &programs[program];
+	variant.featureMask = featureMask;
+	variant.state = VARIANT_BUILDING;
+	variant.pipeline = VK_NULL_HANDLE;
+
+	variantIndices[key] = static_cast<uint32_t>(variants.size() - 1);
+
+	std::lock_guard<std::mutex> lock(mutex);
+	++statistics.variantCount;
+
+	return variant;
+}
+
+void ShaderPermutations::buildVariantJob(void *data, uint32_t begin, uint32_t end)
+{
+	Variant &variant = *static_cast<Variant *>(data);
+	variant.owner->buildVariant(variant);
+}
+
+void ShaderPermutations::buildVariant(Variant &variant)
+{
+	typedef std::chrono::steady_clock Clock;
+	Clock::time_point buildStart = Clock::now();
+
+	const ShaderProgramDescription &description = variant.program->description;
+
+	// Defines pick the SPIR-V, specialization constants are set per variant
+	std::vector<const char *> defines;
+	std::vector<VkSpecializationMapEntry> mapEntries;
+	std::vector<VkBool32> constants;
+
+	for (uint32_t i = 0; i < description.features.size(); ++i)
+	{
+		const ShaderFeature &feature = description.features[i];
+		bool isEnabled = (variant.featureMask & (1u << i)) != 0;
+
+		if (feature.binding == FeatureBinding::Define)
+		{
+			if (isEnabled)
+				defines.push_back(feature.name);
+
+			continue;
+		}
+
+		VkSpecializationMapEntry entry = {};
+		entry.constantID = feature.constantId;
+		entry.offset = static_cast<uint32_t>(sizeof(VkBool32) * constants.size());
+		entry.size = sizeof(VkBool32);
+
+		mapEntries.push_back(entry);
+		constants.push_back(isEnabled ? VK_TRUE : VK_FALSE);
+	}
+
+	VkSpecializationInfo specializationInfo = {};
+	specializationInfo.mapEntryCount = static_cast<uint32_t>(mapEntries.size());
+	specializationInfo.pMapEntries = mapEntries.data();
+	specializationInfo.dataSize = sizeof(VkBool32) * constants.size();
+	specializationInfo.pData = constants.data();
+
+	// Constants that a stage does not declare are ignored
+	std::vector<VkPipelineShaderStageCreateInfo> stages(description.stages.size());
+	bool hasAllModules = true;
+
+	for (uint32_t i = 0; i < stages.size(); ++i)
+	{
+		VkPipelineShaderStageCreateInfo &stage = stages[i];
+		stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+		stage.stage = description.stages[i].stage;
+		stage.module = getShaderModule(*variant.program, i, defines);
+		stage.pName = "main";
+		stage.pSpecializationInfo = mapEntries.empty() ? nullptr : &specializationInfo;
+
+		hasAllModules = hasAllModules && stage.module != VK_NULL_HANDLE;
+	}
+
+	if (hasAllModules)
+	{
+		variant.pipeline = description.buildPipeline(
+			description.buildData,
+			stages.data(),
+			static_cast<uint32_t>(stages.size()),
+			pipelineCache);
+	}
+
+	bool isReady = (variant.pipeline != VK_NULL_HANDLE);
+	variant.state.store(isReady ? VARIANT_READY : VARIANT_FAILED, std::memory_order_release);
+
+	double buildTime = std::chrono::duration<double, std::milli>(Clock::now() - buildStart).count();
+
+	std::lock_guard<std::mutex> lock(mutex);
+
+	if (isReady)
+		++statistics.readyCount;
+	else
+		++statistics.failedCount;
+
+	statistics.buildTime += buildTime;
+}
+
+VkShaderModule ShaderPermutations::getShaderModule(
+	const Program &program,
+	uint32_t stageIndex,
+	const std::vector<const char *> &defines)
+{
+	const ShaderStageSource &stage = program.description.stages[stageIndex];
+	uint64_t version = program.sourceVersions[stageIndex];
+
+	// The SPIR-V only depends on the source, its version and the defines
+	uint64_t compileKey = hashString(stage.source, 14695981039346656037ull);
+	compileKey = hashBytes(&version, sizeof(version), compileKey);
+	for (const char *define : defines)
+		compileKey = hashString(define, compileKey);
+
+	uint64_t codeHash = 0;
+	bool isCompiled = false;
+
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+
+		auto found = compiledCode.find(compileKey);
+		if (found != compiledCode.end() && spirv.count(found->second) != 0)
+		{
+			codeHash = found->second;
+			isCompiled = true;
+		}
+	}
+
+	// Compiling can take a while, other variants keep building meanwhile
+	std::vector<uint32_t> code;
+	if (!isCompiled)
+	{
+		const ShaderProgramDescription &description = program.description;
+
+		bool isCompiledNow = description.compile(
+			description.compileData,
+			stage.source,
+			defines.data(),
+			static_cast<uint32_t>(defines.size()),
+			code);
+
+		if (!isCompiledNow || code.empty())
+			return VK_NULL_HANDLE;
+
+		codeHash = hashBytes(code.data(), sizeof(uint32_t) * code.size());
+	}
+
+	std::lock_guard<std::mutex> lock(mutex);
+
+	if (isCompiled)
+	{
+		++statistics.cachedCodeCount;
+	}
+	else
+	{
+		compiledCode[compileKey] = codeHash;
+		++statistics.compileCount;
+
+		if (spirv.count(codeHash) == 0)
+			spirv[codeHash].swap(code);
+	}
+
+	// Different defines can still produce the same SPIR-V
+	auto module = modules.find(codeHash);
+	if (module != modules.end())
+	{
+		++statistics.sharedModuleCount;
+		return module->second;
+	}
+
+	const std::vector<uint32_t> &moduleCode = spirv[codeHash];
+
+	VkShaderModuleCreateInfo moduleCreateInfo = {};
+	moduleCreateInfo.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
+	moduleCreateInfo.codeSize = sizeof(uint32_t) * moduleCode.size();
+	moduleCreateInfo.pCode = moduleCode.data();
+
+	VkShaderModule shaderModule = VK_NULL_HANDLE;
+	VkResult result = vkCreateShaderModule(device, &moduleCreateInfo, allocator, &shaderModule);
+
+	if (result != VK_SUCCESS)
+		return VK_NULL_HANDLE;
+
+	modules[codeHash] = shaderModule;
+	++statistics.moduleCount;
+
+	return shaderModule;
+}
\ No newline at end of file
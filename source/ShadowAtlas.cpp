@@ -0,0 +1,937 @@
+#include "LearningVulkan/ShadowAtlas.hpp"
+#include "LearningVulkan/Renderer.hpp"
+#include "LearningVulkan/Utility.hpp"
+
+#include <algorithm>
+#include <assert.h>
+#include <cmath>
+#include <cstring>
+
+const VkFormat SHADOW_ATLAS_FORMAT = VK_FORMAT_D16_UNORM;
+
+// Bounds of a caster change, center and radius
+const uint32_t CASTER_CHANGE_SIZE = 4;
+
+static bool spheresOverlap(const float *centerA, float radiusA, const float *centerB, float radiusB)
+{
+	float dx = centerA[0] - centerB[0];
+	float dy = centerA[1] - centerB[1];
+	float dz = centerA[2] - centerB[2];
+	float radius = radiusA + radiusB;
+
+	return dx * dx + dy * dy + dz * dz <= radius * radius;
+}
+
+static void transitionImage(
+	VkCommandBuffer commandBuffer,
+	VkImage image,
+	VkImageLayout oldLayout,
+	VkImageLayout newLayout,
+	VkPipelineStageFlags srcStageMask,
+	VkAccessFlags srcAccessMask,
+	VkPipelineStageFlags dstStageMask,
+	VkAccessFlags dstAccessMask)
+{
+	VkImageMemoryBarrier barrier = {};
+	barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+	barrier.srcAccessMask = srcAccessMask;
+	barrier.dstAccessMask = dstAccessMask;
+	barrier.oldLayout = oldLayout;
+	barrier.newLayout = newLayout;
+	barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	barrier.image = image;
+	barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_DEPTH_BIT;
+	barrier.subresourceRange.baseMipLevel = 0;
+	barrier.subresourceRange.levelCount = 1;
+	barrier.subresourceRange.baseArrayLayer = 0;
+	barrier.subresourceRange.layerCount = 1;
+
+	vkCmdPipelineBarrier(
+		commandBuffer,
+		srcStageMask,
+		dstStageMask,
+		0,
+		0, nullptr,
+		0, nullptr,
+		1, &barrier);
+}
+
+ShadowAtlas::ShadowAtlas() :
+	device(VK_NULL_HANDLE),
+	allocator(nullptr),
+	maxLights(0),
+	isStagingCoherent(true),
+	atlasImage(VK_NULL_HANDLE),
+	atlasMemory(VK_NULL_HANDLE),
+	atlasView(VK_NULL_HANDLE),
+	atlasFramebuffer(VK_NULL_HANDLE),
+	staticImage(VK_NULL_HANDLE),
+	staticMemory(VK_NULL_HANDLE),
+	staticView(VK_NULL_HANDLE),
+	staticFramebuffer(VK_NULL_HANDLE),
+	renderPass(VK_NULL_HANDLE),
+	areImagesCleared(false),
+	tileBuffer(VK_NULL_HANDLE),
+	tileMemory(VK_NULL_HANDLE),
+	drawFunction(nullptr),
+	drawData(nullptr),
+	cellCount(0),
+	tileVersion(0),
+	uploadedVersion(0)
+{
+	settings = {};
+	statistics = {};
+}
+
+ShadowAtlas::~ShadowAtlas()
+{
+	destroy();
+}
+
+void ShadowAtlas::initialize(const VulkanContext &context, const ShadowAtlasSettings &settings, uint32_t maxLights)
+{
+	assert((settings.minFaceSize & (settings.minFaceSize - 1)) == 0 &&
+		settings.minFaceSize <= settings.maxFaceSize,
+		"Shadow faces have to be a power of two between the smallest and largest size.");
+	assert(settings.maxFaceSize * 3 <= settings.atlasSize,
+		"The largest shadow tile does not fit into the atlas.");
+
+	device = context.device;
+	allocator = context.allocator;
+	this->settings = settings;
+	this->maxLights = maxLights;
+
+	cellCount = settings.atlasSize / settings.minFaceSize;
+	cells.assign(cellCount * cellCount, 0);
+	tiles.reserve(maxLights);
+
+	// The static layer is only ever copied into the atlas
+	createDepthImage(
+		context,
+		VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT,
+		atlasImage,
+		atlasMemory,
+		atlasView);
+
+	createDepthImage(
+		context,
+		VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT,
+		staticImage,
+		staticMemory,
+		staticView);
+
+	// Tiles are cleared one by one, the rest of the atlas is kept
+	VkAttachmentDescription depthAttachment = {};
+	depthAttachment.format = SHADOW_ATLAS_FORMAT;
+	depthAttachment.samples = VK_SAMPLE_COUNT_1_BIT;
+	depthAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_LOAD;
+	depthAttachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+	depthAttachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+	depthAttachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+	depthAttachment.initialLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+	depthAttachment.finalLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+
+	VkAttachmentReference depthAttachmentReference = {};
+	depthAttachmentReference.attachment = 0;
+	depthAttachmentReference.layout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+
+	VkSubpassDescription subpass = {};
+	subpass.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
+	subpass.pDepthStencilAttachment = &depthAttachmentReference;
+
+	VkRenderPassCreateInfo renderPassCreateInfo = {};
+	renderPassCreateInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
+	renderPassCreateInfo.attachmentCount = 1;
+	renderPassCreateInfo.pAttachments = &depthAttachment;
+	renderPassCreateInfo.subpassCount = 1;
+	renderPassCreateInfo.pSubpasses = &subpass;
+
+	VkResult result = vkCreateRenderPass(device, &renderPassCreateInfo, allocator, &renderPass);
+	Utility::checkVulkanResult(result, "Failed to create the shadow render pass.");
+
+	VkFramebufferCreateInfo framebufferCreateInfo = {};
+	framebufferCreateInfo.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
+	framebufferCreateInfo.renderPass = renderPass;
+	framebufferCreateInfo.attachmentCount = 1;
+	framebufferCreateInfo.pAttachments = &atlasView;
+	framebufferCreateInfo.width = settings.atlasSize;
+	framebufferCreateInfo.height = settings.atlasSize;
+	framebufferCreateInfo.layers = 1;
+
+	result = vkCreateFramebuffer(device, &framebufferCreateInfo, allocator, &atlasFramebuffer);
+	Utility::checkVulkanResult(result, "Failed to create the shadow atlas framebuffer.");
+
+	framebufferCreateInfo.pAttachments = &staticView;
+
+	result = vkCreateFramebuffer(device, &framebufferCreateInfo, allocator, &staticFramebuffer);
+	Utility::checkVulkanResult(result, "Failed to create the static shadow framebuffer.");
+
+	VkDeviceSize tileSize = sizeof(ShadowTileData) * maxLights;
+
+	Utility::createBuffer(
+		device,
+		allocator,
+		context.physicalDeviceMemoryProperties,
+		tileSize,
+		VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+		VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+		tileBuffer,
+		tileMemory);
+
+	stagingBuffers.resize(context.framesInFlight);
+	stagingMemory.resize(context.framesInFlight);
+	stagingData.resize(context.framesInFlight);
+
+	for (uint32_t i = 0; i < context.framesInFlight; ++i)
+	{
+		Utility::createBuffer(
+			device,
+			allocator,
+			context.physicalDeviceMemoryProperties,
+			tileSize,
+			VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+			VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT,
+			stagingBuffers[i],
+			stagingMemory[i]);
+
+		// Stays mapped for the lifetime of the buffer
+		result = vkMapMemory(
+			device,
+			stagingMemory[i],
+			0,
+			VK_WHOLE_SIZE,
+			0,
+			&stagingData[i]);
+
+		Utility::checkVulkanResult(result, "Failed to map a shadow tile staging buffer.");
+	}
+
+	// All staging buffers use the same memory type
+	VkMemoryRequirements memoryRequirements = {};
+	vkGetBufferMemoryRequirements(device, stagingBuffers[0], &memoryRequirements);
+
+	uint32_t memoryTypeIndex = 0;
+	Utility::findMemoryType(
+		context.physicalDeviceMemoryProperties,
+		memoryRequirements.memoryTypeBits,
+		VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT,
+		memoryTypeIndex);
+
+	isStagingCoherent =
+		(context.physicalDeviceMemoryProperties.memoryTypes[memoryTypeIndex].propertyFlags &
+		VK_MEMORY_PROPERTY_HOST_COHERENT_BIT) != 0;
+}
+
+void ShadowAtlas::destroy()
+{
+	if (device == VK_NULL_HANDLE)
+		return;
+
+	for (uint32_t i = 0; i < stagingBuffers.size(); ++i)
+	{
+		vkUnmapMemory(device, stagingMemory[i]);
+		vkDestroyBuffer(device, stagingBuffers[i], allocator);
+		vkFreeMemory(device, stagingMemory[i], allocator);
+	}
+
+	vkDestroyBuffer(device, tileBuffer, allocator);
+	vkFreeMemory(device, tileMemory, allocator);
+
+	vkDestroyFramebuffer(device, atlasFramebuffer, allocator);
+	vkDestroyFramebuffer(device, staticFramebuffer, allocator);
+	vkDestroyRenderPass(device, renderPass, allocator);
+
+	vkDestroyImageView(device, atlasView, allocator);
+	vkDestroyImage(device, atlasImage, allocator);
+	vkFreeMemory(device, atlasMemory, allocator);
+	vkDestroyImageView(device, staticView, allocator);
+	vkDestroyImage(device, staticImage, allocator);
+	vkFreeMemory(device, staticMemory, allocator);
+
+	stagingBuffers.clear();
+	stagingMemory.clear();
+	stagingData.clear();
+	device = VK_NULL_HANDLE;
+}
+
+void ShadowAtlas::setDrawFunction(ShadowDrawFunction drawFunction, void *data)
+{
+	this->drawFunction = drawFunction;
+	drawData = data;
+}
+
+CasterId ShadowAtlas::addCaster(const float center[3], float radius, ShadowLayer layer)
+{
+	CasterId caster;
+	if (!freeCasterIds.empty())
+	{
+		caster = freeCasterIds.back();
+		freeCasterIds.pop_back();
+	}
+	else
+	{
+		caster = static_cast<CasterId>(casters.size());
+		casters.push_back(ShadowCaster());
+	}
+
+	ShadowCaster &data = casters[caster];
+	memcpy(data.center, center, sizeof(data.center));
+	data.radius = radius;
+	data.layer = layer;
+	data.isAlive = true;
+
+	markCasterChange(center, radius, layer);
+	return caster;
+}
+
+void ShadowAtlas::moveCaster(CasterId caster, const float center[3], float radius)
+{
+	assert(caster < casters.size() && casters[caster].isAlive, "Invalid shadow caster.");
+
+	ShadowCaster &data = casters[caster];
+	if (memcmp(data.center, center, sizeof(data.center)) == 0 && data.radius == radius)
+		return;
+
+	// Lights around the old and the new place see the caster change
+	markCasterChange(data.center, data.radius, data.layer);
+	markCasterChange(center, radius, data.layer);
+
+	memcpy(data.center, center, sizeof(data.center));
+	data.radius = radius;
+}
+
+void ShadowAtlas::removeCaster(CasterId caster)
+{
+	assert(caster < casters.size() && casters[caster].isAlive, "Invalid shadow caster.");
+
+	ShadowCaster &data = casters[caster];
+	markCasterChange(data.center, data.radius, data.layer);
+
+	data.isAlive = false;
+	freeCasterIds.push_back(caster);
+}
+
+void ShadowAtlas::update(const PointLight *lights, uint32_t lightCount, const float cameraPosition[3])
+{
+	assert(lightCount <= maxLights, "Exceeded the maximum number of lights.");
+
+	if (lightStates.size() != lightCount)
+	{
+		LightState emptyState = {};
+		emptyState.isStaticDirty = true;
+		lightStates.resize(lightCount, emptyState);
+		tiles.resize(lightCount);
+		++tileVersion;
+	}
+
+	// Only the position and the radius change the shadows of a light
+	for (uint32_t i = 0; i < lightCount; ++i)
+	{
+		LightState &state = lightStates[i];
+		const PointLight &light = lights[i];
+
+		if (memcmp(state.light.position, light.position, sizeof(light.position)) != 0 ||
+			state.light.radius != light.radius)
+		{
+			state.isStaticDirty = true;
+		}
+
+		state.light = light;
+
+		// Roughly the size on screen, a light around the camera covers it
+		float dx = light.position[0] - cameraPosition[0];
+		float dy = light.position[1] - cameraPosition[1];
+		float dz = light.position[2] - cameraPosition[2];
+		float distance = sqrtf(dx * dx + dy * dy + dz * dz);
+		state.importance = light.radius / std::max(distance, light.radius);
+	}
+
+	// Changes only matter to the lights that have a tile
+	const std::vector<float> *changes[2] = { &staticChanges, &dynamicChanges };
+	for (uint32_t layer = 0; layer < 2; ++layer)
+	{
+		const std::vector<float> &bounds = *changes[layer];
+
+		for (LightState &state : lightStates)
+		{
+			if (state.faceSize == 0)
+				continue;
+
+			for (size_t j = 0; j < bounds.size(); j += CASTER_CHANGE_SIZE)
+			{
+				if (spheresOverlap(state.light.position, state.light.radius, &bounds[j], bounds[j + 3]))
+				{
+					if (layer == 0)
+						state.isStaticDirty = true;
+					else
+						state.isDynamicDirty = true;
+
+					break;
+				}
+			}
+		}
+	}
+
+	staticChanges.clear();
+	dynamicChanges.clear();
+
+	// The most important lights first, ties go to the lower index so the
+	// choice does not flicker
+	uint32_t shadowedCount = std::min(lightCount, settings.maxShadowedLights);
+
+	lightOrder.resize(lightCount);
+	for (uint32_t i = 0; i < lightCount; ++i)
+		lightOrder[i] = i;
+
+	auto isMoreImportant = [this](uint32_t a, uint32_t b)
+	{
+		if (lightStates[a].importance != lightStates[b].importance)
+			return lightStates[a].importance > lightStates[b].importance;
+
+		return a < b;
+	};
+
+	if (shadowedCount < lightCount)
+		std::nth_element(lightOrder.begin(), lightOrder.begin() + shadowedCount, lightOrder.end(), isMoreImportant);
+
+	std::sort(lightOrder.begin(), lightOrder.begin() + shadowedCount, isMoreImportant);
+
+	// Lights that still want the same size keep their tiles, so their
+	// shadows stay valid
+	std::fill(cells.begin(), cells.end(), 0);
+
+	for (uint32_t i = 0; i < lightCount; ++i)
+	{
+		LightState &state = lightStates[lightOrder[i]];
+		uint32_t faceSize = i < shadowedCount ? chooseFaceSize(state.importance) : 0;
+
+		if (state.faceSize != 0 && faceSize == state.requestedFaceSize)
+		{
+			uint32_t cellSize = state.faceSize / settings.minFaceSize;
+			markArea(
+				state.x / settings.minFaceSize,
+				state.y / settings.minFaceSize,
+				cellSize * 3,
+				cellSize * 2);
+		}
+		else if (state.faceSize != 0 || state.requestedFaceSize != faceSize)
+		{
+			state.faceSize = 0;
+			state.requestedFaceSize = faceSize;
+			tiles[lightOrder[i]] = ShadowTileData();
+			++tileVersion;
+		}
+	}
+
+	// The rest are placed largest first, with smaller tiles while the atlas
+	// is full. Tiles that got smaller than they asked for move to a larger
+	// tile once there is room again, their old area stays taken until the
+	// next update.
+	statistics.shadowedLightCount = 0;
+	statistics.droppedLightCount = 0;
+
+	for (uint32_t i = 0; i < shadowedCount; ++i)
+	{
+		uint32_t lightIndex = lightOrder[i];
+		LightState &state = lightStates[lightIndex];
+
+		uint32_t previousFaceSize = state.faceSize;
+		if (previousFaceSize == 0 || previousFaceSize < state.requestedFaceSize)
+		{
+			uint32_t faceSize = state.requestedFaceSize;
+			uint32_t minFaceSize = previousFaceSize != 0 ? previousFaceSize * 2 : settings.minFaceSize;
+			while (!allocateTile(state, faceSize) && faceSize > minFaceSize)
+				faceSize /= 2;
+
+			if (state.faceSize == 0)
+			{
+				++statistics.droppedLightCount;
+				continue;
+			}
+
+			if (state.faceSize == previousFaceSize)
+			{
+				++statistics.shadowedLightCount;
+				continue;
+			}
+
+			ShadowTileData &tile = tiles[lightIndex];
+			tile.offset[0] = static_cast<float>(state.x) / settings.atlasSize;
+			tile.offset[1] = static_cast<float>(state.y) / settings.atlasSize;
+			tile.faceScale = static_cast<float>(state.faceSize) / settings.atlasSize;
+
+			state.isStaticDirty = true;
+			++tileVersion;
+		}
+
+		++statistics.shadowedLightCount;
+	}
+
+	// The dynamic layer is drawn over a copy of the static one
+	staticDirtyLights.clear();
+	dynamicDirtyLights.clear();
+
+	for (uint32_t i = 0; i < lightCount; ++i)
+	{
+		LightState &state = lightStates[i];
+
+		if (state.faceSize == 0)
+		{
+			state.isStaticDirty = false;
+			state.isDynamicDirty = false;
+			continue;
+		}
+
+		if (state.isStaticDirty)
+		{
+			state.isDynamicDirty = true;
+			staticDirtyLights.push_back(i);
+		}
+
+		if (state.isDynamicDirty)
+			dynamicDirtyLights.push_back(i);
+	}
+
+	statistics.staticTileUpdates = static_cast<uint32_t>(staticDirtyLights.size());
+	statistics.dynamicTileUpdates = static_cast<uint32_t>(dynamicDirtyLights.size());
+	statistics.totalTileUpdates += dynamicDirtyLights.size();
+	statistics.totalTilesSkipped += statistics.shadowedLightCount - dynamicDirtyLights.size();
+}
+
+void ShadowAtlas::recordUpdates(VkCommandBuffer commandBuffer, uint32_t frameSlot)
+{
+	if (!areImagesCleared)
+	{
+		// Nothing casts a shadow yet
+		VkImage images[2] = { atlasImage, staticImage };
+		for (uint32_t i = 0; i < 2; ++i)
+		{
+			transitionImage(
+				commandBuffer,
+				images[i],
+				VK_IMAGE_LAYOUT_UNDEFINED,
+				VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+				VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
+				0,
+				VK_PIPELINE_STAGE_TRANSFER_BIT,
+				VK_ACCESS_TRANSFER_WRITE_BIT);
+
+			VkClearDepthStencilValue clearValue = { 1.0f, 0 };
+
+			VkImageSubresourceRange resourceRange = {};
+			resourceRange.aspectMask = VK_IMAGE_ASPECT_DEPTH_BIT;
+			resourceRange.baseMipLevel = 0;
+			resourceRange.levelCount = 1;
+			resourceRange.baseArrayLayer = 0;
+			resourceRange.layerCount = 1;
+
+			vkCmdClearDepthStencilImage(
+				commandBuffer,
+				images[i],
+				VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+				&clearValue,
+				1,
+				&resourceRange);
+		}
+
+		// Between updates the atlas is sampled and the static layer copied
+		transitionImage(
+			commandBuffer,
+			atlasImage,
+			VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+			VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL,
+			VK_PIPELINE_STAGE_TRANSFER_BIT,
+			VK_ACCESS_TRANSFER_WRITE_BIT,
+			VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
+			VK_ACCESS_SHADER_READ_BIT);
+
+		transitionImage(
+			commandBuffer,
+			staticImage,
+			VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+			VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+			VK_PIPELINE_STAGE_TRANSFER_BIT,
+			VK_ACCESS_TRANSFER_WRITE_BIT,
+			VK_PIPELINE_STAGE_TRANSFER_BIT,
+			VK_ACCESS_TRANSFER_READ_BIT);
+
+		areImagesCleared = true;
+	}
+
+	if (uploadedVersion != tileVersion && !tiles.empty())
+	{
+		VkBufferCopy region = {};
+		region.size = sizeof(ShadowTileData) * tiles.size();
+
+		memcpy(stagingData[frameSlot], tiles.data(), static_cast<size_t>(region.size));
+
+		if (!isStagingCoherent)
+		{
+			VkMappedMemoryRange range = {};
+			range.sType = VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE;
+			range.memory = stagingMemory[frameSlot];
+			range.offset = 0;
+			range.size = VK_WHOLE_SIZE;
+			vkFlushMappedMemoryRanges(device, 1, &range);
+		}
+
+		// Previous frames may still be shading with the old tiles
+		VkBufferMemoryBarrier bufferBarrier = {};
+		bufferBarrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+		bufferBarrier.srcAccessMask = VK_ACCESS_SHADER_READ_BIT;
+		bufferBarrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+		bufferBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		bufferBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		bufferBarrier.buffer = tileBuffer;
+		bufferBarrier.offset = 0;
+		bufferBarrier.size = VK_WHOLE_SIZE;
+
+		vkCmdPipelineBarrier(
+			commandBuffer,
+			VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
+			VK_PIPELINE_STAGE_TRANSFER_BIT,
+			0,
+			0, nullptr,
+			1, &bufferBarrier,
+			0, nullptr);
+
+		vkCmdCopyBuffer(commandBuffer, stagingBuffers[frameSlot], tileBuffer, 1, &region);
+
+		bufferBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+		bufferBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+
+		vkCmdPipelineBarrier(
+			commandBuffer,
+			VK_PIPELINE_STAGE_TRANSFER_BIT,
+			VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
+			0,
+			0, nullptr,
+			1, &bufferBarrier,
+			0, nullptr);
+
+		uploadedVersion = tileVersion;
+	}
+
+	// Dirty tiles stay dirty until someone can draw them
+	if (dynamicDirtyLights.empty() || drawFunction == nullptr)
+		return;
+
+	if (!staticDirtyLights.empty())
+	{
+		transitionImage(
+			commandBuffer,
+			staticImage,
+			VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+			VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL,
+			VK_PIPELINE_STAGE_TRANSFER_BIT,
+			0,
+			VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT,
+			VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT);
+
+		drawTiles(commandBuffer, staticFramebuffer, ShadowLayer::Static);
+
+		transitionImage(
+			commandBuffer,
+			staticImage,
+			VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL,
+			VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+			VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT,
+			VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT,
+			VK_PIPELINE_STAGE_TRANSFER_BIT,
+			VK_ACCESS_TRANSFER_READ_BIT);
+	}
+
+	// Previous frames may still be sampling the atlas
+	transitionImage(
+		commandBuffer,
+		atlasImage,
+		VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL,
+		VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+		VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
+		0,
+		VK_PIPELINE_STAGE_TRANSFER_BIT,
+		VK_ACCESS_TRANSFER_WRITE_BIT);
+
+	copyRegions.resize(dynamicDirtyLights.size());
+	for (size_t i = 0; i < dynamicDirtyLights.size(); ++i)
+	{
+		const LightState &state = lightStates[dynamicDirtyLights[i]];
+
+		VkImageCopy &region = copyRegions[i];
+		region = {};
+		region.srcSubresource.aspectMask = VK_IMAGE_ASPECT_DEPTH_BIT;
+		region.srcSubresource.layerCount = 1;
+		region.srcOffset = { static_cast<int32_t>(state.x), static_cast<int32_t>(state.y), 0 };
+		region.dstSubresource = region.srcSubresource;
+		region.dstOffset = region.srcOffset;
+		region.extent = { state.faceSize * 3, state.faceSize * 2, 1 };
+	}
+
+	vkCmdCopyImage(
+		commandBuffer,
+		staticImage,
+		VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+		atlasImage,
+		VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+		static_cast<uint32_t>(copyRegions.size()),
+		copyRegions.data());
+
+	transitionImage(
+		commandBuffer,
+		atlasImage,
+		VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+		VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL,
+		VK_PIPELINE_STAGE_TRANSFER_BIT,
+		VK_ACCESS_TRANSFER_WRITE_BIT,
+		VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT,
+		VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT);
+
+	drawTiles(commandBuffer, atlasFramebuffer, ShadowLayer::Dynamic);
+
+	transitionImage(
+		commandBuffer,
+		atlasImage,
+		VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL,
+		VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL,
+		VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT,
+		VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT,
+		VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
+		VK_ACCESS_SHADER_READ_BIT);
+
+	for (uint32_t lightIndex : dynamicDirtyLights)
+	{
+		lightStates[lightIndex].isStaticDirty = false;
+		lightStates[lightIndex].isDynamicDirty = false;
+	}
+
+	staticDirtyLights.clear();
+	dynamicDirtyLights.clear();
+}
+
+VkRenderPass ShadowAtlas::getRenderPass() const
+{
+	return renderPass;
+}
+
+VkDescriptorImageInfo ShadowAtlas::getAtlasImageInfo() const
+{
+	VkDescriptorImageInfo imageInfo = {};
+	imageInfo.sampler = VK_NULL_HANDLE;
+	imageInfo.imageView = atlasView;
+	imageInfo.imageLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL;
+
+	return imageInfo;
+}
+
+VkDescriptorBufferInfo ShadowAtlas::getTileBufferInfo() const
+{
+	VkDescriptorBufferInfo bufferInfo = {};
+	bufferInfo.buffer = tileBuffer;
+	bufferInfo.offset = 0;
+	bufferInfo.range = VK_WHOLE_SIZE;
+
+	return bufferInfo;
+}
+
+const std::vector<ShadowTileData> &ShadowAtlas::getTiles() const
+{
+	return tiles;
+}
+
+ShadowAtlasStatistics ShadowAtlas::getStatistics() const
+{
+	return statistics;
+}
+
+void ShadowAtlas::markCasterChange(const float center[3], float radius, ShadowLayer layer)
+{
+	std::vector<float> &changes = (layer == ShadowLayer::Static) ? staticChanges : dynamicChanges;
+
+	changes.push_back(center[0]);
+	changes.push_back(center[1]);
+	changes.push_back(center[2]);
+	changes.push_back(radius);
+}
+
+uint32_t ShadowAtlas::chooseFaceSize(float importance) const
+{
+	// Halves while the light would still get as many texels as it covers
+	float desiredSize = importance * settings.maxFaceSize;
+
+	uint32_t faceSize = settings.maxFaceSize;
+	while (faceSize > settings.minFaceSize && faceSize / 2 >= desiredSize)
+		faceSize /= 2;
+
+	return faceSize;
+}
+
+bool ShadowAtlas::isAreaFree(uint32_t cellX, uint32_t cellY, uint32_t cellWidth, uint32_t cellHeight) const
+{
+	for (uint32_t y = cellY; y < cellY + cellHeight; ++y)
+	{
+		for (uint32_t x = cellX; x < cellX + cellWidth; ++x)
+		{
+			if (cells[y * cellCount + x] != 0)
+				return false;
+		}
+	}
+
+	return true;
+}
+
+void ShadowAtlas::markArea(uint32_t cellX, uint32_t cellY, uint32_t cellWidth, uint32_t cellHeight)
+{
+	for (uint32_t y = cellY; y < cellY + cellHeight; ++y)
+		memset(&cells[y * cellCount + cellX], 1, cellWidth);
+}
+
+bool ShadowAtlas::allocateTile(LightState &state, uint32_t faceSize)
+{
+	// Tiles are aligned to their face size, which keeps the holes between
+	// them usable by smaller tiles
+	uint32_t cellSize = faceSize / settings.minFaceSize;
+	uint32_t cellWidth = cellSize * 3;
+	uint32_t cellHeight = cellSize * 2;
+
+	for (uint32_t y = 0; y + cellHeight <= cellCount; y += cellSize)
+	{
+		for (uint32_t x = 0; x + cellWidth <= cellCount; x += cellSize)
+		{
+			if (!isAreaFree(x, y, cellWidth, cellHeight))
+				continue;
+
+			markArea(x, y, cellWidth, cellHeight);
+
+			state.faceSize = faceSize;
+			state.x = x * settings.minFaceSize;
+			state.y = y * settings.minFaceSize;
+			return true;
+		}
+	}
+
+	return false;
+}
+
+void ShadowAtlas::createDepthImage(
+	const VulkanContext &context,
+	VkImageUsageFlags usage,
+	VkImage &image,
+	VkDeviceMemory &memory,
+	VkImageView &view)
+{
+	VkImageCreateInfo imageCreateInfo = {};
+	imageCreateInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+	imageCreateInfo.imageType = VK_IMAGE_TYPE_2D;
+	imageCreateInfo.format = SHADOW_ATLAS_FORMAT;
+	imageCreateInfo.extent.width = settings.atlasSize;
+	imageCreateInfo.extent.height = settings.atlasSize;
+	imageCreateInfo.extent.depth = 1;
+	imageCreateInfo.mipLevels = 1;
+	imageCreateInfo.arrayLayers = 1;
+	imageCreateInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+	imageCreateInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+	imageCreateInfo.usage = usage;
+	imageCreateInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+	imageCreateInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+
+	VkResult result = vkCreateImage(device, &imageCreateInfo, allocator, &image);
+	Utility::checkVulkanResult(result, "Failed to create a shadow atlas image.");
+
+	VkMemoryRequirements memoryRequirements = {};
+	vkGetImageMemoryRequirements(device, image, &memoryRequirements);
+
+	VkMemoryAllocateInfo allocateInfo = {};
+	allocateInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+	allocateInfo.allocationSize = memoryRequirements.size;
+
+	bool hasMemoryType = Utility::findMemoryType(
+		context.physicalDeviceMemoryProperties,
+		memoryRequirements.memoryTypeBits,
+		VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+		allocateInfo.memoryTypeIndex);
+
+	assert(hasMemoryType, "No device local memory for the shadow atlas.");
+
+	result = vkAllocateMemory(device, &allocateInfo, allocator, &memory);
+	Utility::checkVulkanResult(result, "Failed to allocate memory for a shadow atlas image.");
+
+	result = vkBindImageMemory(device, image, memory, 0);
+	Utility::checkVulkanResult(result, "Failed to bind memory for a shadow atlas image.");
+
+	VkImageViewCreateInfo viewCreateInfo = {};
+	viewCreateInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+	viewCreateInfo.image = image;
+	viewCreateInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+	viewCreateInfo.format = SHADOW_ATLAS_FORMAT;
+	viewCreateInfo.subresourceRange.aspectMask = VK_IMAGE_ASPECT_DEPTH_BIT;
+	viewCreateInfo.subresourceRange.baseMipLevel = 0;
+	viewCreateInfo.subresourceRange.levelCount = 1;
+	viewCreateInfo.subresourceRange.baseArrayLayer = 0;
+	viewCreateInfo.subresourceRange.layerCount = 1;
+
+	result = vkCreateImageView(device, &viewCreateInfo, allocator, &view);
+	Utility::checkVulkanResult(result, "Failed to create a shadow atlas image view.");
+}
+
+void ShadowAtlas::drawTiles(VkCommandBuffer commandBuffer, VkFramebuffer framebuffer, ShadowLayer layer)
+{
+	VkRenderPassBeginInfo renderPassBeginInfo = {};
+	renderPassBeginInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+	renderPassBeginInfo.renderPass = renderPass;
+	renderPassBeginInfo.framebuffer = framebuffer;
+	renderPassBeginInfo.renderArea.offset = { 0, 0 };
+	renderPassBeginInfo.renderArea.extent = { settings.atlasSize, settings.atlasSize };
+
+	vkCmdBeginRenderPass(commandBuffer, &renderPassBeginInfo, VK_SUBPASS_CONTENTS_INLINE);
+
+	const std::vector<uint32_t> &lightIndices =
+		(layer == ShadowLayer::Static) ? staticDirtyLights : dynamicDirtyLights;
+
+	for (uint32_t lightIndex : lightIndices)
+	{
+		const LightState &state = lightStates[lightIndex];
+
+		// The static layer starts empty, the dynamic one from the copy of it
+		if (layer == ShadowLayer::Static)
+		{
+			VkClearAttachment clearAttachment = {};
+			clearAttachment.aspectMask = VK_IMAGE_ASPECT_DEPTH_BIT;
+			clearAttachment.clearValue.depthStencil = { 1.0f, 0 };
+
+			VkClearRect clearRect = {};
+			clearRect.rect.offset = { static_cast<int32_t>(state.x), static_cast<int32_t>(state.y) };
+			clearRect.rect.extent = { state.faceSize * 3, state.faceSize * 2 };
+			clearRect.baseArrayLayer = 0;
+			clearRect.layerCount = 1;
+
+			vkCmdClearAttachments(commandBuffer, 1, &clearAttachment, 1, &clearRect);
+		}
+
+		for (uint32_t face = 0; face < 6; ++face)
+		{
+			ShadowFaceDraw draw = {};
+			draw.lightIndex = lightIndex;
+			draw.light = &state.light;
+			draw.face = face;
+			draw.layer = layer;
+			draw.rect.offset.x = static_cast<int32_t>(state.x + (face % 3) * state.faceSize);
+			draw.rect.offset.y = static_cast<int32_t>(state.y + (face / 3) * state.faceSize);
+			draw.rect.extent = { state.faceSize, state.faceSize };
+
+			VkViewport viewport = {};
+			viewport.x = static_cast<float>(draw.rect.offset.x);
+			viewport.y = static_cast<float>(draw.rect.offset.y);
+			viewport.width = static_cast<float>(state.faceSize);
+			viewport.height = static_cast<float>(state.faceSize);
+			viewport.maxDepth = 1.0f;
+
+			vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
+			vkCmdSetScissor(commandBuffer, 0, 1, &draw.rect);
+
+			drawFunction(drawData, commandBuffer, draw);
+		}
+	}
+
+	vkCmdEndRenderPass(commandBuffer);
+}
\ No newline at end of file
@@ -0,0 +1,105 @@
+#include "LearningVulkan/TaskGraph.hpp"
+
+#include <assert.h>
+
+TaskGraph::TaskGraph() :
+	jobSystem(nullptr),
+	totalTime(0.0)
+{
+}
+
+TaskGraph::~TaskGraph()
+{
+}
+
+TaskId TaskGraph::addTask(const char *name, TaskFunction function, void *data)
+{
+	std::unique_ptr<Task> task(new Task());
+	task->name = name;
+	task->function = function;
+	task->data = data;
+	task->dependencyCount = 0;
+	task->remainingDependencies = 0;
+	task->timing = {};
+	task->timing.name = name;
+
+	tasks.push_back(std::move(task));
+	return static_cast<TaskId>(tasks.size() - 1);
+}
+
+void TaskGraph::addDependency(TaskId task, TaskId dependency)
+{
+	assert(task < tasks.size() && dependency < tasks.size(), "Unknown task.");
+
+	// Tasks can only depend on earlier tasks, which rules out cycles
+	assert(dependency < task, "Tasks have to be added after their dependencies.");
+
+	tasks[dependency]->dependents.push_back(task);
+	++tasks[task]->dependencyCount;
+}
+
+void TaskGraph::execute(JobSystem &jobSystem)
+{
+	this->jobSystem = &jobSystem;
+	startTime = std::chrono::steady_clock::now();
+
+	for (const std::unique_ptr<Task> &task : tasks)
+		task->remainingDependencies = task->dependencyCount;
+
+	// Start everything that does not wait for anything else, the rest is
+	// started by the tasks it depends on
+	for (TaskId i = 0; i < tasks.size(); ++i)
+	{
+		if (tasks[i]->dependencyCount == 0)
+			jobSystem.run(runTaskJob, this, i, i + 1, counter);
+	}
+
+	jobSystem.wait(counter);
+
+	totalTime = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - startTime).count();
+}
+
+std::vector<TaskTiming> TaskGraph::getTimeline() const
+{
+	std::vector<TaskTiming> timeline;
+
+	for (const std::unique_ptr<Task> &task : tasks)
+		timeline.push_back(task->timing);
+
+	return timeline;
+}
+
+double TaskGraph::getTotalTime() const
+{
+	return totalTime;
+}
+
+void TaskGraph::clear()
+{
+	tasks.clear();
+	totalTime = 0.0;
+}
+
+void TaskGraph::runTaskJob(void *data, uint32_t begin, uint32_t end)
+{
+	TaskGraph *graph = static_cast<TaskGraph *>(data);
+	Task &task = *graph->tasks[begin];
+
+	typedef std::chrono::steady_clock Clock;
+
+	Clock::time_point taskStart = Clock::now();
+	task.function(task.data);
+	Clock::time_point taskEnd = Clock::now();
+
+	task.timing.startTime = std::chrono::duration<double, std::milli>(taskStart - graph->startTime).count();
+	task.timing.endTime = std::chrono::duration<double, std::milli>(taskEnd - graph->startTime).count();
+	task.timing.workerIndex = graph->jobSystem->getCurrentWorkerIndex();
+
+	// The counter cannot reach zero while this job is still running, so the
+	// dependents are always started before execute returns
+	for (TaskId dependent : task.dependents)
+	{
+		if (--graph->tasks[dependent]->remainingDependencies == 0)
+			graph->jobSystem->run(runTaskJob, graph, dependent, dependent + 1, graph->counter);
+	}
+}
\ No newline at end of file
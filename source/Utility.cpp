@@ -8,6 +8,72 @@ void Utility::checkVulkanResult(VkResult & result, char * message)
 	assert(result == VK_SUCCESS, message);
 }
 
+bool Utility::findMemoryType(
+	const VkPhysicalDeviceMemoryProperties & memoryProperties,
+	uint32_t memoryTypeBits,
+	VkMemoryPropertyFlags desiredMemoryFlags,
+	uint32_t & memoryTypeIndex)
+{
+	for (uint32_t i = 0; i < memoryProperties.memoryTypeCount; ++i)
+	{
+		VkMemoryType memoryType = memoryProperties.memoryTypes[i];
+
+		if (memoryTypeBits & 1)
+		{
+			if ((memoryType.propertyFlags & desiredMemoryFlags) == desiredMemoryFlags)
+			{
+				memoryTypeIndex = i;
+				return true;
+			}
+		}
+
+		memoryTypeBits = memoryTypeBits >> 1;
+	}
+
+	return false;
+}
+
+void Utility::createBuffer(
+	VkDevice device,
+	const VkAllocationCallbacks * allocator,
+	const VkPhysicalDeviceMemoryProperties & memoryProperties,
+	VkDeviceSize size,
+	VkBufferUsageFlags usage,
+	VkMemoryPropertyFlags memoryFlags,
+	VkBuffer & buffer,
+	VkDeviceMemory & memory)
+{
+	VkBufferCreateInfo bufferCreateInfo = {};
+	bufferCreateInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+	bufferCreateInfo.size = size;
+	bufferCreateInfo.usage = usage;
+	bufferCreateInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+	VkResult result = vkCreateBuffer(device, &bufferCreateInfo, allocator, &buffer);
+	checkVulkanResult(result, "Failed to create a buffer.");
+
+	VkMemoryRequirements memoryRequirements = {};
+	vkGetBufferMemoryRequirements(device, buffer, &memoryRequirements);
+
+	VkMemoryAllocateInfo allocateInfo = {};
+	allocateInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+	allocateInfo.allocationSize = memoryRequirements.size;
+
+	bool foundMemoryType = findMemoryType(
+		memoryProperties,
+		memoryRequirements.memoryTypeBits,
+		memoryFlags,
+		allocateInfo.memoryTypeIndex);
+
+	assert(foundMemoryType, "Failed to find a suitable memory type.");
+
+	result = vkAllocateMemory(device, &allocateInfo, allocator, &memory);
+	checkVulkanResult(result, "Failed to allocate buffer memory.");
+
+	result = vkBindBufferMemory(device, buffer, memory, 0);
+	checkVulkanResult(result, "Failed to bind buffer memory.");
+}
+
 Utility::Utility()
 {
 }
@@ -0,0 +1,320 @@
+#include "LearningVulkan/WorkloadTrace.hpp"
+
+#include <assert.h>
+#include <cstring>
+
+// Has to change whenever the encoding of a command does
+static const uint32_t TRACE_MAGIC = 0x5254564C;	// "LVTR"
+static const uint32_t TRACE_VERSION = 2;
+
+// Commands are collected in memory and written in blocks of this size
+static const size_t TRACE_BUFFER_SIZE = 256 * 1024;
+
+TraceWriter::TraceWriter() :
+	file(nullptr),
+	frameCount(0)
+{
+}
+
+TraceWriter::~TraceWriter()
+{
+	close();
+}
+
+bool TraceWriter::open(const char *path, uint32_t width, uint32_t height, uint32_t framesInFlight)
+{
+	close();
+
+	file = fopen(path, "wb");
+	if (!file)
+		return false;
+
+	TraceHeader header = {};
+	header.magic = TRACE_MAGIC;
+	header.version = TRACE_VERSION;
+	header.width = width;
+	header.height = height;
+	header.framesInFlight = framesInFlight;
+
+	buffer.reserve(TRACE_BUFFER_SIZE);
+	frameCount = 0;
+
+	write(&header, sizeof(header));
+	return true;
+}
+
+void TraceWriter::close()
+{
+	if (!file)
+		return;
+
+	flush();
+	fclose(file);
+	file = nullptr;
+}
+
+bool TraceWriter::isOpen() const
+{
+	return file != nullptr;
+}
+
+void TraceWriter::addMesh(MeshId mesh, const InstanceMesh &meshData)
+{
+	uint8_t command = static_cast<uint8_t>(TraceCommand::AddMesh);
+	uint8_t hasGeometry = meshData.geometry ? 1 : 0;
+
+	write(&command, sizeof(command));
+	write(&mesh, sizeof(mesh));
+	write(&hasGeometry, sizeof(hasGeometry));
+	write(&meshData.vertexCount, sizeof(meshData.vertexCount));
+	write(&meshData.indexCount, sizeof(meshData.indexCount));
+
+	if (!hasGeometry)
+		return;
+
+	const Mesh &geometry = *meshData.geometry;
+	assert(geometry.vertices.size() >= meshData.vertexCount && geometry.indices.size() >= meshData.indexCount,
+		"The geometry of a traced mesh is smaller than its buffers.");
+
+	write(geometry.vertices.data(), sizeof(Vertex) * meshData.vertexCount);
+	write(geometry.indices.data(), sizeof(uint32_t) * meshData.indexCount);
+}
+
+void TraceWriter::addMaterial(MaterialId material)
+{
+	uint8_t command = static_cast<uint8_t>(TraceCommand::AddMaterial);
+
+	write(&command, sizeof(command));
+	write(&material, sizeof(material));
+}
+
+void TraceWriter::addInstance(InstanceId instance, MeshId mesh, MaterialId material, const InstanceData &data)
+{
+	uint8_t command = static_cast<uint8_t>(TraceCommand::AddInstance);
+
+	write(&command, sizeof(command));
+	write(&instance, sizeof(instance));
+	write(&mesh, sizeof(mesh));
+	write(&material, sizeof(material));
+	write(&data, sizeof(data));
+}
+
+void TraceWriter::updateInstance(InstanceId instance, const InstanceData &data)
+{
+	uint8_t command = static_cast<uint8_t>(TraceCommand::UpdateInstance);
+
+	write(&command, sizeof(command));
+	write(&instance, sizeof(instance));
+	write(&data, sizeof(data));
+}
+
+void TraceWriter::removeInstance(InstanceId instance)
+{
+	uint8_t command = static_cast<uint8_t>(TraceCommand::RemoveInstance);
+
+	write(&command, sizeof(command));
+	write(&instance, sizeof(instance));
+}
+
+void TraceWriter::setLights(const PointLight *lights, uint32_t lightCount)
+{
+	uint8_t command = static_cast<uint8_t>(TraceCommand::SetLights);
+
+	write(&command, sizeof(command));
+	write(&lightCount, sizeof(lightCount));
+	write(lights, sizeof(PointLight) * lightCount);
+}
+
+void TraceWriter::setLightView(const LightGridView &view)
+{
+	uint8_t command = static_cast<uint8_t>(TraceCommand::SetLightView);
+
+	write(&command, sizeof(command));
+	write(&view, sizeof(view));
+}
+
+void TraceWriter::setParticleEmitter(const ParticleEmitter &emitter)
+{
+	uint8_t command = static_cast<uint8_t>(TraceCommand::SetParticleEmitter);
+
+	write(&command, sizeof(command));
+	write(&emitter, sizeof(emitter));
+}
+
+void TraceWriter::updateParticles(float deltaTime)
+{
+	uint8_t command = static_cast<uint8_t>(TraceCommand::UpdateParticles);
+
+	write(&command, sizeof(command));
+	write(&deltaTime, sizeof(deltaTime));
+}
+
+void TraceWriter::frame(double cpuTime)
+{
+	uint8_t command = static_cast<uint8_t>(TraceCommand::Frame);
+
+	write(&command, sizeof(command));
+	write(&cpuTime, sizeof(cpuTime));
+
+	++frameCount;
+}
+
+uint32_t TraceWriter::getFrameCount() const
+{
+	return frameCount;
+}
+
+void TraceWriter::write(const void *data, size_t size)
+{
+	const uint8_t *bytes = static_cast<const uint8_t *>(data);
+	buffer.insert(buffer.end(), bytes, bytes + size);
+
+	if (buffer.size() >= TRACE_BUFFER_SIZE)
+		flush();
+}
+
+void TraceWriter::flush()
+{
+	fwrite(buffer.data(), 1, buffer.size(), file);
+	buffer.clear();
+}
+
+TraceReader::TraceReader() :
+	file(nullptr),
+	hasDecodeError(false)
+{
+	header = {};
+}
+
+TraceReader::~TraceReader()
+{
+	close();
+}
+
+bool TraceReader::open(const char *path)
+{
+	close();
+
+	file = fopen(path, "rb");
+	if (!file)
+		return false;
+
+	hasDecodeError = false;
+
+	if (!readBytes(&header, sizeof(header)) ||
+		header.magic != TRACE_MAGIC ||
+		header.version != TRACE_VERSION)
+	{
+		close();
+		return false;
+	}
+
+	return true;
+}
+
+void TraceReader::close()
+{
+	if (!file)
+		return;
+
+	fclose(file);
+	file = nullptr;
+}
+
+const TraceHeader &TraceReader::getHeader() const
+{
+	return header;
+}
+
+bool TraceReader::read(TraceRecord &record)
+{
+	uint8_t command = 0;
+	if (!readBytes(&command, sizeof(command)))
+		return false;
+
+	record = {};
+	record.command = static_cast<TraceCommand>(command);
+
+	hasDecodeError = !readCommand(record);
+	return !hasDecodeError;
+}
+
+bool TraceReader::isTruncated() const
+{
+	return hasDecodeError;
+}
+
+bool TraceReader::readCommand(TraceRecord &record)
+{
+	switch (record.command)
+	{
+	case TraceCommand::AddMesh:
+	{
+		uint8_t hasGeometry = 0;
+
+		bool isComplete =
+			readBytes(&record.id, sizeof(record.id)) &&
+			readBytes(&hasGeometry, sizeof(hasGeometry)) &&
+			readBytes(&record.vertexCount, sizeof(record.vertexCount)) &&
+			readBytes(&record.indexCount, sizeof(record.indexCount));
+
+		record.hasGeometry = (hasGeometry != 0);
+		if (!isComplete || !record.hasGeometry)
+			return isComplete;
+
+		record.vertices.resize(record.vertexCount);
+		record.indices.resize(record.indexCount);
+
+		return
+			readBytes(record.vertices.data(), sizeof(Vertex) * record.vertexCount) &&
+			readBytes(record.indices.data(), sizeof(uint32_t) * record.indexCount);
+	}
+
+	case TraceCommand::AddMaterial:
+	case TraceCommand::RemoveInstance:
+		return readBytes(&record.id, sizeof(record.id));
+
+	case TraceCommand::AddInstance:
+		return
+			readBytes(&record.id, sizeof(record.id)) &&
+			readBytes(&record.mesh, sizeof(record.mesh)) &&
+			readBytes(&record.material, sizeof(record.material)) &&
+			readBytes(&record.data, sizeof(record.data));
+
+	case TraceCommand::UpdateInstance:
+		return
+			readBytes(&record.id, sizeof(record.id)) &&
+			readBytes(&record.data, sizeof(record.data));
+
+	case TraceCommand::Frame:
+		return readBytes(&record.cpuTime, sizeof(record.cpuTime));
+
+	case TraceCommand::SetLights:
+	{
+		uint32_t lightCount = 0;
+		if (!readBytes(&lightCount, sizeof(lightCount)))
+			return false;
+
+		record.lights.resize(lightCount);
+		return readBytes(record.lights.data(), sizeof(PointLight) * lightCount);
+	}
+
+	case TraceCommand::SetLightView:
+		return readBytes(&record.lightView, sizeof(record.lightView));
+
+	case TraceCommand::SetParticleEmitter:
+		return readBytes(&record.emitter, sizeof(record.emitter));
+
+	case TraceCommand::UpdateParticles:
+		return readBytes(&record.deltaTime, sizeof(record.deltaTime));
+
+	default:
+		// Unknown command, the rest of the trace cannot be decoded
+		return false;
+	}
+}
+
+bool TraceReader::readBytes(void *data, size_t size)
+{
+	return fread(data, 1, size, file) == size;
+}
\ No newline at end of file
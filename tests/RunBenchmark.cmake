@@ -0,0 +1,41 @@
+# Runs a canned benchmark scene for the performance tests, called with
+# cmake -P. The results go to <OUTPUT_DIRECTORY>/<NAME>.json and the first
+# measured frame of a second, single frame run to <OUTPUT_DIRECTORY>/<NAME>_000000.raw.
+# The timings come from the long run alone, capturing stalls every frame.
+#
+#   BENCHMARK         Path of LearningVulkanBenchmark
+#   SCENE             Scene to render
+#   NAME              Name of the results, the scene if not set
+#   OUTPUT_DIRECTORY  Where the results are written
+#   ARGUMENTS         Further benchmark arguments, separated by semicolons
+
+foreach(VARIABLE BENCHMARK SCENE OUTPUT_DIRECTORY)
+	if(NOT DEFINED ${VARIABLE})
+		message(FATAL_ERROR "${VARIABLE} is not set.")
+	endif()
+endforeach()
+
+if(NOT NAME)
+	set(NAME ${SCENE})
+endif()
+
+file(MAKE_DIRECTORY "${OUTPUT_DIRECTORY}")
+file(REMOVE "${OUTPUT_DIRECTORY}/${NAME}.json" "${OUTPUT_DIRECTORY}/${NAME}_000000.raw")
+
+execute_process(
+	COMMAND "${BENCHMARK}" --scene ${SCENE} ${ARGUMENTS}
+	OUTPUT_FILE "${OUTPUT_DIRECTORY}/${NAME}.json"
+	RESULT_VARIABLE RESULT)
+
+if(NOT RESULT EQUAL 0)
+	message(FATAL_ERROR "The ${NAME} benchmark failed: ${RESULT}")
+endif()
+
+execute_process(
+	COMMAND "${BENCHMARK}" --scene ${SCENE} ${ARGUMENTS} --frames 1 --warm-up 0 --capture "${OUTPUT_DIRECTORY}/${NAME}"
+	OUTPUT_QUIET
+	RESULT_VARIABLE RESULT)
+
+if(NOT RESULT EQUAL 0)
+	message(FATAL_ERROR "The ${NAME} capture failed: ${RESULT}")
+endif()
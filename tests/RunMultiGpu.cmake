@@ -0,0 +1,57 @@
+# Renders the same frames on a single GPU, with alternate and with split
+# frame rendering for the performance tests, called with cmake -P. The
+# captures go to <OUTPUT_DIRECTORY>/<mode>_<frame>.raw and the results of
+# every run to <mode>.json, where the mode is single, afr or sfr. The single
+# GPU captures act as the golden images of the other two.
+#
+# Without a device group the afr and sfr runs fall back to a single GPU, so
+# the comparison only covers that fallback. That is all a software driver
+# can check, REQUIRE_DEVICE_GROUP makes it a failure instead on machines
+# that are meant to have several GPUs.
+#
+#   BENCHMARK             Path of LearningVulkanBenchmark
+#   SCENE                 Scene to render
+#   FRAMES                Frames to capture, at least two so every GPU renders one
+#   OUTPUT_DIRECTORY      Where the results are written
+#   ARGUMENTS             Further benchmark arguments, separated by semicolons
+#   REQUIRE_DEVICE_GROUP  Fail unless both runs use a device group of several GPUs
+
+foreach(VARIABLE BENCHMARK SCENE FRAMES OUTPUT_DIRECTORY)
+	if(NOT DEFINED ${VARIABLE})
+		message(FATAL_ERROR "${VARIABLE} is not set.")
+	endif()
+endforeach()
+
+file(MAKE_DIRECTORY "${OUTPUT_DIRECTORY}")
+file(GLOB PREVIOUS_CAPTURES "${OUTPUT_DIRECTORY}/*.raw")
+file(REMOVE "${OUTPUT_DIRECTORY}/single.json" "${OUTPUT_DIRECTORY}/afr.json" "${OUTPUT_DIRECTORY}/sfr.json" ${PREVIOUS_CAPTURES})
+
+foreach(MODE single afr sfr)
+	if(MODE STREQUAL "single")
+		set(MULTI_GPU_MODE off)
+	else()
+		set(MULTI_GPU_MODE ${MODE})
+	endif()
+
+	execute_process(
+		COMMAND "${BENCHMARK}" --scene ${SCENE} ${ARGUMENTS} --multi-gpu ${MULTI_GPU_MODE} --frames ${FRAMES} --warm-up 0 --capture "${OUTPUT_DIRECTORY}/${MODE}"
+		OUTPUT_FILE "${OUTPUT_DIRECTORY}/${MODE}.json"
+		RESULT_VARIABLE RESULT)
+
+	if(NOT RESULT EQUAL 0)
+		message(FATAL_ERROR "The ${MODE} benchmark failed: ${RESULT}")
+	endif()
+
+	if(NOT MODE STREQUAL "single")
+		file(STRINGS "${OUTPUT_DIRECTORY}/${MODE}.json" GROUP_SIZE_LINE REGEX "\"deviceGroupSize\"")
+		string(REGEX MATCH "[0-9]+" GROUP_SIZE "${GROUP_SIZE_LINE}")
+
+		if(NOT GROUP_SIZE OR GROUP_SIZE LESS 2)
+			if(REQUIRE_DEVICE_GROUP)
+				message(FATAL_ERROR "The ${MODE} benchmark found no device group of several GPUs.")
+			endif()
+
+			message(STATUS "No device group for ${MODE}, only the single GPU fallback is compared.")
+		endif()
+	endif()
+endforeach()
@@ -0,0 +1,34 @@
+# Starts a benchmark scene twice for the shader cache tests, called with
+# cmake -P. The first run starts without a cache and writes one, the second
+# loads it. The results go to <OUTPUT_DIRECTORY>/cold.json and warm.json.
+#
+#   BENCHMARK         Path of LearningVulkanBenchmark
+#   SCENE             Scene to render
+#   OUTPUT_DIRECTORY  Where the results and the cache are written
+#   ARGUMENTS         Further benchmark arguments, separated by semicolons
+
+foreach(VARIABLE BENCHMARK SCENE OUTPUT_DIRECTORY)
+	if(NOT DEFINED ${VARIABLE})
+		message(FATAL_ERROR "${VARIABLE} is not set.")
+	endif()
+endforeach()
+
+set(SHADER_CACHE "${OUTPUT_DIRECTORY}/shaders.cache")
+
+file(MAKE_DIRECTORY "${OUTPUT_DIRECTORY}")
+file(REMOVE "${OUTPUT_DIRECTORY}/cold.json" "${OUTPUT_DIRECTORY}/warm.json" "${SHADER_CACHE}")
+
+foreach(RUN cold warm)
+	execute_process(
+		COMMAND "${BENCHMARK}" --scene ${SCENE} ${ARGUMENTS} --shader-cache "${SHADER_CACHE}"
+		OUTPUT_FILE "${OUTPUT_DIRECTORY}/${RUN}.json"
+		RESULT_VARIABLE RESULT)
+
+	if(NOT RESULT EQUAL 0)
+		message(FATAL_ERROR "The ${RUN} benchmark failed: ${RESULT}")
+	endif()
+
+	if(NOT EXISTS "${SHADER_CACHE}")
+		message(FATAL_ERROR "The ${RUN} benchmark wrote no shader cache.")
+	endif()
+endforeach()